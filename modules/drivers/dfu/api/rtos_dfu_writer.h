@@ -0,0 +1,174 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+/**
+ * Provides a streaming writer of DFU upgrade images
+ */
+
+#ifndef RTOS_DFU_WRITER_H_
+#define RTOS_DFU_WRITER_H_
+
+/**
+ * \addtogroup rtos_dfu_writer rtos_dfu_writer
+ *
+ * The public API for writing an upgrade image to flash as it is received.
+ *
+ * The image may be given to the writer in chunks of any size, as they
+ * arrive from USB DFU, HTTP, device control, etc. The writer erases the
+ * flash one erase block ahead of the data, and the QSPI flash driver
+ * erases and programs in its own thread, so the next chunk can be
+ * received while the flash is busy with the previous one.
+ *
+ * A CRC-32 of the image is kept as it is written, and is checked against
+ * the flash once the image is complete. Progress is optionally saved to a
+ * checkpoint sector so that an interrupted update can be resumed.
+ * @{
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rtos_qspi_flash.h"
+
+/**
+ * The number of bytes buffered before they are written to flash. This
+ * must be a multiple of the flash sector size.
+ */
+#ifndef RTOS_DFU_WRITER_BUFFER_SIZE
+#define RTOS_DFU_WRITER_BUFFER_SIZE 4096
+#endif
+
+/**
+ * The number of bytes that are erased at once, ahead of the data. This
+ * must be a multiple of the flash sector size. Erases are aligned to this
+ * size, so that when the QSPI flash driver is built with
+ * QSPI_FL_BLOCK_ERASE_COMMAND set, 64 KiB erases use a single block erase.
+ */
+#ifndef RTOS_DFU_WRITER_ERASE_SIZE
+#define RTOS_DFU_WRITER_ERASE_SIZE (64 * 1024)
+#endif
+
+/**
+ * The number of bytes written between checkpoints. This must be a
+ * multiple of RTOS_DFU_WRITER_BUFFER_SIZE.
+ */
+#ifndef RTOS_DFU_WRITER_CHECKPOINT_INTERVAL
+#define RTOS_DFU_WRITER_CHECKPOINT_INTERVAL (64 * 1024)
+#endif
+
+/**
+ * Struct representing an RTOS DFU writer instance.
+ *
+ * The members in this struct should not be accessed directly. It holds a
+ * buffer of RTOS_DFU_WRITER_BUFFER_SIZE bytes, so it is normally best not
+ * allocated on a task's stack.
+ */
+typedef struct {
+    rtos_qspi_flash_t *flash;
+    unsigned start_address;
+    size_t max_size;
+    unsigned checkpoint_address;
+    int checkpoint_slot;
+    uint32_t image_id;
+
+    size_t written;         /* Bytes of the image sent to the flash */
+    unsigned erased_to;     /* The end of the erased region */
+    uint32_t crc;           /* Of the bytes sent to the flash */
+
+    size_t buffer_len;
+    uint8_t buffer[RTOS_DFU_WRITER_BUFFER_SIZE];
+} rtos_dfu_writer_t;
+
+/**
+ * Initializes an RTOS DFU writer instance. The region is normally the
+ * upgrade image, from rtos_dfu_image_get_upgrade_addr() up to
+ * rtos_dfu_image_get_data_partition_addr().
+ *
+ * \param writer             A pointer to the DFU writer instance to initialize.
+ * \param flash              The QSPI flash driver instance to write to. It
+ *                           must have been started.
+ * \param start_address      The sector aligned address to write the image to.
+ * \param max_size           The size of the region that the image may use.
+ *                           This must be a multiple of the sector size.
+ * \param checkpoint_address The address of a flash sector, outside of the
+ *                           image region, to save checkpoints to. Set to 0 to
+ *                           disable checkpoints.
+ *
+ * \retval 0  on success.
+ * \retval -1 if the region or the checkpoint sector is not sector aligned.
+ */
+int rtos_dfu_writer_init(
+        rtos_dfu_writer_t *writer,
+        rtos_qspi_flash_t *flash,
+        unsigned start_address,
+        size_t max_size,
+        unsigned checkpoint_address);
+
+/**
+ * Begins writing an image.
+ *
+ * If \p resume is set and the checkpoint shows that an earlier update of
+ * the same image was interrupted, then the update continues from the last
+ * checkpoint. Otherwise the update starts from the beginning of the image,
+ * and any earlier checkpoint is discarded.
+ *
+ * \param writer   A pointer to the DFU writer instance.
+ * \param image_id A value identifying the image, such as its version or
+ *                 digest, so that an update is only resumed with the
+ *                 image that it was started with.
+ * \param resume   Whether to resume an interrupted update.
+ *
+ * \returns the offset in the image that the data given to
+ * rtos_dfu_writer_write() must start from. This is 0 unless an update
+ * is resumed.
+ */
+size_t rtos_dfu_writer_begin(
+        rtos_dfu_writer_t *writer,
+        uint32_t image_id,
+        int resume);
+
+/**
+ * Writes the next chunk of the image. The data is copied, so the buffer
+ * may be reused as soon as this returns.
+ *
+ * \param writer A pointer to the DFU writer instance.
+ * \param data   The data to write.
+ * \param len    The number of bytes to write.
+ *
+ * \retval 0  on success.
+ * \retval -1 if the image does not fit in the region.
+ */
+int rtos_dfu_writer_write(
+        rtos_dfu_writer_t *writer,
+        const void *data,
+        size_t len);
+
+/**
+ * Finishes writing the image. The last of the data is written, and the
+ * image is read back from flash and checked against the CRC of the data
+ * that was given to rtos_dfu_writer_write(). The checkpoint is then
+ * cleared.
+ *
+ * \param writer A pointer to the DFU writer instance.
+ * \param crc    Set to the CRC-32 of the whole image, so that it may be
+ *               checked against one from the update's source. May be NULL.
+ *
+ * \retval 0  on success.
+ * \retval -1 if the image in flash does not match the data written.
+ */
+int rtos_dfu_writer_finish(
+        rtos_dfu_writer_t *writer,
+        uint32_t *crc);
+
+/**
+ * \returns the number of bytes of the image that have been given to the
+ * writer, including any resumed from a checkpoint.
+ */
+inline size_t rtos_dfu_writer_size_get(
+        rtos_dfu_writer_t *writer)
+{
+    return writer->written + writer->buffer_len;
+}
+
+/**@}*/
+
+#endif /* RTOS_DFU_WRITER_H_ */
@@ -0,0 +1,311 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#define DEBUG_UNIT RTOS_DFU_WRITER
+
+#include <string.h>
+
+#include "rtos_printf.h"
+#include "rtos_dfu_writer.h"
+
+#define CHECKPOINT_MAGIC        0x50434644 /* "DFCP" */
+#define CHECKPOINT_SECTOR_SIZE  4096
+#define CHECKPOINT_SLOTS        ((int) (CHECKPOINT_SECTOR_SIZE / sizeof(checkpoint_t)))
+
+#if (RTOS_DFU_WRITER_BUFFER_SIZE % CHECKPOINT_SECTOR_SIZE) != 0
+#error RTOS_DFU_WRITER_BUFFER_SIZE must be a multiple of the flash sector size
+#endif
+#if (RTOS_DFU_WRITER_ERASE_SIZE % CHECKPOINT_SECTOR_SIZE) != 0
+#error RTOS_DFU_WRITER_ERASE_SIZE must be a multiple of the flash sector size
+#endif
+#if (RTOS_DFU_WRITER_CHECKPOINT_INTERVAL % RTOS_DFU_WRITER_BUFFER_SIZE) != 0
+#error RTOS_DFU_WRITER_CHECKPOINT_INTERVAL must be a multiple of RTOS_DFU_WRITER_BUFFER_SIZE
+#endif
+
+/*
+ * Checkpoints are appended to the checkpoint sector, so that it is only
+ * erased once every CHECKPOINT_SLOTS checkpoints. The last valid one is
+ * the current one. A checkpoint with written set to 0 means that there is
+ * no update to resume.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t image_id;
+    uint32_t start_address;
+    uint32_t written;
+    uint32_t crc;
+    uint32_t reserved[2];
+    uint32_t checkpoint_crc;
+} checkpoint_t;
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table[crc & 0xF];
+        crc = (crc >> 4) ^ table[crc & 0xF];
+    }
+
+    return ~crc;
+}
+
+static void checkpoint_save(rtos_dfu_writer_t *writer)
+{
+    checkpoint_t checkpoint = {
+            .magic = CHECKPOINT_MAGIC,
+            .image_id = writer->image_id,
+            .start_address = writer->start_address,
+            .written = writer->written,
+            .crc = writer->crc,
+            .reserved = {0xFFFFFFFF, 0xFFFFFFFF},
+    };
+
+    if (writer->checkpoint_address == 0) {
+        return;
+    }
+
+    checkpoint.checkpoint_crc = crc32_update(0, (const uint8_t *) &checkpoint,
+                                             offsetof(checkpoint_t, checkpoint_crc));
+
+    if (writer->checkpoint_slot == CHECKPOINT_SLOTS) {
+        rtos_qspi_flash_erase(writer->flash, writer->checkpoint_address, CHECKPOINT_SECTOR_SIZE);
+        writer->checkpoint_slot = 0;
+    }
+
+    /*
+     * The flash driver performs operations in the order that they are
+     * requested, so the checkpoint is not written until all of the data
+     * before it has been.
+     */
+    rtos_qspi_flash_write(writer->flash, (const uint8_t *) &checkpoint,
+                          writer->checkpoint_address + writer->checkpoint_slot * sizeof(checkpoint),
+                          sizeof(checkpoint));
+    writer->checkpoint_slot++;
+}
+
+/*
+ * Finds the current checkpoint and the next free slot. The sector is
+ * read into the writer's buffer, which must be empty.
+ */
+static int checkpoint_load(rtos_dfu_writer_t *writer, checkpoint_t *current)
+{
+    const checkpoint_t *slots = (const checkpoint_t *) writer->buffer;
+    int found = 0;
+
+    writer->checkpoint_slot = 0;
+
+    if (writer->checkpoint_address == 0) {
+        return 0;
+    }
+
+    rtos_qspi_flash_read(writer->flash, writer->buffer, writer->checkpoint_address, CHECKPOINT_SECTOR_SIZE);
+
+    for (int i = 0; i < CHECKPOINT_SLOTS; i++) {
+        const uint8_t *p = (const uint8_t *) &slots[i];
+        int erased = 1;
+
+        for (size_t j = 0; j < sizeof(checkpoint_t) && erased; j++) {
+            erased = p[j] == 0xFF;
+        }
+        if (erased) {
+            continue;
+        }
+
+        /* Partly written slots are skipped over */
+        writer->checkpoint_slot = i + 1;
+        if (slots[i].magic == CHECKPOINT_MAGIC &&
+            slots[i].checkpoint_crc == crc32_update(0, p, offsetof(checkpoint_t, checkpoint_crc))) {
+            *current = slots[i];
+            found = 1;
+        }
+    }
+
+    return found;
+}
+
+static void erase_ahead(rtos_dfu_writer_t *writer, unsigned address)
+{
+    unsigned end = writer->start_address + writer->max_size;
+
+    /* Keep one erase block ahead of the data being written */
+    address += RTOS_DFU_WRITER_ERASE_SIZE;
+    if (address > end) {
+        address = end;
+    }
+
+    while (writer->erased_to < address) {
+        /* Align the erases to the erase size, so that block erases can be used */
+        unsigned len = RTOS_DFU_WRITER_ERASE_SIZE - (writer->erased_to % RTOS_DFU_WRITER_ERASE_SIZE);
+
+        if (len > end - writer->erased_to) {
+            len = end - writer->erased_to;
+        }
+
+        rtos_printf_debug("Erase %u bytes at 0x%x\n", len, writer->erased_to);
+        rtos_qspi_flash_erase(writer->flash, writer->erased_to, len);
+        writer->erased_to += len;
+    }
+}
+
+static void buffer_flush(rtos_dfu_writer_t *writer)
+{
+    unsigned address = writer->start_address + writer->written;
+
+    if (writer->buffer_len == 0) {
+        return;
+    }
+
+    erase_ahead(writer, address);
+    writer->crc = crc32_update(writer->crc, writer->buffer, writer->buffer_len);
+    rtos_qspi_flash_write(writer->flash, writer->buffer, address, writer->buffer_len);
+    writer->written += writer->buffer_len;
+    writer->buffer_len = 0;
+
+    if (writer->written % RTOS_DFU_WRITER_CHECKPOINT_INTERVAL == 0) {
+        checkpoint_save(writer);
+    }
+}
+
+int rtos_dfu_writer_init(
+        rtos_dfu_writer_t *writer,
+        rtos_qspi_flash_t *flash,
+        unsigned start_address,
+        size_t max_size,
+        unsigned checkpoint_address)
+{
+    /*
+     * The flash driver erases whole sectors, so an unaligned region would
+     * have data outside of it erased.
+     */
+    if (start_address % CHECKPOINT_SECTOR_SIZE != 0 ||
+        max_size % CHECKPOINT_SECTOR_SIZE != 0 ||
+        checkpoint_address % CHECKPOINT_SECTOR_SIZE != 0) {
+        rtos_printf("DFU region 0x%x-0x%x and checkpoint 0x%x must be sector aligned\n",
+                    start_address, start_address + (unsigned) max_size, checkpoint_address);
+        return -1;
+    }
+
+    memset(writer, 0, offsetof(rtos_dfu_writer_t, buffer));
+
+    writer->flash = flash;
+    writer->start_address = start_address;
+    writer->max_size = max_size;
+    writer->checkpoint_address = checkpoint_address;
+
+    return 0;
+}
+
+size_t rtos_dfu_writer_begin(
+        rtos_dfu_writer_t *writer,
+        uint32_t image_id,
+        int resume)
+{
+    checkpoint_t checkpoint = {0};
+
+    writer->image_id = image_id;
+    writer->written = 0;
+    writer->crc = 0;
+    writer->buffer_len = 0;
+
+    if (checkpoint_load(writer, &checkpoint) &&
+        resume &&
+        checkpoint.image_id == image_id &&
+        checkpoint.start_address == writer->start_address &&
+        checkpoint.written <= writer->max_size) {
+
+        writer->written = checkpoint.written;
+        writer->crc = checkpoint.crc;
+        rtos_printf("Resuming DFU at offset %u\n", (unsigned) writer->written);
+    } else if (writer->checkpoint_address != 0) {
+        /* Discard any earlier checkpoint */
+        checkpoint_save(writer);
+    }
+
+    /*
+     * Data past the checkpoint may have been partly written before the
+     * update was interrupted, so it is erased again.
+     */
+    writer->erased_to = writer->start_address + writer->written;
+
+    return writer->written;
+}
+
+int rtos_dfu_writer_write(
+        rtos_dfu_writer_t *writer,
+        const void *data,
+        size_t len)
+{
+    const uint8_t *p = data;
+
+    if (len > writer->max_size - writer->written - writer->buffer_len) {
+        rtos_printf("DFU image exceeds %u bytes\n", (unsigned) writer->max_size);
+        return -1;
+    }
+
+    while (len > 0) {
+        size_t n = RTOS_DFU_WRITER_BUFFER_SIZE - writer->buffer_len;
+
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&writer->buffer[writer->buffer_len], p, n);
+        writer->buffer_len += n;
+        p += n;
+        len -= n;
+
+        if (writer->buffer_len == RTOS_DFU_WRITER_BUFFER_SIZE) {
+            buffer_flush(writer);
+        }
+    }
+
+    return 0;
+}
+
+int rtos_dfu_writer_finish(
+        rtos_dfu_writer_t *writer,
+        uint32_t *crc)
+{
+    uint32_t flash_crc = 0;
+    size_t offset = 0;
+
+    buffer_flush(writer);
+
+    /* Reads are queued behind the writes, so they see the written data */
+    while (offset < writer->written) {
+        size_t n = writer->written - offset;
+
+        if (n > RTOS_DFU_WRITER_BUFFER_SIZE) {
+            n = RTOS_DFU_WRITER_BUFFER_SIZE;
+        }
+        rtos_qspi_flash_read(writer->flash, writer->buffer, writer->start_address + offset, n);
+        flash_crc = crc32_update(flash_crc, writer->buffer, n);
+        offset += n;
+    }
+
+    if (crc != NULL) {
+        *crc = writer->crc;
+    }
+
+    /*
+     * Either the update is complete, or the image in flash is corrupt and
+     * must not be resumed. In both cases there is nothing to resume.
+     */
+    writer->written = 0;
+    checkpoint_save(writer);
+    writer->written = offset;
+
+    if (flash_crc != writer->crc) {
+        rtos_printf("DFU image verification failed\n");
+        return -1;
+    }
+
+    return 0;
+}
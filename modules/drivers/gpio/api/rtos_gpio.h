@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_GPIO_H_
@@ -14,6 +14,7 @@
 #include <xcore/port.h>
 
 #include "rtos_osal.h"
+#include "rtos_stats.h"
 #include "rtos_driver_rpc.h"
 
 /**
@@ -131,6 +132,12 @@ struct rtos_gpio_struct {
     rtos_gpio_isr_info_t *isr_info[RTOS_GPIO_TOTAL_PORT_CNT];
 
     rtos_osal_mutex_t lock; /* Only used by RPC client */
+
+#if RTOS_STATS_ENABLED
+    struct {
+        rtos_stats_probe_t isr_time;
+    } stats;
+#endif
 };
 
 #include "rtos_gpio_rpc.h"
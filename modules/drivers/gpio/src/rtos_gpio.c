@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <string.h>
@@ -30,6 +30,7 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_gpio_isr, arg)
     void *isr_app_data;
     RTOS_GPIO_ISR_CALLBACK_ATTR rtos_gpio_isr_cb_t cb;
     int enabled = INTERRUPT_ENABLED;
+    RTOS_STATS_PROBE_START(start);
 
     int state = rtos_osal_critical_enter();
     {
@@ -48,6 +49,8 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_gpio_isr, arg)
         cb(ctx, isr_app_data, cb_arg->port_id, value);
         port_set_trigger_value(p, value);
     }
+
+    RTOS_STATS_PROBE_END(ctx->stats.isr_time, start);
 }
 
 static int port_valid(rtos_gpio_port_id_t port_id)
@@ -180,6 +183,8 @@ void rtos_gpio_init(
 {
     memset(ctx->isr_info, 0, sizeof(ctx->isr_info));
 
+    RTOS_STATS_PROBE_REGISTER(ctx->stats.isr_time, "gpio.isr");
+
     ctx->port_enable = gpio_local_port_enable;
     ctx->port_in = gpio_local_port_in;
     ctx->port_out = gpio_local_port_out;
@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <xcore/triggerable.h>
@@ -23,10 +23,13 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_i2c_slave_isr, arg)
 {
     rtos_i2c_slave_t *ctx = arg;
     int isr_action;
+    RTOS_STATS_PROBE_START(start);
 
     isr_action = s_chan_in_byte(ctx->c.end_b);
 
     rtos_osal_event_group_set_bits(&ctx->events, 1 << isr_action);
+
+    RTOS_STATS_PROBE_END(ctx->stats.isr_time, start);
 }
 
 static void tx_state_clear(rtos_i2c_slave_t *ctx)
@@ -136,6 +139,9 @@ static i2c_slave_ack_t i2c_master_sent_data(rtos_i2c_slave_t *ctx, uint8_t data)
 
     if (ctx->rx_data_i < RTOS_I2C_SLAVE_BUF_LEN) {
         ctx->data_buf[ctx->rx_data_i++] = data;
+        RTOS_STATS_COUNTER_HIGH_WATER(ctx->stats.rx_high_water, ctx->rx_data_i);
+    } else {
+        RTOS_STATS_COUNTER_ADD(ctx->stats.rx_overruns, 1);
     }
 
     if (ctx->rx_data_i < RTOS_I2C_SLAVE_BUF_LEN) {
@@ -247,6 +253,10 @@ void rtos_i2c_slave_start(
     i2c_slave_ctx->rx_byte_check = rx_byte_check;
     i2c_slave_ctx->write_addr_req = write_addr_req;
 
+    RTOS_STATS_PROBE_REGISTER(i2c_slave_ctx->stats.isr_time, "i2c_slave.isr");
+    RTOS_STATS_COUNTER_REGISTER(i2c_slave_ctx->stats.rx_overruns, "i2c_slave.rx_overruns", RTOS_STATS_COUNTER_TOTAL);
+    RTOS_STATS_COUNTER_REGISTER(i2c_slave_ctx->stats.rx_high_water, "i2c_slave.rx_high_water", RTOS_STATS_COUNTER_HIGH_WATER);
+
     i2c_slave_ctx->rx_data_i = 0;
     i2c_slave_ctx->tx_data = NULL;
     i2c_slave_ctx->tx_data_len = 0;
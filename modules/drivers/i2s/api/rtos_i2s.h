@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_I2S_H_
@@ -17,6 +17,7 @@
 
 #include "rtos_osal.h"
 #include "rtos_driver_rpc.h"
+#include "rtos_stats.h"
 
 /**
  * This attribute must be specified on all RTOS I2S send filter callback functions
@@ -149,6 +150,17 @@ struct rtos_i2s_struct{
     } recv_buffer;
     uint8_t isr_cmd;
     bool is_slave;
+
+#if RTOS_STATS_ENABLED
+    struct {
+        rtos_stats_probe_t isr_time;
+        rtos_stats_probe_t receive_time;
+        rtos_stats_probe_t send_time;
+        rtos_stats_counter_t recv_overruns;
+        rtos_stats_counter_t send_underruns;
+        rtos_stats_counter_t recv_high_water;
+    } stats;
+#endif
 };
 
 #include "rtos_i2s_rpc.h"
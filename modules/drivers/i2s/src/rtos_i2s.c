@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT RTOS_I2S
@@ -21,18 +21,21 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_i2s_isr, arg)
 {
     rtos_i2s_t *ctx = arg;
     int isr_action;
+    RTOS_STATS_PROBE_START(start);
 
     isr_action = s_chan_in_byte(ctx->c_i2s_isr.end_b);
 
     if (isr_action & ISR_RESUME_SEND_BM) {
-        rtos_printf("send put\n");
+        rtos_printf_debug("send put\n");
         rtos_osal_semaphore_put(&ctx->send_sem);
     }
 
     if (isr_action & ISR_RESUME_RECV_BM) {
-        rtos_printf("recv put\n");
+        rtos_printf_debug("recv put\n");
         rtos_osal_semaphore_put(&ctx->recv_sem);
     }
+
+    RTOS_STATS_PROBE_END(ctx->stats.isr_time, start);
 }
 
 I2S_CALLBACK_ATTR
@@ -54,13 +57,14 @@ static void i2s_receive(rtos_i2s_t *ctx, size_t num_in, const int32_t *i2s_sampl
     size_t words_available = ctx->recv_buffer.total_written - ctx->recv_buffer.total_read;
     size_t words_free = ctx->recv_buffer.buf_size - words_available;
     size_t buffer_words_written = 0;
+    RTOS_STATS_PROBE_START(start);
 
     if (ctx->receive_filter_cb == NULL) {
         if (num_in <= words_free) {
             memcpy(&ctx->recv_buffer.buf[ctx->recv_buffer.write_index], i2s_sample_buf, num_in * sizeof(int32_t));
             buffer_words_written = num_in;
         } else {
-            // rtos_printf("i2s rx overrun\n");
+            RTOS_STATS_COUNTER_ADD(ctx->stats.recv_overruns, 1);
         }
     } else {
         /*
@@ -78,6 +82,7 @@ static void i2s_receive(rtos_i2s_t *ctx, size_t num_in, const int32_t *i2s_sampl
         }
         RTOS_MEMORY_BARRIER();
         ctx->recv_buffer.total_written += num_in;
+        RTOS_STATS_COUNTER_HIGH_WATER(ctx->stats.recv_high_water, ctx->recv_buffer.total_written - ctx->recv_buffer.total_read);
     }
 
     if (ctx->recv_buffer.required_available_count > 0) {
@@ -93,6 +98,8 @@ static void i2s_receive(rtos_i2s_t *ctx, size_t num_in, const int32_t *i2s_sampl
         s_chan_out_byte(ctx->c_i2s_isr.end_a, ctx->isr_cmd);
         ctx->isr_cmd = 0;
     }
+
+    RTOS_STATS_PROBE_END(ctx->stats.receive_time, start);
 }
 
 I2S_CALLBACK_ATTR
@@ -100,13 +107,14 @@ static void i2s_send(rtos_i2s_t *ctx, size_t num_out, int32_t *i2s_sample_buf)
 {
     size_t words_available = ctx->send_buffer.total_written - ctx->send_buffer.total_read;
     size_t buffer_words_read = 0;
+    RTOS_STATS_PROBE_START(start);
 
     if (ctx->send_filter_cb == NULL) {
         if (words_available >= num_out) {
             memcpy(i2s_sample_buf, &ctx->send_buffer.buf[ctx->send_buffer.read_index], num_out * sizeof(int32_t));
             buffer_words_read = num_out;
         } else {
-            // rtos_printf("i2s tx underrun\n");
+            RTOS_STATS_COUNTER_ADD(ctx->stats.send_underruns, 1);
         }
     } else {
         /*
@@ -139,6 +147,8 @@ static void i2s_send(rtos_i2s_t *ctx, size_t num_out, int32_t *i2s_sample_buf)
         s_chan_out_byte(ctx->c_i2s_isr.end_a, ctx->isr_cmd);
         ctx->isr_cmd = 0;
     }
+
+    RTOS_STATS_PROBE_END(ctx->stats.send_time, start);
 }
 
 static void i2s_master_thread(rtos_i2s_t *ctx)
@@ -238,7 +248,7 @@ static size_t i2s_local_rx(rtos_i2s_t *ctx,
     }
 
     if (ctx->recv_blocked) {
-        rtos_printf("recv get\n");
+        rtos_printf_debug("recv get\n");
         if (rtos_osal_semaphore_get(&ctx->recv_sem, timeout) == RTOS_OSAL_SUCCESS) {
             ctx->recv_blocked = 0;
         }
@@ -290,7 +300,7 @@ static size_t i2s_local_tx(rtos_i2s_t *ctx,
     }
 
     if (ctx->send_blocked) {
-        rtos_printf("send get\n");
+        rtos_printf_debug("send get\n");
         if (rtos_osal_semaphore_get(&ctx->send_sem, timeout) == RTOS_OSAL_SUCCESS) {
             ctx->send_blocked = 0;
         }
@@ -333,6 +343,13 @@ void rtos_i2s_start(
     i2s_ctx->mode = mode;
     i2s_ctx->isr_cmd = 0;
 
+    RTOS_STATS_PROBE_REGISTER(i2s_ctx->stats.isr_time, "i2s.isr");
+    RTOS_STATS_PROBE_REGISTER(i2s_ctx->stats.receive_time, "i2s.receive");
+    RTOS_STATS_PROBE_REGISTER(i2s_ctx->stats.send_time, "i2s.send");
+    RTOS_STATS_COUNTER_REGISTER(i2s_ctx->stats.recv_overruns, "i2s.recv_overruns", RTOS_STATS_COUNTER_TOTAL);
+    RTOS_STATS_COUNTER_REGISTER(i2s_ctx->stats.send_underruns, "i2s.send_underruns", RTOS_STATS_COUNTER_TOTAL);
+    RTOS_STATS_COUNTER_REGISTER(i2s_ctx->stats.recv_high_water, "i2s.recv_high_water", RTOS_STATS_COUNTER_HIGH_WATER);
+
     memset(&i2s_ctx->recv_buffer, 0, sizeof(i2s_ctx->send_buffer));
     if (i2s_ctx->num_in > 0) {
         i2s_ctx->recv_buffer.buf_size = recv_buffer_size * (2 * i2s_ctx->num_in);
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 /**
@@ -27,6 +27,7 @@
 #include <xcore/channel_transaction.h>
 
 #include "rtos_osal.h"
+#include "rtos_stats.h"
 
 /**
  * Struct representing an RTOS intertile driver instance.
@@ -40,6 +41,12 @@ typedef struct {
     size_t rx_len;
     rtos_osal_mutex_t lock;
     rtos_osal_event_group_t event_group;
+
+#if RTOS_STATS_ENABLED
+    struct {
+        rtos_stats_probe_t isr_time;
+    } stats;
+#endif
 } rtos_intertile_t;
 
 /**
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <xcore/triggerable.h>
@@ -12,6 +12,7 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_intertile_isr, arg)
 {
     rtos_intertile_t *ctx = arg;
     uint8_t port;
+    RTOS_STATS_PROBE_START(start);
 
     triggerable_disable_trigger(ctx->c);
 
@@ -23,6 +24,8 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_intertile_isr, arg)
         /* This shouldn't fail */
         xassert(0);
     }
+
+    RTOS_STATS_PROBE_END(ctx->stats.isr_time, start);
 }
 
 void rtos_intertile_tx_len(rtos_intertile_t *ctx, uint8_t port, size_t len)
@@ -125,6 +128,8 @@ size_t rtos_intertile_rx(rtos_intertile_t *ctx, uint8_t port, void **msg,
 
 void rtos_intertile_start(rtos_intertile_t *intertile_ctx)
 {
+    RTOS_STATS_PROBE_REGISTER(intertile_ctx->stats.isr_time, "intertile.isr");
+
     triggerable_setup_interrupt_callback(
             intertile_ctx->c, intertile_ctx,
             RTOS_INTERRUPT_CALLBACK(rtos_intertile_isr));
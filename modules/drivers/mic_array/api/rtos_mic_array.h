@@ -1,4 +1,4 @@
-// Copyright 2020-2022 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_MIC_ARRAY_H_
@@ -18,6 +18,7 @@
 #include "mic_array_vanilla.h"
 
 #include "rtos_osal.h"
+#include "rtos_stats.h"
 #include "rtos_driver_rpc.h"
 
 /**
@@ -63,6 +64,14 @@ struct rtos_mic_array_struct {
     } recv_buffer;
     
     int32_t isr_decoupling_buf[MIC_ARRAY_CONFIG_SAMPLES_PER_FRAME * MIC_ARRAY_CONFIG_MIC_COUNT];
+
+#if RTOS_STATS_ENABLED
+    struct {
+        rtos_stats_probe_t isr_time;
+        rtos_stats_counter_t recv_overruns;
+        rtos_stats_counter_t recv_high_water;
+    } stats;
+#endif
 };
 
 #include "rtos_mic_array_rpc.h"
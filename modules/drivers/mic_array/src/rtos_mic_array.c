@@ -1,4 +1,4 @@
-// Copyright 2020-2022 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT RTOS_MIC_ARRAY
@@ -39,6 +39,7 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_mic_array_isr, arg)
     size_t words_remaining = MIC_ARRAY_CONFIG_SAMPLES_PER_FRAME * MIC_ARRAY_CONFIG_MIC_COUNT;
     size_t words_available = ctx->recv_buffer.total_written - ctx->recv_buffer.total_read;
     size_t words_free = ctx->recv_buffer.buf_size - words_available;
+    RTOS_STATS_PROBE_START(start);
 
     if (ctx->format == RTOS_MIC_ARRAY_CHANNEL_SAMPLE) {
         ma_frame_rx(ctx->isr_decoupling_buf, ctx->c_pdm_mic.end_b, MIC_ARRAY_CONFIG_SAMPLES_PER_FRAME, MIC_ARRAY_CONFIG_MIC_COUNT);
@@ -65,7 +66,9 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_mic_array_isr, arg)
 
         RTOS_MEMORY_BARRIER();
         ctx->recv_buffer.total_written += MIC_ARRAY_CONFIG_SAMPLES_PER_FRAME * MIC_ARRAY_CONFIG_MIC_COUNT;
+        RTOS_STATS_COUNTER_HIGH_WATER(ctx->stats.recv_high_water, ctx->recv_buffer.total_written - ctx->recv_buffer.total_read);
     } else {
+        RTOS_STATS_COUNTER_ADD(ctx->stats.recv_overruns, 1);
         rtos_printf("mic rx overrun\n");
     }
 
@@ -77,6 +80,8 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_mic_array_isr, arg)
             rtos_osal_semaphore_put(&ctx->recv_sem);
         }
     }
+
+    RTOS_STATS_PROBE_END(ctx->stats.isr_time, start);
 }
 
 __attribute__((fptrgroup("rtos_mic_array_rx_fptr_grp")))
@@ -144,6 +149,11 @@ void rtos_mic_array_start(
     uint32_t core_exclude_map;
 
     xassert(buffer_size >= MIC_ARRAY_CONFIG_SAMPLES_PER_FRAME);
+
+    RTOS_STATS_PROBE_REGISTER(mic_array_ctx->stats.isr_time, "mic_array.isr");
+    RTOS_STATS_COUNTER_REGISTER(mic_array_ctx->stats.recv_overruns, "mic_array.recv_overruns", RTOS_STATS_COUNTER_TOTAL);
+    RTOS_STATS_COUNTER_REGISTER(mic_array_ctx->stats.recv_high_water, "mic_array.recv_high_water", RTOS_STATS_COUNTER_HIGH_WATER);
+
     memset(&mic_array_ctx->recv_buffer, 0, sizeof(mic_array_ctx->recv_buffer));
     mic_array_ctx->recv_buffer.buf_size = buffer_size * MIC_ARRAY_CONFIG_MIC_COUNT;
     mic_array_ctx->recv_buffer.buf = rtos_osal_malloc(mic_array_ctx->recv_buffer.buf_size * sizeof(int32_t));
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_QSPI_FLASH_H_
@@ -18,6 +18,7 @@
 
 #include "rtos_osal.h"
 #include "rtos_driver_rpc.h"
+#include "rtos_stats.h"
 
 #define RTOS_QSPI_FLASH_READ_CHUNK_SIZE (24*1024)
 
@@ -66,6 +67,14 @@ struct rtos_qspi_flash_struct {
     rtos_osal_mutex_t mutex;
     volatile int spinlock;
     volatile int ll_req_flag;
+
+#if RTOS_STATS_ENABLED
+    struct {
+        rtos_stats_probe_t read_time;
+        rtos_stats_probe_t write_time;
+        rtos_stats_probe_t erase_time;
+    } stats;
+#endif
 };
 
 #include "rtos_qspi_flash_rpc.h"
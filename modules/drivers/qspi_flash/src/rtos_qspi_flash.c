@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT RTOS_QSPI_FLASH
@@ -20,6 +20,16 @@
 #define QSPI_FL_RETRY_ATTEMPT_CNT 5
 #endif
 
+/*
+ * The command used to erase aligned 64 KiB blocks, which is much faster
+ * than erasing each of their sectors. Not every flash supports it, or
+ * uses the same command, so it is disabled by default. Set this from the
+ * board or application configuration to enable it, usually to 0xD8.
+ */
+#ifndef QSPI_FL_BLOCK_ERASE_COMMAND
+#define QSPI_FL_BLOCK_ERASE_COMMAND 0
+#endif
+
 /* TODO, these will be removed once moved to the public API */
 #define ERASE_CHIP 0xC7
 
@@ -41,6 +51,7 @@ extern void fl_int_eraseSector(
 
 /* Library only supports 4096 sector size*/
 #define QSPI_ERASE_TYPE_SIZE_LOG2   12
+#define QSPI_BLOCK_ERASE_SIZE_LOG2  16
 
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 
@@ -147,7 +158,7 @@ int rtos_qspi_flash_read_ll(
             memset(&data[read_len], 0xFF, original_len - read_len);
         }
 
-        rtos_printf("Read %d bytes from flash at address 0x%x\n", read_len, address);
+        rtos_printf_debug("Read %d bytes from flash at address 0x%x\n", read_len, address);
 
         interrupt_mask_all();
         fl_int_read(ctx->qspi_spec.readCommand, address, data, read_len);
@@ -204,7 +215,7 @@ int rtos_qspi_flash_fast_read_ll(
             memset(&data[read_len], 0xFF, original_len - read_len);
         }
 
-        rtos_printf("Read %d bytes from flash at address 0x%x\n", read_len, address);
+        rtos_printf_debug("Read %d bytes from flash at address 0x%x\n", read_len, address);
 
         interrupt_mask_all();
         qspi_flash_fast_read(qspi_flash_fast_read_ctx, address, data, read_len);
@@ -262,7 +273,7 @@ int rtos_qspi_flash_fast_read_mode_ll(
             memset(&data[read_len], 0xFF, original_len - read_len);
         }
 
-        rtos_printf("Read %d bytes from flash at address 0x%x in mode %d\n", read_len, address, mode);
+        rtos_printf_debug("Read %d bytes from flash at address 0x%x in mode %d\n", read_len, address, mode);
 
         qspi_flash_fast_read_mode_set(&ctx->ctx, mode);
 
@@ -344,7 +355,7 @@ static void read_op(
             memset(&data[read_len], 0xFF, original_len - read_len);
         }
 
-        rtos_printf("Read %d bytes from flash at address 0x%x\n", read_len, address);
+        rtos_printf_debug("Read %d bytes from flash at address 0x%x\n", read_len, address);
 
         interrupt_mask_all();
         fl_int_read(ctx->qspi_spec.readCommand, address, data, read_len);
@@ -389,7 +400,7 @@ static void read_fast_op(
             memset(&data[read_len], 0xFF, original_len - read_len);
         }
 
-        rtos_printf("Read %d bytes from flash at address 0x%x\n", read_len, address);
+        rtos_printf_debug("Read %d bytes from flash at address 0x%x\n", read_len, address);
 
         interrupt_mask_all();
         qspi_flash_fast_read(qspi_flash_fast_read_ctx, address, data, read_len);
@@ -433,7 +444,7 @@ static void write_op(
             break; /* do not write past the end of the flash */
         }
 
-        rtos_printf("Write %d bytes from flash at address 0x%x\n", bytes_to_write, address_to_write);
+        rtos_printf_debug("Write %d bytes from flash at address 0x%x\n", bytes_to_write, address_to_write);
         interrupt_mask_all(); {
             fl_int_sendSingleByteCommand(ctx->qspi_spec.writeEnableCommand);
         } interrupt_unmask_all();
@@ -497,22 +508,31 @@ static void erase_op(
         while (bytes_left_to_erase > 0) {
             int erase_length;
             int erase_length_log2 = QSPI_ERASE_TYPE_SIZE_LOG2;
+            unsigned char erase_command = ctx->qspi_spec.sectorEraseCommand;
 
             if (address_to_erase >= ctx->flash_size) {
                 break; /* do not erase past the end of the flash */
             }
 
+#if QSPI_FL_BLOCK_ERASE_COMMAND
+            if (bytes_left_to_erase >= (1 << QSPI_BLOCK_ERASE_SIZE_LOG2) &&
+                SECTOR_TO_BYTE_ADDRESS(BYTE_TO_SECTOR_ADDRESS(address_to_erase, QSPI_BLOCK_ERASE_SIZE_LOG2), QSPI_BLOCK_ERASE_SIZE_LOG2) == address_to_erase) {
+                erase_length_log2 = QSPI_BLOCK_ERASE_SIZE_LOG2;
+                erase_command = QSPI_FL_BLOCK_ERASE_COMMAND;
+            }
+#endif
+
             erase_length = 1 << erase_length_log2;
 
             xassert(address_to_erase == SECTOR_TO_BYTE_ADDRESS(BYTE_TO_SECTOR_ADDRESS(address_to_erase, erase_length_log2), erase_length_log2));
 
-            rtos_printf("Erasing %d bytes (%d) at byte address %d, sector %d\n", erase_length, bytes_left_to_erase, address_to_erase, BYTE_TO_SECTOR_ADDRESS(address_to_erase, erase_length_log2));
+            rtos_printf_debug("Erasing %d bytes (%d) at byte address %d, sector %d\n", erase_length, bytes_left_to_erase, address_to_erase, BYTE_TO_SECTOR_ADDRESS(address_to_erase, erase_length_log2));
 
             interrupt_mask_all(); {
                 fl_int_sendSingleByteCommand(ctx->qspi_spec.writeEnableCommand);
             } interrupt_unmask_all();
             interrupt_mask_all(); {
-                fl_int_eraseSector(ctx->qspi_spec.sectorEraseCommand, address_to_erase);
+                fl_int_eraseSector(erase_command, address_to_erase);
             } interrupt_unmask_all();
             while_busy();
             interrupt_mask_all(); {
@@ -543,7 +563,10 @@ static void qspi_flash_op_thread(rtos_qspi_flash_t *ctx)
             * operation.
             */
             rtos_osal_thread_priority_set(&ctx->op_task, op.priority);
-            
+
+            /* Includes the time taken to switch between read modes */
+            RTOS_STATS_PROBE_START(start);
+
             switch (ctx->last_op) {
             case FLASH_OP_NONE:
                 if ((op.op == FLASH_OP_READ_FAST_RAW)
@@ -578,23 +601,28 @@ static void qspi_flash_op_thread(rtos_qspi_flash_t *ctx)
             switch (op.op) {
             case FLASH_OP_READ:
                 read_op(ctx, op.data, op.address, op.len);
+                RTOS_STATS_PROBE_END(ctx->stats.read_time, start);
                 rtos_osal_semaphore_put(&ctx->data_ready);
                 break;
             case FLASH_OP_WRITE:
                 write_op(ctx, op.data, op.address, op.len);
+                RTOS_STATS_PROBE_END(ctx->stats.write_time, start);
                 rtos_osal_free(op.data);
                 break;
             case FLASH_OP_ERASE:
                 erase_op(ctx, op.address, op.len);
+                RTOS_STATS_PROBE_END(ctx->stats.erase_time, start);
                 break;
             case FLASH_OP_READ_FAST_RAW:
                 qspi_flash_fast_read_mode_set(&ctx->ctx, qspi_fast_flash_read_transfer_raw);
                 read_fast_op(ctx, op.data, op.address, op.len);
+                RTOS_STATS_PROBE_END(ctx->stats.read_time, start);
                 rtos_osal_semaphore_put(&ctx->data_ready);
                 break;
             case FLASH_OP_READ_FAST_NIBBLE_SWAP:
                 qspi_flash_fast_read_mode_set(&ctx->ctx, qspi_fast_flash_read_transfer_nibble_swap);
                 read_fast_op(ctx, op.data, op.address, op.len);
+                RTOS_STATS_PROBE_END(ctx->stats.read_time, start);
                 rtos_osal_semaphore_put(&ctx->data_ready);
                 break;
             }
@@ -802,6 +830,10 @@ void rtos_qspi_flash_start(
     rtos_osal_queue_create(&ctx->op_queue, "qspi_req_queue", 2, sizeof(qspi_flash_op_req_t));
     rtos_osal_semaphore_create(&ctx->data_ready, "qspi_dr_sem", 1, 0);
 
+    RTOS_STATS_PROBE_REGISTER(ctx->stats.read_time, "qspi_flash.read");
+    RTOS_STATS_PROBE_REGISTER(ctx->stats.write_time, "qspi_flash.write");
+    RTOS_STATS_PROBE_REGISTER(ctx->stats.erase_time, "qspi_flash.erase");
+
     ctx->op_task_priority = priority;
     rtos_osal_thread_create(
             &ctx->op_task,
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_SPI_MASTER_H_
@@ -26,6 +26,15 @@ typedef struct rtos_spi_master_struct rtos_spi_master_t;
  */
 typedef struct rtos_spi_master_device_struct rtos_spi_master_device_t;
 
+/**
+ * One segment of a transfer made with rtos_spi_master_transfer_segments().
+ */
+typedef struct {
+    uint8_t *data_out; /**< Pointer to the data to send, or NULL if there is none. */
+    uint8_t *data_in;  /**< Pointer to the buffer to receive into, or NULL if the received data is not needed. */
+    size_t len;        /**< The number of bytes to transfer in each direction. */
+} rtos_spi_master_segment_t;
+
 /**
  * Struct representing an RTOS SPI master driver instance.
  *
@@ -40,6 +49,9 @@ struct rtos_spi_master_struct {
     __attribute__((fptrgroup("rtos_spi_master_transfer_fptr_grp")))
     void (*transfer)(rtos_spi_master_device_t *, uint8_t *, uint8_t *, size_t);
 
+    __attribute__((fptrgroup("rtos_spi_master_transfer_segments_fptr_grp")))
+    void (*transfer_segments)(rtos_spi_master_device_t *, const rtos_spi_master_segment_t *, size_t);
+
     __attribute__((fptrgroup("rtos_spi_master_delay_before_next_transfer_fptr_grp")))
     void (*delay_before_next_transfer)(rtos_spi_master_device_t *, uint32_t);
 
@@ -124,6 +136,28 @@ inline void rtos_spi_master_transfer(
     ctx->bus_ctx->transfer(ctx, data_out, data_in, len);
 }
 
+/**
+ * Transfers several segments of data to and from the specified SPI device
+ * back to back, as a single request to the driver's thread. The transaction
+ * must already have been started by calling rtos_spi_master_transaction_start()
+ * on the same device instance.
+ *
+ * Unlike rtos_spi_master_transfer(), no data is copied, even for segments
+ * that only send data. This function does not return until every segment has
+ * been transferred, so all the buffers only need to remain valid until then.
+ *
+ * \param ctx          A pointer to the SPI device instance.
+ * \param segments     Array of the segments to transfer, in order.
+ * \param segment_count The number of segments in \p segments.
+ */
+inline void rtos_spi_master_transfer_segments(
+        rtos_spi_master_device_t *ctx,
+        const rtos_spi_master_segment_t *segments,
+        size_t segment_count)
+{
+    ctx->bus_ctx->transfer_segments(ctx, segments, segment_count);
+}
+
 /**
  * If there is a minimum amount of idle time that is required by
  * the device between transfers within a single transaction, then
@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_SPI_SLAVE_H_
@@ -15,6 +15,7 @@
 #include "spi.h"
 
 #include "rtos_osal.h"
+#include "rtos_stats.h"
 #include "rtos_driver_rpc.h"
 
 /**
@@ -125,6 +126,13 @@ struct rtos_spi_slave_struct {
     rtos_osal_thread_t hil_thread;
     rtos_osal_thread_t app_thread;
     unsigned interrupt_core_id;
+
+#if RTOS_STATS_ENABLED
+    struct {
+        rtos_stats_probe_t isr_time;
+        rtos_stats_counter_t lost_transfers;
+    } stats;
+#endif
 };
 
 /**
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <string.h>
@@ -12,12 +12,14 @@
 #define SPI_OP_XFER  1
 #define SPI_OP_DELAY 2
 #define SPI_OP_END   3
+#define SPI_OP_XFER_SEGMENTS 4
 
 typedef struct {
     rtos_spi_master_device_t *ctx;
     int op;
     uint8_t *data_out;
     uint8_t *data_in;
+    const rtos_spi_master_segment_t *segments;
     size_t len;
     unsigned priority;
 } spi_xfer_req_t;
@@ -69,6 +71,21 @@ static void spi_xfer_thread(rtos_spi_master_t *ctx)
             }
             break;
 
+        case SPI_OP_XFER_SEGMENTS:
+            interrupt_mask_all();
+
+            for (size_t i = 0; i < req.len; i++) {
+                spi_master_transfer(&req.ctx->dev_ctx,
+                        req.segments[i].data_out,
+                        req.segments[i].data_in,
+                        req.segments[i].len);
+            }
+
+            interrupt_unmask_all();
+
+            rtos_osal_semaphore_put(&ctx->data_ready);
+            break;
+
         case SPI_OP_DELAY:
             spi_master_delay_before_next_transfer(&req.ctx->dev_ctx, req.len);
             break;
@@ -136,6 +153,27 @@ static void spi_master_local_transfer(
     }
 }
 
+__attribute__((fptrgroup("rtos_spi_master_transfer_segments_fptr_grp")))
+static void spi_master_local_transfer_segments(
+        rtos_spi_master_device_t *ctx,
+        const rtos_spi_master_segment_t *segments,
+        size_t segment_count)
+{
+    spi_xfer_req_t req;
+
+    req.op = SPI_OP_XFER_SEGMENTS;
+    req.ctx = ctx;
+    req.segments = segments;
+    req.len = segment_count;
+
+    /*
+     * The caller always waits for the transfer to complete,
+     * so the segments' buffers are used in place.
+     */
+    rtos_osal_queue_send(&ctx->bus_ctx->xfer_req_queue, &req, RTOS_OSAL_WAIT_FOREVER);
+    rtos_osal_semaphore_get(&ctx->bus_ctx->data_ready, RTOS_OSAL_WAIT_FOREVER);
+}
+
 __attribute__((fptrgroup("rtos_spi_master_delay_before_next_transfer_fptr_grp")))
 static void spi_master_local_delay_before_next_transfer(
         rtos_spi_master_device_t *ctx,
@@ -204,6 +242,7 @@ void rtos_spi_master_init(
     bus_ctx->rpc_config = NULL;
     bus_ctx->transaction_start = spi_master_local_transaction_start;
     bus_ctx->transfer = spi_master_local_transfer;
+    bus_ctx->transfer_segments = spi_master_local_transfer_segments;
     bus_ctx->delay_before_next_transfer = spi_master_local_delay_before_next_transfer;
     bus_ctx->transaction_end = spi_master_local_transaction_end;
 }
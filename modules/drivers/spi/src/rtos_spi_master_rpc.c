@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include "rtos_rpc.h"
@@ -59,6 +59,21 @@ static void spi_master_remote_transfer(
             &host_dev_ctx_ptr, data_out, data_in, &len);
 }
 
+__attribute__((fptrgroup("rtos_spi_master_transfer_segments_fptr_grp")))
+static void spi_master_remote_transfer_segments(
+        rtos_spi_master_device_t *dev_ctx,
+        const rtos_spi_master_segment_t *segments,
+        size_t segment_count)
+{
+    /*
+     * Each segment is sent to the host as a separate transfer. The buffers
+     * must be copied to and from the host tile regardless.
+     */
+    for (size_t i = 0; i < segment_count; i++) {
+        spi_master_remote_transfer(dev_ctx, segments[i].data_out, segments[i].data_in, segments[i].len);
+    }
+}
+
 __attribute__((fptrgroup("rtos_spi_master_delay_before_next_transfer_fptr_grp")))
 static void spi_master_remote_delay_before_next_transfer(
         rtos_spi_master_device_t *dev_ctx,
@@ -280,6 +295,7 @@ void rtos_spi_master_rpc_client_init(
     spi_master_ctx->rpc_config = rpc_config;
     spi_master_ctx->transaction_start = spi_master_remote_transaction_start;
     spi_master_ctx->transfer = spi_master_remote_transfer;
+    spi_master_ctx->transfer_segments = spi_master_remote_transfer_segments;
     spi_master_ctx->delay_before_next_transfer = spi_master_remote_delay_before_next_transfer;
     spi_master_ctx->transaction_end = spi_master_remote_transaction_end;
     rpc_config->rpc_host_start = NULL;
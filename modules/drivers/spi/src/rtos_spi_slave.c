@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT RTOS_SPI
@@ -34,6 +34,7 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_spi_slave_isr, arg)
     rtos_spi_slave_t *ctx = arg;
     int isr_action;
     xfer_done_queue_item_t item;
+    RTOS_STATS_PROBE_START(start);
 
     isr_action = s_chan_in_byte(ctx->c.end_b);
 
@@ -61,8 +62,11 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_spi_slave_isr, arg)
             xTaskNotifyGive(ctx->app_thread.thread);
         }
     } else {
+        RTOS_STATS_COUNTER_ADD(ctx->stats.lost_transfers, 1);
         rtos_printf("Lost SPI slave transfer\n");
     }
+
+    RTOS_STATS_PROBE_END(ctx->stats.isr_time, start);
 }
 
 void slave_transaction_started(rtos_spi_slave_t *ctx, uint8_t **out_buf, size_t *outbuf_len, uint8_t **in_buf, size_t *inbuf_len)
@@ -233,6 +237,9 @@ void rtos_spi_slave_start(
     spi_slave_ctx->xfer_done = xfer_done;
     spi_slave_ctx->interrupt_core_id = interrupt_core_id;
 
+    RTOS_STATS_PROBE_REGISTER(spi_slave_ctx->stats.isr_time, "spi_slave.isr");
+    RTOS_STATS_COUNTER_REGISTER(spi_slave_ctx->stats.lost_transfers, "spi_slave.lost_transfers", RTOS_STATS_COUNTER_TOTAL);
+
     rtos_osal_queue_create(&spi_slave_ctx->xfer_done_queue, "spi_slave_queue", RTOS_SPI_SLAVE_XFER_DONE_QUEUE_SIZE, sizeof(xfer_done_queue_item_t));
 
     if (start != NULL || xfer_done != NULL) {
@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <xs1.h>
@@ -8,6 +8,7 @@
 #include <xcore/triggerable.h>
 
 #include "rtos_interrupt.h"
+#include "rtos_stats.h"
 #include "rtos_swmem.h"
 static swmem_fill_t swmem_fill_res;
 static swmem_evict_t swmem_evict_res;
@@ -25,6 +26,11 @@ static uint32_t evict_buf[SWMEM_EVICT_SIZE_WORDS];
 static evict_slot_t evict_slot;
 static evict_mask_t dirty_mask;
 
+#if RTOS_STATS_ENABLED
+static rtos_stats_probe_t fill_isr_time;
+static rtos_stats_probe_t evict_isr_time;
+#endif
+
 #define SWMEM_ADDRESS_UNINITIALISED 0xffffffff
 
 // This must be initialized to a value, to prevent it from being memset to zero during
@@ -34,6 +40,8 @@ static volatile unsigned int __swmem_address = SWMEM_ADDRESS_UNINITIALISED;
 DEFINE_RTOS_INTERRUPT_CALLBACK(sw_mem_fill_isr, arg)
 {
     bool handled = false;
+    RTOS_STATS_PROBE_START(start);
+
     fill_slot = swmem_fill_in_address(swmem_fill_res);
 
     if (rtos_swmem_read_request_isr) {
@@ -60,11 +68,13 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(sw_mem_fill_isr, arg)
     }
 
     xassert(handled);
+    RTOS_STATS_PROBE_END(fill_isr_time, start);
 }
 
 DEFINE_RTOS_INTERRUPT_CALLBACK(sw_mem_evict_isr, arg)
 {
     bool handled = false;
+    RTOS_STATS_PROBE_START(start);
 
     evict_slot = swmem_evict_in_address(swmem_evict_res);
     dirty_mask = swmem_evict_get_dirty_mask(swmem_evict_res, evict_slot);
@@ -84,6 +94,7 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(sw_mem_evict_isr, arg)
     }
 
     xassert(handled);
+    RTOS_STATS_PROBE_END(evict_isr_time, start);
 }
 
 static void rtos_swmem_thread(void *arg)
@@ -146,12 +157,14 @@ void rtos_swmem_start(unsigned priority)
         }
 
         if (swmem_fill_res != 0) {
+            RTOS_STATS_PROBE_REGISTER(fill_isr_time, "swmem.fill_isr");
             triggerable_setup_interrupt_callback(
                     swmem_fill_res, NULL,
                     RTOS_INTERRUPT_CALLBACK(sw_mem_fill_isr));
             triggerable_enable_trigger(swmem_fill_res);
         }
         if (swmem_evict_res != 0) {
+            RTOS_STATS_PROBE_REGISTER(evict_isr_time, "swmem.evict_isr");
             triggerable_setup_interrupt_callback(
                     swmem_evict_res, NULL,
                     RTOS_INTERRUPT_CALLBACK(sw_mem_evict_isr));
@@ -0,0 +1,129 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef BINARY_TRACE_H_
+#define BINARY_TRACE_H_
+
+#ifndef __ASSEMBLER__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Event IDs. These must be kept in sync with the host decoder in
+ * tools/tracing/parsers/FreeRTOS/binary_trace_decoder.py.
+ */
+#define BINARY_TRACE_EVENT_TASK_SWITCHED_IN     0x01
+#define BINARY_TRACE_EVENT_TASK_SWITCHED_OUT    0x02
+#define BINARY_TRACE_EVENT_TASK_CREATE          0x03
+#define BINARY_TRACE_EVENT_TASK_DELETE          0x04
+#define BINARY_TRACE_EVENT_TASK_NAME            0x05
+#define BINARY_TRACE_EVENT_DROPPED              0x06
+#define BINARY_TRACE_EVENT_ISR_ENTER            0x07
+#define BINARY_TRACE_EVENT_ISR_EXIT             0x08
+
+/* Event IDs from here up are available to the application */
+#define BINARY_TRACE_EVENT_USER                 0x80
+
+/*
+ * A single trace record. All records are the same size so that they may be
+ * written to and drained from the trace rings without any formatting. They
+ * are sent to the host as is, in little endian byte order.
+ *
+ * For BINARY_TRACE_EVENT_TASK_NAME records, arg holds up to four characters
+ * of the task's name and seq holds the index of the first of these within
+ * the name. For BINARY_TRACE_EVENT_DROPPED records, arg holds the number of
+ * records that were dropped because the ring was full. For all other records,
+ * seq is a per-core sequence number that lets the host detect records that
+ * were lost on their way to it.
+ */
+typedef struct {
+    uint32_t timestamp;
+    uint32_t task;
+    uint32_t arg;
+    uint8_t event_id;
+    uint8_t tile;
+    uint8_t core;
+    uint8_t seq;
+} binary_trace_record_t;
+
+/**
+ * Adds a record to the calling core's trace ring. If the ring is full the
+ * record is dropped and counted.
+ *
+ * Note: This must be called with interrupts masked, as is the case for the
+ * FreeRTOS trace hooks. Use binary_trace_user_event() from application code.
+ *
+ * \param event_id The event ID.
+ * \param task     The handle of the task the event relates to.
+ * \param arg      Event specific data.
+ */
+void binary_trace_record(uint8_t event_id, void *task, uint32_t arg);
+
+/**
+ * Adds records with the name of a task to the calling core's trace ring.
+ *
+ * \param task     The handle of the task.
+ * \param name     The name of the task.
+ */
+void binary_trace_task_name(void *task, const char *name);
+
+/**
+ * Adds an application defined event record to the calling core's trace ring.
+ *
+ * \param event_id The event ID. Must be at least BINARY_TRACE_EVENT_USER.
+ * \param arg      Event specific data.
+ */
+void binary_trace_user_event(uint8_t event_id, uint32_t arg);
+
+/**
+ * Sends all records currently in every core's trace ring to the host
+ * over xscope.
+ *
+ * Note: This must not be called by more than one task at a time, including
+ * the drain task if it has been started.
+ *
+ * \returns the number of records sent.
+ */
+unsigned binary_trace_drain(void);
+
+/**
+ * Starts a task that periodically calls binary_trace_drain(). It should
+ * normally be given a low priority so that sending the trace to the host
+ * does not disturb the application.
+ *
+ * \param priority The priority of the drain task.
+ */
+void binary_trace_drain_task_start(unsigned priority);
+
+#define binarytraceRECORD(event_id, task, arg)                  \
+            do {                                                \
+                uint32_t ulState = portDISABLE_INTERRUPTS();    \
+                binary_trace_record(event_id, task, arg);       \
+                portRESTORE_INTERRUPTS(ulState);                \
+            } while(0)
+
+/*
+ * These may be placed at the start and end of an ISR to record the time
+ * spent in it. Interrupts are already masked within an ISR. The ID is any
+ * value that identifies the ISR to the host.
+ */
+#define binarytraceISR_ENTER(isr_id)    binary_trace_record( BINARY_TRACE_EVENT_ISR_ENTER, NULL, isr_id )
+#define binarytraceISR_EXIT(isr_id)     binary_trace_record( BINARY_TRACE_EVENT_ISR_EXIT, NULL, isr_id )
+
+#define traceTASK_SWITCHED_OUT()    binarytraceRECORD( BINARY_TRACE_EVENT_TASK_SWITCHED_OUT, pxCurrentTCB, 0 )
+#define traceTASK_SWITCHED_IN()     binarytraceRECORD( BINARY_TRACE_EVENT_TASK_SWITCHED_IN, pxCurrentTCB, 0 )
+#define traceTASK_CREATE(pxNewTCB)  binary_trace_task_name( pxNewTCB, pxNewTCB->pcTaskName )
+#define traceTASK_DELETE(pxTCB)     binarytraceRECORD( BINARY_TRACE_EVENT_TASK_DELETE, pxTCB, 0 )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* BINARY_TRACE_H_ */
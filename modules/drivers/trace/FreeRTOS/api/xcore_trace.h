@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef XCORE_TRACE_H_
@@ -8,6 +8,7 @@
 #define TRACE_MODE_DISABLED                     0
 #define TRACE_MODE_XSCOPE_ASCII                 1
 #define TRACE_MODE_TRACEALYZER_STREAMING        2
+#define TRACE_MODE_XSCOPE_BINARY                3
 
 /* Set the desired trace mode. To be set in application-level configuration */
 #ifndef USE_TRACE_MODE
@@ -28,6 +29,9 @@
 /* Enable required define for xscope ascii_trace functionality */
 #define ENABLE_RTOS_XSCOPE_TRACE                (USE_TRACE_MODE == TRACE_MODE_XSCOPE_ASCII)
 
+/* Enable required define for xscope binary_trace functionality */
+#define ENABLE_RTOS_XSCOPE_BINARY_TRACE         (USE_TRACE_MODE == TRACE_MODE_XSCOPE_BINARY)
+
 /* Configuration of the trace mode selected (via USE_TRACE_MODE). */
 #if (USE_TRACE_MODE == TRACE_MODE_TRACEALYZER_STREAMING)
 
@@ -52,6 +56,31 @@
 #include "ascii_trace.h"
 #endif /* __XC__ */
 
+#elif (USE_TRACE_MODE == TRACE_MODE_XSCOPE_BINARY)
+
+#include <xscope.h>
+
+/* Set defaults config values */
+
+/* The number of records in each core's trace ring. Must be a power of 2. */
+#ifndef xcoretraceconfigBINARY_TRACE_RING_RECORDS
+#define xcoretraceconfigBINARY_TRACE_RING_RECORDS       128
+#endif
+
+/* The maximum number of records sent in a single xscope packet */
+#ifndef xcoretraceconfigBINARY_TRACE_XSCOPE_RECORDS
+#define xcoretraceconfigBINARY_TRACE_XSCOPE_RECORDS     15
+#endif
+
+/* The period of the drain task started by binary_trace_drain_task_start() */
+#ifndef xcoretraceconfigBINARY_TRACE_DRAIN_PERIOD_MS
+#define xcoretraceconfigBINARY_TRACE_DRAIN_PERIOD_MS    10
+#endif
+
+#if( !( __XC__ ) )
+#include "binary_trace.h"
+#endif /* __XC__ */
+
 #endif /* USE_TRACE_MODE */
 
 #endif /* XCORE_TRACE_H_ */
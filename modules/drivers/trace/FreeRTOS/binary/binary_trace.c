@@ -0,0 +1,192 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if ENABLE_RTOS_XSCOPE_BINARY_TRACE == 1
+#include <string.h>
+#include <xcore/hwtimer.h>
+
+#include "rtos_support.h"
+
+#if (xcoretraceconfigBINARY_TRACE_RING_RECORDS & (xcoretraceconfigBINARY_TRACE_RING_RECORDS - 1)) != 0
+#error xcoretraceconfigBINARY_TRACE_RING_RECORDS must be a power of 2
+#endif
+
+#ifdef configNUM_CORES
+#define BINARY_TRACE_CORE_COUNT     configNUM_CORES
+#define binarytraceGET_CORE_ID()    rtos_core_id_get()
+#else
+#define BINARY_TRACE_CORE_COUNT     1
+#define binarytraceGET_CORE_ID()    0
+#endif
+
+#ifdef THIS_XCORE_TILE
+#define binarytraceGET_TILE_ID()    THIS_XCORE_TILE
+#else
+#define binarytraceGET_TILE_ID()    get_local_tile_id()
+#endif
+
+#define RING_INDEX(i) ((i) & (xcoretraceconfigBINARY_TRACE_RING_RECORDS - 1))
+
+/*
+ * Each core only ever writes to its own ring, with interrupts masked, and
+ * only the drain advances the tail. So no lock is needed between the core
+ * recording events and the task draining them.
+ */
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t dropped;
+    uint8_t seq;
+    binary_trace_record_t records[xcoretraceconfigBINARY_TRACE_RING_RECORDS];
+} binary_trace_ring_t;
+
+static binary_trace_ring_t trace_rings[BINARY_TRACE_CORE_COUNT];
+
+static void ring_write(binary_trace_ring_t *ring,
+                       int core_id,
+                       uint8_t event_id,
+                       void *task,
+                       uint32_t arg,
+                       uint8_t seq)
+{
+    const uint32_t head = ring->head;
+    binary_trace_record_t *rec = &ring->records[RING_INDEX(head)];
+
+    rec->timestamp = get_reference_time();
+    rec->task = (uint32_t) (uintptr_t) task;
+    rec->arg = arg;
+    rec->event_id = event_id;
+    rec->tile = binarytraceGET_TILE_ID();
+    rec->core = core_id;
+    rec->seq = seq;
+
+    /* The record must be complete before the drain can see it */
+    RTOS_MEMORY_BARRIER();
+    ring->head = head + 1;
+}
+
+static int ring_space(binary_trace_ring_t *ring)
+{
+    return xcoretraceconfigBINARY_TRACE_RING_RECORDS - (ring->head - ring->tail);
+}
+
+void binary_trace_record(uint8_t event_id, void *task, uint32_t arg)
+{
+    const int core_id = binarytraceGET_CORE_ID();
+    binary_trace_ring_t *ring = &trace_rings[core_id];
+
+    if (ring->dropped > 0) {
+        /* Leave room for the event itself after the dropped record */
+        if (ring_space(ring) < 2) {
+            ring->dropped++;
+            return;
+        }
+        ring_write(ring, core_id, BINARY_TRACE_EVENT_DROPPED, NULL, ring->dropped, 0);
+        ring->dropped = 0;
+    }
+
+    if (ring_space(ring) < 1) {
+        ring->dropped++;
+        return;
+    }
+
+    ring_write(ring, core_id, event_id, task, arg, ring->seq++);
+}
+
+void binary_trace_task_name(void *task, const char *name)
+{
+    uint32_t ulState = portDISABLE_INTERRUPTS();
+    const int core_id = binarytraceGET_CORE_ID();
+    binary_trace_ring_t *ring = &trace_rings[core_id];
+    size_t len = strnlen(name, configMAX_TASK_NAME_LEN);
+
+    binary_trace_record(BINARY_TRACE_EVENT_TASK_CREATE, task, 0);
+
+    /*
+     * The name is sent four characters at a time. The last record
+     * always contains at least one NUL character.
+     */
+    for (size_t i = 0; i <= len; i += 4) {
+        uint32_t chars = 0;
+
+        for (size_t j = 0; j < 4 && i + j < len; j++) {
+            chars |= (uint32_t) (uint8_t) name[i + j] << (8 * j);
+        }
+
+        if (ring->dropped > 0 || ring_space(ring) < 1) {
+            ring->dropped++;
+        } else {
+            ring_write(ring, core_id, BINARY_TRACE_EVENT_TASK_NAME, task, chars, i);
+        }
+    }
+
+    portRESTORE_INTERRUPTS(ulState);
+}
+
+void binary_trace_user_event(uint8_t event_id, uint32_t arg)
+{
+    configASSERT(event_id >= BINARY_TRACE_EVENT_USER);
+    binarytraceRECORD(event_id, xTaskGetCurrentTaskHandle(), arg);
+}
+
+unsigned binary_trace_drain(void)
+{
+    unsigned count = 0;
+
+    for (int i = 0; i < BINARY_TRACE_CORE_COUNT; i++) {
+        binary_trace_ring_t *ring = &trace_rings[i];
+        uint32_t tail = ring->tail;
+        const uint32_t head = ring->head;
+
+        RTOS_MEMORY_BARRIER();
+
+        while (tail != head) {
+            /* Send as many contiguous records as xscope allows at once */
+            uint32_t n = head - tail;
+            if (n > xcoretraceconfigBINARY_TRACE_RING_RECORDS - RING_INDEX(tail)) {
+                n = xcoretraceconfigBINARY_TRACE_RING_RECORDS - RING_INDEX(tail);
+            }
+            if (n > xcoretraceconfigBINARY_TRACE_XSCOPE_RECORDS) {
+                n = xcoretraceconfigBINARY_TRACE_XSCOPE_RECORDS;
+            }
+
+            xscope_core_bytes(FREERTOS_TRACE,
+                              n * sizeof(binary_trace_record_t),
+                              (unsigned char *) &ring->records[RING_INDEX(tail)]);
+
+            tail += n;
+            count += n;
+
+            /* The records must be sent before the core may overwrite them */
+            RTOS_MEMORY_BARRIER();
+            ring->tail = tail;
+        }
+    }
+
+    return count;
+}
+
+static void binary_trace_drain_task(void *arg)
+{
+    (void) arg;
+
+    for (;;) {
+        binary_trace_drain();
+        vTaskDelay(pdMS_TO_TICKS(xcoretraceconfigBINARY_TRACE_DRAIN_PERIOD_MS));
+    }
+}
+
+void binary_trace_drain_task_start(unsigned priority)
+{
+    xTaskCreate((TaskFunction_t) binary_trace_drain_task,
+                "trace_drain",
+                RTOS_THREAD_STACK_SIZE(binary_trace_drain_task),
+                NULL,
+                priority,
+                NULL);
+}
+
+#endif /* ENABLE_RTOS_XSCOPE_BINARY_TRACE == 1 */
@@ -1,4 +1,4 @@
-// Copyright 2022 XMOS LIMITED.
+// Copyright 2022-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_UART_RX_H_
@@ -15,6 +15,7 @@
 #include "uart.h"
 
 #include "rtos_osal.h"
+#include "rtos_stats.h"
 #include "stream_buffer.h"
 
 /**
@@ -136,6 +137,15 @@ struct rtos_uart_rx_struct {
 
     rtos_osal_thread_t hil_thread;
     rtos_osal_thread_t app_thread;
+
+#if RTOS_STATS_ENABLED
+    struct {
+        rtos_stats_probe_t isr_time;
+        rtos_stats_counter_t fifo_overruns;
+        rtos_stats_counter_t app_buffer_overruns;
+        rtos_stats_counter_t app_buffer_high_water;
+    } stats;
+#endif
 };
 
 
@@ -1,4 +1,4 @@
-// Copyright 2022 XMOS LIMITED.
+// Copyright 2022-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT RTOS_UART_RX
@@ -14,6 +14,7 @@
 DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_uart_rx_isr, arg)
 {
     rtos_uart_rx_t *ctx = (rtos_uart_rx_t*)arg;
+    RTOS_STATS_PROBE_START(start);
 
     /* Grab byte received from rx which triggered ISR */
     uint8_t byte = s_chan_in_byte(ctx->c.end_b);
@@ -26,8 +27,10 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(rtos_uart_rx_isr, arg)
     uart_buffer_error_t err = push_byte_into_buffer(&ctx->isr_to_app_fifo, byte);
     if(err != UART_BUFFER_OK){
         ctx->cb_flags |= UR_OVERRUN_ERR_CB_FLAG;
+        RTOS_STATS_COUNTER_ADD(ctx->stats.fifo_overruns, 1);
     }
 
+    RTOS_STATS_PROBE_END(ctx->stats.isr_time, start);
     portYIELD_FROM_ISR(pxHigherPriorityTaskWoken);
 }
 
@@ -87,7 +90,9 @@ static void uart_rx_app_thread(rtos_uart_rx_t *ctx)
 
             if(xBytesSent != bytes_read){
                 ctx->cb_flags |= UR_OVERRUN_ERR_CB_FLAG;
+                RTOS_STATS_COUNTER_ADD(ctx->stats.app_buffer_overruns, 1);
             }
+            RTOS_STATS_COUNTER_HIGH_WATER(ctx->stats.app_buffer_high_water, xStreamBufferBytesAvailable(ctx->app_byte_buffer));
 
             if ((ctx->cb_flags & RX_ERROR_FLAGS) && ctx->rx_error_cb) {
                 (*ctx->rx_error_cb)(ctx, ctx->cb_flags & RX_ERROR_FLAGS);
@@ -187,6 +192,11 @@ void rtos_uart_rx_start(
 
     uart_rx_ctx->cb_flags = 0; /* Clear all cb code bits */
 
+    RTOS_STATS_PROBE_REGISTER(uart_rx_ctx->stats.isr_time, "uart_rx.isr");
+    RTOS_STATS_COUNTER_REGISTER(uart_rx_ctx->stats.fifo_overruns, "uart_rx.fifo_overruns", RTOS_STATS_COUNTER_TOTAL);
+    RTOS_STATS_COUNTER_REGISTER(uart_rx_ctx->stats.app_buffer_overruns, "uart_rx.app_buffer_overruns", RTOS_STATS_COUNTER_TOTAL);
+    RTOS_STATS_COUNTER_REGISTER(uart_rx_ctx->stats.app_buffer_high_water, "uart_rx.app_buffer_high_water", RTOS_STATS_COUNTER_HIGH_WATER);
+
     /* Ensure that the UART interrupt is enabled on the requested core */
     uint32_t core_exclude_map = 0;
     rtos_osal_thread_core_exclusion_get(NULL, &core_exclude_map);
@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_USB_H_
@@ -21,6 +21,7 @@
 
 #include "rtos_osal.h"
 #include "rtos_driver_rpc.h"
+#include "rtos_stats.h"
 
 /**
  * The maximum number of USB endpoint numbers supported by the RTOS USB driver.
@@ -118,6 +119,14 @@ struct rtos_usb_struct {
     RTOS_USB_ISR_CALLBACK_ATTR rtos_usb_isr_cb_t isr_cb;
     void *isr_app_data;
     rtos_usb_ep_xfer_info_t ep_xfer_info[RTOS_USB_ENDPOINT_COUNT_MAX][2];
+
+#if RTOS_STATS_ENABLED
+    struct {
+        rtos_stats_probe_t isr_time;
+        rtos_stats_probe_t sof_isr_time;
+        rtos_stats_counter_t xfer_errors;
+    } stats;
+#endif
 };
 
 /**
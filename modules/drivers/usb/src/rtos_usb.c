@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT RTOS_USB
@@ -108,6 +108,7 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(usb_isr, arg)
     const int dir = ep_xfer_info->dir;
     size_t xfer_len;
     XUD_Result_t res;
+    RTOS_STATS_PROBE_START(start);
 
     if (ctx->ep[ep_num][dir] != 0) {
         int is_setup;
@@ -116,6 +117,8 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(usb_isr, arg)
 
         if (res == XUD_RES_RST) {
             ctx->reset_received = 1;
+        } else if (res == XUD_RES_ERR) {
+            RTOS_STATS_COUNTER_ADD(ctx->stats.xfer_errors, 1);
         }
 
         if (ctx->isr_cb != NULL) {
@@ -125,17 +128,22 @@ DEFINE_RTOS_INTERRUPT_CALLBACK(usb_isr, arg)
         ctx->ep[ep_num][dir] = XUD_InitEp(ctx->c_ep[ep_num][dir]);
         rtos_printf("EP %d %d initialized\n", ep_num, dir);
     }
+
+    RTOS_STATS_PROBE_END(ctx->stats.isr_time, start);
 }
 
 DEFINE_RTOS_INTERRUPT_CALLBACK(usb_sof_isr, arg)
 {
     rtos_usb_t *ctx = arg;
+    RTOS_STATS_PROBE_START(start);
 
     (void) s_chan_in_word(ctx->c_sof);
 
     if (ctx->isr_cb != NULL) {
         ctx->isr_cb(ctx, ctx->isr_app_data, 0, 0, rtos_usb_sof_packet, XUD_RES_OKAY);
     }
+
+    RTOS_STATS_PROBE_END(ctx->stats.sof_isr_time, start);
 }
 
 static inline int endpoint_num(uint32_t endpoint_addr)
@@ -290,6 +298,10 @@ void rtos_usb_start(
     xassert(endpoint_count > 0 && endpoint_count <= RTOS_USB_ENDPOINT_COUNT_MAX);
     ctx->endpoint_count = endpoint_count;
 
+    RTOS_STATS_PROBE_REGISTER(ctx->stats.isr_time, "usb.isr");
+    RTOS_STATS_PROBE_REGISTER(ctx->stats.sof_isr_time, "usb.sof_isr");
+    RTOS_STATS_COUNTER_REGISTER(ctx->stats.xfer_errors, "usb.xfer_errors", RTOS_STATS_COUNTER_TOTAL);
+
     /* Ensure that all USB interrupts are enabled on the requested core */
     rtos_osal_thread_core_exclusion_get(NULL, &core_exclude_map);
 
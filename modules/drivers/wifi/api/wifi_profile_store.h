@@ -0,0 +1,203 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef WIFI_PROFILE_STORE_H_
+#define WIFI_PROFILE_STORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * A store for WiFi network profiles in a dedicated region of flash.
+ *
+ * Each profile is a value of up to WIFI_PROFILE_STORE_VALUE_MAX_LEN bytes
+ * keyed by its SSID. Along with it is kept the BSSID and channel of the
+ * access point that it last connected to.
+ *
+ * The store is a log of records that is appended to, spread over two or
+ * more flash sectors that are used as a ring. When the last free sector
+ * is used the oldest is compacted into it, so that sectors are erased
+ * evenly and only one is ever erased at a time. Records are checked
+ * with a CRC, so a record that was only partly written when power was
+ * lost is ignored.
+ *
+ * The log is read once when the store is initialized, to build an index
+ * in RAM. Looking profiles up, and listing them in the order they were
+ * last connected, does not read the flash again.
+ *
+ * This does not depend on FreeRTOS, and is not thread safe. The caller
+ * must serialize access to each store.
+ */
+
+#ifndef WIFI_PROFILE_STORE_MAX_PROFILES
+#define WIFI_PROFILE_STORE_MAX_PROFILES 16
+#endif
+
+#define WIFI_PROFILE_STORE_KEY_MAX_LEN 32
+#define WIFI_PROFILE_STORE_VALUE_MAX_LEN 96
+#define WIFI_PROFILE_STORE_BSSID_LEN 6
+
+/**
+ * These attributes must be specified on the flash functions given to
+ * wifi_profile_store_init().
+ */
+#if __xcore__
+#define WIFI_PROFILE_STORE_FLASH_READ_ATTR __attribute__((fptrgroup("wifi_profile_store_flash_read_fptr_grp")))
+#define WIFI_PROFILE_STORE_FLASH_WRITE_ATTR __attribute__((fptrgroup("wifi_profile_store_flash_write_fptr_grp")))
+#define WIFI_PROFILE_STORE_FLASH_ERASE_ATTR __attribute__((fptrgroup("wifi_profile_store_flash_erase_fptr_grp")))
+#else
+#define WIFI_PROFILE_STORE_FLASH_READ_ATTR
+#define WIFI_PROFILE_STORE_FLASH_WRITE_ATTR
+#define WIFI_PROFILE_STORE_FLASH_ERASE_ATTR
+#endif
+
+/**
+ * Reads \p len bytes from the flash at \p address.
+ */
+typedef void (*wifi_profile_store_flash_read_t)(void *flash_ctx, unsigned address, void *data, size_t len);
+
+/**
+ * Programs \p len bytes to the flash at \p address, which have been erased.
+ */
+typedef void (*wifi_profile_store_flash_write_t)(void *flash_ctx, unsigned address, const void *data, size_t len);
+
+/**
+ * Erases the sector of \p len bytes at \p address.
+ */
+typedef void (*wifi_profile_store_flash_erase_t)(void *flash_ctx, unsigned address, size_t len);
+
+/**
+ * A profile in the index.
+ */
+typedef struct {
+    char key[WIFI_PROFILE_STORE_KEY_MAX_LEN + 1];   /* The SSID, NULL terminated */
+    uint8_t key_len;
+    uint16_t value_len;
+    unsigned value_address;                         /* Where the value is in flash */
+    unsigned put_address;                           /* The live record of the value */
+    unsigned connected_address;                     /* The live record of the last connection, or 0 */
+    uint32_t added_seq;
+    uint32_t connected_seq;                         /* 0 if it has never connected */
+    uint8_t bssid[WIFI_PROFILE_STORE_BSSID_LEN];    /* The AP last connected to */
+    int8_t channel;                                 /* The channel of that AP, or 0 */
+} wifi_profile_store_entry_t;
+
+typedef struct {
+    WIFI_PROFILE_STORE_FLASH_READ_ATTR wifi_profile_store_flash_read_t read;
+    WIFI_PROFILE_STORE_FLASH_WRITE_ATTR wifi_profile_store_flash_write_t write;
+    WIFI_PROFILE_STORE_FLASH_ERASE_ATTR wifi_profile_store_flash_erase_t erase;
+
+    void *flash_ctx;
+    unsigned base;
+    size_t sector_size;
+    unsigned sector_count;
+
+    unsigned head;          /* The sector being appended to */
+    unsigned tail;          /* The oldest sector in use */
+    size_t head_offset;     /* Where the next record goes in the head sector */
+    uint32_t sector_seq;    /* The sequence number of the head sector */
+    uint32_t seq;           /* The sequence number of the next record */
+
+    int count;
+    /* In the order they were added */
+    wifi_profile_store_entry_t entries[WIFI_PROFILE_STORE_MAX_PROFILES];
+    /* Indices into entries, most recently connected first */
+    uint8_t recent[WIFI_PROFILE_STORE_MAX_PROFILES];
+} wifi_profile_store_t;
+
+/**
+ * Initializes a store in a region of flash, and reads its index. A region
+ * that does not hold a store is formatted.
+ *
+ * \param store         The store to initialize.
+ * \param read          Function to read from the flash.
+ * \param write         Function to program the flash.
+ * \param erase         Function to erase a sector of the flash.
+ * \param flash_ctx     Passed to the flash functions.
+ * \param base          The address of the region. Must be sector aligned.
+ * \param sector_size   The size of each flash sector. This must be large
+ *                      enough to hold every profile at once, which it is
+ *                      with the default settings and 4 KiB sectors.
+ * \param sector_count  The number of sectors in the region. At least 2.
+ *
+ * \returns 0 on success, or -1 if the parameters are invalid.
+ */
+int wifi_profile_store_init(wifi_profile_store_t *store,
+                            wifi_profile_store_flash_read_t read,
+                            wifi_profile_store_flash_write_t write,
+                            wifi_profile_store_flash_erase_t erase,
+                            void *flash_ctx,
+                            unsigned base,
+                            size_t sector_size,
+                            unsigned sector_count);
+
+/**
+ * Erases every profile from the store.
+ */
+void wifi_profile_store_format(wifi_profile_store_t *store);
+
+/**
+ * Adds a profile, or replaces the value of an existing profile with the
+ * same key. A replaced profile keeps its position and its last connection.
+ *
+ * \returns the index of the profile, or -1 if the store is full or the
+ *          key or value are too long.
+ */
+int wifi_profile_store_put(wifi_profile_store_t *store,
+                           const char *key, size_t key_len,
+                           const void *value, size_t value_len);
+
+/**
+ * Deletes the profile at \p index. The indices of the profiles after it
+ * move down by one.
+ *
+ * \returns 0 on success, or -1 if there is no such profile.
+ */
+int wifi_profile_store_delete(wifi_profile_store_t *store, int index);
+
+/**
+ * Records that the profile at \p index has connected to the access point
+ * with \p bssid on \p channel, making it the most recently connected. The
+ * flash is only written if this changes anything.
+ *
+ * \returns 0 on success, or -1 if there is no such profile.
+ */
+int wifi_profile_store_connected(wifi_profile_store_t *store, int index,
+                                 const uint8_t *bssid, int8_t channel);
+
+/**
+ * Returns the index of the profile with \p key, or -1 if there is none.
+ */
+int wifi_profile_store_find(const wifi_profile_store_t *store, const char *key, size_t key_len);
+
+/**
+ * Returns the index of the profile at \p rank when ordered by their last
+ * connection, most recent first. Profiles that have never connected
+ * follow, in the order they were added. Returns -1 if \p rank is not
+ * less than the number of profiles.
+ */
+int wifi_profile_store_recent(const wifi_profile_store_t *store, int rank);
+
+/**
+ * Returns the profile at \p index, or NULL if there is none.
+ */
+const wifi_profile_store_entry_t *wifi_profile_store_entry(const wifi_profile_store_t *store, int index);
+
+/**
+ * Reads the value of the profile at \p index into \p value.
+ *
+ * \returns the length of the value, or -1 if there is no such profile or
+ *          its value is longer than \p max_len.
+ */
+int wifi_profile_store_value_get(const wifi_profile_store_t *store, int index,
+                                 void *value, size_t max_len);
+
+/**
+ * Returns the number of profiles in the store.
+ */
+static inline int wifi_profile_store_count(const wifi_profile_store_t *store)
+{
+    return store->count;
+}
+
+#endif /* WIFI_PROFILE_STORE_H_ */
@@ -0,0 +1,64 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef SL_WFX_BOOT_IMAGE_H_
+#define SL_WFX_BOOT_IMAGE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The format of a WF200 boot image. This holds the PDS data and the
+ * WF200 firmware together, so that the driver can read both directly
+ * from flash when it starts the WF200. It is created on the host by the
+ * wf200_mkimage tool, which also uses this header.
+ *
+ * The image starts with the header below. All fields are little endian.
+ *
+ * The PDS block starts with an array of pds_count 16-bit offsets, one
+ * for each line of PDS data, from the start of the block. Each line is
+ * NULL terminated. The lines are checked with pds_crc, as they are read
+ * into RAM and passed to the WF200 as they are.
+ *
+ * The firmware is not checked by the driver, as the WF200 verifies its
+ * signature while it is downloaded.
+ */
+
+#define SL_WFX_BOOT_IMAGE_MAGIC         0x49584657 /* "WFXI" */
+#define SL_WFX_BOOT_IMAGE_VERSION       1
+
+/** The largest PDS block that the driver accepts. */
+#define SL_WFX_BOOT_IMAGE_PDS_MAX_SIZE  4096
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t pds_count;     /* The number of lines of PDS data */
+    uint32_t pds_offset;    /* From the start of the image */
+    uint32_t pds_size;      /* Including the offset array */
+    uint32_t pds_crc;       /* The CRC-32 of the PDS block */
+    uint32_t fw_offset;     /* From the start of the image */
+    uint32_t fw_size;
+    uint32_t header_crc;    /* The CRC-32 of the preceding fields */
+} sl_wfx_boot_image_header_t;
+
+/**
+ * Updates the CRC-32 (as used by Ethernet and zlib) \p crc with \p len
+ * bytes of \p data. Start with a \p crc of 0.
+ */
+static inline uint32_t sl_wfx_boot_image_crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        }
+    }
+
+    return ~crc;
+}
+
+#endif /* SL_WFX_BOOT_IMAGE_H_ */
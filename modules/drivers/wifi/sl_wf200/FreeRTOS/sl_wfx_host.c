@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <stdlib.h>
@@ -6,6 +6,7 @@
 
 #include "sl_wfx.h"
 #include "FreeRTOS/sl_wfx_host.h"
+#include "FreeRTOS/sl_wfx_boot_image.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -28,6 +29,13 @@ typedef struct {
     uint8_t firmware_data[DOWNLOAD_BLOCK_SIZE];
     uint16_t pds_size;
     uint8_t waited_event_id;
+
+    /* Set when the firmware is read from a boot image in flash */
+    rtos_qspi_flash_t *fw_flash;
+    unsigned fw_address;
+    uint32_t fw_size;
+    /* The PDS lines read from the boot image, and the pointers to them */
+    void *image_pds;
 } sl_wfx_host_ctx_t;
 
 static sl_wfx_host_ctx_t host_ctx;
@@ -44,6 +52,84 @@ void sl_wfx_host_set_pds(const char * const pds_data[],
     host_ctx.pds_size = pds_size;
 }
 
+static void boot_image_release(void)
+{
+    if (host_ctx.image_pds != NULL) {
+        if (host_ctx.pds_data == host_ctx.image_pds) {
+            host_ctx.pds_data = NULL;
+            host_ctx.pds_size = 0;
+        }
+        vPortFree(host_ctx.image_pds);
+        host_ctx.image_pds = NULL;
+    }
+    host_ctx.fw_flash = NULL;
+    host_ctx.fw_address = 0;
+    host_ctx.fw_size = 0;
+}
+
+sl_status_t sl_wfx_host_set_boot_image(rtos_qspi_flash_t *flash,
+                                       unsigned address)
+{
+    sl_wfx_boot_image_header_t header;
+    const char **lines;
+    uint8_t *pds;
+
+    boot_image_release();
+
+    if (flash == NULL) {
+        return SL_STATUS_OK;
+    }
+
+    rtos_qspi_flash_read(flash, (uint8_t *) &header, address, sizeof(header));
+
+    if (header.magic != SL_WFX_BOOT_IMAGE_MAGIC ||
+        header.version != SL_WFX_BOOT_IMAGE_VERSION ||
+        header.header_crc != sl_wfx_boot_image_crc32(0, &header, offsetof(sl_wfx_boot_image_header_t, header_crc)) ||
+        header.pds_count == 0 ||
+        header.pds_size <= header.pds_count * sizeof(uint16_t) ||
+        header.pds_size > SL_WFX_BOOT_IMAGE_PDS_MAX_SIZE ||
+        header.fw_size == 0) {
+        return SL_STATUS_FAIL;
+    }
+
+    /*
+     * The line pointers and the lines are kept in a single allocation.
+     * The pointers come first so that they are aligned.
+     */
+    lines = pvPortMalloc(header.pds_count * sizeof(char *) + header.pds_size);
+    if (lines == NULL) {
+        return SL_STATUS_NO_MORE_RESOURCE;
+    }
+    pds = (uint8_t *) &lines[header.pds_count];
+
+    rtos_qspi_flash_read(flash, pds, address + header.pds_offset, header.pds_size);
+
+    if (header.pds_crc != sl_wfx_boot_image_crc32(0, pds, header.pds_size) ||
+        pds[header.pds_size - 1] != '\0') {
+        vPortFree(lines);
+        return SL_STATUS_FAIL;
+    }
+
+    for (int i = 0; i < header.pds_count; i++) {
+        uint16_t offset = pds[2 * i] | (pds[2 * i + 1] << 8);
+
+        if (offset < header.pds_count * sizeof(uint16_t) || offset >= header.pds_size) {
+            vPortFree(lines);
+            return SL_STATUS_FAIL;
+        }
+        lines[i] = (const char *) &pds[offset];
+    }
+
+    host_ctx.image_pds = lines;
+    host_ctx.pds_data = lines;
+    host_ctx.pds_size = header.pds_count;
+    host_ctx.fw_flash = flash;
+    host_ctx.fw_address = address + header.fw_offset;
+    host_ctx.fw_size = header.fw_size;
+
+    return SL_STATUS_OK;
+}
+
 void sl_wfx_host_reset(void)
 {
     sl_wfx_context->state &= ~SL_WFX_STARTED;
@@ -111,7 +197,16 @@ sl_status_t sl_wfx_host_get_firmware_data(const uint8_t **data, uint32_t data_si
 {
 	sl_status_t ret;
 
-	ret = sl_wfx_app_fw_read(host_ctx.firmware_data, host_ctx.firmware_index, data_size);
+	if (host_ctx.fw_flash != NULL) {
+		if (host_ctx.firmware_index + data_size <= host_ctx.fw_size) {
+			rtos_qspi_flash_read(host_ctx.fw_flash, host_ctx.firmware_data, host_ctx.fw_address + host_ctx.firmware_index, data_size);
+			ret = SL_STATUS_OK;
+		} else {
+			ret = SL_STATUS_FAIL;
+		}
+	} else {
+		ret = sl_wfx_app_fw_read(host_ctx.firmware_data, host_ctx.firmware_index, data_size);
+	}
 
 	if (ret == SL_STATUS_OK) {
 		host_ctx.firmware_index += data_size;
@@ -124,7 +219,11 @@ sl_status_t sl_wfx_host_get_firmware_data(const uint8_t **data, uint32_t data_si
 
 sl_status_t sl_wfx_host_get_firmware_size(uint32_t *firmware_size)
 {
-    *firmware_size = sl_wfx_app_fw_size();
+    if (host_ctx.fw_flash != NULL) {
+        *firmware_size = host_ctx.fw_size;
+    } else {
+        *firmware_size = sl_wfx_app_fw_size();
+    }
     if (*firmware_size == 0) {
     	return SL_STATUS_NOT_AVAILABLE;
     }
@@ -380,39 +479,13 @@ sl_status_t sl_wfx_host_allocate_buffer(void **buffer,
                                         sl_wfx_buffer_type_t type,
                                         uint32_t buffer_size)
 {
-/*
- * Zero copy RX is no longer supported. This code is being left in place
- * for the future if support for these is ever added back in.
- */
-#if 0
-    if (ipconfigZERO_COPY_RX_DRIVER != 0 && type == SL_WFX_RX_FRAME_BUFFER) {
-        NetworkBufferDescriptor_t *network_buffer;
-        network_buffer = pxGetNetworkBufferWithDescriptor( buffer_size, 0 );
-        if (network_buffer != NULL) {
-            /*
-             * The pointer that will be returned to the driver is behind the beginning
-             * of the Ethernet Frame by the size of the received indication message and
-             * SL_WFX_NORMAL_FRAME_PAD_LENGTH padding bytes. This way frames with 2 pad
-             * bytes will begin at where pucEthernetBuffer points to.
-             *
-             * When the padding is other than SL_WFX_NORMAL_FRAME_PAD_LENGTH bytes then
-             * this needs to be dealt with in the receive callback.
-             *
-             * This requires that the FreeRTOS+TCP option ipBUFFER_PADDING be large enough
-             * to hold the sl_wfx_received_ind_t message.
-             */
-            *buffer = network_buffer->pucEthernetBuffer - sizeof(sl_wfx_received_ind_t) - SL_WFX_NORMAL_FRAME_PAD_LENGTH;
-        } else {
-            *buffer = NULL;
-        }
-    } else {
-        *buffer = pvPortMalloc(buffer_size);
+    if (type == SL_WFX_RX_FRAME_BUFFER) {
+        return sl_wfx_host_rx_frame_buffer_allocate(buffer, buffer_size);
     }
-#else
+
     *buffer = pvPortMalloc(buffer_size);
-#endif
 
-    if (buffer != NULL) {
+    if (*buffer != NULL) {
         return SL_STATUS_OK;
     } else {
         return SL_STATUS_NO_MORE_RESOURCE;
@@ -421,9 +494,11 @@ sl_status_t sl_wfx_host_allocate_buffer(void **buffer,
 
 sl_status_t sl_wfx_host_free_buffer(void *buffer, sl_wfx_buffer_type_t type)
 {
-//    if (ipconfigZERO_COPY_RX_DRIVER == 0 || type != SL_WFX_RX_FRAME_BUFFER) {
+    if (type == SL_WFX_RX_FRAME_BUFFER) {
+        sl_wfx_host_rx_frame_buffer_free(buffer);
+    } else {
         vPortFree(buffer);
-//    }
+    }
 
     return SL_STATUS_OK;
 }
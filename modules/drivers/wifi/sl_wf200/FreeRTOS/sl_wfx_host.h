@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef SL_WFX_HOST_H_
@@ -9,6 +9,7 @@
 
 #include "rtos_spi_master.h"
 #include "rtos_gpio.h"
+#include "rtos_qspi_flash.h"
 
 /**
  * To be used with sl_wfx_host_gpio() to set the value
@@ -30,6 +31,46 @@
  */
 #define SL_WFX_NORMAL_FRAME_PAD_LENGTH 2
 
+/**
+ * Set this to 1 when FreeRTOS+TCP is built with BufferAllocation_1.c.
+ * The network interface then provides the RAM for the network buffers
+ * itself, with room after each frame for the secure link tag. This
+ * allows frames to be encrypted in place rather than copied into a
+ * separate secure link buffer.
+ */
+#ifndef SL_WFX_HOST_STATIC_NETWORK_BUFFERS
+#define SL_WFX_HOST_STATIC_NETWORK_BUFFERS 0
+#endif
+
+/**
+ * The maximum number of messages that the host task reads from the
+ * WF200 each time it wakes up. Received frames are passed to the IP task
+ * together at the end of each batch. If more are still pending, the task
+ * yields and then continues without waiting for another interrupt.
+ */
+#ifndef SL_WFX_HOST_RX_BUDGET
+#define SL_WFX_HOST_RX_BUDGET 16
+#endif
+
+/**
+ * Interrupt coalescing. When a batch receives at least this many
+ * messages, traffic is considered heavy and the host task waits
+ * SL_WFX_HOST_RX_COALESCE_MS after the next interrupt before it reads
+ * any messages, so that more arrive to be handled in the same batch.
+ * Set to 0, the default, to disable this.
+ */
+#ifndef SL_WFX_HOST_RX_COALESCE_FRAMES
+#define SL_WFX_HOST_RX_COALESCE_FRAMES 0
+#endif
+
+/**
+ * The time in milliseconds to wait before reading messages from the
+ * WF200 when interrupt coalescing is active.
+ */
+#ifndef SL_WFX_HOST_RX_COALESCE_MS
+#define SL_WFX_HOST_RX_COALESCE_MS 1
+#endif
+
 /**
  * @{
  * Wi-Fi events
@@ -49,6 +90,30 @@
 
 extern EventGroupHandle_t sl_wfx_event_group;
 
+/**
+ * Receive statistics, kept by the host task. The counters wrap.
+ */
+typedef struct {
+    uint32_t wakeups;           /**< Times the host task woke up to read messages */
+    uint32_t batches;           /**< Wake-ups that read at least one message */
+    uint32_t messages;          /**< Messages of any kind read from the WF200 */
+    uint32_t frames;            /**< Ethernet frames passed to the IP task */
+    uint32_t ip_events;         /**< Events sent to the IP task to deliver them */
+    uint32_t max_batch;         /**< The most messages read in a single batch */
+    uint32_t budget_exhausted;  /**< Batches that ended with messages still pending */
+    uint32_t coalesced;         /**< Wake-ups that were delayed by interrupt coalescing */
+    uint32_t dropped_no_buffer; /**< Frames dropped as no network buffer was available */
+    uint32_t dropped_ip_task;   /**< Frames dropped as the IP task's queue was full */
+} sl_wfx_host_rx_stats_t;
+
+/**
+ * Gets a copy of the receive statistics. As they are updated by the host
+ * task without any locking, the copy may be made part way through an update.
+ *
+ * \param stats Pointer to the structure to copy the statistics into.
+ */
+void sl_wfx_host_rx_stats_get(sl_wfx_host_rx_stats_t *stats);
+
 /**
  * Must be called prior to calling sl_wfx_init() to let the driver
  * know which driver instances to use for SPI and GPIO, as well as which
@@ -83,6 +148,29 @@ void sl_wfx_host_set_hif(rtos_spi_master_device_t *spi_dev,
 void sl_wfx_host_set_pds(const char * const pds_data[],
                          uint16_t pds_size);
 
+/**
+ * May be called prior to calling sl_wfx_init() to read both the PDS data
+ * and the WF200 firmware from a boot image in flash, created by the
+ * wf200_mkimage tool. The image's header and PDS data are read and checked
+ * now, and the PDS lines are kept in RAM. The firmware is read from the
+ * flash a block at a time while it is downloaded to the WF200, rather
+ * than with sl_wfx_app_fw_read().
+ *
+ * This replaces the PDS data given to sl_wfx_host_set_pds(). If the image
+ * is not valid, then neither the PDS data nor the firmware are set, and
+ * sl_wfx_host_set_pds() must be called instead.
+ *
+ * \param flash   The QSPI flash driver instance that holds the image, or
+ *                NULL to release a previously set image.
+ * \param address The address of the image in the flash.
+ *
+ * \returns SL_STATUS_OK if the image was read, SL_STATUS_FAIL if it is
+ *          not valid, or SL_STATUS_NO_MORE_RESOURCE if there is not
+ *          enough memory for its PDS data.
+ */
+sl_status_t sl_wfx_host_set_boot_image(rtos_qspi_flash_t *flash,
+                                       unsigned address);
+
 /**
  * This is called by the host driver code when unrecoverable errors
  * are detected. It de-initializes the host interface bus and holds
@@ -110,4 +198,26 @@ void sl_wfx_host_received_frame_callback(sl_wfx_received_ind_t* rx_buffer);
 void sl_wfx_reset_request_callback(void);
 /**@}*/
 
+/**
+ * @{
+ * Implemented by the network interface to allocate and free the
+ * buffers that received frames are read into. With ipconfigZERO_COPY_RX_DRIVER
+ * these are FreeRTOS+TCP network buffers, so that frames are passed
+ * to the IP task without being copied.
+ */
+sl_status_t sl_wfx_host_rx_frame_buffer_allocate(void **buffer, uint32_t buffer_size);
+void sl_wfx_host_rx_frame_buffer_free(void *buffer);
+/**@}*/
+
+/**
+ * Implemented by the network interface and called by the host task at
+ * the end of each batch. When ipconfigUSE_LINKED_RX_MESSAGES is enabled,
+ * this passes the frames received during the batch to the IP task as a
+ * single chain. Otherwise each frame has already been passed on.
+ */
+void sl_wfx_host_rx_frames_flush(void);
+
+/* The receive statistics. Only the host task may write to these. */
+extern sl_wfx_host_rx_stats_t sl_wfx_host_rx_stats;
+
 #endif /* SL_WFX_HOST_H_ */
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <string.h>
@@ -187,18 +187,23 @@ sl_status_t sl_wfx_host_spi_transfer_no_cs_assert(sl_wfx_host_bus_transfer_type_
                                                   uint8_t *buffer,
                                                   uint16_t buffer_length)
 {
-    uint8_t *rx_buf = NULL;
-    uint8_t *tx_buf = NULL;
+    rtos_spi_master_segment_t segments[2] = {
+        {.data_out = header, .data_in = NULL, .len = header_length},
+        {.data_out = NULL, .data_in = NULL, .len = buffer_length},
+    };
 
     if (type & SL_WFX_BUS_READ) {
-        rx_buf = buffer;
+        segments[1].data_in = buffer;
     }
     if (type & SL_WFX_BUS_WRITE) {
-        tx_buf = buffer;
+        segments[1].data_out = buffer;
     }
 
-    rtos_spi_master_transfer(hif_ctx.spi_dev, header, NULL, header_length);
-    rtos_spi_master_transfer(hif_ctx.spi_dev, tx_buf, rx_buf, buffer_length);
+    /*
+     * The header and the body are sent as a single request so that
+     * neither is copied and the SPI thread is only woken once.
+     */
+    rtos_spi_master_transfer_segments(hif_ctx.spi_dev, segments, 2);
 
     return SL_STATUS_OK;
 }
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <string.h>
@@ -20,17 +20,36 @@ static TaskHandle_t receive_task_handle;
 SemaphoreHandle_t s_xDriverSemaphore = NULL;
 EventGroupHandle_t sl_wfx_event_group = NULL;
 
-static sl_status_t sl_wfx_host_receive_frames(void)
+sl_wfx_host_rx_stats_t sl_wfx_host_rx_stats;
+
+void sl_wfx_host_rx_stats_get(sl_wfx_host_rx_stats_t *stats)
+{
+    memcpy(stats, &sl_wfx_host_rx_stats, sizeof(sl_wfx_host_rx_stats_t));
+}
+
+/*
+ * Reads up to SL_WFX_HOST_RX_BUDGET messages from the WF200 and then
+ * passes the frames received to the IP task. *more is set when the
+ * budget ran out with messages still pending.
+ */
+static sl_status_t sl_wfx_host_receive_frames(int *more, uint32_t *count)
 {
     sl_status_t result;
     uint16_t control_register = 0;
 
+    *count = 0;
+    *more = 0;
+
     do {
         result = sl_wfx_receive_frame(&control_register);
         SL_WFX_ERROR_CHECK(result);
-    } while ((control_register & SL_WFX_CONT_NEXT_LEN_MASK) != 0);
+        (*count)++;
+    } while ((control_register & SL_WFX_CONT_NEXT_LEN_MASK) != 0 && *count < SL_WFX_HOST_RX_BUDGET);
+
+    *more = (control_register & SL_WFX_CONT_NEXT_LEN_MASK) != 0;
 
     error_handler:
+    sl_wfx_host_rx_frames_flush();
     return result;
 }
 
@@ -41,18 +60,29 @@ static void sl_wfx_host_receive_task(void *arg)
     int error_count = 0;
     const int max_errors = 3;
     int reset = 0;
+    int more = 0;
+    int coalesce = 0;
 
     for (;;) {
-        /* Wait for an interrupt from WF200 */
-        bits = xEventGroupWaitBits(sl_wfx_event_group, SL_WFX_INTERRUPT | SL_WFX_DEINITIALIZED, pdTRUE, pdFALSE, ticks_to_wait);
-
-        if ((bits & (SL_WFX_INTERRUPT | SL_WFX_DEINITIALIZED)) == 0 && ticks_to_wait != portMAX_DELAY) {
+        if (more) {
             /*
-             * The wait timed out. If a timeout value was set (not portMAX_DELAY)
-             * then treat it as if an interrupt occurred.
+             * The last batch used its whole budget. Messages are still
+             * pending, so continue without waiting for an interrupt.
              */
-            bits = SL_WFX_INTERRUPT;
-            sl_wfx_host_log("Checking for frames again\n");
+            bits = xEventGroupWaitBits(sl_wfx_event_group, SL_WFX_INTERRUPT | SL_WFX_DEINITIALIZED, pdTRUE, pdFALSE, 0);
+            bits |= SL_WFX_INTERRUPT;
+        } else {
+            /* Wait for an interrupt from WF200 */
+            bits = xEventGroupWaitBits(sl_wfx_event_group, SL_WFX_INTERRUPT | SL_WFX_DEINITIALIZED, pdTRUE, pdFALSE, ticks_to_wait);
+
+            if ((bits & (SL_WFX_INTERRUPT | SL_WFX_DEINITIALIZED)) == 0 && ticks_to_wait != portMAX_DELAY) {
+                /*
+                 * The wait timed out. If a timeout value was set (not portMAX_DELAY)
+                 * then treat it as if an interrupt occurred.
+                 */
+                bits = SL_WFX_INTERRUPT;
+                sl_wfx_host_log("Checking for frames again\n");
+            }
         }
 
         if (bits & SL_WFX_DEINITIALIZED) {
@@ -62,9 +92,36 @@ static void sl_wfx_host_receive_task(void *arg)
 
         if (bits & SL_WFX_INTERRUPT) {
             sl_status_t result;
+            uint32_t count;
+
+            sl_wfx_host_rx_stats.wakeups++;
+
+            if (coalesce && !more) {
+                /*
+                 * Traffic is heavy. Let more messages arrive so that they
+                 * are handled together. Any interrupts raised meanwhile are
+                 * for messages that are about to be read anyway.
+                 */
+                sl_wfx_host_rx_stats.coalesced++;
+                vTaskDelay(pdMS_TO_TICKS(SL_WFX_HOST_RX_COALESCE_MS));
+                xEventGroupClearBits(sl_wfx_event_group, SL_WFX_INTERRUPT);
+            }
 
             /* Receive the frame(s) pending in WF200 */
-            result = sl_wfx_host_receive_frames();
+            result = sl_wfx_host_receive_frames(&more, &count);
+
+            if (count > 0) {
+                sl_wfx_host_rx_stats.batches++;
+                sl_wfx_host_rx_stats.messages += count;
+                if (count > sl_wfx_host_rx_stats.max_batch) {
+                    sl_wfx_host_rx_stats.max_batch = count;
+                }
+            }
+            if (more) {
+                sl_wfx_host_rx_stats.budget_exhausted++;
+            }
+            coalesce = SL_WFX_HOST_RX_COALESCE_FRAMES > 0 && count >= SL_WFX_HOST_RX_COALESCE_FRAMES;
+
             switch (result) {
             case SL_STATUS_OK:
                 ticks_to_wait = portMAX_DELAY;
@@ -72,6 +129,8 @@ static void sl_wfx_host_receive_task(void *arg)
                 break;
             case SL_STATUS_WIFI_NO_PACKET_TO_RECEIVE:
             case SL_STATUS_TIMEOUT:
+                more = 0;
+                coalesce = 0;
                 if (error_count++ == max_errors) {
                     reset = 1;
                     ticks_to_wait = portMAX_DELAY;
@@ -80,6 +139,8 @@ static void sl_wfx_host_receive_task(void *arg)
                 }
                 break;
             default:
+                more = 0;
+                coalesce = 0;
                 reset = 1;
                 ticks_to_wait = portMAX_DELAY;
                 break;
@@ -89,6 +150,12 @@ static void sl_wfx_host_receive_task(void *arg)
                 reset = 0;
                 sl_wfx_host_log("Frame receive error %04x, will reset module\n", result);
                 sl_wfx_host_reset();
+            } else if (more) {
+                /*
+                 * Let other tasks of the same priority run between batches.
+                 * The IP task may meanwhile process this batch on another core.
+                 */
+                taskYIELD();
             }
         }
     }
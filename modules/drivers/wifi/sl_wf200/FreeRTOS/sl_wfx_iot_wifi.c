@@ -1,8 +1,10 @@
-// Copyright 2019-2023 XMOS LIMITED.
+// Copyright 2019-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT IOT_WIFI
 
+#include <string.h>
+
 /* FreeRTOS headers */
 #include "FreeRTOS.h"
 #include "task.h"
@@ -20,6 +22,7 @@
 
 /* SW services headers */
 #include "FreeRTOS/sl_wfx_iot_wifi.h"
+#include "wifi_profile_store.h"
 #if USE_DHCPD
 #include "dhcpd.h"
 #endif
@@ -52,6 +55,21 @@ static struct
 static SemaphoreHandle_t wifi_lock;
 static QueueHandle_t ping_reply_queue;
 
+static struct
+{
+    rtos_qspi_flash_t *flash;
+    uint32_t address;
+} boot_image;
+
+/*
+ * The length of the PMK of a WPA network, which the WF200 accepts as
+ * hexadecimal digits in place of the passphrase.
+ */
+#define NETWORK_PMK_LEN 32
+#define NETWORK_PMK_HEX_LEN ( 2 * NETWORK_PMK_LEN )
+
+static int network_store_pmk_get( const WIFINetworkParams_t * const pxNetworkParams, char *pmk_hex );
+
 WIFIReturnCode_t WIFI_GetLock( void )
 {
     WIFIReturnCode_t ret;
@@ -101,6 +119,13 @@ void WIFI_ReleaseLock( void )
     }
 }
 
+void WIFI_SetBootImage( rtos_qspi_flash_t * pxFlash,
+                        uint32_t ulAddress )
+{
+    boot_image.flash = pxFlash;
+    boot_image.address = ulAddress;
+}
+
 #if USE_FATFS
 static char *pds_file_load(char **pds, int *line_count)
 {
@@ -172,31 +197,53 @@ WIFIReturnCode_t WIFI_On( void )
 
         if( xSemaphoreTakeRecursive( wifi_lock, pdMS_TO_TICKS( wificonfigMAX_SEMAPHORE_WAIT_TIME_MS ) ) == pdPASS )
         {
+            int pds_set = 0;
 #if USE_FATFS
-            char *pds_data;
-			char *pds[10];
-			int line_count = 10;
-
-			pds_data = pds_file_load( pds, &line_count );
-
-			if( line_count > 0 ) {
-				rtos_printf("Loading %d lines of WF200 PDS data from filesystem:\n", line_count);
-				sl_wfx_host_set_pds( (const char **) pds, line_count );
-				for (int i = 0; i < line_count; i++) {
-					rtos_printf("  %s\n", pds[i]);
-				}
-			}
-			else
+            char *pds_data = NULL;
+            char *pds[10];
+            int line_count;
+#endif
+
+            sl_ret = sl_wfx_host_set_boot_image( boot_image.flash, boot_image.address );
+            if( boot_image.flash != NULL )
+            {
+                if( sl_ret == SL_STATUS_OK )
+                {
+                    rtos_printf("Loaded WF200 PDS data and firmware from boot image at 0x%x\n", (unsigned) boot_image.address);
+                    pds_set = 1;
+                }
+                else
+                {
+                    rtos_printf("WF200 boot image at 0x%x is not valid\n", (unsigned) boot_image.address);
+                }
+            }
+
+#if USE_FATFS
+            if( !pds_set )
+            {
+                line_count = 10;
+                pds_data = pds_file_load( pds, &line_count );
+
+                if( line_count > 0 ) {
+                    rtos_printf("Loading %d lines of WF200 PDS data from filesystem:\n", line_count);
+                    sl_wfx_host_set_pds( (const char **) pds, line_count );
+                    for (int i = 0; i < line_count; i++) {
+                        rtos_printf("  %s\n", pds[i]);
+                    }
+                    pds_set = 1;
+                }
+            }
 #endif
-			{
+            if( !pds_set )
+            {
 #if XCOREAI_EXPLORER || XCORE200_MAB
-				rtos_printf("WF200 PDS data not found in filesystem.\nUsing brd8023a PDS data\n");
-				sl_wfx_host_set_pds( pds_table_brd8023a, SL_WFX_ARRAY_COUNT( pds_table_brd8023a ) );
+                rtos_printf("WF200 PDS data not found in filesystem.\nUsing brd8023a PDS data\n");
+                sl_wfx_host_set_pds( pds_table_brd8023a, SL_WFX_ARRAY_COUNT( pds_table_brd8023a ) );
 #elif OSPREY_BOARD
-				rtos_printf("WF200 PDS data not found in filesystem.\nUsing brd8022a PDS data\n");
-				sl_wfx_host_set_pds( pds_table_brd8022a, SL_WFX_ARRAY_COUNT( pds_table_brd8022a ) );
+                rtos_printf("WF200 PDS data not found in filesystem.\nUsing brd8022a PDS data\n");
+                sl_wfx_host_set_pds( pds_table_brd8022a, SL_WFX_ARRAY_COUNT( pds_table_brd8022a ) );
 #endif
-			}
+            }
 
             sl_ret = sl_wfx_init( &wfx_ctx );
 
@@ -407,6 +454,9 @@ WIFIReturnCode_t WIFI_ConnectAP( const WIFINetworkParams_t * const pxNetworkPara
     EventBits_t bits;
     WIFIReturnCode_t ret;
     uint8_t prevent_roaming = 0;
+    char pmk_hex[ NETWORK_PMK_HEX_LEN ];
+    const char *passkey;
+    uint8_t passkey_length;
 
     configASSERT( pxNetworkParams != NULL );
 
@@ -481,6 +531,21 @@ WIFIReturnCode_t WIFI_ConnectAP( const WIFINetworkParams_t * const pxNetworkPara
             bits = xEventGroupClearBits( sl_wfx_event_group, SL_WFX_CONNECT_FAIL );
             configASSERT( ( bits & SL_WFX_CONNECT ) == 0 );
 
+            /*
+             * Deriving the PMK from the passphrase is slow, so when one was
+             * saved with the profile from an earlier connection it is used
+             * instead.
+             */
+            passkey = pxNetworkParams->pcPassword;
+            passkey_length = pxNetworkParams->ucPasswordLength;
+            if( ( security == WFM_SECURITY_MODE_WPA2_PSK || security == WFM_SECURITY_MODE_WPA2_WPA1_PSK ) &&
+                network_store_pmk_get( pxNetworkParams, pmk_hex ) )
+            {
+                rtos_printf( "Using the saved PMK\n" );
+                passkey = pmk_hex;
+                passkey_length = NETWORK_PMK_HEX_LEN;
+            }
+
             sl_ret = sl_wfx_send_join_command( ( const uint8_t * ) pxNetworkParams->pcSSID,
                                                pxNetworkParams->ucSSIDLength,
                                                connect_bssid,
@@ -490,8 +555,8 @@ WIFIReturnCode_t WIFI_ConnectAP( const WIFINetworkParams_t * const pxNetworkPara
                                                /* enable management frame protection if WPA */
                                                security == WFM_SECURITY_MODE_WPA2_PSK ||
                                                security == WFM_SECURITY_MODE_WPA2_WPA1_PSK ? WFM_MGMT_FRAME_PROTECTION_OPTIONAL : WFM_MGMT_FRAME_PROTECTION_DISABLED,
-                                               ( const uint8_t * ) pxNetworkParams->pcPassword,
-                                               pxNetworkParams->ucPasswordLength,
+                                               ( const uint8_t * ) passkey,
+                                               passkey_length,
                                                NULL,
                                                0);
             connect_bssid = NULL;
@@ -602,8 +667,8 @@ WIFIReturnCode_t WIFI_GetMode( WIFIDeviceMode_t *pxDeviceMode )
     return ret;
 }
 
-WIFIReturnCode_t WIFI_NetworkAdd( const WIFINetworkProfile_t * const pxNetworkProfile,
-                                  uint16_t *pusIndex )
+static WIFIReturnCode_t network_file_add( const WIFINetworkProfile_t * const pxNetworkProfile,
+                                         uint16_t *pusIndex )
 {
 #if USE_FATFS && FF_FS_MINIMIZE == 0 && !FF_FS_READONLY
     int opened = 0;
@@ -661,8 +726,8 @@ WIFIReturnCode_t WIFI_NetworkAdd( const WIFINetworkProfile_t * const pxNetworkPr
 #endif
 }
 
-WIFIReturnCode_t WIFI_NetworkGet( WIFINetworkProfile_t *pxNetworkProfile,
-                                  uint16_t usIndex )
+static WIFIReturnCode_t network_file_get( WIFINetworkProfile_t *pxNetworkProfile,
+                                         uint16_t usIndex )
 {
 #if USE_FATFS
     WIFIReturnCode_t ret = eWiFiFailure;
@@ -704,7 +769,7 @@ WIFIReturnCode_t WIFI_NetworkGet( WIFINetworkProfile_t *pxNetworkProfile,
 #endif
 }
 
-WIFIReturnCode_t WIFI_NetworkDelete( uint16_t usIndex )
+static WIFIReturnCode_t network_file_delete( uint16_t usIndex )
 {
 #if USE_FATFS && FF_FS_MINIMIZE == 0 && !FF_FS_READONLY
     WIFIReturnCode_t ret = eWiFiFailure;
@@ -758,6 +823,428 @@ WIFIReturnCode_t WIFI_NetworkDelete( uint16_t usIndex )
 #endif
 }
 
+/*
+ * The value of each profile in the store is its security type, the length
+ * of its password and the password. Once it has connected to a WPA network
+ * this is followed by the PMK. The SSID is the key.
+ */
+#define NETWORK_STORE_VALUE_LEN ( 2 + wificonfigMAX_PASSPHRASE_LEN + NETWORK_PMK_LEN )
+
+#if NETWORK_STORE_VALUE_LEN > WIFI_PROFILE_STORE_VALUE_MAX_LEN || wificonfigMAX_SSID_LEN > WIFI_PROFILE_STORE_KEY_MAX_LEN
+#error The WiFi profile store is too small for the network profiles
+#endif
+
+static wifi_profile_store_t network_store;
+
+/* NULL until WIFI_NetworkStoreInit() is called, after which the store is used rather than the file */
+static SemaphoreHandle_t network_store_lock;
+
+WIFI_PROFILE_STORE_FLASH_READ_ATTR
+static void network_store_flash_read( void *flash_ctx, unsigned address, void *data, size_t len )
+{
+    rtos_qspi_flash_read( flash_ctx, data, address, len );
+}
+
+WIFI_PROFILE_STORE_FLASH_WRITE_ATTR
+static void network_store_flash_write( void *flash_ctx, unsigned address, const void *data, size_t len )
+{
+    rtos_qspi_flash_write( flash_ctx, data, address, len );
+}
+
+WIFI_PROFILE_STORE_FLASH_ERASE_ATTR
+static void network_store_flash_erase( void *flash_ctx, unsigned address, size_t len )
+{
+    rtos_qspi_flash_erase( flash_ctx, address, len );
+}
+
+/*
+ * Returns the length of the password in the value of a profile, or -1 if
+ * the value is not valid. Sets pmk to the PMK, or to NULL if there is none.
+ */
+static int network_store_value_parse( const uint8_t *value, int value_len, const uint8_t **pmk )
+{
+    int password_len;
+
+    if( value_len < 2 || value[ 1 ] > wificonfigMAX_PASSPHRASE_LEN )
+    {
+        return -1;
+    }
+
+    password_len = value[ 1 ];
+    if( value_len == 2 + password_len )
+    {
+        *pmk = NULL;
+    }
+    else if( value_len == 2 + password_len + NETWORK_PMK_LEN )
+    {
+        *pmk = &value[ 2 + password_len ];
+    }
+    else
+    {
+        return -1;
+    }
+
+    return password_len;
+}
+
+static WIFIReturnCode_t network_store_add( const WIFINetworkProfile_t * const pxNetworkProfile,
+                                           uint16_t *pusIndex )
+{
+    uint8_t value[ NETWORK_STORE_VALUE_LEN ];
+    uint8_t current[ NETWORK_STORE_VALUE_LEN ];
+    const uint8_t *pmk;
+    size_t ssid_len;
+    size_t password_len;
+    size_t value_len;
+    int index;
+
+    ssid_len = strnlen( pxNetworkProfile->cSSID, wificonfigMAX_SSID_LEN );
+    if( ssid_len > pxNetworkProfile->ucSSIDLength )
+    {
+        ssid_len = pxNetworkProfile->ucSSIDLength;
+    }
+
+    password_len = strnlen( pxNetworkProfile->cPassword, wificonfigMAX_PASSPHRASE_LEN );
+    if( password_len > pxNetworkProfile->ucPasswordLength )
+    {
+        password_len = pxNetworkProfile->ucPasswordLength;
+    }
+
+    value[ 0 ] = ( uint8_t ) pxNetworkProfile->xSecurity;
+    value[ 1 ] = ( uint8_t ) password_len;
+    memcpy( &value[ 2 ], pxNetworkProfile->cPassword, password_len );
+    value_len = 2 + password_len;
+
+    /* A profile that is added again with the same password keeps its PMK */
+    index = wifi_profile_store_find( &network_store, pxNetworkProfile->cSSID, ssid_len );
+    if( index >= 0 &&
+        network_store_value_parse( current, wifi_profile_store_value_get( &network_store, index, current, sizeof( current ) ), &pmk ) >= 0 &&
+        pmk != NULL && memcmp( current, value, value_len ) == 0 )
+    {
+        memcpy( &value[ value_len ], pmk, NETWORK_PMK_LEN );
+        value_len += NETWORK_PMK_LEN;
+    }
+
+    index = wifi_profile_store_put( &network_store, pxNetworkProfile->cSSID, ssid_len, value, value_len );
+    if( index < 0 )
+    {
+        return eWiFiFailure;
+    }
+
+    if( pusIndex != NULL )
+    {
+        *pusIndex = index;
+    }
+
+    return eWiFiSuccess;
+}
+
+static WIFIReturnCode_t network_store_get( WIFINetworkProfile_t *pxNetworkProfile,
+                                           int8_t *pcChannel,
+                                           int index )
+{
+    const wifi_profile_store_entry_t *entry = wifi_profile_store_entry( &network_store, index );
+    uint8_t value[ NETWORK_STORE_VALUE_LEN ];
+    const uint8_t *pmk;
+    int password_len;
+
+    password_len = network_store_value_parse( value, wifi_profile_store_value_get( &network_store, index, value, sizeof( value ) ), &pmk );
+    if( entry == NULL || password_len < 0 )
+    {
+        return eWiFiFailure;
+    }
+
+    memset( pxNetworkProfile, 0, sizeof( WIFINetworkProfile_t ) );
+    memcpy( pxNetworkProfile->cSSID, entry->key, entry->key_len );
+    pxNetworkProfile->ucSSIDLength = entry->key_len;
+    memcpy( pxNetworkProfile->ucBSSID, entry->bssid, wificonfigMAX_BSSID_LEN );
+    memcpy( pxNetworkProfile->cPassword, &value[ 2 ], password_len );
+    pxNetworkProfile->ucPasswordLength = password_len;
+    pxNetworkProfile->xSecurity = ( WIFISecurity_t ) value[ 0 ];
+
+    if( pcChannel != NULL )
+    {
+        *pcChannel = entry->channel;
+    }
+
+    return eWiFiSuccess;
+}
+
+static int network_store_pmk_get( const WIFINetworkParams_t * const pxNetworkParams, char *pmk_hex )
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    uint8_t value[ NETWORK_STORE_VALUE_LEN ];
+    const uint8_t *pmk = NULL;
+    int password_len;
+    int index;
+
+    if( network_store_lock == NULL )
+    {
+        return 0;
+    }
+
+    xSemaphoreTake( network_store_lock, portMAX_DELAY );
+    index = wifi_profile_store_find( &network_store, pxNetworkParams->pcSSID,
+                                     strnlen( pxNetworkParams->pcSSID, pxNetworkParams->ucSSIDLength ) );
+    password_len = network_store_value_parse( value, wifi_profile_store_value_get( &network_store, index, value, sizeof( value ) ), &pmk );
+    xSemaphoreGive( network_store_lock );
+
+    /* The PMK is only valid for the same security and password */
+    if( password_len < 0 || pmk == NULL ||
+        value[ 0 ] != ( uint8_t ) pxNetworkParams->xSecurity ||
+        password_len != pxNetworkParams->ucPasswordLength ||
+        memcmp( &value[ 2 ], pxNetworkParams->pcPassword, password_len ) != 0 )
+    {
+        return 0;
+    }
+
+    for( int i = 0; i < NETWORK_PMK_LEN; i++ )
+    {
+        pmk_hex[ 2 * i ] = hex_digits[ pmk[ i ] >> 4 ];
+        pmk_hex[ 2 * i + 1 ] = hex_digits[ pmk[ i ] & 0xF ];
+    }
+
+    return 1;
+}
+
+static int hex_digit_value( uint8_t c )
+{
+    if( c >= '0' && c <= '9' )
+    {
+        return c - '0';
+    }
+    else if( c >= 'a' && c <= 'f' )
+    {
+        return c - 'a' + 10;
+    }
+    else if( c >= 'A' && c <= 'F' )
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Reads the PMK of the current connection from the WF200. Returns 0 if
+ * there is none.
+ */
+static int network_pmk_read( uint8_t *pmk )
+{
+    sl_wfx_password_t password;
+    uint32_t password_length = 0;
+    sl_status_t sl_ret = SL_STATUS_FAIL;
+
+    if( WIFI_GetLock() == eWiFiSuccess )
+    {
+        sl_ret = sl_wfx_get_pmk( &password, &password_length, SL_WFX_STA_INTERFACE );
+        WIFI_ReleaseLock();
+    }
+
+    if( sl_ret != SL_STATUS_OK )
+    {
+        return 0;
+    }
+
+    /* Depending on the firmware, the PMK is given either as bytes or as hexadecimal digits */
+    if( password_length == NETWORK_PMK_LEN )
+    {
+        memcpy( pmk, password.password, NETWORK_PMK_LEN );
+        return 1;
+    }
+    else if( password_length == NETWORK_PMK_HEX_LEN )
+    {
+        for( int i = 0; i < NETWORK_PMK_LEN; i++ )
+        {
+            int high = hex_digit_value( password.password[ 2 * i ] );
+            int low = hex_digit_value( password.password[ 2 * i + 1 ] );
+
+            if( high < 0 || low < 0 )
+            {
+                return 0;
+            }
+            pmk[ i ] = ( high << 4 ) | low;
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+WIFIReturnCode_t WIFI_NetworkStoreInit( rtos_qspi_flash_t *pxFlash,
+                                        uint32_t ulBase,
+                                        uint32_t ulSize )
+{
+    const size_t sector_size = rtos_qspi_flash_sector_size_get( pxFlash );
+    WIFINetworkProfile_t profile;
+    SemaphoreHandle_t lock;
+
+    configASSERT( network_store_lock == NULL );
+
+    if( wifi_profile_store_init( &network_store,
+                                 network_store_flash_read,
+                                 network_store_flash_write,
+                                 network_store_flash_erase,
+                                 pxFlash,
+                                 ulBase,
+                                 sector_size,
+                                 ulSize / sector_size ) != 0 )
+    {
+        rtos_printf( "The WiFi profile store region at 0x%x is too small or not aligned\n", ulBase );
+        return eWiFiFailure;
+    }
+
+    lock = xSemaphoreCreateMutex();
+    if( lock == NULL )
+    {
+        return eWiFiFailure;
+    }
+
+    /* Bring across the profiles from the file the first time the store is used */
+    if( wifi_profile_store_count( &network_store ) == 0 )
+    {
+        for( uint16_t i = 0; network_file_get( &profile, i ) == eWiFiSuccess; i++ )
+        {
+            if( network_store_add( &profile, NULL ) != eWiFiSuccess )
+            {
+                break;
+            }
+        }
+    }
+
+    network_store_lock = lock;
+
+    return eWiFiSuccess;
+}
+
+WIFIReturnCode_t WIFI_NetworkAdd( const WIFINetworkProfile_t * const pxNetworkProfile,
+                                  uint16_t *pusIndex )
+{
+    WIFIReturnCode_t ret;
+
+    configASSERT( pxNetworkProfile != NULL );
+
+    if( network_store_lock == NULL )
+    {
+        return network_file_add( pxNetworkProfile, pusIndex );
+    }
+
+    xSemaphoreTake( network_store_lock, portMAX_DELAY );
+    ret = network_store_add( pxNetworkProfile, pusIndex );
+    xSemaphoreGive( network_store_lock );
+
+    return ret;
+}
+
+WIFIReturnCode_t WIFI_NetworkGet( WIFINetworkProfile_t *pxNetworkProfile,
+                                  uint16_t usIndex )
+{
+    WIFIReturnCode_t ret;
+
+    configASSERT( pxNetworkProfile != NULL );
+
+    if( network_store_lock == NULL )
+    {
+        return network_file_get( pxNetworkProfile, usIndex );
+    }
+
+    xSemaphoreTake( network_store_lock, portMAX_DELAY );
+    ret = network_store_get( pxNetworkProfile, NULL, usIndex );
+    xSemaphoreGive( network_store_lock );
+
+    return ret;
+}
+
+WIFIReturnCode_t WIFI_NetworkDelete( uint16_t usIndex )
+{
+    WIFIReturnCode_t ret;
+
+    if( network_store_lock == NULL )
+    {
+        return network_file_delete( usIndex );
+    }
+
+    xSemaphoreTake( network_store_lock, portMAX_DELAY );
+    ret = wifi_profile_store_delete( &network_store, usIndex ) == 0 ? eWiFiSuccess : eWiFiFailure;
+    xSemaphoreGive( network_store_lock );
+
+    return ret;
+}
+
+WIFIReturnCode_t WIFI_NetworkGetRecent( WIFINetworkProfile_t *pxNetworkProfile,
+                                        int8_t *pcChannel,
+                                        uint16_t usRank )
+{
+    WIFIReturnCode_t ret;
+
+    configASSERT( pxNetworkProfile != NULL );
+
+    if( network_store_lock == NULL )
+    {
+        return eWiFiNotSupported;
+    }
+
+    xSemaphoreTake( network_store_lock, portMAX_DELAY );
+    ret = network_store_get( pxNetworkProfile, pcChannel, wifi_profile_store_recent( &network_store, usRank ) );
+    xSemaphoreGive( network_store_lock );
+
+    return ret;
+}
+
+WIFIReturnCode_t WIFI_NetworkConnected( const char *pcSSID,
+                                        uint8_t ucSSIDLength,
+                                        const uint8_t *pucBSSID,
+                                        int8_t cChannel )
+{
+    const size_t ssid_len = strnlen( pcSSID, ucSSIDLength );
+    uint8_t value[ NETWORK_STORE_VALUE_LEN ];
+    uint8_t pmk[ NETWORK_PMK_LEN ];
+    const uint8_t *saved_pmk = NULL;
+    int password_len = -1;
+    int need_pmk = 0;
+    int index;
+
+    configASSERT( pcSSID != NULL && pucBSSID != NULL );
+
+    if( network_store_lock == NULL )
+    {
+        return eWiFiNotSupported;
+    }
+
+    xSemaphoreTake( network_store_lock, portMAX_DELAY );
+    index = wifi_profile_store_find( &network_store, pcSSID, ssid_len );
+    if( index >= 0 )
+    {
+        wifi_profile_store_connected( &network_store, index, pucBSSID, cChannel );
+        password_len = network_store_value_parse( value, wifi_profile_store_value_get( &network_store, index, value, sizeof( value ) ), &saved_pmk );
+        need_pmk = password_len >= 0 && saved_pmk == NULL &&
+                   ( value[ 0 ] == eWiFiSecurityWPA || value[ 0 ] == eWiFiSecurityWPA2 );
+    }
+    xSemaphoreGive( network_store_lock );
+
+    /*
+     * The first time a WPA profile connects, its PMK is saved so that it
+     * does not need to be derived again. The lock is not held while it is
+     * read from the WF200, so the profile is checked again afterwards.
+     */
+    if( need_pmk && network_pmk_read( pmk ) )
+    {
+        uint8_t current[ NETWORK_STORE_VALUE_LEN ];
+
+        xSemaphoreTake( network_store_lock, portMAX_DELAY );
+        index = wifi_profile_store_find( &network_store, pcSSID, ssid_len );
+        if( index >= 0 &&
+            wifi_profile_store_value_get( &network_store, index, current, sizeof( current ) ) == 2 + password_len &&
+            memcmp( current, value, 2 + password_len ) == 0 )
+        {
+            memcpy( &value[ 2 + password_len ], pmk, NETWORK_PMK_LEN );
+            wifi_profile_store_put( &network_store, pcSSID, ssid_len, value, 2 + password_len + NETWORK_PMK_LEN );
+        }
+        xSemaphoreGive( network_store_lock );
+    }
+
+    return index >= 0 ? eWiFiSuccess : eWiFiFailure;
+}
+
 #if ( ipconfigSUPPORT_OUTGOING_PINGS == 1 )
 __attribute__((weak))
 void vApplicationPingReplyHook(ePingReplyStatus_t eStatus, uint16_t usIdentifier)
@@ -973,6 +1460,25 @@ WIFIReturnCode_t WIFI_ScanSetSSIDList(const sl_wfx_ssid_def_t *list, int count)
     return ret;
 }
 
+static const uint8_t *scan_channels;
+static int scan_channel_count;
+
+WIFIReturnCode_t WIFI_ScanSetChannels(const uint8_t *channels, int count)
+{
+    WIFIReturnCode_t ret;
+
+    ret = WIFI_GetLock();
+    if( ret == eWiFiSuccess )
+    {
+        scan_channels = channels;
+        scan_channel_count = count;
+
+        WIFI_ReleaseLock();
+    }
+
+    return ret;
+}
+
 static const sl_wfx_mac_address_t *scan_bssid;
 
 WIFIReturnCode_t WIFI_ScanSetBSSID(const uint8_t *bssid)
@@ -1010,14 +1516,16 @@ WIFIReturnCode_t WIFI_Scan( WIFIScanResult_t *pxBuffer,
         memset( pxBuffer, 0, sizeof( WIFIScanResult_t ) * ucNumNetworks );
 
         sl_ret = sl_wfx_send_scan_command( WFM_SCAN_MODE_ACTIVE,
-                                           NULL,
-                                           0,
+                                           scan_channels,
+                                           scan_channel_count,
                                            scan_search_list,
                                            scan_search_list_count,
                                            NULL,
                                            0,
                                            (uint8_t *) scan_bssid);
 
+        scan_channels = NULL;
+        scan_channel_count = 0;
         scan_bssid = NULL;
 
         if( sl_ret == SL_STATUS_OK || sl_ret == SL_STATUS_WIFI_WARNING )
@@ -44,6 +44,9 @@
 #include "sl_wfx.h"
 #include "FreeRTOS/sl_wfx_host.h"
 
+/* Flash driver include, for the network profile store */
+#include "rtos_qspi_flash.h"
+
 /**
  * @brief Return code denoting API status.
  *
@@ -160,6 +163,25 @@ typedef struct
     WIFISecurity_t xSecurity;                           /**< Wi-Fi Security. @see WIFISecurity_t. */
 } WIFINetworkProfile_t;
 
+/**
+ * @brief Sets the boot image that Wi-Fi is started with.
+ *
+ * By default WIFI_On() reads the WF200 PDS data from /flash/firmware/wf200pds.dat on
+ * the filesystem, or uses the data built in for the board, and the firmware is read
+ * with sl_wfx_app_fw_read(). Once a boot image is set, WIFI_On() instead reads both
+ * from the image in flash, which is created by the wf200_mkimage tool. This does not
+ * require the filesystem to be mounted, and the PDS data does not need to be parsed.
+ *
+ * If the image is not valid when WIFI_On() is called, the default sources are used.
+ *
+ * This must be called before WIFI_On().
+ *
+ * @param[in] pxFlash - The flash driver instance to use, or NULL to stop using a boot image.
+ * @param[in] ulAddress - The address of the image in the flash.
+ */
+void WIFI_SetBootImage( rtos_qspi_flash_t * pxFlash,
+                        uint32_t ulAddress );
+
 /**
  * @brief Turns on Wi-Fi.
  *
@@ -367,6 +389,78 @@ WIFIReturnCode_t WIFI_NetworkGet( WIFINetworkProfile_t * pxNetworkProfile,
 WIFIReturnCode_t WIFI_NetworkDelete( uint16_t usIndex );
 /* @[declare_wifi_wifi_networkdelete] */
 
+/**
+ * @brief Keeps the Wi-Fi network profiles in a dedicated region of flash.
+ *
+ * Until this is called, WIFI_NetworkAdd(), WIFI_NetworkGet() and WIFI_NetworkDelete()
+ * keep the profiles in /flash/wifi/networks.dat on the filesystem. Afterwards they use
+ * a store in the given flash region, which is indexed in RAM when it is initialized so
+ * that profiles may be read without accessing the flash again. If the store is empty
+ * then any profiles in the file are copied into it.
+ *
+ * Unlike the file, the store keeps one profile per SSID. Adding a profile with the SSID
+ * of one that is already stored replaces it. Up to WIFI_PROFILE_STORE_MAX_PROFILES
+ * profiles may be stored. The store also records the access point that each profile
+ * last connected to, see WIFI_NetworkGetRecent() and WIFI_NetworkConnected().
+ *
+ * This should be called once, before the Wi-Fi connection manager is started.
+ *
+ * @param[in] pxFlash - The flash driver instance to use.
+ * @param[in] ulBase - The address of the region. Must be aligned to a flash sector.
+ * @param[in] ulSize - The size of the region. This must be at least two sectors. More
+ *                     sectors spread the wear of the flash over more of it.
+ *
+ * @return @ref eWiFiSuccess if successful, failure code otherwise.
+ */
+WIFIReturnCode_t WIFI_NetworkStoreInit( rtos_qspi_flash_t * pxFlash,
+                                        uint32_t ulBase,
+                                        uint32_t ulSize );
+
+/**
+ * @brief Get a Wi-Fi network profile by how recently it connected.
+ *
+ * Gets the Wi-Fi network profiles from the store in order of when they last connected,
+ * most recent first. Profiles that have never connected follow, in the order they
+ * were added. The ucBSSID member of the profile is set to the BSSID of the access
+ * point that it last connected to.
+ *
+ * @param[out] pxNetworkProfile - pointer to return network profile parameters
+ * @param[out] pcChannel - The channel of the access point that the profile last
+ *                         connected to, or 0 if it has never connected. May be NULL.
+ * @param[in] usRank - The position of the profile in this order.
+ *
+ * @return @ref eWiFiSuccess if the network profile was successfully retrieved,
+ * @ref eWiFiNotSupported if WIFI_NetworkStoreInit() has not been called, or
+ * @ref eWiFiFailure if there are no more profiles.
+ */
+WIFIReturnCode_t WIFI_NetworkGetRecent( WIFINetworkProfile_t * pxNetworkProfile,
+                                        int8_t * pcChannel,
+                                        uint16_t usRank );
+
+/**
+ * @brief Record that a Wi-Fi network profile has connected.
+ *
+ * Records in the store the access point that the profile with the given SSID connected
+ * to, making it the most recently connected profile. The flash is only written when
+ * this changes.
+ *
+ * The first time a WPA profile connects, the PMK derived from its passphrase is read
+ * from the module and saved with it. WIFI_ConnectAP() then uses the saved PMK when
+ * connecting with the same SSID and passphrase, which avoids deriving it again.
+ *
+ * @param[in] pcSSID - The SSID of the profile.
+ * @param[in] ucSSIDLength - The length of the SSID.
+ * @param[in] pucBSSID - The BSSID of the access point.
+ * @param[in] cChannel - The channel of the access point.
+ *
+ * @return @ref eWiFiSuccess if successful, @ref eWiFiNotSupported if
+ * WIFI_NetworkStoreInit() has not been called, or failure code otherwise.
+ */
+WIFIReturnCode_t WIFI_NetworkConnected( const char * pcSSID,
+                                        uint8_t ucSSIDLength,
+                                        const uint8_t * pucBSSID,
+                                        int8_t cChannel );
+
 /**
  * @brief Ping an IP address in the network.
  *
@@ -442,6 +536,15 @@ WIFIReturnCode_t WIFI_ScanSetSSIDList(const sl_wfx_ssid_def_t *list, int count);
 
 WIFIReturnCode_t WIFI_ScanSetBSSID(const uint8_t *bssid);
 
+/**
+ * @brief Limits the next Wi-Fi network scan to the given channels.
+ *
+ * Like WIFI_ScanSetBSSID(), this only applies to the next call to WIFI_Scan(),
+ * after which all channels are scanned again. The list is not copied and must
+ * remain valid until then.
+ */
+WIFIReturnCode_t WIFI_ScanSetChannels(const uint8_t *channels, int count);
+
 /**
  * @brief Perform a Wi-Fi network Scan.
  *
@@ -48,24 +48,48 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "sl_wfx_host.h"
 
 /********************************************
- * These options are no longer supported. The code that used to
- * support these options is being left in place for the future if
- * support for these is ever added back in.
+ * This option is no longer supported. The code that used to
+ * support it is being left in place for the future if support
+ * for it is ever added back in. Note that transmitted frames
+ * are not copied anyway when the secure link is not used, as the
+ * send request header is placed in the network buffer's padding.
  ********************************************/
-#if ipconfigZERO_COPY_RX_DRIVER != 0
-#error The WF200 WiFi FreeRTOS driver does not support the ipconfigZERO_COPY_RX_DRIVER option
-#endif
-
 #if ipconfigZERO_COPY_TX_DRIVER != 0
 #error The WF200 WiFi FreeRTOS driver does not support the ipconfigZERO_COPY_TX_DRIVER option
 #endif
 /********************************************/
 
+#if SL_WFX_HOST_STATIC_NETWORK_BUFFERS && defined(SL_WFX_USE_SECURE_LINK)
+/* Frames are padded to an even length and followed by the secure link tag */
+#define NETWORK_BUFFER_TAILROOM ( 1 + SL_WFX_SECURE_LINK_OVERHEAD - SL_WFX_SECURE_LINK_HEADER_SIZE )
+#else
+#define NETWORK_BUFFER_TAILROOM 0
+#endif
+
+/* Frames received over the secure link are decrypted by the driver
+ * into its own buffer, so they are always copied. */
+#if ipconfigZERO_COPY_RX_DRIVER != 0 && !defined(SL_WFX_USE_SECURE_LINK)
+#define SL_WFX_ZERO_COPY_RX 1
+#else
+#define SL_WFX_ZERO_COPY_RX 0
+#endif
 
 /* FreeRTOS_IP_Private.h mistakenly only declares this when
  * ipconfigZERO_COPY_TX_DRIVER is not 0. */
-#if ipconfigZERO_COPY_RX_DRIVER != 0
+#if SL_WFX_ZERO_COPY_RX
 NetworkBufferDescriptor_t *pxPacketBuffer_to_NetworkBuffer( const void *pvBuffer );
+
+/* The offset from the start of an RX buffer to the Ethernet frame
+ * within it when the frame has the normal amount of padding. */
+#define RX_FRAME_OFFSET ( sizeof( sl_wfx_received_ind_t ) + SL_WFX_NORMAL_FRAME_PAD_LENGTH )
+
+/*
+ * The driver reads, handles and frees one received message at a time,
+ * all from the WF200 host task. So there is only ever one RX buffer
+ * outstanding and these describe it.
+ */
+static BaseType_t xRxBufferIsNetworkBuffer;
+static BaseType_t xRxBufferPassedToIPTask;
 #endif
 
 /*
@@ -76,6 +100,127 @@ NetworkBufferDescriptor_t *pxPacketBuffer_to_NetworkBuffer( const void *pvBuffer
 
 #define PRINT_MAC_ADDR( A ) rtos_printf("%x:%x:%x:%x:%x:%x\n", A[0], A[1], A[2], A[3], A[4], A[5])
 
+sl_status_t sl_wfx_host_rx_frame_buffer_allocate( void **buffer, uint32_t buffer_size )
+{
+#if SL_WFX_ZERO_COPY_RX
+NetworkBufferDescriptor_t *pxNetworkBuffer = NULL;
+
+    /* Messages other than Ethernet frames may be larger than a
+    network buffer when BufferAllocation_1 is used, or smaller than
+    the received indication that precedes a frame. These are read into
+    a normal heap buffer. */
+    if( ( buffer_size >= RX_FRAME_OFFSET ) &&
+        ( buffer_size <= RX_FRAME_OFFSET + ipTOTAL_ETHERNET_FRAME_SIZE ) )
+    {
+        pxNetworkBuffer = pxGetNetworkBufferWithDescriptor( buffer_size - RX_FRAME_OFFSET, 0 );
+    }
+
+    xRxBufferPassedToIPTask = pdFALSE;
+    xRxBufferIsNetworkBuffer = ( pxNetworkBuffer != NULL );
+
+    if( pxNetworkBuffer != NULL )
+    {
+        /* The pointer that is returned to the driver is behind the beginning
+        of the Ethernet frame by the size of the received indication message and
+        SL_WFX_NORMAL_FRAME_PAD_LENGTH padding bytes. This way frames with the
+        normal padding begin where pucEthernetBuffer points to. Frames with
+        other padding are moved in the receive callback. */
+        *buffer = pxNetworkBuffer->pucEthernetBuffer - RX_FRAME_OFFSET;
+    }
+    else
+    {
+        *buffer = pvPortMalloc( buffer_size );
+    }
+#else
+    *buffer = pvPortMalloc( buffer_size );
+#endif
+
+    return *buffer != NULL ? SL_STATUS_OK : SL_STATUS_NO_MORE_RESOURCE;
+}
+
+void sl_wfx_host_rx_frame_buffer_free( void *buffer )
+{
+#if SL_WFX_ZERO_COPY_RX
+    if( xRxBufferIsNetworkBuffer != pdFALSE )
+    {
+        /* Once passed to the IP task the network buffer is
+        no longer ours to release. */
+        if( xRxBufferPassedToIPTask == pdFALSE )
+        {
+            vReleaseNetworkBufferAndDescriptor( pxPacketBuffer_to_NetworkBuffer( ( uint8_t * ) buffer + RX_FRAME_OFFSET ) );
+        }
+        xRxBufferIsNetworkBuffer = pdFALSE;
+        xRxBufferPassedToIPTask = pdFALSE;
+        return;
+    }
+#endif
+
+    vPortFree( buffer );
+}
+
+#if ipconfigUSE_LINKED_RX_MESSAGES != 0
+/*
+ * The frames received during the current batch. These are passed to
+ * the IP task as a single event by sl_wfx_host_rx_frames_flush(). They
+ * are only accessed by the WF200 host task.
+ */
+static NetworkBufferDescriptor_t *pxRxChainHead;
+static NetworkBufferDescriptor_t *pxRxChainTail;
+static UBaseType_t uxRxChainLength;
+#endif
+
+static void prvSendToIPTask( NetworkBufferDescriptor_t *pxNetworkBuffer, UBaseType_t uxFrameCount )
+{
+IPStackEvent_t xRxEvent = { eNetworkRxEvent, NULL };
+
+    xRxEvent.pvData = ( void * ) pxNetworkBuffer;
+
+    /* Data was received and stored.  Send a message to the IP
+    task to let it know. */
+    if( xSendEventStructToIPTask( &xRxEvent, ( TickType_t ) 0 ) == pdFAIL )
+    {
+        while( pxNetworkBuffer != NULL )
+        {
+            NetworkBufferDescriptor_t *pxNext;
+#if ipconfigUSE_LINKED_RX_MESSAGES != 0
+            pxNext = pxNetworkBuffer->pxNextBuffer;
+#else
+            pxNext = NULL;
+#endif
+            vReleaseNetworkBufferAndDescriptor( pxNetworkBuffer );
+            iptraceETHERNET_RX_EVENT_LOST();
+            pxNetworkBuffer = pxNext;
+        }
+        sl_wfx_host_rx_stats.dropped_ip_task += uxFrameCount;
+        rtos_printf("eth data lost 1\n");
+    }
+    else
+    {
+        sl_wfx_host_rx_stats.frames += uxFrameCount;
+        sl_wfx_host_rx_stats.ip_events++;
+        iptraceNETWORK_INTERFACE_RECEIVE();
+    }
+}
+
+static void prvDeliverFrame( NetworkBufferDescriptor_t *pxNetworkBuffer )
+{
+#if ipconfigUSE_LINKED_RX_MESSAGES != 0
+    pxNetworkBuffer->pxNextBuffer = NULL;
+    if( pxRxChainHead == NULL )
+    {
+        pxRxChainHead = pxNetworkBuffer;
+    }
+    else
+    {
+        pxRxChainTail->pxNextBuffer = pxNetworkBuffer;
+    }
+    pxRxChainTail = pxNetworkBuffer;
+    uxRxChainLength++;
+#else
+    prvSendToIPTask( pxNetworkBuffer, 1 );
+#endif
+}
+
 void sl_wfx_host_received_frame_callback(sl_wfx_received_ind_t *rx_buffer)
 {
 uint8_t *frame_buffer;
@@ -85,62 +230,67 @@ int frame_length;
     frame_buffer = &rx_buffer->body.frame[ rx_buffer->body.frame_padding ];
     frame_length = rx_buffer->body.frame_length;
 
-    /* Allocate a new network buffer */
     if ( frame_length > 0 )
     {
-#if ipconfigZERO_COPY_RX_DRIVER == 0
-        pxNetworkBuffer = pxGetNetworkBufferWithDescriptor( frame_length, 0 );
+#if SL_WFX_ZERO_COPY_RX
+        if( xRxBufferIsNetworkBuffer != pdFALSE )
+        {
+            /* The frame was received directly into a network buffer */
+            pxNetworkBuffer = pxPacketBuffer_to_NetworkBuffer( &rx_buffer->body.frame[ SL_WFX_NORMAL_FRAME_PAD_LENGTH ] );
+            xassert( pxNetworkBuffer->pucEthernetBuffer == &rx_buffer->body.frame[ SL_WFX_NORMAL_FRAME_PAD_LENGTH ] );
 
-        if( pxNetworkBuffer != NULL )
-#else
-        pxNetworkBuffer = pxPacketBuffer_to_NetworkBuffer( &rx_buffer->body.frame[ SL_WFX_NORMAL_FRAME_PAD_LENGTH ] );
-        xassert( pxNetworkBuffer->pucEthernetBuffer == &rx_buffer->body.frame[ SL_WFX_NORMAL_FRAME_PAD_LENGTH ] );
+            pxNetworkBuffer->xDataLength = frame_length;
 
-        pxNetworkBuffer->xDataLength = frame_length;
+            if ( rx_buffer->body.frame_padding != SL_WFX_NORMAL_FRAME_PAD_LENGTH )
+            {
+                memmove( pxNetworkBuffer->pucEthernetBuffer, frame_buffer, frame_length );
+            }
 
-        if ( rx_buffer->body.frame_padding != SL_WFX_NORMAL_FRAME_PAD_LENGTH )
-        {
-            memmove( pxNetworkBuffer->pucEthernetBuffer, frame_buffer, frame_length );
-            //rtos_printf("moving %d bytes (padding is %d)\n", frame_length, rx_buffer->body.frame_padding);
+            /* From here the network buffer belongs to the IP task, or is
+            released if it cannot be sent to it, so it must not be released
+            again when the RX buffer is freed. */
+            xRxBufferPassedToIPTask = pdTRUE;
         }
         else
-        {
-            //rtos_printf("leaving %d bytes where it is\n", frame_length);
-        }
 #endif
         {
-            IPStackEvent_t xRxEvent = { eNetworkRxEvent, NULL };
+            /* Allocate a new network buffer */
+            pxNetworkBuffer = pxGetNetworkBufferWithDescriptor( frame_length, 0 );
 
-#if ipconfigZERO_COPY_RX_DRIVER == 0
-            memcpy( pxNetworkBuffer->pucEthernetBuffer, frame_buffer, frame_length );
-#endif
-            xRxEvent.pvData = ( void * ) pxNetworkBuffer;
-
-            /* Data was received and stored.  Send a message to the IP
-            task to let it know. */
-            if( xSendEventStructToIPTask( &xRxEvent, ( TickType_t ) 0 ) == pdFAIL )
-            {
-                vReleaseNetworkBufferAndDescriptor( pxNetworkBuffer );
-                iptraceETHERNET_RX_EVENT_LOST();
-                rtos_printf("eth data lost 1\n", frame_length);
-            }
-            else
+            if( pxNetworkBuffer != NULL )
             {
-                iptraceNETWORK_INTERFACE_RECEIVE();
+                memcpy( pxNetworkBuffer->pucEthernetBuffer, frame_buffer, frame_length );
             }
         }
-#if ipconfigZERO_COPY_RX_DRIVER == 0
+
+        if( pxNetworkBuffer != NULL )
+        {
+            prvDeliverFrame( pxNetworkBuffer );
+        }
         else
         {
             /* There is not a new network buffer available */
 
+            sl_wfx_host_rx_stats.dropped_no_buffer++;
             iptraceETHERNET_RX_EVENT_LOST();
             rtos_printf("eth data lost 2\n", frame_length);
         }
-#endif
     }
 }
 
+void sl_wfx_host_rx_frames_flush( void )
+{
+#if ipconfigUSE_LINKED_RX_MESSAGES != 0
+    if( pxRxChainHead != NULL )
+    {
+        prvSendToIPTask( pxRxChainHead, uxRxChainLength );
+        pxRxChainHead = NULL;
+        pxRxChainTail = NULL;
+        uxRxChainLength = 0;
+    }
+#endif
+}
+
 BaseType_t xNetworkInterfaceInitialise( void )
 {
 BaseType_t xStatus;
@@ -153,6 +303,13 @@ WIFIDeviceMode_t mode;
 #ifndef SL_WFX_USE_SECURE_LINK
     xassert( ipBUFFER_PADDING >= sizeof( void * ) + sizeof( sl_wfx_send_frame_req_t ) );
     xassert( sizeof( sl_wfx_received_ind_t ) <= sizeof( sl_wfx_send_frame_req_t ) );
+#elif SL_WFX_HOST_STATIC_NETWORK_BUFFERS
+    xassert( ipBUFFER_PADDING >= sizeof( void * ) + SL_WFX_SECURE_LINK_HEADER_SIZE + sizeof( sl_wfx_send_frame_req_t ) );
+#endif
+#if SL_WFX_ZERO_COPY_RX
+    /* Received frames are read into network buffers along with the indication
+    message that precedes them, which must fit into the buffer padding. */
+    xassert( ipBUFFER_PADDING >= sizeof( void * ) + RX_FRAME_OFFSET );
 #endif
 
     if( xOriginalFreeRTOSMACAddressSet == pdFALSE )
@@ -274,9 +431,12 @@ WIFIDeviceMode_t mode;
 BaseType_t xNetworkInterfaceOutput( NetworkBufferDescriptor_t * const pxNetworkBuffer, BaseType_t xReleaseAfterSend )
 {
 sl_wfx_send_frame_req_t *tx_buffer;
-sl_status_t result;
+sl_status_t result = SL_STATUS_OK;
 uint32_t frame_length;
 WIFIDeviceMode_t mode;
+#ifdef SL_WFX_USE_SECURE_LINK
+BaseType_t xInPlace;
+#endif
 
     /* Obtaining the WiFi lock and then only sending if the WiFi is connected
     ensures that sends only ever happen when there is a WiFi connection, and
@@ -287,33 +447,47 @@ WIFIDeviceMode_t mode;
         if( WIFI_IsConnected() != pdFALSE )
         {
 
-            /* When not using the secure link, the sl_wfx_send_frame_req_t header is
-             * inserted immediately before the beginning of the Ethernet frame, inside
-             * the frame buffer already allocated by FreeRTOS+TCP. The same cannot be done
-             * when using the secure link (at least not with BufferAllocation_2) because
-             * it also requires a tag following the frame which isn't possible to allocate
-             * space for without modifying FreeRTOS+TCP. It might be possible with
-             * BufferAllocation_1.
+            /* The sl_wfx_send_frame_req_t header is inserted immediately before the
+             * beginning of the Ethernet frame, inside the frame buffer already allocated
+             * by FreeRTOS+TCP.
              *
              * The space for the sl_wfx_send_frame_req_t header is made by requiring that
              * ipconfigPACKET_FILLER_SIZE be at least sizeof(sl_wfx_send_frame_req_t).
              * This creates space between the beginning of the buffer and the beginning
              * of the Ethernet Frame, the first sizeof(void *) bytes of which are used to
-             * store a pointer back to the NetworkBufferDescriptor_t struct. */
+             * store a pointer back to the NetworkBufferDescriptor_t struct.
+             *
+             * The secure link additionally requires its own header before this, and a
+             * tag following the frame. There is only room for the tag when the network
+             * buffers are provided by vNetworkInterfaceAllocateRAMToBuffers() below.
+             * The frame is encrypted in place, so this is only done when the buffer is
+             * released after the send. A buffer that the IP task keeps may be sent again
+             * and so is copied into a separate secure link buffer instead. */
 
 #ifndef SL_WFX_USE_SECURE_LINK
-            frame_length = pxNetworkBuffer->xDataLength; /* is the round up really necessary? */
-            tx_buffer = ( sl_wfx_send_frame_req_t * ) ( pxNetworkBuffer->pucEthernetBuffer - sizeof( sl_wfx_send_frame_req_t ) );
+            frame_length = pxNetworkBuffer->xDataLength;
 #else
             frame_length = SL_WFX_ROUND_UP(pxNetworkBuffer->xDataLength, 2);
-            result = sl_wfx_allocate_command_buffer((sl_wfx_generic_message_t**)(&tx_buffer),
-                                                    SL_WFX_SEND_FRAME_REQ_ID,
-                                                    SL_WFX_TX_FRAME_BUFFER,
-                                                    frame_length + sizeof(sl_wfx_send_frame_req_t));
+#endif
+            tx_buffer = ( sl_wfx_send_frame_req_t * ) ( pxNetworkBuffer->pucEthernetBuffer - sizeof( sl_wfx_send_frame_req_t ) );
+
+#ifdef SL_WFX_USE_SECURE_LINK
+            xInPlace = SL_WFX_HOST_STATIC_NETWORK_BUFFERS && xReleaseAfterSend != pdFALSE;
+
+            if( xInPlace == pdFALSE )
+            {
+                result = sl_wfx_allocate_command_buffer((sl_wfx_generic_message_t**)(&tx_buffer),
+                                                        SL_WFX_SEND_FRAME_REQ_ID,
+                                                        SL_WFX_TX_FRAME_BUFFER,
+                                                        frame_length + sizeof(sl_wfx_send_frame_req_t));
+                if( result == SL_STATUS_OK )
+                {
+                    memcpy( tx_buffer->body.packet_data, pxNetworkBuffer->pucEthernetBuffer, pxNetworkBuffer->xDataLength );
+                }
+            }
 
             if( result == SL_STATUS_OK )
             {
-                memcpy( tx_buffer->body.packet_data, pxNetworkBuffer->pucEthernetBuffer, pxNetworkBuffer->xDataLength );
 #endif
 
                 /* Send the packet */
@@ -323,9 +497,12 @@ WIFIDeviceMode_t mode;
                                                     mode == eWiFiModeStation ? SL_WFX_STA_INTERFACE : SL_WFX_SOFTAP_INTERFACE,
                                                     0);
 #ifdef SL_WFX_USE_SECURE_LINK
-                sl_wfx_free_command_buffer((sl_wfx_generic_message_t*) tx_buffer,
-                                           SL_WFX_SEND_FRAME_REQ_ID,
-                                           SL_WFX_TX_FRAME_BUFFER);
+                if( xInPlace == pdFALSE )
+                {
+                    sl_wfx_free_command_buffer((sl_wfx_generic_message_t*) tx_buffer,
+                                               SL_WFX_SEND_FRAME_REQ_ID,
+                                               SL_WFX_TX_FRAME_BUFFER);
+                }
 #endif
                 if( result == SL_STATUS_OK )
                 {
@@ -365,8 +542,25 @@ WIFIDeviceMode_t mode;
 
 void vNetworkInterfaceAllocateRAMToBuffers( NetworkBufferDescriptor_t pxNetworkBuffers[ ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS ] )
 {
+#if SL_WFX_HOST_STATIC_NETWORK_BUFFERS
+#define NETWORK_BUFFER_SIZE SL_WFX_ROUND_UP( ipBUFFER_PADDING + ipTOTAL_ETHERNET_FRAME_SIZE + NETWORK_BUFFER_TAILROOM, 4 )
+static uint8_t ucNetworkBuffers[ ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS ][ NETWORK_BUFFER_SIZE ] __attribute__( ( aligned( 8 ) ) );
+BaseType_t x;
+
+    /* Used with BufferAllocation_1.c, which uses preallocated static network
+    buffers. Each has room after the frame for the secure link tag. As
+    BufferAllocation_1.c expects, the first bytes of each buffer point back
+    to its descriptor. */
+    for( x = 0; x < ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS; x++ )
+    {
+        pxNetworkBuffers[ x ].pucEthernetBuffer = &ucNetworkBuffers[ x ][ ipBUFFER_PADDING ];
+        *( ( NetworkBufferDescriptor_t ** ) &ucNetworkBuffers[ x ][ 0 ] ) = &pxNetworkBuffers[ x ];
+    }
+#undef NETWORK_BUFFER_SIZE
+#else
     /* Only required if using BufferAllocation_1.c, which uses
      * preallocated static network buffers */
+#endif
 }
 
 BaseType_t xGetPhyLinkStatus( void )
@@ -0,0 +1,616 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <string.h>
+
+#include "wifi_profile_store.h"
+
+#define SECTOR_MAGIC 0x53505749 /* "IWPS" */
+
+#define RECORD_PUT       0x01
+#define RECORD_DELETE    0x02
+#define RECORD_CONNECTED 0x03
+#define RECORD_ERASED    0xFF
+
+#define CONNECTED_VALUE_LEN (WIFI_PROFILE_STORE_BSSID_LEN + 1)
+
+#define ALIGN4(n) (((n) + 3) & ~(size_t) 3)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} sector_header_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t key_len;
+    uint16_t value_len;
+    uint32_t seq;
+    uint32_t crc;       /* Of the fields above, the key and the value */
+} record_header_t;
+
+#define RECORD_MAX_SIZE ALIGN4(sizeof(record_header_t) + WIFI_PROFILE_STORE_KEY_MAX_LEN + WIFI_PROFILE_STORE_VALUE_MAX_LEN)
+#define RECORD_CONNECTED_MAX_SIZE ALIGN4(sizeof(record_header_t) + WIFI_PROFILE_STORE_KEY_MAX_LEN + CONNECTED_VALUE_LEN)
+
+/*
+ * Every live record must fit in one sector along with one more, so that
+ * compacting the oldest sector into a new one always leaves room for the
+ * record being written.
+ */
+#define SECTOR_MIN_SIZE (sizeof(sector_header_t) + \
+                         WIFI_PROFILE_STORE_MAX_PROFILES * (RECORD_MAX_SIZE + RECORD_CONNECTED_MAX_SIZE) + \
+                         RECORD_MAX_SIZE)
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    /* Bitwise, as records are small and only checked when read at init */
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+static uint32_t record_crc(const record_header_t *hdr, const uint8_t *payload)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    crc = crc32_update(crc, hdr, offsetof(record_header_t, crc));
+    crc = crc32_update(crc, payload, hdr->key_len + hdr->value_len);
+    return ~crc;
+}
+
+static unsigned sector_address(const wifi_profile_store_t *store, unsigned sector)
+{
+    return store->base + sector * store->sector_size;
+}
+
+static unsigned next_sector(const wifi_profile_store_t *store, unsigned sector)
+{
+    return sector + 1 < store->sector_count ? sector + 1 : 0;
+}
+
+static int address_in_sector(const wifi_profile_store_t *store, unsigned address, unsigned sector)
+{
+    const unsigned start = sector_address(store, sector);
+
+    return address >= start && address < start + store->sector_size;
+}
+
+/*
+ * The index
+ */
+
+static int find(const wifi_profile_store_t *store, const char *key, size_t key_len)
+{
+    for (int i = 0; i < store->count; i++) {
+        if (store->entries[i].key_len == key_len && memcmp(store->entries[i].key, key, key_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int more_recent(const wifi_profile_store_entry_t *a, const wifi_profile_store_entry_t *b)
+{
+    if (a->connected_seq != b->connected_seq) {
+        return a->connected_seq > b->connected_seq;
+    }
+    return a->added_seq < b->added_seq;
+}
+
+static void recent_build(wifi_profile_store_t *store)
+{
+    for (int i = 0; i < store->count; i++) {
+        int j = i;
+        while (j > 0 && more_recent(&store->entries[i], &store->entries[store->recent[j - 1]])) {
+            store->recent[j] = store->recent[j - 1];
+            j--;
+        }
+        store->recent[j] = i;
+    }
+}
+
+static void entry_remove(wifi_profile_store_t *store, int index)
+{
+    memmove(&store->entries[index], &store->entries[index + 1],
+            (store->count - index - 1) * sizeof(wifi_profile_store_entry_t));
+    store->count--;
+}
+
+/*
+ * Compacting copies records to the head out of order, so a record may be
+ * replayed after a newer one for the same key. Records are ignored if they
+ * are older than the profile that they apply to.
+ */
+static void record_apply(wifi_profile_store_t *store, const record_header_t *hdr,
+                         const uint8_t *payload, unsigned address)
+{
+    const uint8_t *value = payload + hdr->key_len;
+    wifi_profile_store_entry_t *entry;
+    int i = find(store, (const char *) payload, hdr->key_len);
+
+    if (hdr->seq >= store->seq) {
+        store->seq = hdr->seq + 1;
+    }
+
+    switch (hdr->type) {
+    case RECORD_PUT:
+        if (i < 0) {
+            if (store->count == WIFI_PROFILE_STORE_MAX_PROFILES) {
+                return;
+            }
+            i = store->count++;
+            entry = &store->entries[i];
+            memset(entry, 0, sizeof(wifi_profile_store_entry_t));
+            memcpy(entry->key, payload, hdr->key_len);
+            entry->key_len = hdr->key_len;
+            entry->added_seq = hdr->seq;
+        }
+        entry = &store->entries[i];
+        entry->value_len = hdr->value_len;
+        entry->value_address = address + sizeof(record_header_t) + hdr->key_len;
+        entry->put_address = address;
+        break;
+
+    case RECORD_DELETE:
+        if (i >= 0 && hdr->seq > store->entries[i].added_seq) {
+            entry_remove(store, i);
+        }
+        break;
+
+    case RECORD_CONNECTED:
+        if (i >= 0 && hdr->seq > store->entries[i].added_seq && hdr->seq >= store->entries[i].connected_seq) {
+            entry = &store->entries[i];
+            memcpy(entry->bssid, value, WIFI_PROFILE_STORE_BSSID_LEN);
+            entry->channel = (int8_t) value[WIFI_PROFILE_STORE_BSSID_LEN];
+            entry->connected_seq = hdr->seq;
+            entry->connected_address = address;
+        }
+        break;
+    }
+}
+
+/*
+ * The log
+ */
+
+static int record_header_valid(const wifi_profile_store_t *store, const record_header_t *hdr, size_t offset)
+{
+    if (hdr->key_len == 0 || hdr->key_len > WIFI_PROFILE_STORE_KEY_MAX_LEN) {
+        return 0;
+    }
+
+    switch (hdr->type) {
+    case RECORD_PUT:
+        if (hdr->value_len > WIFI_PROFILE_STORE_VALUE_MAX_LEN) {
+            return 0;
+        }
+        break;
+    case RECORD_DELETE:
+        if (hdr->value_len != 0) {
+            return 0;
+        }
+        break;
+    case RECORD_CONNECTED:
+        if (hdr->value_len != CONNECTED_VALUE_LEN) {
+            return 0;
+        }
+        break;
+    default:
+        return 0;
+    }
+
+    return offset + ALIGN4(sizeof(record_header_t) + hdr->key_len + hdr->value_len) <= store->sector_size;
+}
+
+/*
+ * Replays the records in a sector into the index, either the connection
+ * records or all the others. Returns the offset that the next record may
+ * be written at. A record that fails its check, most likely as power was
+ * lost while writing it, ends the sector, as the space after it may not
+ * be erased.
+ */
+static size_t sector_replay(wifi_profile_store_t *store, unsigned sector, int connections)
+{
+    const unsigned start = sector_address(store, sector);
+    size_t offset = sizeof(sector_header_t);
+    uint8_t payload[WIFI_PROFILE_STORE_KEY_MAX_LEN + WIFI_PROFILE_STORE_VALUE_MAX_LEN];
+    record_header_t hdr;
+
+    while (offset + sizeof(record_header_t) <= store->sector_size) {
+        store->read(store->flash_ctx, start + offset, &hdr, sizeof(hdr));
+
+        if (hdr.type == RECORD_ERASED) {
+            static const record_header_t erased = { 0xFF, 0xFF, 0xFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+            /* Only if none of the header was written can the next record go here */
+            return memcmp(&hdr, &erased, sizeof(hdr)) == 0 ? offset : store->sector_size;
+        }
+        if (!record_header_valid(store, &hdr, offset)) {
+            return store->sector_size;
+        }
+
+        store->read(store->flash_ctx, start + offset + sizeof(hdr), payload, hdr.key_len + hdr.value_len);
+        if (record_crc(&hdr, payload) != hdr.crc) {
+            return store->sector_size;
+        }
+
+        if ((hdr.type == RECORD_CONNECTED) == connections) {
+            record_apply(store, &hdr, payload, start + offset);
+        }
+        offset += ALIGN4(sizeof(record_header_t) + hdr.key_len + hdr.value_len);
+    }
+
+    return store->sector_size;
+}
+
+static int sector_blank(const wifi_profile_store_t *store, unsigned sector)
+{
+    uint32_t buf[16];
+    const unsigned start = sector_address(store, sector);
+
+    for (size_t offset = 0; offset < store->sector_size; offset += sizeof(buf)) {
+        store->read(store->flash_ctx, start + offset, buf, sizeof(buf));
+        for (int i = 0; i < 16; i++) {
+            if (buf[i] != 0xFFFFFFFF) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void sector_begin(wifi_profile_store_t *store, unsigned sector)
+{
+    sector_header_t hdr;
+
+    hdr.magic = SECTOR_MAGIC;
+    hdr.seq = ++store->sector_seq;
+    /* The magic number goes last, so that a sector that has it has a whole header */
+    store->write(store->flash_ctx, sector_address(store, sector) + offsetof(sector_header_t, seq),
+                 &hdr.seq, sizeof(hdr.seq));
+    store->write(store->flash_ctx, sector_address(store, sector), &hdr.magic, sizeof(hdr.magic));
+
+    store->head = sector;
+    store->head_offset = sizeof(sector_header_t);
+}
+
+/*
+ * Writes a record to the head sector, which must have room for it.
+ * Returns its address.
+ */
+static unsigned record_write(wifi_profile_store_t *store, uint8_t type, uint32_t seq,
+                             const char *key, size_t key_len,
+                             const void *value, size_t value_len)
+{
+    uint32_t buf[RECORD_MAX_SIZE / sizeof(uint32_t)];
+    record_header_t *hdr = (record_header_t *) buf;
+    uint8_t *payload = (uint8_t *) buf + sizeof(record_header_t);
+    const size_t size = ALIGN4(sizeof(record_header_t) + key_len + value_len);
+    const unsigned address = sector_address(store, store->head) + store->head_offset;
+
+    /* The padding is left erased */
+    memset(buf, 0xFF, size);
+    hdr->type = type;
+    hdr->key_len = key_len;
+    hdr->value_len = value_len;
+    hdr->seq = seq;
+    memcpy(payload, key, key_len);
+    if (value_len > 0) {
+        memcpy(payload + key_len, value, value_len);
+    }
+    hdr->crc = record_crc(hdr, payload);
+
+    store->write(store->flash_ctx, address, buf, size);
+    store->head_offset += size;
+
+    return address;
+}
+
+static void connected_record_write(wifi_profile_store_t *store, wifi_profile_store_entry_t *entry)
+{
+    uint8_t value[CONNECTED_VALUE_LEN];
+
+    memcpy(value, entry->bssid, WIFI_PROFILE_STORE_BSSID_LEN);
+    value[WIFI_PROFILE_STORE_BSSID_LEN] = (uint8_t) entry->channel;
+
+    entry->connected_address = record_write(store, RECORD_CONNECTED, entry->connected_seq,
+                                            entry->key, entry->key_len, value, sizeof(value));
+}
+
+/*
+ * Copies the live records in the oldest sector to the head sector, and
+ * then erases it.
+ */
+static void compact(wifi_profile_store_t *store)
+{
+    const unsigned victim = store->tail;
+
+    for (int i = 0; i < store->count; i++) {
+        wifi_profile_store_entry_t *entry = &store->entries[i];
+
+        if (address_in_sector(store, entry->put_address, victim)) {
+            uint8_t value[WIFI_PROFILE_STORE_VALUE_MAX_LEN];
+
+            store->read(store->flash_ctx, entry->value_address, value, entry->value_len);
+            entry->put_address = record_write(store, RECORD_PUT, entry->added_seq,
+                                              entry->key, entry->key_len, value, entry->value_len);
+            entry->value_address = entry->put_address + sizeof(record_header_t) + entry->key_len;
+        }
+        if (entry->connected_address != 0 && address_in_sector(store, entry->connected_address, victim)) {
+            connected_record_write(store, entry);
+        }
+    }
+
+    store->erase(store->flash_ctx, sector_address(store, victim), store->sector_size);
+    store->tail = next_sector(store, victim);
+}
+
+/*
+ * Makes room in the head sector for a record of size bytes. There is
+ * always at least one erased sector after the head to move on to.
+ */
+static void reserve(wifi_profile_store_t *store, size_t size)
+{
+    if (store->head_offset + size <= store->sector_size) {
+        return;
+    }
+
+    sector_begin(store, next_sector(store, store->head));
+
+    if (next_sector(store, store->head) == store->tail) {
+        compact(store);
+    }
+}
+
+/*
+ * The API
+ */
+
+void wifi_profile_store_format(wifi_profile_store_t *store)
+{
+    for (unsigned i = 0; i < store->sector_count; i++) {
+        store->erase(store->flash_ctx, sector_address(store, i), store->sector_size);
+    }
+
+    store->count = 0;
+    store->seq = 1;
+    store->sector_seq = 0;
+    store->tail = 0;
+    sector_begin(store, 0);
+}
+
+int wifi_profile_store_init(wifi_profile_store_t *store,
+                            wifi_profile_store_flash_read_t read,
+                            wifi_profile_store_flash_write_t write,
+                            wifi_profile_store_flash_erase_t erase,
+                            void *flash_ctx,
+                            unsigned base,
+                            size_t sector_size,
+                            unsigned sector_count)
+{
+    int found = 0;
+    uint32_t tail_seq = 0;
+
+    if (sector_count < 2 || sector_size < SECTOR_MIN_SIZE || base % sector_size != 0) {
+        return -1;
+    }
+
+    memset(store, 0, sizeof(wifi_profile_store_t));
+    store->read = read;
+    store->write = write;
+    store->erase = erase;
+    store->flash_ctx = flash_ctx;
+    store->base = base;
+    store->sector_size = sector_size;
+    store->sector_count = sector_count;
+    store->seq = 1;
+
+    /* The sectors in use are those from the oldest to the newest */
+    for (unsigned i = 0; i < sector_count; i++) {
+        sector_header_t hdr;
+
+        store->read(store->flash_ctx, sector_address(store, i), &hdr, sizeof(hdr));
+        if (hdr.magic != SECTOR_MAGIC) {
+            continue;
+        }
+        if (!found || hdr.seq < tail_seq) {
+            tail_seq = hdr.seq;
+            store->tail = i;
+        }
+        if (!found || hdr.seq > store->sector_seq) {
+            store->sector_seq = hdr.seq;
+            store->head = i;
+        }
+        found = 1;
+    }
+
+    if (!found) {
+        wifi_profile_store_format(store);
+        return 0;
+    }
+
+    /*
+     * The connection records are replayed once every profile is known, as
+     * the profile's record may have been copied after them when compacting.
+     */
+    for (int connections = 0; connections <= 1; connections++) {
+        for (unsigned i = store->tail;; i = next_sector(store, i)) {
+            sector_header_t hdr;
+
+            store->read(store->flash_ctx, sector_address(store, i), &hdr, sizeof(hdr));
+            if (hdr.magic == SECTOR_MAGIC) {
+                store->head_offset = sector_replay(store, i, connections);
+            }
+            if (i == store->head) {
+                break;
+            }
+        }
+    }
+
+    /* The rest must be erased, in case power was lost while erasing them */
+    for (unsigned i = next_sector(store, store->head); i != store->tail; i = next_sector(store, i)) {
+        if (!sector_blank(store, i)) {
+            store->erase(store->flash_ctx, sector_address(store, i), store->sector_size);
+        }
+    }
+
+    /* Records copied out of order when compacting are put back in the order they were added */
+    for (int i = 1; i < store->count; i++) {
+        wifi_profile_store_entry_t entry = store->entries[i];
+        int j = i;
+        while (j > 0 && store->entries[j - 1].added_seq > entry.added_seq) {
+            store->entries[j] = store->entries[j - 1];
+            j--;
+        }
+        store->entries[j] = entry;
+    }
+    recent_build(store);
+
+    /*
+     * Power was lost while the oldest sector was being compacted. The head
+     * holds nothing but copies of its records, and perhaps a part written
+     * one, so is erased and the compaction is done again when it is next
+     * needed.
+     */
+    if (store->head != store->tail && next_sector(store, store->head) == store->tail) {
+        store->erase(store->flash_ctx, sector_address(store, store->head), store->sector_size);
+        return wifi_profile_store_init(store, read, write, erase, flash_ctx, base, sector_size, sector_count);
+    }
+
+    return 0;
+}
+
+int wifi_profile_store_put(wifi_profile_store_t *store,
+                           const char *key, size_t key_len,
+                           const void *value, size_t value_len)
+{
+    wifi_profile_store_entry_t *entry;
+    uint32_t seq;
+    int i;
+
+    if (key_len == 0 || key_len > WIFI_PROFILE_STORE_KEY_MAX_LEN || value_len > WIFI_PROFILE_STORE_VALUE_MAX_LEN) {
+        return -1;
+    }
+
+    i = find(store, key, key_len);
+    if (i >= 0) {
+        uint8_t current[WIFI_PROFILE_STORE_VALUE_MAX_LEN];
+
+        entry = &store->entries[i];
+        if (entry->value_len == value_len) {
+            store->read(store->flash_ctx, entry->value_address, current, value_len);
+            if (memcmp(current, value, value_len) == 0) {
+                return i;
+            }
+        }
+    } else if (store->count == WIFI_PROFILE_STORE_MAX_PROFILES) {
+        return -1;
+    }
+
+    /* Compacting may move the entries' records, so is done first */
+    reserve(store, ALIGN4(sizeof(record_header_t) + key_len + value_len));
+
+    if (i >= 0) {
+        entry = &store->entries[i];
+        seq = entry->added_seq;
+    } else {
+        i = store->count++;
+        entry = &store->entries[i];
+        memset(entry, 0, sizeof(wifi_profile_store_entry_t));
+        memcpy(entry->key, key, key_len);
+        entry->key_len = key_len;
+        entry->added_seq = seq = store->seq++;
+    }
+
+    entry->put_address = record_write(store, RECORD_PUT, seq, key, key_len, value, value_len);
+    entry->value_address = entry->put_address + sizeof(record_header_t) + key_len;
+    entry->value_len = value_len;
+
+    recent_build(store);
+
+    return i;
+}
+
+int wifi_profile_store_delete(wifi_profile_store_t *store, int index)
+{
+    wifi_profile_store_entry_t *entry;
+
+    if (index < 0 || index >= store->count) {
+        return -1;
+    }
+
+    entry = &store->entries[index];
+    reserve(store, ALIGN4(sizeof(record_header_t) + entry->key_len));
+    record_write(store, RECORD_DELETE, store->seq++, entry->key, entry->key_len, NULL, 0);
+
+    entry_remove(store, index);
+    recent_build(store);
+
+    return 0;
+}
+
+int wifi_profile_store_connected(wifi_profile_store_t *store, int index,
+                                 const uint8_t *bssid, int8_t channel)
+{
+    wifi_profile_store_entry_t *entry;
+
+    if (index < 0 || index >= store->count) {
+        return -1;
+    }
+
+    entry = &store->entries[index];
+    if (entry->connected_seq != 0 && store->recent[0] == index &&
+            entry->channel == channel && memcmp(entry->bssid, bssid, WIFI_PROFILE_STORE_BSSID_LEN) == 0) {
+        return 0;
+    }
+
+    reserve(store, RECORD_CONNECTED_MAX_SIZE);
+    memcpy(entry->bssid, bssid, WIFI_PROFILE_STORE_BSSID_LEN);
+    entry->channel = channel;
+    entry->connected_seq = store->seq++;
+    connected_record_write(store, entry);
+
+    recent_build(store);
+
+    return 0;
+}
+
+int wifi_profile_store_find(const wifi_profile_store_t *store, const char *key, size_t key_len)
+{
+    return find(store, key, key_len);
+}
+
+int wifi_profile_store_recent(const wifi_profile_store_t *store, int rank)
+{
+    if (rank < 0 || rank >= store->count) {
+        return -1;
+    }
+    return store->recent[rank];
+}
+
+const wifi_profile_store_entry_t *wifi_profile_store_entry(const wifi_profile_store_t *store, int index)
+{
+    if (index < 0 || index >= store->count) {
+        return NULL;
+    }
+    return &store->entries[index];
+}
+
+int wifi_profile_store_value_get(const wifi_profile_store_t *store, int index,
+                                 void *value, size_t max_len)
+{
+    const wifi_profile_store_entry_t *entry = wifi_profile_store_entry(store, index);
+
+    if (entry == NULL || entry->value_len > max_len) {
+        return -1;
+    }
+
+    store->read(store->flash_ctx, entry->value_address, value, entry->value_len);
+
+    return entry->value_len;
+}
@@ -1,4 +1,4 @@
-// Copyright 2019-2023 XMOS LIMITED.
+// Copyright 2019-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_LOCKS_H_
@@ -26,6 +26,20 @@
 #error XCORE does not support more than 4 hardware locks
 #endif
 
+#ifndef RTOS_SUPPORT_DEDICATED_LOCKS
+/*
+ * When set, rtos_support allocates its own hardware lock for IRQ delivery
+ * so that it does not contend with the RTOS. This uses RTOS_SUPPORT_LOCK_COUNT
+ * more of the tile's four hardware locks. When not set, or when the lock
+ * cannot be allocated, RTOS lock 0 is used instead.
+ */
+#define RTOS_SUPPORT_DEDICATED_LOCKS 1
+#endif
+
+/* IDs of the locks used internally by rtos_support */
+#define RTOS_SUPPORT_LOCK_IRQ   0
+#define RTOS_SUPPORT_LOCK_COUNT 1
+
 void rtos_locks_initialize(void);
 
 inline int rtos_lock_acquire(int lock_id)
@@ -71,6 +85,38 @@ inline int rtos_lock_release(int lock_id)
     return counter;
 }
 
+/**
+ * Acquires one of the locks used internally by rtos_support.
+ * These are not recursive. Interrupts must be masked on the calling
+ * core while the lock is held.
+ */
+inline void rtos_support_lock_acquire(int lock_id)
+{
+    extern lock_t rtos_support_locks[RTOS_SUPPORT_LOCK_COUNT];
+
+    xassert(lock_id >= 0 && lock_id < RTOS_SUPPORT_LOCK_COUNT);
+    if (rtos_support_locks[lock_id] != 0) {
+        lock_acquire(rtos_support_locks[lock_id]);
+    } else {
+        rtos_lock_acquire(0);
+    }
+}
+
+/**
+ * Releases a lock acquired with rtos_support_lock_acquire().
+ */
+inline void rtos_support_lock_release(int lock_id)
+{
+    extern lock_t rtos_support_locks[RTOS_SUPPORT_LOCK_COUNT];
+
+    xassert(lock_id >= 0 && lock_id < RTOS_SUPPORT_LOCK_COUNT);
+    if (rtos_support_locks[lock_id] != 0) {
+        lock_release(rtos_support_locks[lock_id]);
+    } else {
+        rtos_lock_release(0);
+    }
+}
+
 #endif // !defined(__XC__)
 
 #endif /* RTOS_LOCKS_H_ */
@@ -1,4 +1,4 @@
-// Copyright 2019-2023 XMOS LIMITED.
+// Copyright 2019-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef _rtos_printf_h_
@@ -17,6 +17,26 @@ This uses the same DEBUG macros as lib_logging to control "debug units",
 but implements a slightly more capable and RTOS safe printf function.
 It also provides sprintf and snprintf functions.
 
+Prints may additionally be given a level with rtos_printf_error(),
+rtos_printf_warning(), rtos_printf_info() and rtos_printf_debug().
+Prints above RTOS_PRINTF_LEVEL, or above RTOS_PRINTF_LEVEL_<DEBUG_UNIT>
+when this is defined for the debug unit, are removed at compile time.
+
+When RTOS_PRINTF_DEFERRED is set to 1, rtos_printf() does not format its
+message. It only stores the format string pointer and the arguments in a
+ring buffer belonging to the calling core, and returns. The messages are
+formatted and printed later by rtos_printf_deferred_flush(), which the
+application should call periodically from a low priority task. If a ring
+is full the message is dropped and counted rather than blocking.
+
+When RTOS_PRINTF_DEFERRED_BINARY is also set to 1, format strings are
+placed in the RTOS_PRINTF_FMT_SECTION section of the ELF and the flush
+does not format the messages at all. It sends each message, as an
+rtos_printf_binary_header_t followed by its arguments, to the output
+function set with rtos_printf_binary_output_set(). The host tool
+tools/rtos_printf/rtos_printf_decode.py recreates the text from these
+and the application's ELF, or a format string table extracted from it.
+
 **/
 
 #include "rtos_support_rtos_config.h"
@@ -30,10 +50,105 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdarg.h>
 
 #include "xcore_utils.h"
 
+/**
+ * \defgroup RTOS printf levels
+ *
+ * Levels that may be used for RTOS_PRINTF_LEVEL and
+ * RTOS_PRINTF_LEVEL_<DEBUG_UNIT>.
+ * @{
+ */
+#define RTOS_PRINTF_LEVEL_ERROR    1
+#define RTOS_PRINTF_LEVEL_WARNING  2
+#define RTOS_PRINTF_LEVEL_INFO     3
+#define RTOS_PRINTF_LEVEL_DEBUG    4
+/**@}*/
+
+#ifndef RTOS_PRINTF_LEVEL
+/**
+ * The highest level printed by debug units that do
+ * not define RTOS_PRINTF_LEVEL_<DEBUG_UNIT>.
+ */
+#define RTOS_PRINTF_LEVEL RTOS_PRINTF_LEVEL_DEBUG
+#endif
+
+#ifndef RTOS_PRINTF_DEFERRED
+/**
+ * Set to 1 to store rtos_printf() messages and print
+ * them later with rtos_printf_deferred_flush().
+ */
+#define RTOS_PRINTF_DEFERRED 0
+#endif
+
+#ifndef RTOS_PRINTF_DEFERRED_RING_LEN
+/**
+ * The number of messages that may be waiting to be
+ * printed for each logical core. Must be a power of 2.
+ */
+#define RTOS_PRINTF_DEFERRED_RING_LEN 8
+#endif
+
+#ifndef RTOS_PRINTF_DEFERRED_BINARY
+/**
+ * Set to 1, along with RTOS_PRINTF_DEFERRED, to send
+ * deferred messages to the host unformatted.
+ */
+#define RTOS_PRINTF_DEFERRED_BINARY 0
+#endif
+
+/**
+ * The ELF section that format strings are placed in
+ * when RTOS_PRINTF_DEFERRED_BINARY is set.
+ */
+#define RTOS_PRINTF_FMT_SECTION ".rtos_printf_fmt"
+
+/**
+ * The maximum number of arguments, following the
+ * format string, of a deferred rtos_printf(). Each
+ * must be 32 bits or less.
+ */
+#define RTOS_PRINTF_DEFERRED_MAX_ARGS 8
+
+/*
+ * The prefixes are part of the pasted tokens rather than macro arguments
+ * since they may themselves be defined as macros.
+ */
+#define RTOS_PRINTF_UNIT_LEVEL_I(UNIT) RTOS_PRINTF_LEVEL_ ## UNIT
+#define RTOS_PRINTF_UNIT_LEVEL_OF(UNIT) RTOS_PRINTF_UNIT_LEVEL_I(UNIT)
+#define RTOS_PRINTF_UNIT_ENABLE_I(UNIT) DEBUG_PRINT_ENABLE_ ## UNIT
+#define RTOS_PRINTF_UNIT_ENABLE_OF(UNIT) RTOS_PRINTF_UNIT_ENABLE_I(UNIT)
+#define RTOS_PRINTF_UNIT_DISABLE_I(UNIT) DEBUG_PRINT_DISABLE_ ## UNIT
+#define RTOS_PRINTF_UNIT_DISABLE_OF(UNIT) RTOS_PRINTF_UNIT_DISABLE_I(UNIT)
+
+/*
+ * Resolve the level for this debug unit once, so that the
+ * level macros below are either a print or nothing at all.
+ */
+#if defined(DEBUG_UNIT) && RTOS_PRINTF_UNIT_LEVEL_OF(DEBUG_UNIT)
+#define RTOS_PRINTF_UNIT_LEVEL RTOS_PRINTF_UNIT_LEVEL_OF(DEBUG_UNIT)
+#else
+#define RTOS_PRINTF_UNIT_LEVEL RTOS_PRINTF_LEVEL
+#endif
+
+/*
+ * Whether this debug unit prints at all. This follows the same
+ * DEBUG_PRINT_ENABLE, DEBUG_PRINT_ENABLE_<DEBUG_UNIT> and
+ * DEBUG_PRINT_DISABLE_<DEBUG_UNIT> rules as xcore_utils_printf().
+ */
+#if defined(DEBUG_UNIT) && RTOS_PRINTF_UNIT_DISABLE_OF(DEBUG_UNIT)
+#define RTOS_PRINTF_UNIT_ENABLED 0
+#elif defined(DEBUG_UNIT) && RTOS_PRINTF_UNIT_ENABLE_OF(DEBUG_UNIT)
+#define RTOS_PRINTF_UNIT_ENABLED 1
+#elif defined(DEBUG_PRINT_ENABLE) && DEBUG_PRINT_ENABLE
+#define RTOS_PRINTF_UNIT_ENABLED 1
+#else
+#define RTOS_PRINTF_UNIT_ENABLED 0
+#endif
+
 /**
  * Just like snprintf, but not all of the
  * standard C format control are supported.
@@ -54,12 +169,152 @@ extern "C" {
 #define rtos_vprintf  xcore_utils_vprintf
 #endif
 
+#if RTOS_PRINTF_DEFERRED && !defined(__XC__)
+
+/*
+ * Evaluates to the number of arguments following the format string,
+ * or fails to compile if there are more than RTOS_PRINTF_DEFERRED_MAX_ARGS.
+ */
+#define RTOS_PRINTF_NARGS_I(_f, _1, _2, _3, _4, _5, _6, _7, _8, _9, N, ...) N
+#define RTOS_PRINTF_NARGS(...) \
+    RTOS_PRINTF_NARGS_I(__VA_ARGS__, rtos_printf_deferred_supports_at_most_8_arguments, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0)
+
+/**
+ * Stores a message to be printed later by rtos_printf_deferred_flush().
+ * This is called by rtos_printf() when RTOS_PRINTF_DEFERRED is set, and
+ * should not normally be called directly.
+ *
+ * It does not block or take any locks, and may be called from an ISR or
+ * from a thread that is not running the RTOS.
+ *
+ * Note: Only the format string pointer and the arguments are stored.
+ * The format string, and any strings printed with %s, must remain valid
+ * until the message has been printed.
+ *
+ * \param nargs The number of arguments following \p fmt.
+ * \param fmt   The format string.
+ *
+ * \returns 0 if the message was stored, or -1 if it was dropped.
+ */
+int rtos_printf_deferred(int nargs, const char *fmt, ...);
+
+/**
+ * Prints all messages stored by deferred rtos_printf() calls on every
+ * core, followed by the number of messages dropped since the last flush,
+ * if any. In binary mode they are sent with the output function instead.
+ *
+ * Note: This must not be called by more than one thread at a time.
+ *
+ * \returns the number of messages printed or sent.
+ */
+unsigned rtos_printf_deferred_flush(void);
+
+#if RTOS_PRINTF_DEFERRED_BINARY
+
+/**
+ * The header of each message sent by rtos_printf_deferred_flush()
+ * in binary mode. It is followed by \c nargs 32-bit arguments. All
+ * fields are sent in little endian byte order.
+ *
+ * A header with a \c fmt of 0 reports dropped messages. It has a
+ * single argument, the number of messages dropped on \c core.
+ *
+ * This must be kept in sync with tools/rtos_printf/rtos_printf_decode.py.
+ */
+typedef struct {
+    uint32_t fmt;       /**< The address of the format string */
+    uint32_t timestamp; /**< The reference time when the message was stored */
+    uint8_t core;       /**< The logical core that stored the message */
+    uint8_t nargs;      /**< The number of arguments that follow */
+    uint8_t reserved[2];
+} rtos_printf_binary_header_t;
+
+/**
+ * Function type that sends binary messages to the host, for
+ * example over xscope or a UART.
+ *
+ * \param data Buffer containing a header and its arguments.
+ * \param len  The number of bytes in \p data.
+ */
+typedef void (*rtos_printf_binary_output_t)(const void *data, size_t len);
+
+/** Function pointer group of rtos_printf_binary_output_t functions */
+#define RTOS_PRINTF_BINARY_OUTPUT_ATTR __attribute__((fptrgroup("rtos_printf_binary_output_fptr_grp")))
+
+/**
+ * Sets the function that rtos_printf_deferred_flush() sends binary
+ * messages with. Until this is set, the flush leaves messages stored.
+ *
+ * \param output The output function.
+ */
+void rtos_printf_binary_output_set(rtos_printf_binary_output_t output);
+
+/*
+ * The format string must be a string literal. It is placed in its own
+ * section so that the host can find every format string in the ELF.
+ */
+#define RTOS_PRINTF_DEFERRED_CALL(fmt, ...) \
+    ({ \
+        static const char rtos_printf_fmt_[] __attribute__((section(RTOS_PRINTF_FMT_SECTION))) = fmt; \
+        rtos_printf_deferred(RTOS_PRINTF_NARGS(fmt, ##__VA_ARGS__), rtos_printf_fmt_, ##__VA_ARGS__); \
+    })
+
+#else
+
+#define RTOS_PRINTF_DEFERRED_CALL(...) rtos_printf_deferred(RTOS_PRINTF_NARGS(__VA_ARGS__), __VA_ARGS__)
+
+#endif /* RTOS_PRINTF_DEFERRED_BINARY */
+
+/**
+ * Just like printf, but not all of the standard C format control are
+ * supported. The message is printed later by rtos_printf_deferred_flush().
+ */
+#if RTOS_PRINTF_UNIT_ENABLED
+#define rtos_printf(...) RTOS_PRINTF_DEFERRED_CALL(__VA_ARGS__)
+#else
+#define rtos_printf(...)
+#endif
+
+#else
+
 /**
  * Just like printf, but not all of the
  * standard C format control are supported.
  */
 #define rtos_printf  xcore_utils_printf
 
+#endif /* RTOS_PRINTF_DEFERRED && !defined(__XC__) */
+
+/**
+ * Just like rtos_printf(), but removed at compile time when
+ * the debug unit's level is below the given level.
+ * @{
+ */
+#if RTOS_PRINTF_UNIT_LEVEL >= RTOS_PRINTF_LEVEL_ERROR
+#define rtos_printf_error(...) rtos_printf(__VA_ARGS__)
+#else
+#define rtos_printf_error(...)
+#endif
+
+#if RTOS_PRINTF_UNIT_LEVEL >= RTOS_PRINTF_LEVEL_WARNING
+#define rtos_printf_warning(...) rtos_printf(__VA_ARGS__)
+#else
+#define rtos_printf_warning(...)
+#endif
+
+#if RTOS_PRINTF_UNIT_LEVEL >= RTOS_PRINTF_LEVEL_INFO
+#define rtos_printf_info(...) rtos_printf(__VA_ARGS__)
+#else
+#define rtos_printf_info(...)
+#endif
+
+#if RTOS_PRINTF_UNIT_LEVEL >= RTOS_PRINTF_LEVEL_DEBUG
+#define rtos_printf_debug(...) rtos_printf(__VA_ARGS__)
+#else
+#define rtos_printf_debug(...)
+#endif
+/**@}*/
+
 #if defined(__cplusplus) || defined(__XC__)
 }
 #endif
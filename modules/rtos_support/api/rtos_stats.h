@@ -0,0 +1,300 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_STATS_H_
+#define RTOS_STATS_H_
+
+/**
+ * \addtogroup rtos_stats rtos_stats
+ *
+ * Lightweight driver instrumentation. Drivers record counters, such as
+ * buffer overruns and queue high-water marks, and latency probes, such as
+ * ISR durations, which may then be queried by the application.
+ *
+ * Each counter and probe holds a separate set of values for every logical
+ * core, so recording never takes a lock. Latencies are measured with the
+ * 100 MHz reference timer.
+ *
+ * Instrumentation is compiled in only when RTOS_STATS_ENABLED is set to 1,
+ * either in rtos_support_rtos_config.h or as a compile definition. Otherwise
+ * the recording macros expand to nothing.
+ * @{
+ */
+
+#include "rtos_support_rtos_config.h"
+
+#ifndef RTOS_STATS_ENABLED
+#define RTOS_STATS_ENABLED 0
+#endif
+
+#if !defined(__XC__)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+
+#include "rtos_cores.h"
+#include "rtos_interrupt.h"
+
+/**
+ * The number of buckets in each probe's latency histogram. Bucket \c n
+ * counts latencies shorter than RTOS_STATS_HISTOGRAM_BOUND(n) reference
+ * clock ticks that do not fall into a lower bucket. The last bucket also
+ * counts all longer latencies.
+ */
+#define RTOS_STATS_HISTOGRAM_BUCKETS 8
+
+/**
+ * The upper bound, in reference clock ticks, of histogram bucket \p n.
+ * This is 2.56 us for bucket 0, increasing by a factor of 4 for each bucket.
+ */
+#define RTOS_STATS_HISTOGRAM_BOUND(n) (1 << (2 * (n) + 8))
+
+/** The maximum length of the name in an rtos_stats_record_t, including the terminator */
+#define RTOS_STATS_RECORD_NAME_LEN 24
+
+/**
+ * How the per-core values of a counter are combined when it is read.
+ */
+typedef enum {
+    RTOS_STATS_COUNTER_TOTAL,      /**< The counter is a count of events. The values are summed. */
+    RTOS_STATS_COUNTER_HIGH_WATER, /**< The counter is a high-water mark. The largest value is reported. */
+} rtos_stats_counter_type_t;
+
+/**
+ * A named counter. Its members should not be accessed directly.
+ */
+typedef struct rtos_stats_counter {
+    const char *name;
+    rtos_stats_counter_type_t type;
+    struct rtos_stats_counter *next;
+    volatile uint32_t value[RTOS_MAX_CORE_COUNT];
+} rtos_stats_counter_t;
+
+/**
+ * The values recorded by a probe on a single logical core.
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[RTOS_STATS_HISTOGRAM_BUCKETS];
+} rtos_stats_probe_core_t;
+
+/**
+ * A named latency probe. Its members should not be accessed directly.
+ */
+typedef struct rtos_stats_probe {
+    const char *name;
+    struct rtos_stats_probe *next;
+    volatile rtos_stats_probe_core_t core[RTOS_MAX_CORE_COUNT];
+} rtos_stats_probe_t;
+
+/**
+ * A probe's values combined across all cores.
+ */
+typedef struct {
+    uint32_t count; /**< The number of latencies recorded */
+    uint32_t min;   /**< The shortest latency in reference clock ticks */
+    uint32_t max;   /**< The longest latency in reference clock ticks */
+    uint64_t total; /**< The sum of all latencies in reference clock ticks */
+    uint32_t histogram[RTOS_STATS_HISTOGRAM_BUCKETS]; /**< See RTOS_STATS_HISTOGRAM_BOUND() */
+} rtos_stats_probe_summary_t;
+
+/**
+ * A fixed size snapshot of a single counter or probe, suitable for returning
+ * to a host as the payload of a device control read command.
+ */
+typedef struct {
+    char name[RTOS_STATS_RECORD_NAME_LEN]; /**< The name it was registered with, truncated if necessary */
+    uint32_t is_probe;                     /**< Non-zero for a probe, zero for a counter */
+    uint32_t count;                        /**< A counter's value, or the number of latencies a probe recorded */
+    uint32_t min;                          /**< A probe's shortest latency in reference clock ticks */
+    uint32_t max;                          /**< A probe's longest latency in reference clock ticks */
+    uint32_t mean;                         /**< A probe's mean latency in reference clock ticks */
+    uint32_t histogram[RTOS_STATS_HISTOGRAM_BUCKETS]; /**< A probe's latency histogram */
+} rtos_stats_record_t;
+
+/**
+ * Registers a counter so that it may be found by the query functions.
+ * The counter's values are cleared. Registering a counter that has already
+ * been registered only clears its values.
+ *
+ * \param counter  The counter to register.
+ * \param name     Its name. This string must remain valid while the counter is registered.
+ * \param type     How its per-core values are combined when it is read.
+ */
+void rtos_stats_counter_register(rtos_stats_counter_t *counter, const char *name, rtos_stats_counter_type_t type);
+
+/**
+ * Registers a probe so that it may be found by the query functions.
+ * The probe's values are cleared. Registering a probe that has already
+ * been registered only clears its values.
+ *
+ * \param probe  The probe to register.
+ * \param name   Its name. This string must remain valid while the probe is registered.
+ */
+void rtos_stats_probe_register(rtos_stats_probe_t *probe, const char *name);
+
+/**
+ * Adds \p n to the calling core's value of a counter.
+ * This may be called from an ISR or from a thread that is not
+ * running the RTOS.
+ */
+inline void rtos_stats_counter_add(rtos_stats_counter_t *counter, uint32_t n)
+{
+    uint32_t mask = rtos_interrupt_mask_all();
+    counter->value[get_logical_core_id()] += n;
+    rtos_interrupt_mask_set(mask);
+}
+
+/**
+ * Raises the calling core's value of a high-water mark counter to \p value
+ * if it is greater. This may be called from an ISR or from a thread that is
+ * not running the RTOS.
+ */
+inline void rtos_stats_counter_high_water(rtos_stats_counter_t *counter, uint32_t value)
+{
+    uint32_t mask = rtos_interrupt_mask_all();
+    const unsigned core_id = get_logical_core_id();
+    if (value > counter->value[core_id]) {
+        counter->value[core_id] = value;
+    }
+    rtos_interrupt_mask_set(mask);
+}
+
+/**
+ * Records a latency of \p ticks reference clock ticks on the calling core.
+ * This may be called from an ISR or from a thread that is not running the
+ * RTOS.
+ */
+inline void rtos_stats_probe_record(rtos_stats_probe_t *probe, uint32_t ticks)
+{
+    int bucket = (31 - __builtin_clz(ticks | 1) - 6) / 2;
+    uint32_t mask;
+    volatile rtos_stats_probe_core_t *core;
+
+    if (bucket < 0) {
+        bucket = 0;
+    } else if (bucket >= RTOS_STATS_HISTOGRAM_BUCKETS) {
+        bucket = RTOS_STATS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    mask = rtos_interrupt_mask_all();
+    core = &probe->core[get_logical_core_id()];
+    if (core->count == 0 || ticks < core->min) {
+        core->min = ticks;
+    }
+    if (ticks > core->max) {
+        core->max = ticks;
+    }
+    core->count++;
+    core->total += ticks;
+    core->histogram[bucket]++;
+    rtos_interrupt_mask_set(mask);
+}
+
+/**
+ * Returns the next registered counter after \p counter, or the first when
+ * \p counter is NULL. Returns NULL when there are no more.
+ */
+rtos_stats_counter_t *rtos_stats_counter_next(rtos_stats_counter_t *counter);
+
+/**
+ * Returns the next registered probe after \p probe, or the first when
+ * \p probe is NULL. Returns NULL when there are no more.
+ */
+rtos_stats_probe_t *rtos_stats_probe_next(rtos_stats_probe_t *probe);
+
+/**
+ * Returns the value of a counter, combined across all cores according
+ * to its type.
+ */
+uint32_t rtos_stats_counter_get(const rtos_stats_counter_t *counter);
+
+/**
+ * Combines a probe's values across all cores.
+ *
+ * Values are read while they may be being updated, so a summary taken
+ * while the probe is active may be very slightly inconsistent.
+ *
+ * \param probe    The probe to read.
+ * \param summary  Filled in with the probe's combined values.
+ */
+void rtos_stats_probe_summary_get(const rtos_stats_probe_t *probe, rtos_stats_probe_summary_t *summary);
+
+/**
+ * Clears the values of every registered counter and probe. Values being
+ * recorded at the same time may be lost.
+ */
+void rtos_stats_reset_all(void);
+
+/**
+ * Fills in a snapshot of a registered counter or probe. All registered
+ * counters are numbered first, in the order they were registered, followed
+ * by all registered probes.
+ *
+ * This allows a device control servicer to return every counter and probe
+ * to a host, one per read command, without knowing in advance what the
+ * drivers have registered.
+ *
+ * \param index   The index of the counter or probe to read.
+ * \param record  Filled in with its name and values.
+ *
+ * \retval 0  on success.
+ * \retval -1 if \p index is not less than the number of registered counters and probes.
+ */
+int rtos_stats_record_get(unsigned index, rtos_stats_record_t *record);
+
+#endif /* !defined(__XC__) */
+
+#if RTOS_STATS_ENABLED
+
+/**
+ * Registers a counter if instrumentation is enabled.
+ */
+#define RTOS_STATS_COUNTER_REGISTER(counter, name, type) rtos_stats_counter_register(&(counter), (name), (type))
+
+/**
+ * Registers a probe if instrumentation is enabled.
+ */
+#define RTOS_STATS_PROBE_REGISTER(probe, name) rtos_stats_probe_register(&(probe), (name))
+
+/**
+ * Adds \p n to a counter if instrumentation is enabled.
+ */
+#define RTOS_STATS_COUNTER_ADD(counter, n) rtos_stats_counter_add(&(counter), (n))
+
+/**
+ * Updates a high-water mark counter if instrumentation is enabled.
+ */
+#define RTOS_STATS_COUNTER_HIGH_WATER(counter, value) rtos_stats_counter_high_water(&(counter), (value))
+
+/**
+ * Declares the variable \p start and sets it to the current reference time
+ * if instrumentation is enabled. Pair with RTOS_STATS_PROBE_END().
+ */
+#define RTOS_STATS_PROBE_START(start) const uint32_t start = get_reference_time()
+
+/**
+ * Records the time since the matching RTOS_STATS_PROBE_START() in \p probe
+ * if instrumentation is enabled.
+ */
+#define RTOS_STATS_PROBE_END(probe, start) rtos_stats_probe_record(&(probe), get_reference_time() - (start))
+
+#else
+
+#define RTOS_STATS_COUNTER_REGISTER(counter, name, type)
+#define RTOS_STATS_PROBE_REGISTER(probe, name)
+#define RTOS_STATS_COUNTER_ADD(counter, n)
+#define RTOS_STATS_COUNTER_HIGH_WATER(counter, value)
+#define RTOS_STATS_PROBE_START(start)
+#define RTOS_STATS_PROBE_END(probe, start)
+
+#endif /* RTOS_STATS_ENABLED */
+
+/**@}*/
+
+#endif /* RTOS_STATS_H_ */
@@ -1,4 +1,4 @@
-// Copyright 2019-2023 XMOS LIMITED.
+// Copyright 2019-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_SUPPORT_H_
@@ -14,6 +14,7 @@
 #include "rtos_time.h"
 #include "rtos_macros.h"
 #include "rtos_printf.h"
+#include "rtos_stats.h"
 
 #ifndef __XC__
 #include "rtos_irq.h"
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef RTOS_TIME_H_
@@ -29,6 +29,18 @@
  */
 #define RTOS_TICK_PERIOD(hz) ((uint32_t)(((uint64_t)1000000 << 12) / (hz)))
 
+/**
+ * The fastest rate, in parts per million, at which rtos_time_adjust()
+ * slews the time.
+ */
+#define RTOS_TIME_SLEW_MAX_PPM 500
+
+/**
+ * The largest frequency correction, in parts per billion, that may be
+ * set with rtos_time_frequency_set().
+ */
+#define RTOS_TIME_FREQUENCY_MAX_PPB 500000
+
 /**
  * Structure representing the time.
  */
@@ -45,7 +57,10 @@ typedef struct {
  * It is intended to be called by a periodic
  * interrupt, either the system tick interrupt
  * or an RTC interrupt, at a frequency of 1 /
- * \p tick_period.
+ * \p tick_period. It must only be called from
+ * a single core, and at least once every 20
+ * seconds for rtos_time_monotonic_ns() to remain
+ * correct.
  *
  * \param[in] tick_period The number of microseconds
  * to increment the current time by. It must be
@@ -56,17 +71,75 @@ void rtos_time_increment(uint32_t tick_period);
 
 /**
  * This function sets the current time to \p new_time.
+ * Any adjustment in progress from rtos_time_adjust() is
+ * cancelled.
  *
  * \param[in] new_time The value to set the current time to.
  *                     See rtos_time_t.
  */
 void rtos_time_set(rtos_time_t new_time);
 
+/**
+ * This function gradually adjusts the current time by
+ * \p offset_ns nanoseconds, by lengthening or shortening
+ * each tick by up to RTOS_TIME_SLEW_MAX_PPM. Unlike
+ * rtos_time_set(), the time never jumps, and never goes
+ * backwards.
+ *
+ * Any adjustment still in progress is replaced by this
+ * one, so \p offset_ns should be the whole of the error
+ * measured against the current time.
+ *
+ * \param[in] offset_ns The number of nanoseconds to add
+ *                      to the current time. May be negative.
+ */
+void rtos_time_adjust(int64_t offset_ns);
+
+/**
+ * This function sets a correction to the rate at which
+ * the time advances, to compensate for the frequency
+ * error of the clock that drives rtos_time_increment().
+ *
+ * \param[in] ppb The number of parts per billion to speed
+ *                up the time by, or slow it down by if
+ *                negative. Limited to
+ *                RTOS_TIME_FREQUENCY_MAX_PPB.
+ */
+void rtos_time_frequency_set(int32_t ppb);
+
+/**
+ * This function returns the frequency correction set by
+ * rtos_time_frequency_set().
+ *
+ * \returns the frequency correction in parts per billion.
+ */
+int32_t rtos_time_frequency_get(void);
+
 /**
  * This function returns the current time.
  *
+ * It does not take any locks and may be called
+ * from any core, including from an ISR. The time
+ * is interpolated between calls to
+ * rtos_time_increment() with the reference timer,
+ * so its resolution is one microsecond.
+ *
  * \returns the current time. See rtos_time_t.
  */
 rtos_time_t rtos_time_get(void);
 
+/**
+ * This function returns the time elapsed since the
+ * tile started, in nanoseconds.
+ *
+ * It is derived from the 100 MHz reference timer, so
+ * it has a resolution of 10 nanoseconds and is not
+ * affected by rtos_time_set(). It does not take any
+ * locks and may be called from any core, including
+ * from an ISR.
+ *
+ * \returns the monotonic time in nanoseconds.
+ */
+uint64_t rtos_time_monotonic_ns(void);
+
 #endif /* RTOS_TIME_H_ */
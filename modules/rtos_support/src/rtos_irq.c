@@ -1,4 +1,4 @@
-// Copyright 2019-2023 XMOS LIMITED.
+// Copyright 2019-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <xcore/triggerable.h>
@@ -25,11 +25,20 @@ static chanend_t rtos_irq_chanend[ RTOS_MAX_CORE_COUNT ];
 static chanend_t peripheral_irq_chanend[ MAX_ADDITIONAL_SOURCES ];
 
 /*
- * Flag set per core indicating which IRQ sources are pending
+ * Flags set per core indicating which IRQ sources are pending. Each
+ * flag is only ever set by its source and cleared by the core it
+ * belongs to, so no lock is needed to update them.
  */
-static volatile uint32_t irq_pending[ RTOS_MAX_CORE_COUNT ];
+static volatile uint8_t irq_pending[ RTOS_MAX_CORE_COUNT ][ MAX_SOURCE_ID + 1 ];
 
-static int peripheral_source_count;
+/*
+ * Set per core while an IRQ token is on its way to it. Only the source
+ * that sets this sends the token, so a core never has more than one
+ * token waiting in its channel end.
+ */
+static volatile uint32_t irq_token_sent[ RTOS_MAX_CORE_COUNT ];
+
+static volatile int peripheral_source_count;
 
 /*
  * The IRQ enabled bitfield. Represents which cores have
@@ -52,51 +61,57 @@ static isr_info_t isr_info[MAX_ADDITIONAL_SOURCES];
 DEFINE_RTOS_INTERRUPT_CALLBACK( rtos_irq_handler, data )
 {
     int core_id;
-    uint32_t pending;
+    int yield = 0;
+    volatile uint8_t *pending;
 
     core_id = rtos_core_id_get();
-
-    xassert( irq_pending[ core_id ] );
+    pending = irq_pending[ core_id ];
 
     chanend_check_end_token( rtos_irq_chanend[ core_id ] );
 
-    /* just ensure the channel read is done before clearing the pending flags. */
+    /* just ensure the channel read is done before clearing the token flag. */
     RTOS_MEMORY_BARRIER();
 
-    /* grab a snapshot of the pending flags before clearing them.
-    After the clear, this core may be interrupted again. We will
-    handle all the interrupts at the time the snapshot is taken now,
-    and any more will be handled when this ISR is called again. */
+    /* Once this is cleared the next source to raise an IRQ on this core
+    will send another token. Any source that raised one before this point
+    has already set its pending flag, so it will be seen below. A source
+    that raises one after may also be handled below, in which case the
+    next call to this ISR may find nothing pending. The flag is cleared
+    under the same lock that sources test and set it with, so a source
+    can not see the old token as still on its way after it has been
+    read. */
+    rtos_support_lock_acquire( RTOS_SUPPORT_LOCK_IRQ );
+    {
+        irq_token_sent[ core_id ] = 0;
+    }
+    rtos_support_lock_release( RTOS_SUPPORT_LOCK_IRQ );
+    RTOS_MEMORY_BARRIER();
 
-    rtos_lock_acquire(0);
+    for ( int source_id = 0; source_id < RTOS_MAX_CORE_COUNT; source_id++ )
     {
-        pending = irq_pending[ core_id ];
-        irq_pending[ core_id ] = 0;
+        if ( pending[ source_id ] )
+        {
+            pending[ source_id ] = 0;
+            yield = 1;
+        }
     }
-    rtos_lock_release(0);
 
-    if (pending & RTOS_CORE_SOURCE_MASK )
+    if ( yield )
     {
         /* This core is being yielded by at least one other RTOS core.
-        Clear the pending flags from all of them and enter the scheduler. */
-
-        pending &= ~RTOS_CORE_SOURCE_MASK;
-
+        Its pending flags have been cleared, so enter the scheduler. */
         RTOS_INTERCORE_INTERRUPT_ISR();
     }
 
-    while ( pending != 0 )
+    for ( int i = 0; i < peripheral_source_count; i++ )
     {
-        int source_id = 31UL - ( uint32_t ) __builtin_clz( pending );
-
-        xassert( source_id >= RTOS_MAX_CORE_COUNT && source_id <= MAX_SOURCE_ID );
-
-        pending &= ~( 1 << source_id );
-
-        source_id -= RTOS_MAX_CORE_COUNT;
-        if ( isr_info[ source_id ].isr != NULL )
+        if ( pending[ RTOS_MAX_CORE_COUNT + i ] )
         {
-            isr_info[ source_id ].isr( isr_info[ source_id ].data );
+            pending[ RTOS_MAX_CORE_COUNT + i ] = 0;
+            if ( isr_info[ i ].isr != NULL )
+            {
+                isr_info[ i ].isr( isr_info[ i ].data );
+            }
         }
     }
 }
@@ -108,52 +123,66 @@ DEFINE_RTOS_INTERRUPT_CALLBACK( rtos_irq_handler, data )
 void rtos_irq( int core_id, int source_id )
 {
     chanend_t source_chanend;
-    uint32_t pending;
+    uint32_t mask;
+    int send;
     int num_cores = rtos_core_count();
 
     xassert( core_id >= 0 && core_id < num_cores );
     xassert( source_id >= 0 && source_id < RTOS_MAX_CORE_COUNT + peripheral_source_count );
 
+    if( source_id >= 0 && source_id < num_cores )
+    {
+        source_chanend = rtos_irq_chanend[ source_id ];
+    }
+    else if ( source_id >= RTOS_MAX_CORE_COUNT && source_id < RTOS_MAX_CORE_COUNT + peripheral_source_count )
+    {
+        source_chanend = peripheral_irq_chanend[ source_id - RTOS_MAX_CORE_COUNT ];
+    }
+    else
+    {
+        xassert(0);
+        /* If assertions are disabled, setting this to 0
+         * here should cause a resource exception below. */
+        source_chanend = 0;
+    }
+
     /*
-     * Atomically set the pending flag and, if the core we are
-     * sending an IRQ does not already have a pending IRQ, interrupt
-     * it with a channel send. This guarantees that if two cores
-     * simultaneously send a core an IRQ that only one will perform
-     * the channel send. Another channel send will not be performed
-     * until the core reads the token from the channel and clears the
-     * pending flags.
+     * Interrupts are masked so that an ISR on this core cannot use this
+     * source's channel end, or deadlock on the IRQ lock.
      */
-    rtos_lock_acquire(0);
-    {
-        pending = irq_pending[ core_id ];
-        irq_pending[ core_id ] |= ( 1 << source_id );
+    mask = rtos_interrupt_mask_all();
 
-        if( pending == 0 )
-        {
-            if( source_id >= 0 && source_id < num_cores )
-            {
-                source_chanend = rtos_irq_chanend[ source_id ];
-            }
-            else if ( source_id >= RTOS_MAX_CORE_COUNT && source_id < RTOS_MAX_CORE_COUNT + peripheral_source_count )
-            {
-                source_chanend = peripheral_irq_chanend[ source_id - RTOS_MAX_CORE_COUNT ];
-            }
-            else
-            {
-                xassert(0);
-                /* If assertions are disabled, setting this to 0
-                 * here should cause a resource exception below. */
-                source_chanend = 0;
-            }
+    irq_pending[ core_id ][ source_id ] = 1;
 
-            /* just ensure the pending flag is set before the channel send. */
-            RTOS_MEMORY_BARRIER();
+    /* just ensure the pending flag is set before checking for a token. */
+    RTOS_MEMORY_BARRIER();
 
-            chanend_set_dest( source_chanend, rtos_irq_chanend[ core_id ] );
-            chanend_out_end_token( source_chanend );
+    /*
+     * If the core we are sending an IRQ to does not already have a
+     * token on its way, claim the right to send one. This guarantees
+     * that if two sources simultaneously send a core an IRQ that only
+     * one will perform the channel send. Another channel send will not
+     * be performed until the core reads the token from the channel and
+     * clears irq_token_sent. Only this test and set, and the clear, need
+     * the lock, and it is separate from the RTOS's locks.
+     */
+    rtos_support_lock_acquire( RTOS_SUPPORT_LOCK_IRQ );
+    {
+        send = !irq_token_sent[ core_id ];
+        if( send )
+        {
+            irq_token_sent[ core_id ] = 1;
         }
     }
-    rtos_lock_release(0);
+    rtos_support_lock_release( RTOS_SUPPORT_LOCK_IRQ );
+
+    if( send )
+    {
+        chanend_set_dest( source_chanend, rtos_irq_chanend[ core_id ] );
+        chanend_out_end_token( source_chanend );
+    }
+
+    rtos_interrupt_mask_set( mask );
 }
 
 
@@ -176,29 +205,38 @@ int rtos_irq_register(rtos_irq_isr_t isr, void *data, chanend_t source_chanend)
 {
     int source_id;
 
-    xassert( peripheral_source_count < MAX_ADDITIONAL_SOURCES );
+    uint32_t mask;
 
-    rtos_lock_acquire(0);
-    source_id = peripheral_source_count++;
-    rtos_lock_release(0);
+    xassert( peripheral_source_count < MAX_ADDITIONAL_SOURCES );
 
+    mask = rtos_interrupt_mask_all();
+    rtos_support_lock_acquire( RTOS_SUPPORT_LOCK_IRQ );
+    source_id = peripheral_source_count;
     isr_info[ source_id ].isr = isr;
     isr_info[ source_id ].data = data;
     peripheral_irq_chanend[ source_id ] = source_chanend;
 
+    /* The handler may look at this source as soon as the count includes it */
+    RTOS_MEMORY_BARRIER();
+    peripheral_source_count++;
+    rtos_support_lock_release( RTOS_SUPPORT_LOCK_IRQ );
+    rtos_interrupt_mask_set( mask );
+
     return RTOS_MAX_CORE_COUNT + source_id;
 }
 
 void rtos_irq_enable( int total_rtos_cores )
 {
     int core_id;
+    uint32_t mask;
 
     core_id = rtos_core_id_get();
     rtos_irq_chanend[ core_id ] = chanend_alloc();
     triggerable_setup_interrupt_callback( rtos_irq_chanend[ core_id ], NULL, RTOS_INTERRUPT_CALLBACK( rtos_irq_handler ) );
     triggerable_enable_trigger( rtos_irq_chanend[ core_id ] );
 
-    rtos_lock_acquire(0);
+    mask = rtos_interrupt_mask_all();
+    rtos_support_lock_acquire( RTOS_SUPPORT_LOCK_IRQ );
     {
         irq_enable_bf |= (1 << core_id);
 
@@ -206,7 +244,8 @@ void rtos_irq_enable( int total_rtos_cores )
             irq_ready = 1;
         }
     }
-    rtos_lock_release(0);
+    rtos_support_lock_release( RTOS_SUPPORT_LOCK_IRQ );
+    rtos_interrupt_mask_set( mask );
 }
 
 int rtos_irq_ready(void)
@@ -1,4 +1,4 @@
-// Copyright 2019-2023 XMOS LIMITED.
+// Copyright 2019-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include "rtos_support.h"
@@ -20,6 +20,9 @@ lock_t rtos_locks[RTOS_LOCK_COUNT] = {
 
 int rtos_lock_counters[RTOS_LOCK_COUNT] = {0};
 
+/* Zero when not allocated, in which case RTOS lock 0 is used instead */
+lock_t rtos_support_locks[RTOS_SUPPORT_LOCK_COUNT] = {0};
+
 void rtos_locks_initialize(void)
 {
     int i;
@@ -28,6 +31,13 @@ void rtos_locks_initialize(void)
         rtos_locks[i] = lock_alloc();
         xassert(rtos_locks[i] != 0);
     }
+
+#if RTOS_SUPPORT_DEDICATED_LOCKS
+    for (i = 0; i < RTOS_SUPPORT_LOCK_COUNT; i++) {
+        /* Not fatal if this fails; rtos_support falls back to lock 0 */
+        rtos_support_locks[i] = lock_alloc();
+    }
+#endif
 }
 
 /*
@@ -36,3 +46,5 @@ void rtos_locks_initialize(void)
  */
 extern inline int rtos_lock_acquire(int lock_id);
 extern inline int rtos_lock_release(int lock_id);
+extern inline void rtos_support_lock_acquire(int lock_id);
+extern inline void rtos_support_lock_release(int lock_id);
@@ -0,0 +1,170 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+/*
+ * Messages are filtered when they are stored, so those
+ * that reach the flush must always be printed.
+ */
+#define DEBUG_UNIT RTOS_PRINTF_DEFERRED_FLUSH
+#define DEBUG_PRINT_ENABLE_RTOS_PRINTF_DEFERRED_FLUSH 1
+
+#include <string.h>
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+
+#include "rtos_support.h"
+
+#if RTOS_PRINTF_DEFERRED
+
+#if (RTOS_PRINTF_DEFERRED_RING_LEN & (RTOS_PRINTF_DEFERRED_RING_LEN - 1)) != 0
+#error RTOS_PRINTF_DEFERRED_RING_LEN must be a power of 2
+#endif
+
+#define RING_INDEX(i) ((i) & (RTOS_PRINTF_DEFERRED_RING_LEN - 1))
+
+typedef struct {
+    const char *fmt;
+#if RTOS_PRINTF_DEFERRED_BINARY
+    uint32_t timestamp;
+    uint32_t nargs;
+#endif
+    uint32_t args[RTOS_PRINTF_DEFERRED_MAX_ARGS];
+} deferred_msg_t;
+
+/*
+ * Each logical core only ever writes to its own ring, with interrupts
+ * masked, and only the flush advances the tail. So no lock is needed
+ * between the cores storing messages and the thread printing them.
+ */
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;
+    uint32_t dropped_reported;
+    deferred_msg_t msgs[RTOS_PRINTF_DEFERRED_RING_LEN];
+} deferred_ring_t;
+
+static deferred_ring_t deferred_rings[RTOS_MAX_CORE_COUNT];
+
+#if RTOS_PRINTF_DEFERRED_BINARY
+static RTOS_PRINTF_BINARY_OUTPUT_ATTR rtos_printf_binary_output_t binary_output;
+
+void rtos_printf_binary_output_set(rtos_printf_binary_output_t output)
+{
+    binary_output = output;
+}
+
+static void binary_send(const char *fmt, uint32_t timestamp, int core, int nargs, const uint32_t *args)
+{
+    struct {
+        rtos_printf_binary_header_t header;
+        uint32_t args[RTOS_PRINTF_DEFERRED_MAX_ARGS];
+    } msg;
+
+    msg.header.fmt = (uint32_t) (uintptr_t) fmt;
+    msg.header.timestamp = timestamp;
+    msg.header.core = core;
+    msg.header.nargs = nargs;
+    msg.header.reserved[0] = 0;
+    msg.header.reserved[1] = 0;
+    memcpy(msg.args, args, nargs * sizeof(uint32_t));
+
+    binary_output(&msg, sizeof(msg.header) + nargs * sizeof(uint32_t));
+}
+#endif
+
+int rtos_printf_deferred(int nargs, const char *fmt, ...)
+{
+    deferred_ring_t *ring;
+    deferred_msg_t *msg;
+    uint32_t head;
+    uint32_t mask;
+    va_list ap;
+
+    mask = rtos_interrupt_mask_all();
+    ring = &deferred_rings[get_logical_core_id()];
+    head = ring->head;
+
+    if (head - ring->tail >= RTOS_PRINTF_DEFERRED_RING_LEN) {
+        ring->dropped++;
+        rtos_interrupt_mask_set(mask);
+        return -1;
+    }
+
+    msg = &ring->msgs[RING_INDEX(head)];
+    msg->fmt = fmt;
+#if RTOS_PRINTF_DEFERRED_BINARY
+    msg->timestamp = get_reference_time();
+    msg->nargs = nargs;
+#endif
+    va_start(ap, fmt);
+    for (int i = 0; i < nargs; i++) {
+        msg->args[i] = va_arg(ap, uint32_t);
+    }
+    va_end(ap);
+
+    /* The message must be complete before the flush can see it */
+    RTOS_MEMORY_BARRIER();
+    ring->head = head + 1;
+
+    rtos_interrupt_mask_set(mask);
+    return 0;
+}
+
+unsigned rtos_printf_deferred_flush(void)
+{
+    unsigned count = 0;
+
+#if RTOS_PRINTF_DEFERRED_BINARY
+    if (binary_output == NULL) {
+        return 0;
+    }
+#endif
+
+    for (int i = 0; i < RTOS_MAX_CORE_COUNT; i++) {
+        deferred_ring_t *ring = &deferred_rings[i];
+        uint32_t tail = ring->tail;
+        const uint32_t head = ring->head;
+        uint32_t dropped;
+
+        RTOS_MEMORY_BARRIER();
+
+        while (tail != head) {
+            const deferred_msg_t *msg = &ring->msgs[RING_INDEX(tail)];
+
+#if RTOS_PRINTF_DEFERRED_BINARY
+            binary_send(msg->fmt, msg->timestamp, i, msg->nargs, msg->args);
+#else
+            /*
+             * Unused arguments are passed too. Every argument is a
+             * 32-bit word, so the format string consumes the right ones.
+             */
+            xcore_utils_printf(msg->fmt,
+                               msg->args[0], msg->args[1], msg->args[2], msg->args[3],
+                               msg->args[4], msg->args[5], msg->args[6], msg->args[7]);
+#endif
+
+            tail++;
+            count++;
+
+            /* The message must be printed before the core may overwrite it */
+            RTOS_MEMORY_BARRIER();
+            ring->tail = tail;
+        }
+
+        dropped = ring->dropped;
+        if (dropped != ring->dropped_reported) {
+#if RTOS_PRINTF_DEFERRED_BINARY
+            const uint32_t count_dropped = dropped - ring->dropped_reported;
+            binary_send(NULL, get_reference_time(), i, 1, &count_dropped);
+#else
+            xcore_utils_printf("rtos_printf: %u messages dropped on core %d\n", dropped - ring->dropped_reported, i);
+#endif
+            ring->dropped_reported = dropped;
+        }
+    }
+
+    return count;
+}
+
+#endif /* RTOS_PRINTF_DEFERRED */
@@ -0,0 +1,171 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <string.h>
+
+#include "rtos_support.h"
+#include "rtos_stats.h"
+
+static rtos_stats_counter_t *counter_list;
+static rtos_stats_probe_t *probe_list;
+
+/*
+ * Registration is rare, so the lists are simply protected by RTOS lock 0
+ * with interrupts masked. Readers walk the lists without it. New entries
+ * are fully initialized before they are linked in at the end.
+ */
+static uint32_t list_lock(void)
+{
+    uint32_t mask = rtos_interrupt_mask_all();
+    rtos_lock_acquire(0);
+    return mask;
+}
+
+static void list_unlock(uint32_t mask)
+{
+    rtos_lock_release(0);
+    rtos_interrupt_mask_set(mask);
+}
+
+void rtos_stats_counter_register(rtos_stats_counter_t *counter, const char *name, rtos_stats_counter_type_t type)
+{
+    rtos_stats_counter_t **tail;
+    uint32_t mask;
+
+    mask = list_lock();
+    for (tail = &counter_list; *tail != NULL && *tail != counter; tail = &(*tail)->next);
+    memset((void *) counter->value, 0, sizeof(counter->value));
+    if (*tail == NULL) {
+        counter->name = name;
+        counter->type = type;
+        counter->next = NULL;
+        RTOS_MEMORY_BARRIER();
+        *tail = counter;
+    }
+    list_unlock(mask);
+}
+
+void rtos_stats_probe_register(rtos_stats_probe_t *probe, const char *name)
+{
+    rtos_stats_probe_t **tail;
+    uint32_t mask;
+
+    mask = list_lock();
+    for (tail = &probe_list; *tail != NULL && *tail != probe; tail = &(*tail)->next);
+    memset((void *) probe->core, 0, sizeof(probe->core));
+    if (*tail == NULL) {
+        probe->name = name;
+        probe->next = NULL;
+        RTOS_MEMORY_BARRIER();
+        *tail = probe;
+    }
+    list_unlock(mask);
+}
+
+rtos_stats_counter_t *rtos_stats_counter_next(rtos_stats_counter_t *counter)
+{
+    return counter == NULL ? counter_list : counter->next;
+}
+
+rtos_stats_probe_t *rtos_stats_probe_next(rtos_stats_probe_t *probe)
+{
+    return probe == NULL ? probe_list : probe->next;
+}
+
+uint32_t rtos_stats_counter_get(const rtos_stats_counter_t *counter)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < RTOS_MAX_CORE_COUNT; i++) {
+        if (counter->type == RTOS_STATS_COUNTER_HIGH_WATER) {
+            if (counter->value[i] > value) {
+                value = counter->value[i];
+            }
+        } else {
+            value += counter->value[i];
+        }
+    }
+
+    return value;
+}
+
+void rtos_stats_probe_summary_get(const rtos_stats_probe_t *probe, rtos_stats_probe_summary_t *summary)
+{
+    memset(summary, 0, sizeof(rtos_stats_probe_summary_t));
+
+    for (int i = 0; i < RTOS_MAX_CORE_COUNT; i++) {
+        volatile const rtos_stats_probe_core_t *core = &probe->core[i];
+        const uint32_t count = core->count;
+
+        if (count == 0) {
+            continue;
+        }
+        if (summary->count == 0 || core->min < summary->min) {
+            summary->min = core->min;
+        }
+        if (core->max > summary->max) {
+            summary->max = core->max;
+        }
+        summary->count += count;
+        summary->total += core->total;
+        for (int j = 0; j < RTOS_STATS_HISTOGRAM_BUCKETS; j++) {
+            summary->histogram[j] += core->histogram[j];
+        }
+    }
+}
+
+void rtos_stats_reset_all(void)
+{
+    for (rtos_stats_counter_t *counter = counter_list; counter != NULL; counter = counter->next) {
+        memset((void *) counter->value, 0, sizeof(counter->value));
+    }
+    for (rtos_stats_probe_t *probe = probe_list; probe != NULL; probe = probe->next) {
+        memset((void *) probe->core, 0, sizeof(probe->core));
+    }
+}
+
+int rtos_stats_record_get(unsigned index, rtos_stats_record_t *record)
+{
+    rtos_stats_counter_t *counter = counter_list;
+    rtos_stats_probe_t *probe = probe_list;
+
+    memset(record, 0, sizeof(rtos_stats_record_t));
+
+    while (counter != NULL && index > 0) {
+        counter = counter->next;
+        index--;
+    }
+    if (counter != NULL) {
+        strncpy(record->name, counter->name, RTOS_STATS_RECORD_NAME_LEN - 1);
+        record->count = rtos_stats_counter_get(counter);
+        return 0;
+    }
+
+    while (probe != NULL && index > 0) {
+        probe = probe->next;
+        index--;
+    }
+    if (probe != NULL) {
+        rtos_stats_probe_summary_t summary;
+
+        rtos_stats_probe_summary_get(probe, &summary);
+        strncpy(record->name, probe->name, RTOS_STATS_RECORD_NAME_LEN - 1);
+        record->is_probe = 1;
+        record->count = summary.count;
+        record->min = summary.min;
+        record->max = summary.max;
+        record->mean = summary.count > 0 ? (uint32_t) (summary.total / summary.count) : 0;
+        memcpy(record->histogram, summary.histogram, sizeof(record->histogram));
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * Ensure that these normally inline functions exist
+ * when compiler optimizations are disabled.
+ */
+extern inline void rtos_stats_counter_add(rtos_stats_counter_t *counter, uint32_t n);
+extern inline void rtos_stats_counter_high_water(rtos_stats_counter_t *counter, uint32_t value);
+extern inline void rtos_stats_probe_record(rtos_stats_probe_t *probe, uint32_t ticks);
@@ -1,49 +1,325 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
+#include <xcore/hwtimer.h>
+
 #include "rtos_time.h"
 #include "rtos_locks.h"
-
-static rtos_time_t current_time;
+#include "rtos_interrupt.h"
+#include "rtos_macros.h"
 
 #define US_FRACTIONAL_BITS 12
-#define ONE_SECOND_US (1000000 << US_FRACTIONAL_BITS)
+#define ONE_SECOND_US ((uint32_t) 1000000 << US_FRACTIONAL_BITS)
+
+#define NS_PER_REF_TICK 10
+
+/*
+ * A time with its microseconds in Q12 format.
+ */
+typedef struct {
+    uint64_t seconds;
+    uint32_t microseconds;
+} q12_time_t;
+
+/*
+ * The time is kept as the uptime accumulated by rtos_time_increment() plus
+ * an offset set by rtos_time_set(), so that the two never write the same
+ * variables.
+ *
+ * Each part is published with a sequence count. A writer makes the count
+ * odd before it updates its part and even again afterwards. A reader
+ * retries if the count was odd or changed while it was reading. Readers
+ * therefore never take a lock, and the only cost of contending with a
+ * writer is a retry.
+ *
+ * rtos_time_increment() is only ever called by a single core's tick ISR,
+ * so the uptime has a single writer. Writers mask interrupts so that a
+ * reader on the same core can never interrupt them and spin forever.
+ */
+static volatile uint32_t uptime_seq;
+static volatile q12_time_t uptime;
+static volatile uint64_t uptime_ref_time; /* The reference time, extended to 64 bits, at the last tick */
+static volatile uint32_t uptime_interp_max; /* The most that may be interpolated past the last tick */
+
+static volatile uint32_t offset_seq;
+static volatile q12_time_t offset;
+
+/*
+ * Adjustments requested by rtos_time_adjust(), published with a sequence
+ * count as above, and a request count so that the tick ISR can tell when
+ * there is a new one. Only the tick ISR uses the slew in progress and the
+ * frequency correction remainder.
+ */
+static volatile uint32_t adjust_seq;
+static volatile uint32_t adjust_request;
+static volatile int64_t adjust_offset; /* Q12 microseconds */
+static volatile int32_t frequency_ppb;
+
+static uint32_t adjust_applied;
+static int64_t slew_remaining; /* Q12 microseconds */
+static int64_t frequency_remainder;
+
+/*
+ * Adds microseconds to a time. ONE_SECOND_US only just fits in 32 bits,
+ * so the sum is formed in 64 bits before it is normalized. Every caller
+ * adds less than a second or two, so this avoids a 64-bit division.
+ */
+static void q12_time_add_us(q12_time_t *a, uint64_t microseconds)
+{
+    microseconds += a->microseconds;
+    while (microseconds >= ONE_SECOND_US) {
+        microseconds -= ONE_SECOND_US;
+        a->seconds++;
+    }
+    a->microseconds = microseconds;
+}
+
+static void q12_time_add(q12_time_t *a, const q12_time_t *b)
+{
+    a->seconds += b->seconds;
+    q12_time_add_us(a, b->microseconds);
+}
+
+static void q12_time_sub(q12_time_t *a, const q12_time_t *b)
+{
+    a->seconds -= b->seconds;
+    if (a->microseconds < b->microseconds) {
+        a->microseconds += ONE_SECOND_US;
+        a->seconds--;
+    }
+    a->microseconds -= b->microseconds;
+}
+
+static void uptime_get(q12_time_t *t)
+{
+    uint32_t seq;
+
+    do {
+        seq = uptime_seq;
+        RTOS_MEMORY_BARRIER();
+        t->seconds = uptime.seconds;
+        t->microseconds = uptime.microseconds;
+        RTOS_MEMORY_BARRIER();
+    } while ((seq & 1) || seq != uptime_seq);
+}
+
+/*
+ * Returns the length of this tick, which is tick_period adjusted for
+ * the frequency correction and any slew in progress.
+ */
+static uint32_t adjusted_tick_period(uint32_t tick_period)
+{
+    const int64_t max_slew = (int64_t) tick_period * RTOS_TIME_SLEW_MAX_PPM / 1000000;
+    int64_t step = tick_period;
+    int64_t correction;
+
+    if (adjust_request != adjust_applied) {
+        uint32_t seq;
+        do {
+            seq = adjust_seq;
+            RTOS_MEMORY_BARRIER();
+            adjust_applied = adjust_request;
+            slew_remaining = adjust_offset;
+            RTOS_MEMORY_BARRIER();
+        } while ((seq & 1) || seq != adjust_seq);
+    }
+
+    frequency_remainder += (int64_t) tick_period * frequency_ppb;
+    correction = frequency_remainder / 1000000000;
+    frequency_remainder -= correction * 1000000000;
+    step += correction;
+
+    if (slew_remaining != 0) {
+        correction = slew_remaining;
+        if (correction > max_slew) {
+            correction = max_slew;
+        } else if (correction < -max_slew) {
+            correction = -max_slew;
+        }
+        slew_remaining -= correction;
+        step += correction;
+    }
+
+    return step;
+}
 
 void rtos_time_increment(uint32_t tick_period)
 {
-    rtos_lock_acquire(0);
+    uint32_t mask = rtos_interrupt_mask_all();
+    const uint64_t last_ref_time = uptime_ref_time;
+    const uint32_t now = get_reference_time();
+    const uint32_t step = adjusted_tick_period(tick_period);
+
+    uptime_seq++;
+    RTOS_MEMORY_BARRIER();
     {
-        current_time.microseconds += tick_period;
-        if (current_time.microseconds >= ONE_SECOND_US) {
-            current_time.microseconds -= ONE_SECOND_US;
-            current_time.seconds++;
-        }
+        q12_time_t t = {uptime.seconds, uptime.microseconds};
+
+        q12_time_add_us(&t, step);
+        uptime.seconds = t.seconds;
+        uptime.microseconds = t.microseconds;
+        uptime_ref_time = last_ref_time + (uint32_t) (now - (uint32_t) last_ref_time);
+        /*
+         * The next tick is never shorter than this, as the frequency
+         * correction and the slew are each limited to 500 ppm.
+         */
+        uptime_interp_max = tick_period - (tick_period >> 9);
     }
-    rtos_lock_release(0);
+    RTOS_MEMORY_BARRIER();
+    uptime_seq++;
+
+    rtos_interrupt_mask_set(mask);
 }
 
 void rtos_time_set(rtos_time_t new_time)
 {
-    new_time.microseconds <<= US_FRACTIONAL_BITS;
+    q12_time_t new_offset;
+    q12_time_t now;
+    uint32_t mask;
 
+    new_offset.seconds = new_time.seconds;
+    new_offset.microseconds = new_time.microseconds << US_FRACTIONAL_BITS;
+
+    /*
+     * Setting the time is rare, so concurrent setters are simply
+     * serialized with RTOS lock 0.
+     */
+    mask = rtos_interrupt_mask_all();
     rtos_lock_acquire(0);
     {
-        current_time = new_time;
+        uptime_get(&now);
+        q12_time_sub(&new_offset, &now);
+
+        offset_seq++;
+        RTOS_MEMORY_BARRIER();
+        offset.seconds = new_offset.seconds;
+        offset.microseconds = new_offset.microseconds;
+        RTOS_MEMORY_BARRIER();
+        offset_seq++;
+
+        /* Any slew in progress no longer applies */
+        adjust_seq++;
+        RTOS_MEMORY_BARRIER();
+        adjust_offset = 0;
+        adjust_request++;
+        RTOS_MEMORY_BARRIER();
+        adjust_seq++;
     }
     rtos_lock_release(0);
+    rtos_interrupt_mask_set(mask);
 }
 
-rtos_time_t rtos_time_get(void)
+void rtos_time_adjust(int64_t offset_ns)
 {
-    rtos_time_t tmp_time;
+    uint32_t mask;
 
+    mask = rtos_interrupt_mask_all();
     rtos_lock_acquire(0);
     {
-        tmp_time = current_time;
+        adjust_seq++;
+        RTOS_MEMORY_BARRIER();
+        adjust_offset = offset_ns * (1 << US_FRACTIONAL_BITS) / 1000;
+        adjust_request++;
+        RTOS_MEMORY_BARRIER();
+        adjust_seq++;
     }
     rtos_lock_release(0);
+    rtos_interrupt_mask_set(mask);
+}
+
+void rtos_time_frequency_set(int32_t ppb)
+{
+    if (ppb > RTOS_TIME_FREQUENCY_MAX_PPB) {
+        ppb = RTOS_TIME_FREQUENCY_MAX_PPB;
+    } else if (ppb < -RTOS_TIME_FREQUENCY_MAX_PPB) {
+        ppb = -RTOS_TIME_FREQUENCY_MAX_PPB;
+    }
+
+    /* A single word, so the tick ISR always reads it whole */
+    frequency_ppb = ppb;
+}
+
+int32_t rtos_time_frequency_get(void)
+{
+    return frequency_ppb;
+}
+
+/*
+ * Gets the uptime, interpolated with the reference timer since the last
+ * tick. The interpolation is limited so that it never reaches the time
+ * of the next tick, so the time never goes backwards.
+ */
+static void uptime_get_interpolated(q12_time_t *t)
+{
+    uint32_t seq;
+    uint32_t ref_time;
+    uint32_t now;
+    uint32_t interp_max;
+    uint64_t interp;
+
+    do {
+        seq = uptime_seq;
+        RTOS_MEMORY_BARRIER();
+        t->seconds = uptime.seconds;
+        t->microseconds = uptime.microseconds;
+        ref_time = (uint32_t) uptime_ref_time;
+        interp_max = uptime_interp_max;
+        now = get_reference_time();
+        RTOS_MEMORY_BARRIER();
+    } while ((seq & 1) || seq != uptime_seq);
+
+    /* Reference timer ticks are 10 ns, so there are 100 per microsecond */
+    interp = ((uint64_t) (now - ref_time) << US_FRACTIONAL_BITS) / 100;
+    if (interp > interp_max) {
+        interp = interp_max;
+    }
+
+    q12_time_add_us(t, interp);
+}
+
+rtos_time_t rtos_time_get(void)
+{
+    q12_time_t t;
+    q12_time_t t_offset;
+    rtos_time_t tmp_time;
+    uint32_t seq;
+
+    do {
+        seq = offset_seq;
+        RTOS_MEMORY_BARRIER();
+        t_offset.seconds = offset.seconds;
+        t_offset.microseconds = offset.microseconds;
+        uptime_get_interpolated(&t);
+        RTOS_MEMORY_BARRIER();
+    } while ((seq & 1) || seq != offset_seq);
+
+    q12_time_add(&t, &t_offset);
 
-    tmp_time.microseconds >>= US_FRACTIONAL_BITS;
+    tmp_time.seconds = t.seconds;
+    tmp_time.microseconds = t.microseconds >> US_FRACTIONAL_BITS;
 
     return tmp_time;
 }
+
+uint64_t rtos_time_monotonic_ns(void)
+{
+    uint64_t ref_time;
+    uint32_t now;
+    uint32_t seq;
+
+    /*
+     * The reference time must be read after the last tick's reference
+     * time, or the difference between them would be negative.
+     */
+    do {
+        seq = uptime_seq;
+        RTOS_MEMORY_BARRIER();
+        ref_time = uptime_ref_time;
+        now = get_reference_time();
+        RTOS_MEMORY_BARRIER();
+    } while ((seq & 1) || seq != uptime_seq);
+
+    ref_time += (uint32_t) (now - (uint32_t) ref_time);
+
+    return ref_time * NS_PER_REF_TICK;
+}
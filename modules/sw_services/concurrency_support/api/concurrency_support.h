@@ -1,9 +1,11 @@
-// Copyright 2022-2023 XMOS LIMITED.
+// Copyright 2022-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef CONCURRENCY_SUPPORT_H_
 #define CONCURRENCY_SUPPORT_H_
 
 #include "mrsw_lock.h"
+#include "seqlock.h"
+#include "rcu_publish.h"
 
 #endif /* CONCURRENCY_SUPPORT_H_ */
@@ -1,4 +1,4 @@
-// Copyright 2022-2023 XMOS LIMITED.
+// Copyright 2022-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef MRSW_LOCK_H_
@@ -22,40 +22,25 @@ typedef enum {
 } mrsw_lock_type_t;
 
 #include "rtos_osal.h"
+#include "rtos_cores.h"
 
 /**
  * Struct representing an MRSW instance.
  *
+ * Readers are counted per core so that acquiring and releasing a read lock
+ * only needs to update a counter belonging to the calling core, with
+ * interrupts briefly masked. No kernel object is used unless a writer holds,
+ * or is waiting for, the lock.
+ *
  * The members in this struct should not be accessed directly.
  */
 typedef struct mrsw_lock {
-    void* lock_setup;
+    volatile int32_t readers_active[RTOS_MAX_CORE_COUNT];
+    volatile uint32_t writer_state;
     mrsw_lock_type_t type;
-} mrsw_lock_t;
-
-/**
- * Struct representing an reader preferred MRSW
- *
- * The members in this struct should not be accessed directly.
- */
-typedef struct read_pref_mrsw_lock {
-    rtos_osal_semaphore_t lock_global;
-    rtos_osal_mutex_t lock_readers;
-    uint32_t num_readers_active;
-} read_pref_mrsw_lock_t;
-
-/**
- * Struct representing an writer preferred MRSW
- *
- * The members in this struct should not be accessed directly.
- */
-typedef struct write_pref_mrsw_lock {
     rtos_osal_mutex_t lock_global;
     rtos_osal_event_group_t cond;
-    uint32_t num_readers_active;
-    uint32_t num_writers_waiting;
-    uint32_t writer_active;
-} write_pref_mrsw_lock_t;
+} mrsw_lock_t;
 
 /**
  * Create a MRSW lock
@@ -0,0 +1,147 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RCU_PUBLISH_H_
+#define RCU_PUBLISH_H_
+
+/**
+ * \addtogroup rcu_publish rcu_publish
+ *
+ * The public API for using the RCU style publish object.
+ *
+ * A publish object holds two copies of a block of data, such as a set of
+ * filter coefficients. Readers acquire a pointer to the most recently
+ * published copy and may use it for as long as they need, without ever
+ * waiting on a writer or using a kernel object. A writer fills in the other
+ * copy and then publishes it. Before a copy may be written again, the writer
+ * waits for a grace period to end, which is once every reader that acquired
+ * it on any core has released it.
+ *
+ * Example reader:
+ * \code
+ * unsigned token;
+ * const coeffs_t *coeffs = rcu_publish_acquire(&ctx, &token);
+ * process(coeffs);
+ * rcu_publish_release(&ctx, token);
+ * \endcode
+ *
+ * Example writer:
+ * \code
+ * coeffs_t *coeffs = rcu_publish_write_begin(&ctx, RTOS_OSAL_WAIT_FOREVER);
+ * if (coeffs != NULL) {
+ *     coeffs->gain = new_gain;
+ *     rcu_publish_write_end(&ctx);
+ * }
+ * \endcode
+ *
+ * @{
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rtos_osal.h"
+#include "rtos_cores.h"
+
+/**
+ * Struct representing an RCU style publish object.
+ *
+ * The members in this struct should not be accessed directly.
+ */
+typedef struct rcu_publish {
+    void *buf[2];
+    size_t size;
+    volatile uint32_t current;
+    volatile int32_t readers_active[2][RTOS_MAX_CORE_COUNT];
+} rcu_publish_t;
+
+/**
+ * Create a publish object.
+ *
+ * \param ctx     A pointer to an uninitialized publish object context.
+ * \param size    The size in bytes of the data held by the publish object.
+ * \param initial A pointer to the initial data to publish. May be NULL, in
+ *                which case the initial data is zeroed.
+ *
+ * \returns       RTOS_OSAL_SUCCESS on success
+ *                RTOS_OSAL_ERROR otherwise
+ */
+rtos_osal_status_t rcu_publish_create(rcu_publish_t *ctx, size_t size, const void *initial);
+
+/**
+ * Destroy a publish object.
+ *
+ * Note: This does not check if there are any active readers.
+ *
+ * \param ctx     A pointer to the associated publish object context.
+ */
+void rcu_publish_delete(rcu_publish_t *ctx);
+
+/**
+ * \addtogroup rcu_publish_reader rcu_publish_reader
+ *
+ * The core functions for using a publish object as a reader.
+ * These may be called from any core and never block.
+ * @{
+ */
+
+/**
+ * Acquire the most recently published data.
+ *
+ * \param ctx     A pointer to the associated publish object context.
+ * \param token   Set to the value that must be passed to rcu_publish_release().
+ *
+ * \returns       A pointer to the published data. It remains valid until
+ *                rcu_publish_release() is called.
+ */
+const void *rcu_publish_acquire(rcu_publish_t *ctx, unsigned *token);
+
+/**
+ * Release data acquired with rcu_publish_acquire(). This may be called
+ * on a different core from the one that acquired it.
+ *
+ * \param ctx     A pointer to the associated publish object context.
+ * \param token   The token set by rcu_publish_acquire().
+ */
+void rcu_publish_release(rcu_publish_t *ctx, unsigned token);
+
+/**@}*/
+
+/**
+ * \addtogroup rcu_publish_writer rcu_publish_writer
+ *
+ * The core functions for using a publish object as a writer.
+ * @{
+ */
+
+/**
+ * Begin writing new data to publish.
+ *
+ * This waits for any readers still using the unpublished copy of the data
+ * to release it. The copy is then initialized with the currently published
+ * data, so that the writer need only modify the parts that change.
+ *
+ * Note: Only one writer may use a publish object at a time. If there may be
+ * more than one writer then they must be serialized by other means.
+ *
+ * \param ctx     A pointer to the associated publish object context.
+ * \param timeout The maximum time in ticks to wait for readers to release
+ *                the unpublished copy.
+ *
+ * \returns       A pointer to the data to modify, or NULL on timeout.
+ */
+void *rcu_publish_write_begin(rcu_publish_t *ctx, unsigned timeout);
+
+/**
+ * Publish the data returned by rcu_publish_write_begin(). Readers that call
+ * rcu_publish_acquire() after this returns get the new data.
+ *
+ * \param ctx     A pointer to the associated publish object context.
+ */
+void rcu_publish_write_end(rcu_publish_t *ctx);
+
+/**@}*/
+
+/**@}*/
+
+#endif /* RCU_PUBLISH_H_ */
@@ -0,0 +1,112 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+/**
+ * \addtogroup sequence_lock sequence_lock
+ *
+ * The public API for using the sequence lock implementation.
+ *
+ * A sequence lock protects data that is written by a single writer and read
+ * by any number of readers. Readers never block the writer and never use
+ * a kernel object. Instead, a reader copies the data and then checks whether
+ * the writer modified it in the meantime, in which case it retries.
+ *
+ * Example reader:
+ * \code
+ * uint32_t seq;
+ * do {
+ *     seq = seqlock_read_begin(&lock);
+ *     local_copy = shared_data;
+ * } while (seqlock_read_retry(&lock, seq));
+ * \endcode
+ *
+ * @{
+ */
+
+#include <stdint.h>
+
+#include "rtos_support.h"
+
+/**
+ * Struct representing a sequence lock instance.
+ *
+ * The members in this struct should not be accessed directly.
+ */
+typedef struct seqlock {
+    volatile uint32_t sequence;
+} seqlock_t;
+
+/**
+ * Initialize a sequence lock.
+ *
+ * \param ctx    A pointer to the sequence lock context to initialize.
+ */
+inline void seqlock_init(seqlock_t *ctx)
+{
+    ctx->sequence = 0;
+}
+
+/**
+ * Begin a read of data protected by a sequence lock.
+ *
+ * \param ctx    A pointer to the associated sequence lock context.
+ *
+ * \returns      The sequence number to pass to seqlock_read_retry().
+ */
+inline uint32_t seqlock_read_begin(const seqlock_t *ctx)
+{
+    /*
+     * An odd sequence number means a write is in progress. It is
+     * rounded down so that seqlock_read_retry() always fails.
+     */
+    uint32_t seq = ctx->sequence & ~1;
+    RTOS_MEMORY_BARRIER();
+    return seq;
+}
+
+/**
+ * End a read of data protected by a sequence lock.
+ *
+ * \param ctx    A pointer to the associated sequence lock context.
+ * \param seq    The sequence number returned by seqlock_read_begin().
+ *
+ * \returns      Non-zero if the data was modified while it was being read,
+ *               in which case the read must be repeated. Zero otherwise.
+ */
+inline int seqlock_read_retry(const seqlock_t *ctx, uint32_t seq)
+{
+    RTOS_MEMORY_BARRIER();
+    return ctx->sequence != seq;
+}
+
+/**
+ * Begin a write of data protected by a sequence lock.
+ *
+ * Note: Only one writer may use a sequence lock at a time. If there may be
+ * more than one writer then they must be serialized by other means.
+ *
+ * \param ctx    A pointer to the associated sequence lock context.
+ */
+inline void seqlock_write_begin(seqlock_t *ctx)
+{
+    ctx->sequence = ctx->sequence + 1;
+    RTOS_MEMORY_BARRIER();
+}
+
+/**
+ * End a write of data protected by a sequence lock.
+ *
+ * \param ctx    A pointer to the associated sequence lock context.
+ */
+inline void seqlock_write_end(seqlock_t *ctx)
+{
+    RTOS_MEMORY_BARRIER();
+    ctx->sequence = ctx->sequence + 1;
+}
+
+/**@}*/
+
+#endif /* SEQLOCK_H_ */
@@ -1,362 +1,246 @@
-// Copyright 2022 XMOS LIMITED.
+// Copyright 2022-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT MRSW_LOCK
 
+#include <string.h>
 #include <xcore/assert.h>
 
 #include "rtos_osal.h"
 #include "rtos_printf.h"
+#include "rtos_support.h"
 #include "concurrency_support.h"
 
-#define MRSW_FLAG 1
+#define MRSW_FLAG_READERS_DONE  1
+
+/*
+ * The writer states. When writer preferred, a writer sets
+ * MRSW_WRITER_ACTIVE before checking whether there are any active readers.
+ * Readers that see this back out and wait on lock_global, which the writer
+ * holds until it is done.
+ *
+ * When reader preferred, readers must only be stopped once the writer owns
+ * the lock, or a reader taking the lock again while a writer waits would
+ * deadlock with it. The writer sets MRSW_WRITER_CHECKING, with interrupts
+ * masked, while it checks for active readers, and then either
+ * MRSW_WRITER_ACTIVE if there are none or MRSW_WRITER_WAITING if there
+ * are. Readers that see MRSW_WRITER_CHECKING retry until it is resolved.
+ * MRSW_WRITER_WAITING does not stop new readers from acquiring the lock.
+ */
+#define MRSW_WRITER_IDLE     0
+#define MRSW_WRITER_WAITING  1
+#define MRSW_WRITER_ACTIVE   2
+#define MRSW_WRITER_CHECKING 3
+
+static int32_t readers_active(mrsw_lock_t *ctx)
+{
+    int32_t count = 0;
+
+    /*
+     * A reader may release the lock on a different core from the one it
+     * acquired it on, so individual counters may be negative. Only the
+     * sum is meaningful.
+     */
+    for (int i = 0; i < RTOS_MAX_CORE_COUNT; i++) {
+        count += ctx->readers_active[i];
+    }
+
+    return count;
+}
+
+/*
+ * Increments the calling core's reader count. Interrupts are masked so
+ * that the task cannot be preempted or moved to another core while the
+ * count is updated. Returns non-zero if the lock was acquired. Otherwise
+ * the count is restored and the caller must take the slow path.
+ */
+static int reader_try_get(mrsw_lock_t *ctx, int ignore_writer)
+{
+    const uint32_t blocking_state = ctx->type == MRSW_READER_PREFERRED ? MRSW_WRITER_ACTIVE : MRSW_WRITER_WAITING;
+    uint32_t writer_state;
+    uint32_t mask;
+    int core_id;
+    int acquired;
+
+    do {
+        mask = rtos_interrupt_mask_all();
+        core_id = rtos_core_id_get();
+
+        ctx->readers_active[core_id] += 1;
+        RTOS_MEMORY_BARRIER();
+        writer_state = ctx->writer_state;
+        acquired = ignore_writer || writer_state < blocking_state;
+        if (!acquired) {
+            ctx->readers_active[core_id] -= 1;
+        }
+
+        rtos_interrupt_mask_set(mask);
+
+        /*
+         * A writer on another core is checking for readers, with interrupts
+         * masked, so it will shortly either own the lock or be waiting.
+         */
+    } while (!acquired && writer_state == MRSW_WRITER_CHECKING);
+
+    return acquired;
+}
+
+/*
+ * Decrements the calling core's reader count. Returns non-zero if a writer
+ * may be waiting for the readers to finish.
+ */
+static int reader_release(mrsw_lock_t *ctx)
+{
+    uint32_t mask;
+    int core_id;
+    uint32_t writer_state;
+
+    mask = rtos_interrupt_mask_all();
+    core_id = rtos_core_id_get();
+
+    ctx->readers_active[core_id] -= 1;
+    RTOS_MEMORY_BARRIER();
+    writer_state = ctx->writer_state;
+
+    rtos_interrupt_mask_set(mask);
+
+    return writer_state != MRSW_WRITER_IDLE;
+}
 
 rtos_osal_status_t mrsw_lock_create(mrsw_lock_t *ctx, char *name, mrsw_lock_type_t type)
 {
-    rtos_osal_status_t retval = RTOS_OSAL_SUCCESS;
+    if (type != MRSW_READER_PREFERRED && type != MRSW_WRITER_PREFERRED) {
+        return RTOS_OSAL_ERROR;
+    }
+
+    memset((void *) ctx->readers_active, 0, sizeof(ctx->readers_active));
+    ctx->writer_state = MRSW_WRITER_IDLE;
     ctx->type = type;
 
-    switch(type) {
-        case MRSW_READER_PREFERRED:
-        {
-            read_pref_mrsw_lock_t *lock = rtos_osal_malloc(sizeof(read_pref_mrsw_lock_t));
-            if (lock != NULL) {
-                if (rtos_osal_semaphore_create(&lock->lock_global, name, 1, 1) != RTOS_OSAL_SUCCESS) {
-                    rtos_osal_free(lock);
-                    retval = RTOS_OSAL_ERROR;
-                    break;
-                }
-
-                if (rtos_osal_mutex_create(&lock->lock_readers, name, RTOS_OSAL_NOT_RECURSIVE) != RTOS_OSAL_SUCCESS) {
-                    rtos_osal_free(lock);
-                    retval = RTOS_OSAL_ERROR;
-                    break;
-                }
-                lock->num_readers_active = 0;
-
-                ctx->lock_setup = lock;
-            } else {
-                retval = RTOS_OSAL_ERROR;
-            }
-            break;
-        }
-        case MRSW_WRITER_PREFERRED:
-        {
-            write_pref_mrsw_lock_t *lock = rtos_osal_malloc(sizeof(write_pref_mrsw_lock_t));
-            if (lock != NULL) {
-                if (rtos_osal_mutex_create(&lock->lock_global, name, RTOS_OSAL_NOT_RECURSIVE) != RTOS_OSAL_SUCCESS) {
-                    rtos_osal_free(lock);
-                    retval = RTOS_OSAL_ERROR;
-                    break;
-                }
-                if (rtos_osal_event_group_create(&lock->cond, name) != RTOS_OSAL_SUCCESS) {
-                    rtos_osal_mutex_delete(&lock->lock_global);
-                    rtos_osal_free(lock);
-                    retval = RTOS_OSAL_ERROR;
-                    break;
-                }
-                lock->num_readers_active = 0;
-                lock->num_writers_waiting = 0;
-                lock->writer_active = 0;
-
-                ctx->lock_setup = lock;
-            } else {
-                retval = RTOS_OSAL_ERROR;
-            }
-            break;
-        }
-        case MRSW_COUNT:
-        default:
-            retval = RTOS_OSAL_ERROR;
-            break;
+    if (rtos_osal_mutex_create(&ctx->lock_global, name, RTOS_OSAL_NOT_RECURSIVE) != RTOS_OSAL_SUCCESS) {
+        return RTOS_OSAL_ERROR;
+    }
+
+    if (rtos_osal_event_group_create(&ctx->cond, name) != RTOS_OSAL_SUCCESS) {
+        rtos_osal_mutex_delete(&ctx->lock_global);
+        return RTOS_OSAL_ERROR;
     }
 
-    return retval;
+    return RTOS_OSAL_SUCCESS;
 }
 
 rtos_osal_status_t mrsw_lock_delete(mrsw_lock_t *ctx)
 {
-    rtos_osal_status_t retval = RTOS_OSAL_SUCCESS;
-
-    switch(ctx->type)
-    {
-        case MRSW_READER_PREFERRED:
-        {
-            read_pref_mrsw_lock_t *lock = (read_pref_mrsw_lock_t*)ctx->lock_setup;
-            rtos_osal_semaphore_delete(&lock->lock_global);
-            rtos_osal_mutex_delete(&lock->lock_readers);
-            rtos_osal_free(lock);
-            break;
-        }
-        case MRSW_WRITER_PREFERRED:
-        {
-            write_pref_mrsw_lock_t *lock = (write_pref_mrsw_lock_t*)ctx->lock_setup;
-            rtos_osal_mutex_delete(&lock->lock_global);
-            rtos_osal_event_group_delete(&lock->cond);
-            rtos_osal_free(lock);
-            break;
-        }
-        case MRSW_COUNT:
-        default:
-            retval = RTOS_OSAL_ERROR;
-            break;
+    if (ctx->type != MRSW_READER_PREFERRED && ctx->type != MRSW_WRITER_PREFERRED) {
+        return RTOS_OSAL_ERROR;
     }
 
-    return retval;
+    rtos_osal_mutex_delete(&ctx->lock_global);
+    rtos_osal_event_group_delete(&ctx->cond);
+    ctx->type = MRSW_COUNT;
+
+    return RTOS_OSAL_SUCCESS;
 }
 
 rtos_osal_status_t mrsw_lock_reader_get(mrsw_lock_t *ctx, unsigned timeout)
 {
-    rtos_osal_status_t retval = RTOS_OSAL_SUCCESS;
+    rtos_osal_status_t retval;
 
-    switch(ctx->type)
-    {
-        case MRSW_READER_PREFERRED:
-        {
-            read_pref_mrsw_lock_t *lock = (read_pref_mrsw_lock_t*)ctx->lock_setup;
-            retval = rtos_osal_mutex_get(&lock->lock_readers, timeout);
+    if (reader_try_get(ctx, 0)) {
+        return RTOS_OSAL_SUCCESS;
+    }
 
-            if (retval != RTOS_OSAL_SUCCESS) {
-                rtos_printf("mrsw_lock_reader_get reader lock timeout\n");
-                break;
-            } else {
-                int state = rtos_osal_critical_enter();
-                lock->num_readers_active += 1;
-                if (lock->num_readers_active == 1) {
-                    rtos_osal_critical_exit(state);
-                    retval = rtos_osal_semaphore_get(&lock->lock_global, RTOS_OSAL_PORT_WAIT_FOREVER);
-
-                    if (retval != RTOS_OSAL_SUCCESS) {
-                        xassert(0);
-                        break;
-                    }
-                } else {
-                    rtos_osal_critical_exit(state);
-                }
-                retval = rtos_osal_mutex_put(&lock->lock_readers);
-            }
-            break;
-        }
-        case MRSW_WRITER_PREFERRED:
-        {
-            write_pref_mrsw_lock_t *lock = (write_pref_mrsw_lock_t*)ctx->lock_setup;
-            uint32_t tmp = 0;
-            while(1) {
-                rtos_printf("read get global lock\n");
-                rtos_osal_mutex_get(&lock->lock_global, RTOS_OSAL_WAIT_FOREVER);
-                rtos_printf("read got global lock\n");
-
-                int state = rtos_osal_critical_enter();
-                if ((!lock->writer_active) && (lock->num_writers_waiting == 0)) {
-                    lock->num_readers_active += 1;
-                    rtos_osal_critical_exit(state);
-                    rtos_osal_mutex_put(&lock->lock_global);
-                    break;
-                } else {
-                    rtos_osal_critical_exit(state);
-                }
-
-                rtos_printf("read get global lock 2\n");
-                rtos_osal_mutex_put(&lock->lock_global);
-                rtos_printf("read got global lock 2\n");
-                if (RTOS_OSAL_TIMEOUT == rtos_osal_event_group_get_bits(
-                                                &lock->cond,
-                                                MRSW_FLAG,    /* req */
-                                                RTOS_OSAL_PORT_CLEAR,
-                                                &tmp,         /* actual */
-                                                timeout)) {
-                    /* We are giving up on reading */
-                    rtos_printf("read get global lock 3\n");
-                    rtos_osal_mutex_get(&lock->lock_global, RTOS_OSAL_WAIT_FOREVER);
-                    rtos_printf("read got global lock 3\n");
-                    state = rtos_osal_critical_enter();
-                    {
-                        lock->num_readers_active -= 1;
-                    }
-                    rtos_osal_critical_exit(state);
-                    rtos_osal_mutex_put(&lock->lock_global);
-                    break;
-                }
-            }
-            break;
-        }
-        case MRSW_COUNT:
-        default:
-            retval = RTOS_OSAL_ERROR;
-            break;
+    /*
+     * A writer holds the lock. It may have seen this reader's count before
+     * it was restored, so let it know that it should check again.
+     */
+    rtos_osal_event_group_set_bits(&ctx->cond, MRSW_FLAG_READERS_DONE);
+
+    /*
+     * The writer holds lock_global until it is done. Once this reader has
+     * it, no writer can be active, so the count may be incremented
+     * regardless of the writer state.
+     */
+    retval = rtos_osal_mutex_get(&ctx->lock_global, timeout);
+    if (retval != RTOS_OSAL_SUCCESS) {
+        rtos_printf("mrsw_lock_reader_get reader lock timeout\n");
+        return retval;
     }
 
-    return retval;
+    (void) reader_try_get(ctx, 1);
+
+    return rtos_osal_mutex_put(&ctx->lock_global);
 }
 
 rtos_osal_status_t mrsw_lock_reader_put(mrsw_lock_t *ctx)
 {
-    rtos_osal_status_t retval = RTOS_OSAL_SUCCESS;
+    if (reader_release(ctx)) {
+        return rtos_osal_event_group_set_bits(&ctx->cond, MRSW_FLAG_READERS_DONE);
+    }
+
+    return RTOS_OSAL_SUCCESS;
+}
+
+rtos_osal_status_t mrsw_lock_writer_get(mrsw_lock_t *ctx, unsigned timeout)
+{
+    rtos_osal_status_t retval;
+    uint32_t tmp = 0;
+
+    retval = rtos_osal_mutex_get(&ctx->lock_global, timeout);
+    if (retval != RTOS_OSAL_SUCCESS) {
+        return retval;
+    }
+
+    for (;;) {
+        /*
+         * Clear the flag before checking the reader count so that a reader
+         * finishing after the check cannot be missed.
+         */
+        rtos_osal_event_group_clear_bits(&ctx->cond, MRSW_FLAG_READERS_DONE);
 
-    switch(ctx->type)
-    {
-        case MRSW_READER_PREFERRED:
-        {
-            read_pref_mrsw_lock_t *lock = (read_pref_mrsw_lock_t*)ctx->lock_setup;
-            retval = rtos_osal_mutex_get(&lock->lock_readers, RTOS_OSAL_PORT_WAIT_FOREVER);
+        if (ctx->type == MRSW_READER_PREFERRED) {
+            uint32_t mask = rtos_interrupt_mask_all();
+            int acquired;
 
-            if (retval != RTOS_OSAL_SUCCESS) {
+            ctx->writer_state = MRSW_WRITER_CHECKING;
+            RTOS_MEMORY_BARRIER();
+            acquired = readers_active(ctx) == 0;
+            RTOS_MEMORY_BARRIER();
+            ctx->writer_state = acquired ? MRSW_WRITER_ACTIVE : MRSW_WRITER_WAITING;
+
+            rtos_interrupt_mask_set(mask);
+
+            if (acquired) {
                 break;
-            } else {
-                int state = rtos_osal_critical_enter();
-                xassert(lock->num_readers_active >= 1);
-                lock->num_readers_active -= 1;
-                if (lock->num_readers_active == 0) {
-                    rtos_osal_critical_exit(state);
-                    retval = rtos_osal_semaphore_put(&lock->lock_global);
-
-                    if (retval != RTOS_OSAL_SUCCESS) {
-                        break;
-                    }
-                } else {
-                    rtos_osal_critical_exit(state);
-                }
-                retval = rtos_osal_mutex_put(&lock->lock_readers);
             }
-            break;
-        }
-        case MRSW_WRITER_PREFERRED:
-        {
-            write_pref_mrsw_lock_t *lock = (write_pref_mrsw_lock_t*)ctx->lock_setup;
-            rtos_printf("read put get global lock\n");
-            retval = rtos_osal_mutex_get(&lock->lock_global, RTOS_OSAL_PORT_WAIT_FOREVER);
-            rtos_printf("read put got global lock\n");
-
-            if (retval != RTOS_OSAL_SUCCESS) {
+        } else {
+            ctx->writer_state = MRSW_WRITER_ACTIVE;
+            RTOS_MEMORY_BARRIER();
+            if (readers_active(ctx) == 0) {
                 break;
-            } else {
-                int state = rtos_osal_critical_enter();
-                lock->num_readers_active -= 1;
-                if (lock->num_readers_active == 0) {
-                    rtos_osal_critical_exit(state);
-                    rtos_osal_event_group_set_bits(&lock->cond, MRSW_FLAG);
-                } else {
-                    rtos_osal_critical_exit(state);
-                }
-                retval = rtos_osal_mutex_put(&lock->lock_global);
             }
-            break;
         }
-        case MRSW_COUNT:
-        default:
-            retval = RTOS_OSAL_ERROR;
-            break;
-    }
 
-    return retval;
-}
-
-rtos_osal_status_t mrsw_lock_writer_get(mrsw_lock_t *ctx, unsigned timeout)
-{
-    rtos_osal_status_t retval = RTOS_OSAL_SUCCESS;
-
-    switch(ctx->type)
-    {
-        case MRSW_READER_PREFERRED:
-        {
-            read_pref_mrsw_lock_t *lock = (read_pref_mrsw_lock_t*)ctx->lock_setup;
-            retval = rtos_osal_semaphore_get(&lock->lock_global, timeout);
-            break;
+        if (RTOS_OSAL_TIMEOUT == rtos_osal_event_group_get_bits(
+                                        &ctx->cond,
+                                        MRSW_FLAG_READERS_DONE, /* req */
+                                        RTOS_OSAL_OR_CLEAR,
+                                        &tmp,                   /* actual */
+                                        timeout)) {
+            /* We are giving up on writing */
+            ctx->writer_state = MRSW_WRITER_IDLE;
+            rtos_osal_mutex_put(&ctx->lock_global);
+            return RTOS_OSAL_TIMEOUT;
         }
-        case MRSW_WRITER_PREFERRED:
-        {
-            write_pref_mrsw_lock_t *lock = (write_pref_mrsw_lock_t*)ctx->lock_setup;
-            uint32_t tmp = 0;
-            rtos_printf("write get get global lock\n");
-            rtos_osal_mutex_get(&lock->lock_global, RTOS_OSAL_WAIT_FOREVER);
-            rtos_printf("write get got global lock\n");
-
-            int state = rtos_osal_critical_enter();
-            lock->num_writers_waiting += 1;
-            rtos_printf("actives %d\n", lock->num_readers_active);
-            if ((lock->num_readers_active > 0) || (lock->writer_active)) {
-                rtos_osal_critical_exit(state);
-                rtos_osal_mutex_put(&lock->lock_global);
-                if (RTOS_OSAL_SUCCESS == rtos_osal_event_group_get_bits(
-                                                &lock->cond,
-                                                MRSW_FLAG,    /* req */
-                                                RTOS_OSAL_PORT_CLEAR,
-                                                &tmp,         /* actual */
-                                                timeout)) {
-                    rtos_printf("write get get global lock 2\n");
-                    rtos_osal_mutex_get(&lock->lock_global, RTOS_OSAL_WAIT_FOREVER);
-                    rtos_printf("write get got global lock 2\n");
-
-                    state = rtos_osal_critical_enter();
-                    {
-                        lock->num_writers_waiting -= 1;
-                        lock->writer_active = 1;
-                    }
-                    rtos_osal_critical_exit(state);
-                    rtos_osal_mutex_put(&lock->lock_global);
-                } else {
-                    /* We are giving up on writing */
-                    rtos_printf("write get get global lock 3\n");
-                    rtos_osal_mutex_get(&lock->lock_global, RTOS_OSAL_WAIT_FOREVER);
-                    rtos_printf("write get got global lock 3\n");
-
-                    state = rtos_osal_critical_enter();
-                    {
-                        lock->num_writers_waiting -= 1;
-                    }
-                    rtos_osal_critical_exit(state);
-                    rtos_osal_mutex_put(&lock->lock_global);
-                }
-            } else {
-                lock->num_writers_waiting -= 1;
-                lock->writer_active = 1;
-                rtos_osal_critical_exit(state);
-                rtos_osal_mutex_put(&lock->lock_global);
-            }
-            break;
-        }
-        case MRSW_COUNT:
-        default:
-            retval = RTOS_OSAL_ERROR;
-            break;
     }
 
-    return retval;
+    return RTOS_OSAL_SUCCESS;
 }
 
 rtos_osal_status_t mrsw_lock_writer_put(mrsw_lock_t *ctx)
 {
-    rtos_osal_status_t retval = RTOS_OSAL_SUCCESS;
-
-    switch(ctx->type)
-    {
-        case MRSW_READER_PREFERRED:
-        {
-            read_pref_mrsw_lock_t *lock = (read_pref_mrsw_lock_t*)ctx->lock_setup;
-            retval = rtos_osal_semaphore_put(&lock->lock_global);
-            break;
-        }
-        case MRSW_WRITER_PREFERRED:
-        {
-            write_pref_mrsw_lock_t *lock = (write_pref_mrsw_lock_t*)ctx->lock_setup;
-            rtos_printf("write put get global lock\n");
-            retval = rtos_osal_mutex_get(&lock->lock_global, RTOS_OSAL_PORT_WAIT_FOREVER);
-            rtos_printf("write put got global lock\n");
-
-            if (retval != RTOS_OSAL_SUCCESS) {
-                break;
-            } else {
-                lock->writer_active = 0;
-                rtos_osal_event_group_set_bits(&lock->cond, MRSW_FLAG);
-                retval = rtos_osal_mutex_put(&lock->lock_global);
-            }
-            break;
-        }
-        case MRSW_COUNT:
-        default:
-            retval = RTOS_OSAL_ERROR;
-            break;
-    }
+    xassert(ctx->writer_state == MRSW_WRITER_ACTIVE);
 
-    return retval;
+    ctx->writer_state = MRSW_WRITER_IDLE;
+    return rtos_osal_mutex_put(&ctx->lock_global);
 }
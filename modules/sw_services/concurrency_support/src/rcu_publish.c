@@ -0,0 +1,135 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#define DEBUG_UNIT RCU_PUBLISH
+
+#include <string.h>
+#include <xcore/assert.h>
+
+#include "rtos_osal.h"
+#include "rtos_printf.h"
+#include "rtos_support.h"
+#include "concurrency_support.h"
+
+static int32_t readers_active(rcu_publish_t *ctx, uint32_t index)
+{
+    int32_t count = 0;
+
+    /*
+     * A reader may release on a different core from the one it acquired
+     * on, so individual counters may be negative. Only the sum is
+     * meaningful.
+     */
+    for (int i = 0; i < RTOS_MAX_CORE_COUNT; i++) {
+        count += ctx->readers_active[index][i];
+    }
+
+    return count;
+}
+
+rtos_osal_status_t rcu_publish_create(rcu_publish_t *ctx, size_t size, const void *initial)
+{
+    memset(ctx, 0, sizeof(rcu_publish_t));
+
+    ctx->buf[0] = rtos_osal_malloc(size);
+    ctx->buf[1] = rtos_osal_malloc(size);
+    if (ctx->buf[0] == NULL || ctx->buf[1] == NULL) {
+        rtos_osal_free(ctx->buf[0]);
+        rtos_osal_free(ctx->buf[1]);
+        return RTOS_OSAL_ERROR;
+    }
+
+    if (initial != NULL) {
+        memcpy(ctx->buf[0], initial, size);
+    } else {
+        memset(ctx->buf[0], 0, size);
+    }
+
+    ctx->size = size;
+    ctx->current = 0;
+
+    return RTOS_OSAL_SUCCESS;
+}
+
+void rcu_publish_delete(rcu_publish_t *ctx)
+{
+    rtos_osal_free(ctx->buf[0]);
+    rtos_osal_free(ctx->buf[1]);
+    ctx->buf[0] = NULL;
+    ctx->buf[1] = NULL;
+}
+
+const void *rcu_publish_acquire(rcu_publish_t *ctx, unsigned *token)
+{
+    uint32_t mask;
+    int core_id;
+    uint32_t index;
+
+    /*
+     * Interrupts are masked so that the task cannot be preempted or moved
+     * to another core while its core's count is updated.
+     */
+    mask = rtos_interrupt_mask_all();
+    core_id = rtos_core_id_get();
+
+    for (;;) {
+        index = ctx->current;
+        ctx->readers_active[index][core_id] += 1;
+        RTOS_MEMORY_BARRIER();
+
+        /*
+         * If the writer published again before the count was incremented,
+         * it may already have started to overwrite this copy. This can only
+         * happen once per publish, so the loop is bounded.
+         */
+        if (ctx->current == index) {
+            break;
+        }
+        ctx->readers_active[index][core_id] -= 1;
+    }
+
+    rtos_interrupt_mask_set(mask);
+
+    *token = index;
+    return ctx->buf[index];
+}
+
+void rcu_publish_release(rcu_publish_t *ctx, unsigned token)
+{
+    uint32_t mask;
+
+    xassert(token < 2);
+
+    mask = rtos_interrupt_mask_all();
+    ctx->readers_active[token][rtos_core_id_get()] -= 1;
+    rtos_interrupt_mask_set(mask);
+}
+
+void *rcu_publish_write_begin(rcu_publish_t *ctx, unsigned timeout)
+{
+    const uint32_t next = ctx->current ^ 1;
+    const rtos_osal_tick_t start = rtos_osal_tick_get();
+
+    /*
+     * Readers never use a kernel object, so there is nothing to block on
+     * here. Writes are expected to be infrequent, so poll once per tick
+     * until the grace period for the unpublished copy has ended.
+     */
+    while (readers_active(ctx, next) != 0) {
+        if (timeout != RTOS_OSAL_WAIT_FOREVER && rtos_osal_tick_get() - start >= timeout) {
+            rtos_printf("rcu_publish_write_begin timeout\n");
+            return NULL;
+        }
+        rtos_osal_delay(1);
+    }
+
+    memcpy(ctx->buf[next], ctx->buf[ctx->current], ctx->size);
+
+    return ctx->buf[next];
+}
+
+void rcu_publish_write_end(rcu_publish_t *ctx)
+{
+    RTOS_MEMORY_BARRIER();
+    ctx->current = ctx->current ^ 1;
+}
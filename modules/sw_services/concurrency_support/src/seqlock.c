@@ -0,0 +1,14 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include "seqlock.h"
+
+/*
+ * Ensure that these normally inline functions exist
+ * when compiler optimizations are disabled.
+ */
+extern inline void seqlock_init(seqlock_t *ctx);
+extern inline uint32_t seqlock_read_begin(const seqlock_t *ctx);
+extern inline int seqlock_read_retry(const seqlock_t *ctx, uint32_t seq);
+extern inline void seqlock_write_begin(seqlock_t *ctx);
+extern inline void seqlock_write_end(seqlock_t *ctx);
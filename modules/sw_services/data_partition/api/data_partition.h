@@ -0,0 +1,157 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef DATA_PARTITION_H_
+#define DATA_PARTITION_H_
+
+/**
+ * \addtogroup data_partition data_partition
+ *
+ * The public API for reading the entries of a data partition table that
+ * was created by datapartition_mkimage with its --partition-table option.
+ * @{
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rtos_qspi_flash.h"
+#include "data_partition_format.h"
+
+/**
+ * Struct representing an open data partition.
+ *
+ * The members in this struct should not be accessed directly.
+ */
+typedef struct {
+    rtos_qspi_flash_t *flash;
+    unsigned base;
+    data_partition_header_t header;
+} data_partition_t;
+
+/**
+ * Struct representing a reader of a single data partition entry.
+ *
+ * The members in this struct should not be accessed directly. It holds a
+ * buffer of one chunk for decompressing LZ4 entries, so it is normally
+ * best not allocated on a task's stack.
+ */
+typedef struct {
+    data_partition_t *dp;
+    data_partition_entry_t entry;
+    uint32_t stored_pos;    /* The offset of the next unread stored byte */
+    uint32_t pos;           /* The offset of the next byte returned */
+    uint32_t crc;
+    int failed;
+
+    /* The current chunk of an LZ4 entry */
+    uint32_t chunk_len;
+    uint32_t chunk_pos;
+    uint8_t chunk[DATA_PARTITION_CHUNK_SIZE];
+
+    /* A cache of compressed data read from flash */
+    uint32_t in_len;
+    uint32_t in_pos;
+    uint32_t in_remaining;
+    uint8_t in[64];
+} data_partition_reader_t;
+
+/**
+ * Opens the data partition table at \p base in \p flash. The header and the
+ * entry table are verified against their CRCs.
+ *
+ * \param dp    A pointer to the data partition to initialize.
+ * \param flash The flash driver instance that holds the partition.
+ * \param base  The address of the partition table in flash.
+ *
+ * \retval 0  on success.
+ * \retval -1 if there is no valid partition table at \p base.
+ */
+int data_partition_open(data_partition_t *dp,
+                        rtos_qspi_flash_t *flash,
+                        unsigned base);
+
+/**
+ * \returns the number of entries in the open data partition \p dp.
+ */
+static inline int data_partition_entry_count(const data_partition_t *dp)
+{
+    return dp->header.entry_count;
+}
+
+/**
+ * Gets an entry of an open data partition by its index. This is a single
+ * flash read.
+ *
+ * \param dp    A pointer to the open data partition.
+ * \param index The index of the entry.
+ * \param entry A pointer to the entry to fill in.
+ *
+ * \retval 0  on success.
+ * \retval -1 if \p index is out of range.
+ */
+int data_partition_entry_get(data_partition_t *dp,
+                             int index,
+                             data_partition_entry_t *entry);
+
+/**
+ * Finds an entry of an open data partition by its name.
+ *
+ * \param dp    A pointer to the open data partition.
+ * \param name  The name of the entry to find.
+ * \param entry A pointer to the entry to fill in.
+ *
+ * \returns the index of the entry, or -1 if there is no entry named \p name.
+ */
+int data_partition_find(data_partition_t *dp,
+                        const char *name,
+                        data_partition_entry_t *entry);
+
+/**
+ * Gets the flash address of the data of an entry. Only entries that are
+ * not compressed may be read directly from this address, and their data
+ * is not verified.
+ *
+ * \param dp    A pointer to the open data partition.
+ * \param entry A pointer to the entry.
+ *
+ * \returns the flash address of the entry's data, or 0 if it is compressed.
+ */
+unsigned data_partition_entry_address(const data_partition_t *dp,
+                                      const data_partition_entry_t *entry);
+
+/**
+ * Initializes a reader of an entry of an open data partition. The reader
+ * returns the entry's data from the start, decompressing it as it is read.
+ *
+ * \param reader A pointer to the reader to initialize.
+ * \param dp     A pointer to the open data partition.
+ * \param entry  A pointer to the entry to read.
+ *
+ * \retval 0  on success.
+ * \retval -1 if the entry is not valid.
+ */
+int data_partition_reader_init(data_partition_reader_t *reader,
+                               data_partition_t *dp,
+                               const data_partition_entry_t *entry);
+
+/**
+ * Reads the next bytes of an entry. The CRC of the entry is checked when
+ * its last byte is read, and if it does not match then -1 is returned
+ * instead. The data returned by the earlier reads should then be
+ * discarded.
+ *
+ * \param reader A pointer to the reader.
+ * \param buf    The buffer to read the data into.
+ * \param len    The maximum number of bytes to read.
+ *
+ * \returns the number of bytes read, which is only less than \p len at the
+ * end of the entry, or -1 if the entry is corrupt.
+ */
+int data_partition_read(data_partition_reader_t *reader,
+                        void *buf,
+                        size_t len);
+
+/**@}*/
+
+#endif /* DATA_PARTITION_H_ */
@@ -0,0 +1,78 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef DATA_PARTITION_FORMAT_H_
+#define DATA_PARTITION_FORMAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The format of a data partition table, which is created on the host by
+ * datapartition_mkimage with its --partition-table option, and read on
+ * the device with the functions in data_partition.h.
+ *
+ * The partition starts with a header, immediately followed by a table of
+ * entry_count entries. The data of each entry follows the table, aligned
+ * to the header's alignment, which is normally the flash's erase block
+ * size. All fields are little endian.
+ *
+ * An entry with DATA_PARTITION_ENTRY_LZ4 set is stored as a sequence of
+ * chunks, each of which holds chunk_size bytes of the entry, except the
+ * last which holds the rest. Each chunk starts with a 32-bit word giving
+ * the length of the data that follows it. If DATA_PARTITION_CHUNK_RAW is
+ * set in this word then the data is not compressed, otherwise it is an
+ * LZ4 block that is independent of the other chunks. This allows an entry
+ * to be decompressed a chunk at a time with a small buffer.
+ *
+ * The CRC of each entry is of its data once decompressed.
+ */
+
+#define DATA_PARTITION_MAGIC            0x54504458 /* "XDPT" */
+#define DATA_PARTITION_VERSION          1
+
+#define DATA_PARTITION_NAME_LEN         32
+#define DATA_PARTITION_CHUNK_SIZE       4096
+
+#define DATA_PARTITION_ENTRY_LZ4        0x00000001
+#define DATA_PARTITION_CHUNK_RAW        0x80000000
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_count;
+    uint32_t alignment;     /* Of the data of each entry */
+    uint32_t chunk_size;    /* Of the chunks of compressed entries */
+    uint32_t table_crc;     /* The CRC-32 of the entry table */
+    uint32_t header_crc;    /* The CRC-32 of the preceding fields */
+} data_partition_header_t;
+
+typedef struct {
+    char name[DATA_PARTITION_NAME_LEN];     /* NULL terminated */
+    uint32_t offset;        /* Of the data, from the start of the partition */
+    uint32_t stored_size;   /* The size of the data in flash */
+    uint32_t size;          /* The size of the data once decompressed */
+    uint32_t crc;           /* The CRC-32 of the data once decompressed */
+    uint32_t flags;
+} data_partition_entry_t;
+
+/**
+ * Updates the CRC-32 (as used by Ethernet and zlib) \p crc with \p len
+ * bytes of \p data. Start with a \p crc of 0.
+ */
+static inline uint32_t data_partition_crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        }
+    }
+
+    return ~crc;
+}
+
+#endif /* DATA_PARTITION_FORMAT_H_ */
@@ -0,0 +1,342 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <string.h>
+
+#include "data_partition.h"
+
+#define HEADER_CRC_LEN offsetof(data_partition_header_t, header_crc)
+
+static unsigned table_address(const data_partition_t *dp, int index)
+{
+    return dp->base + sizeof(data_partition_header_t) + index * sizeof(data_partition_entry_t);
+}
+
+int data_partition_open(data_partition_t *dp,
+                        rtos_qspi_flash_t *flash,
+                        unsigned base)
+{
+    data_partition_header_t *header = &dp->header;
+    uint32_t crc = 0;
+
+    dp->flash = flash;
+    dp->base = base;
+
+    rtos_qspi_flash_read(flash, (uint8_t *) header, base, sizeof(*header));
+
+    if (header->magic != DATA_PARTITION_MAGIC ||
+        header->version != DATA_PARTITION_VERSION ||
+        header->header_crc != data_partition_crc32(0, header, HEADER_CRC_LEN)) {
+        return -1;
+    }
+
+    if (header->chunk_size == 0 || header->chunk_size > DATA_PARTITION_CHUNK_SIZE) {
+        return -1;
+    }
+
+    for (int i = 0; i < header->entry_count; i++) {
+        data_partition_entry_t entry;
+
+        rtos_qspi_flash_read(flash, (uint8_t *) &entry, table_address(dp, i), sizeof(entry));
+        crc = data_partition_crc32(crc, &entry, sizeof(entry));
+    }
+
+    if (crc != header->table_crc) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int data_partition_entry_get(data_partition_t *dp,
+                             int index,
+                             data_partition_entry_t *entry)
+{
+    if (index < 0 || index >= dp->header.entry_count) {
+        return -1;
+    }
+
+    rtos_qspi_flash_read(dp->flash, (uint8_t *) entry, table_address(dp, index), sizeof(*entry));
+
+    return 0;
+}
+
+int data_partition_find(data_partition_t *dp,
+                        const char *name,
+                        data_partition_entry_t *entry)
+{
+    for (int i = 0; i < dp->header.entry_count; i++) {
+        data_partition_entry_get(dp, i, entry);
+        if (strncmp(entry->name, name, DATA_PARTITION_NAME_LEN) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+unsigned data_partition_entry_address(const data_partition_t *dp,
+                                      const data_partition_entry_t *entry)
+{
+    if (entry->flags & DATA_PARTITION_ENTRY_LZ4) {
+        return 0;
+    }
+
+    return dp->base + entry->offset;
+}
+
+int data_partition_reader_init(data_partition_reader_t *reader,
+                               data_partition_t *dp,
+                               const data_partition_entry_t *entry)
+{
+    uint32_t data_start = table_address(dp, dp->header.entry_count) - dp->base;
+
+    if (entry->offset < data_start ||
+        entry->offset + entry->stored_size < entry->offset) {
+        return -1;
+    }
+
+    if (!(entry->flags & DATA_PARTITION_ENTRY_LZ4) && entry->stored_size != entry->size) {
+        return -1;
+    }
+
+    reader->dp = dp;
+    reader->entry = *entry;
+    reader->stored_pos = 0;
+    reader->pos = 0;
+    reader->crc = 0;
+    reader->failed = 0;
+    reader->chunk_len = 0;
+    reader->chunk_pos = 0;
+    reader->in_len = 0;
+    reader->in_pos = 0;
+    reader->in_remaining = 0;
+
+    return 0;
+}
+
+static unsigned stored_address(data_partition_reader_t *reader)
+{
+    return reader->dp->base + reader->entry.offset + reader->stored_pos;
+}
+
+/*
+ * The source of compressed data for the LZ4 decoder. Single bytes are
+ * read through a small cache, and runs of literals straight from flash.
+ */
+static int src_byte(data_partition_reader_t *reader)
+{
+    if (reader->in_pos == reader->in_len) {
+        uint32_t n = reader->in_remaining;
+
+        if (n == 0) {
+            return -1;
+        }
+        if (n > sizeof(reader->in)) {
+            n = sizeof(reader->in);
+        }
+        rtos_qspi_flash_read(reader->dp->flash, reader->in, stored_address(reader), n);
+        reader->stored_pos += n;
+        reader->in_remaining -= n;
+        reader->in_len = n;
+        reader->in_pos = 0;
+    }
+
+    return reader->in[reader->in_pos++];
+}
+
+static int src_read(data_partition_reader_t *reader, uint8_t *dst, uint32_t len)
+{
+    uint32_t n = reader->in_len - reader->in_pos;
+
+    if (n > len) {
+        n = len;
+    }
+    memcpy(dst, &reader->in[reader->in_pos], n);
+    reader->in_pos += n;
+    dst += n;
+    len -= n;
+
+    if (len > reader->in_remaining) {
+        return -1;
+    }
+    if (len > 0) {
+        rtos_qspi_flash_read(reader->dp->flash, dst, stored_address(reader), len);
+        reader->stored_pos += len;
+        reader->in_remaining -= len;
+    }
+
+    return 0;
+}
+
+static int src_empty(data_partition_reader_t *reader)
+{
+    return reader->in_pos == reader->in_len && reader->in_remaining == 0;
+}
+
+static int32_t src_length(data_partition_reader_t *reader, uint32_t len)
+{
+    if (len == 15) {
+        int b;
+        do {
+            if ((b = src_byte(reader)) < 0) {
+                return -1;
+            }
+            len += b;
+            if (len > DATA_PARTITION_CHUNK_SIZE) {
+                return -1;
+            }
+        } while (b == 255);
+    }
+
+    return len;
+}
+
+/*
+ * Decompresses an LZ4 block of in_remaining bytes at stored_pos into the
+ * chunk buffer. Every length and offset is checked, so a corrupt block
+ * can not write outside of the buffer.
+ */
+static int lz4_decompress(data_partition_reader_t *reader, uint32_t out_len)
+{
+    uint8_t *out = reader->chunk;
+    uint32_t op = 0;
+
+    for (;;) {
+        int32_t len;
+        uint32_t offset;
+        int token;
+        int lo, hi;
+
+        if ((token = src_byte(reader)) < 0) {
+            return -1;
+        }
+
+        len = src_length(reader, token >> 4);
+        if (len < 0 || op + len > out_len || src_read(reader, &out[op], len) != 0) {
+            return -1;
+        }
+        op += len;
+
+        if (src_empty(reader)) {
+            break;
+        }
+
+        if ((lo = src_byte(reader)) < 0 || (hi = src_byte(reader)) < 0) {
+            return -1;
+        }
+        offset = lo | (hi << 8);
+        if (offset == 0 || offset > op) {
+            return -1;
+        }
+
+        len = src_length(reader, token & 0xF);
+        if (len < 0 || op + len + 4 > out_len) {
+            return -1;
+        }
+        len += 4;
+
+        /* Matches may overlap the bytes that they write */
+        for (int32_t i = 0; i < len; i++, op++) {
+            out[op] = out[op - offset];
+        }
+    }
+
+    return op == out_len ? 0 : -1;
+}
+
+static int chunk_load(data_partition_reader_t *reader)
+{
+    const data_partition_entry_t *entry = &reader->entry;
+    uint32_t out_len = entry->size - reader->pos;
+    uint32_t word;
+    uint32_t len;
+
+    if (out_len > reader->dp->header.chunk_size) {
+        out_len = reader->dp->header.chunk_size;
+    }
+
+    if (entry->stored_size - reader->stored_pos < sizeof(word)) {
+        return -1;
+    }
+    rtos_qspi_flash_read(reader->dp->flash, (uint8_t *) &word, stored_address(reader), sizeof(word));
+    reader->stored_pos += sizeof(word);
+
+    len = word & ~DATA_PARTITION_CHUNK_RAW;
+    if (len > entry->stored_size - reader->stored_pos) {
+        return -1;
+    }
+
+    if (word & DATA_PARTITION_CHUNK_RAW) {
+        if (len != out_len) {
+            return -1;
+        }
+        rtos_qspi_flash_read(reader->dp->flash, reader->chunk, stored_address(reader), len);
+        reader->stored_pos += len;
+    } else {
+        reader->in_len = 0;
+        reader->in_pos = 0;
+        reader->in_remaining = len;
+        if (lz4_decompress(reader, out_len) != 0 || !src_empty(reader)) {
+            return -1;
+        }
+    }
+
+    reader->chunk_len = out_len;
+    reader->chunk_pos = 0;
+
+    return 0;
+}
+
+int data_partition_read(data_partition_reader_t *reader,
+                        void *buf,
+                        size_t len)
+{
+    const data_partition_entry_t *entry = &reader->entry;
+    uint8_t *dst = buf;
+    uint32_t n;
+
+    if (reader->failed) {
+        return -1;
+    }
+
+    n = entry->size - reader->pos;
+    if (len > n) {
+        len = n;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    if (entry->flags & DATA_PARTITION_ENTRY_LZ4) {
+        size_t done = 0;
+
+        while (done < len) {
+            if (reader->chunk_pos == reader->chunk_len && chunk_load(reader) != 0) {
+                reader->failed = 1;
+                return -1;
+            }
+            n = reader->chunk_len - reader->chunk_pos;
+            if (n > len - done) {
+                n = len - done;
+            }
+            memcpy(&dst[done], &reader->chunk[reader->chunk_pos], n);
+            reader->chunk_pos += n;
+            reader->pos += n;
+            done += n;
+        }
+    } else {
+        rtos_qspi_flash_read(reader->dp->flash, dst, stored_address(reader), len);
+        reader->stored_pos += len;
+        reader->pos += len;
+    }
+
+    reader->crc = data_partition_crc32(reader->crc, dst, len);
+
+    if (reader->pos == entry->size && reader->crc != entry->crc) {
+        reader->failed = 1;
+        return -1;
+    }
+
+    return len;
+}
@@ -12,6 +12,18 @@
 #include "rtos_osal.h"
 #include "rtos_intertile.h"
 
+/**
+ * The maximum payload length, in bytes, of a command sent to a servicer that
+ * is on a different tile than the transport layer. Each device control
+ * instance initialized with DEVICE_CONTROL_CLIENT_MODE preallocates a command
+ * slot of about this size, so that forwarding commands between tiles requires
+ * no heap allocations. Commands with larger payloads are rejected with
+ * CONTROL_DATA_LENGTH_ERROR. This must be set to the same value on all tiles.
+ */
+#ifndef DEVICE_CONTROL_CLIENT_MAX_PAYLOAD_LEN
+#define DEVICE_CONTROL_CLIENT_MAX_PAYLOAD_LEN 256
+#endif
+
 /**
  * \defgroup device_control_xcore
  *
@@ -19,13 +31,48 @@
  * @{
  */
 
+/**
+ * Flag for device_control_resid_range_t indicating that the range of resource IDs
+ * may also be registered by other servicers. Write commands to these resource IDs
+ * are forwarded to every servicer that has registered them, in the order that the
+ * servicers registered. Read commands are only forwarded to the first.
+ *
+ * A broadcast range may overlap other broadcast ranges, but not a range registered
+ * without this flag.
+ */
+#define DEVICE_CONTROL_RESID_BROADCAST 0x01
+
+/**
+ * Struct representing a range of resource IDs registered by a servicer.
+ */
+typedef struct {
+    control_resid_t first; /**< The first resource ID in the range. */
+    control_resid_t last;  /**< The last resource ID in the range, inclusive. */
+    uint8_t flags;         /**< Zero, or DEVICE_CONTROL_RESID_BROADCAST. */
+} device_control_resid_range_t;
+
+/**
+ * Struct holding the command statistics for a single servicer.
+ * Latencies are measured by the transport layer's tile in reference
+ * timer ticks, from forwarding a command to the servicer until its
+ * response is received.
+ */
+typedef struct {
+    uint32_t command_count; /**< The number of commands forwarded to the servicer. */
+    uint32_t error_count;   /**< The number of commands to which the servicer responded with an error. */
+    uint32_t latency_max;   /**< The largest latency of any command. */
+    uint64_t latency_total; /**< The sum of the latencies of all commands. */
+} device_control_servicer_stats_t;
+
+typedef struct device_control_resource_table_struct device_control_resource_table_t;
+
 /**
  * Struct representing a device control instance.
  *
  * The members in this struct should not be accessed directly.
  */
 typedef struct {
-    uint8_t *resource_table; /* NULL on client tiles */
+    device_control_resource_table_t *resource_table; /* NULL on client tiles */
     int intertile_port;
     union {
         rtos_intertile_t *host_intertile;
@@ -46,12 +93,16 @@ typedef struct {
             struct {
                 rtos_intertile_t *intertile_ctx;
                 rtos_osal_queue_t *queue;
+                device_control_servicer_stats_t stats;
             } *servicer_table;
 
             size_t requested_payload_len;
             control_resid_t requested_resid;
             control_cmd_t requested_cmd;
             control_status_t last_status;
+
+            uint8_t *batch_result;
+            size_t batch_result_len;
         };
     };
 } device_control_t;
@@ -62,7 +113,7 @@ typedef struct {
  * This is not necessary to do, but will save a small amount of memory.
  */
 typedef struct {
-    uint8_t *resource_table; /* NULL on client tiles */
+    device_control_resource_table_t *resource_table; /* NULL on client tiles */
     int intertile_port;
     rtos_intertile_t *host_intertile;
 } device_control_client_t;
@@ -258,6 +309,46 @@ control_ret_t device_control_servicer_register(device_control_servicer_t *ctx,
                                                const control_resid_t resources[],
                                                size_t num_resources);
 
+/**
+ * Registers a servicer for a device control instance, with the resource IDs it
+ * handles given as ranges. This is equivalent to device_control_servicer_register(),
+ * but is more compact when a servicer handles many consecutive resource IDs, and
+ * allows resource IDs to be shared with other servicers with
+ * DEVICE_CONTROL_RESID_BROADCAST.
+ *
+ * \param ctx                      A pointer to the device control servicer context to initialize.
+ * \param device_control_ctx       An array of pointers to the device control instance to register
+ *                                 the servicer with.
+ * \param device_control_ctx_count The number of device control instances to register the servicer
+ *                                 with.
+ * \param ranges                   Array of resource ID ranges to associate with this servicer.
+ * \param num_ranges               The number of ranges within \p ranges.
+ */
+control_ret_t device_control_servicer_register_ranges(device_control_servicer_t *ctx,
+                                                      device_control_t *device_control_ctx[],
+                                                      size_t device_control_ctx_count,
+                                                      const device_control_resid_range_t ranges[],
+                                                      size_t num_ranges);
+
+/**
+ * Retrieves the command statistics of a servicer. This must be called on the tile
+ * that runs the transport layer for the device control instance, after
+ * device_control_resources_register() has returned successfully.
+ *
+ * The same statistics may be read by the host with CONTROL_GET_SERVICER_STATS().
+ *
+ * \param ctx            A pointer to the device control instance.
+ * \param servicer_index The index of the servicer, in the order in which the servicers
+ *                       completed registration.
+ * \param stats          Updated with the servicer's statistics.
+ *
+ * \retval CONTROL_SUCCESS if \p servicer_index refers to a registered servicer.
+ * \retval CONTROL_BAD_RESOURCE otherwise.
+ */
+control_ret_t device_control_servicer_stats_get(device_control_t *ctx,
+                                               size_t servicer_index,
+                                               device_control_servicer_stats_t *stats);
+
 /**
  * Starts a device control instance. This must be called by all tiles that have called
  * device_control_init(). It may be called either before or after starting the RTOS, but
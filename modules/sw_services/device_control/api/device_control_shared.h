@@ -115,6 +115,79 @@ typedef enum {
  */
 #define CONTROL_GET_LAST_COMMAND_STATUS CONTROL_CMD_SET_READ(1)
 
+/**
+ * The command to execute a batch of commands packed into a single payload.
+ * It must be sent to resource ID CONTROL_SPECIAL_RESID.
+ *
+ * The payload starts with a one byte command count. This is followed by
+ * that many entries, each consisting of a resource ID, a command code, a
+ * payload length, and then the payload bytes themselves for write commands.
+ * Read commands carry no payload bytes in the request.
+ *
+ * The status of the batch as a whole is returned as the status of this
+ * write command. The per-command results are read back with
+ * CONTROL_GET_BATCH_RESULT.
+ */
+#define CONTROL_BATCH_EXECUTE CONTROL_CMD_SET_WRITE(2)
+
+/**
+ * The command to read the result of the last CONTROL_BATCH_EXECUTE command.
+ * It must be sent to resource ID CONTROL_SPECIAL_RESID.
+ *
+ * The result consists of one control_status_t byte per command in the batch,
+ * in order, followed by the payloads of all read commands in the batch,
+ * concatenated in order.
+ */
+#define CONTROL_GET_BATCH_RESULT CONTROL_CMD_SET_READ(2)
+
+/**
+ * The command to read the number of servicers registered with the device.
+ * It must be sent to resource ID CONTROL_SPECIAL_RESID. The payload is a
+ * single byte.
+ */
+#define CONTROL_GET_SERVICER_COUNT CONTROL_CMD_SET_READ(3)
+
+/**
+ * The command to read the command statistics of a servicer. It must be
+ * sent to resource ID CONTROL_SPECIAL_RESID.
+ *
+ * The servicer index must be less than CONTROL_MAX_STATS_SERVICERS. The
+ * payload is CONTROL_SERVICER_STATS_SIZE bytes long and holds four 32-bit
+ * values in network byte order: the number of commands forwarded to the
+ * servicer, the number of those that failed, and the mean and maximum
+ * latencies of the servicer's responses in 100 MHz reference timer ticks.
+ *
+ * \param[in] servicer The index of the servicer.
+ */
+#define CONTROL_GET_SERVICER_STATS(servicer) CONTROL_CMD_SET_READ(0x40 + (servicer))
+
+/**
+ * The number of servicers whose statistics may be read with CONTROL_GET_SERVICER_STATS().
+ */
+#define CONTROL_MAX_STATS_SERVICERS 0x40
+
+/**
+ * The size in bytes of the payload of CONTROL_GET_SERVICER_STATS().
+ */
+#define CONTROL_SERVICER_STATS_SIZE 16
+
+/**
+ * The size in bytes of the batch payload header, which holds the command count.
+ */
+#define CONTROL_BATCH_HEADER_SIZE 1
+
+/**
+ * The size in bytes of each command entry header within a batch payload.
+ */
+#define CONTROL_BATCH_ENTRY_HEADER_SIZE 3
+
+/**
+ * The maximum size in bytes of a batch payload, and of a batch result.
+ * This is limited by the 8-bit payload length used by the I2C and SPI
+ * transports.
+ */
+#define CONTROL_BATCH_MAX_BYTES 255
+
 /**
  * The mode value to use when initializing a device control instance
  * that is on the same tile as its associated transport layer. These
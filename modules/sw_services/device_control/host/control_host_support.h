@@ -105,4 +105,22 @@ control_build_i2c_data(uint8_t data[I2C_TRANSACTION_MAX_BYTES],
 }
 #endif
 
+#if USE_LOOPBACK
+#define LOOPBACK_TRANSACTION_MAX_BYTES CONTROL_BATCH_MAX_BYTES
+#endif
+
+/*
+ * The largest batch payload, and batch result, that can be exchanged with
+ * the device in a single transaction over the selected transport.
+ */
+#if USE_USB
+#define CONTROL_HOST_BATCH_MAX_BYTES USB_TRANSACTION_MAX_BYTES
+#elif USE_SPI
+#define CONTROL_HOST_BATCH_MAX_BYTES SPI_DATA_MAX_BYTES
+#elif USE_I2C
+#define CONTROL_HOST_BATCH_MAX_BYTES I2C_DATA_MAX_BYTES
+#else
+#define CONTROL_HOST_BATCH_MAX_BYTES LOOPBACK_TRANSACTION_MAX_BYTES
+#endif
+
 #endif // __control_host_support_h__
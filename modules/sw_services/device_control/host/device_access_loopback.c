@@ -0,0 +1,96 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+#if USE_LOOPBACK
+
+#include <stdio.h>
+#include "device_control_host.h"
+#include "control_host_support.h"
+#include "util.h"
+
+static control_loopback_write_cb_t loopback_write_cb = NULL;
+static control_loopback_read_cb_t loopback_read_cb = NULL;
+static void *loopback_app_data = NULL;
+
+static unsigned num_commands = 0;
+
+control_ret_t control_init_loopback(control_loopback_write_cb_t write_cb,
+                                    control_loopback_read_cb_t read_cb,
+                                    void *app_data)
+{
+  if (write_cb == NULL || read_cb == NULL) {
+    PRINT_ERROR("Loopback transport requires both a write and a read handler\n");
+    return CONTROL_ERROR;
+  }
+
+  loopback_write_cb = write_cb;
+  loopback_read_cb = read_cb;
+  loopback_app_data = app_data;
+
+  return CONTROL_SUCCESS;
+}
+
+control_ret_t control_query_version(control_version_t *version)
+{
+  if (loopback_read_cb == NULL) {
+    return CONTROL_ERROR;
+  }
+
+  num_commands++;
+
+  return loopback_read_cb(CONTROL_SPECIAL_RESID, CONTROL_GET_VERSION,
+                          version, sizeof(control_version_t), loopback_app_data);
+}
+
+control_ret_t
+control_write_command(control_resid_t resid, control_cmd_t cmd,
+                      const uint8_t payload[], size_t payload_len)
+{
+  if (loopback_write_cb == NULL) {
+    return CONTROL_ERROR;
+  }
+
+  if (payload_len > LOOPBACK_TRANSACTION_MAX_BYTES) {
+    PRINT_ERROR("Write of %zd bytes exceeds maximum of %d\n", payload_len, LOOPBACK_TRANSACTION_MAX_BYTES);
+    return CONTROL_DATA_LENGTH_ERROR;
+  }
+
+  DBG(printf("%u: loopback write command: resid %d, cmd %d, len %zd: ",
+    num_commands, resid, cmd, payload_len));
+  DBG(print_bytes(payload, (int)payload_len));
+
+  num_commands++;
+
+  return loopback_write_cb(resid, CONTROL_CMD_SET_WRITE(cmd), payload, payload_len, loopback_app_data);
+}
+
+control_ret_t
+control_read_command(control_resid_t resid, control_cmd_t cmd,
+                     uint8_t payload[], size_t payload_len)
+{
+  if (loopback_read_cb == NULL) {
+    return CONTROL_ERROR;
+  }
+
+  if (payload_len > LOOPBACK_TRANSACTION_MAX_BYTES) {
+    PRINT_ERROR("Read of %zd bytes exceeds maximum of %d\n", payload_len, LOOPBACK_TRANSACTION_MAX_BYTES);
+    return CONTROL_DATA_LENGTH_ERROR;
+  }
+
+  DBG(printf("%u: loopback read command: resid %d, cmd %d, len %zd\n",
+    num_commands, resid, cmd, payload_len));
+
+  num_commands++;
+
+  return loopback_read_cb(resid, CONTROL_CMD_SET_READ(cmd), payload, payload_len, loopback_app_data);
+}
+
+control_ret_t control_cleanup_loopback(void)
+{
+  loopback_write_cb = NULL;
+  loopback_read_cb = NULL;
+  loopback_app_data = NULL;
+
+  return CONTROL_SUCCESS;
+}
+
+#endif // USE_LOOPBACK
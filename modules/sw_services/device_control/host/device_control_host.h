@@ -152,10 +152,63 @@ control_ret_t control_init_spi(spi_mode_t spi_mode, int spi_bitrate, unsigned de
  */
 control_ret_t control_cleanup_spi(void);
 #endif
+#if USE_LOOPBACK || __DOXYGEN__
+/**
+ * Function pointer type for the write handler of the loopback transport.
+ * It is called in place of sending a write command to a device.
+ *
+ * \param resid        Resource ID of the command
+ * \param cmd          Command code, with the read bit cleared
+ * \param payload      Array of bytes which constitutes the data payload
+ * \param payload_len  Size of the payload in bytes
+ * \param app_data     The pointer provided to control_init_loopback()
+ *
+ * \returns            The status to return to the caller of control_write_command()
+ */
+typedef control_ret_t (*control_loopback_write_cb_t)(control_resid_t resid, control_cmd_t cmd,
+                                                      const uint8_t payload[], size_t payload_len,
+                                                      void *app_data);
+
+/**
+ * Function pointer type for the read handler of the loopback transport.
+ * It is called in place of sending a read command to a device.
+ *
+ * \param resid        Resource ID of the command
+ * \param cmd          Command code, with the read bit set
+ * \param payload      Array of bytes to fill with the data payload
+ * \param payload_len  Size of the payload in bytes
+ * \param app_data     The pointer provided to control_init_loopback()
+ *
+ * \returns            The status to return to the caller of control_read_command()
+ */
+typedef control_ret_t (*control_loopback_read_cb_t)(control_resid_t resid, control_cmd_t cmd,
+                                                     uint8_t payload[], size_t payload_len,
+                                                     void *app_data);
+
+/** Initialize the loopback host interface. Rather than communicating with a
+ *  device, every command is passed to the given handlers within the host
+ *  process. This allows host applications and the host library itself to be
+ *  tested without any hardware.
+ *
+ *  \param write_cb     Handler for write commands
+ *  \param read_cb      Handler for read commands
+ *  \param app_data     A pointer passed along to the handlers
+ *
+ *  \returns            Whether the initialization was successful or not
+ */
+control_ret_t control_init_loopback(control_loopback_write_cb_t write_cb,
+                                    control_loopback_read_cb_t read_cb,
+                                    void *app_data);
+/** Shutdown the loopback host interface
+ *
+ *  \returns           Whether the shutdown was successful or not
+ */
+control_ret_t control_cleanup_loopback(void);
+#endif
 //#if (!USE_USB && !USE_XSCOPE && !USE_I2C && !USE_SPI)
-#if (!USE_USB && !USE_I2C && !USE_SPI)
+#if (!USE_USB && !USE_I2C && !USE_SPI && !USE_LOOPBACK)
 #error "Please specify transport for device control using USE_xxx define in build file"
-#error "Eg. -DUSE_I2C=1 or -DUSE_USB=1 or -DUSE_SPI=1"
+#error "Eg. -DUSE_I2C=1 or -DUSE_USB=1 or -DUSE_SPI=1 or -DUSE_LOOPBACK=1"
 #endif 
 
 #if USE_I2C && __xcore__
@@ -214,6 +267,74 @@ control_read_command(control_resid_t resid, control_cmd_t cmd,
 #endif
                      uint8_t payload[], size_t payload_len);
 
+#if !(USE_I2C && __xcore__) || __DOXYGEN__
+/**
+ * The maximum number of commands that may be added to a single batch.
+ */
+#ifndef CONTROL_BATCH_MAX_COMMANDS
+#define CONTROL_BATCH_MAX_COMMANDS 64
+#endif
+
+/**
+ * Struct representing a batch of commands to be sent to the device together.
+ *
+ * The members in this struct should not be accessed directly.
+ */
+typedef struct {
+    size_t count;
+    struct {
+        control_resid_t resid;
+        control_cmd_t cmd;
+        uint8_t *payload;
+        size_t payload_len;
+    } cmds[CONTROL_BATCH_MAX_COMMANDS];
+} control_batch_t;
+
+/** Starts a new, empty batch of commands. This must be called before adding
+ *  commands to a batch, and may be called again after committing it to reuse it.
+ *
+ *  \param batch        The batch to initialize
+ */
+void control_batch_begin(control_batch_t *batch);
+
+/** Adds a command to a batch. Nothing is sent to the device until the batch is
+ *  committed with control_batch_commit().
+ *
+ *  \param batch        The batch to add the command to
+ *  \param resid        Resource ID. Indicates which resource the command is intended for
+ *  \param cmd          Command code. Set bit 7 with CONTROL_CMD_SET_READ() for a read
+ *                      command, otherwise this is a write command
+ *  \param payload      For a write command, the payload to send. For a read command,
+ *                      the buffer that the payload read from the device is written to.
+ *                      This is not copied, and so must remain valid until the batch
+ *                      has been committed.
+ *  \param payload_len  Size of the payload in bytes
+ *
+ *  \returns            CONTROL_SUCCESS if the command was added, CONTROL_ERROR if the
+ *                      batch is full, or CONTROL_DATA_LENGTH_ERROR if the command is
+ *                      too large to ever be sent within a batch over this transport.
+ */
+control_ret_t control_batch_add(control_batch_t *batch,
+                                control_resid_t resid, control_cmd_t cmd,
+                                uint8_t payload[], size_t payload_len);
+
+/** Sends all the commands in a batch to the device. The commands are packed into
+ *  as few transactions as the transport allows, and are executed by the device in
+ *  the order they were added.
+ *
+ *  \param batch        The batch to send
+ *  \param status       Array of at least as many entries as there are commands in
+ *                      the batch. This is updated with the status of each command.
+ *
+ *  \returns            CONTROL_SUCCESS if every command was sent and succeeded. If
+ *                      any command failed then CONTROL_ERROR, and \p status indicates
+ *                      which. If a transaction with the device fails, its error is
+ *                      returned and the commands not yet executed are given that
+ *                      same status.
+ */
+control_ret_t control_batch_commit(control_batch_t *batch, control_status_t status[]);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
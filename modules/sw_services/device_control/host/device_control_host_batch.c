@@ -0,0 +1,143 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+#if !(USE_I2C && __xcore__)
+
+#include <stdio.h>
+#include "device_control_host.h"
+#include "control_host_support.h"
+#include "util.h"
+
+/* Size of a single command within the request and the result of a batch */
+static size_t entry_request_size(control_cmd_t cmd, size_t payload_len)
+{
+  return CONTROL_BATCH_ENTRY_HEADER_SIZE + (IS_CONTROL_CMD_READ(cmd) ? 0 : payload_len);
+}
+
+static size_t entry_result_size(control_cmd_t cmd, size_t payload_len)
+{
+  return sizeof(control_status_t) + (IS_CONTROL_CMD_READ(cmd) ? payload_len : 0);
+}
+
+void control_batch_begin(control_batch_t *batch)
+{
+  batch->count = 0;
+}
+
+control_ret_t control_batch_add(control_batch_t *batch,
+                                control_resid_t resid, control_cmd_t cmd,
+                                uint8_t payload[], size_t payload_len)
+{
+  if (batch->count >= CONTROL_BATCH_MAX_COMMANDS) {
+    PRINT_ERROR("Batch already contains the maximum of %d commands\n", CONTROL_BATCH_MAX_COMMANDS);
+    return CONTROL_ERROR;
+  }
+
+  if (CONTROL_BATCH_HEADER_SIZE + entry_request_size(cmd, payload_len) > CONTROL_HOST_BATCH_MAX_BYTES ||
+      entry_result_size(cmd, payload_len) > CONTROL_HOST_BATCH_MAX_BYTES) {
+    PRINT_ERROR("Command of %zd bytes is too large to batch, maximum is %d\n",
+                payload_len, CONTROL_HOST_BATCH_MAX_BYTES);
+    return CONTROL_DATA_LENGTH_ERROR;
+  }
+
+  batch->cmds[batch->count].resid = resid;
+  batch->cmds[batch->count].cmd = cmd;
+  batch->cmds[batch->count].payload = payload;
+  batch->cmds[batch->count].payload_len = payload_len;
+  batch->count++;
+
+  return CONTROL_SUCCESS;
+}
+
+/*
+ * Packs as many commands as will fit into a single transaction, starting
+ * from the command at index first. Returns the number of commands packed.
+ */
+static size_t batch_pack(const control_batch_t *batch, size_t first,
+                         uint8_t request[CONTROL_HOST_BATCH_MAX_BYTES],
+                         size_t *request_len, size_t *result_len)
+{
+  size_t req_len = CONTROL_BATCH_HEADER_SIZE;
+  size_t res_len = 0;
+  size_t n = 0;
+
+  while (first + n < batch->count && n < UINT8_MAX) {
+    const control_cmd_t cmd = batch->cmds[first + n].cmd;
+    const size_t payload_len = batch->cmds[first + n].payload_len;
+
+    if (req_len + entry_request_size(cmd, payload_len) > CONTROL_HOST_BATCH_MAX_BYTES ||
+        res_len + entry_result_size(cmd, payload_len) > CONTROL_HOST_BATCH_MAX_BYTES) {
+      break;
+    }
+
+    request[req_len++] = batch->cmds[first + n].resid;
+    request[req_len++] = cmd;
+    request[req_len++] = (uint8_t)payload_len;
+    if (!IS_CONTROL_CMD_READ(cmd)) {
+      memcpy(&request[req_len], batch->cmds[first + n].payload, payload_len);
+      req_len += payload_len;
+    }
+    res_len += entry_result_size(cmd, payload_len);
+    n++;
+  }
+
+  request[0] = (uint8_t)n;
+  *request_len = req_len;
+  *result_len = res_len;
+
+  return n;
+}
+
+control_ret_t control_batch_commit(control_batch_t *batch, control_status_t status[])
+{
+  uint8_t request[CONTROL_HOST_BATCH_MAX_BYTES];
+  uint8_t result[CONTROL_HOST_BATCH_MAX_BYTES];
+  control_ret_t ret = CONTROL_SUCCESS;
+  size_t first = 0;
+
+  while (first < batch->count) {
+    size_t request_len, result_len, read_offset;
+    size_t n = batch_pack(batch, first, request, &request_len, &result_len);
+
+    DBG(printf("send batch of %zd commands: ", n));
+    DBG(print_bytes(request, (int)request_len));
+
+    control_ret_t xfer_ret = control_write_command(CONTROL_SPECIAL_RESID, CONTROL_BATCH_EXECUTE,
+                                                   request, request_len);
+    if (xfer_ret == CONTROL_SUCCESS) {
+      xfer_ret = control_read_command(CONTROL_SPECIAL_RESID, CONTROL_GET_BATCH_RESULT,
+                                      result, result_len);
+    }
+
+    if (xfer_ret != CONTROL_SUCCESS) {
+      for (size_t i = first; i < batch->count; i++) {
+        status[i] = (control_status_t)xfer_ret;
+      }
+      return xfer_ret;
+    }
+
+    DBG(printf("batch result returned: "));
+    DBG(print_bytes(result, (int)result_len));
+
+    read_offset = n;
+    for (size_t i = 0; i < n; i++) {
+      const control_cmd_t cmd = batch->cmds[first + i].cmd;
+      const size_t payload_len = batch->cmds[first + i].payload_len;
+
+      status[first + i] = result[i];
+      if (result[i] != CONTROL_SUCCESS) {
+        ret = CONTROL_ERROR;
+      }
+
+      if (IS_CONTROL_CMD_READ(cmd)) {
+        memcpy(batch->cmds[first + i].payload, &result[read_offset], payload_len);
+        read_offset += payload_len;
+      }
+    }
+
+    first += n;
+  }
+
+  return ret;
+}
+
+#endif // !(USE_I2C && __xcore__)
@@ -4,10 +4,12 @@
 #define DEBUG_UNIT CONTROL
 #include <rtos_printf.h>
 #include <string.h>
+#include <xcore/hwtimer.h>
 
 #include "rtos_osal.h"
 
 #include "device_control.h"
+#include "device_control_batch.h"
 
 typedef struct {
     int cmd;
@@ -17,8 +19,8 @@ typedef struct {
 
 typedef struct {
     rtos_osal_queue_t *queue;
-    size_t num_resources;
-    control_resid_t resources[];
+    size_t num_ranges;
+    device_control_resid_range_t ranges[];
 } servicer_init_data_t;
 
 typedef struct {
@@ -31,17 +33,31 @@ typedef struct {
     uint8_t buf[];
 } cmd_to_servicer_t;
 
+/*
+ * On client tiles, commands are received into a command slot that is
+ * allocated once when the client thread starts. Space for the status is
+ * reserved in front of the payload so that the response to a read command
+ * can be sent straight from the slot in a single transfer.
+ */
+#define CLIENT_SLOT_PAYLOAD_OFFSET sizeof(control_ret_t)
+#define CLIENT_SLOT_SIZE (sizeof(cmd_to_servicer_t) + CLIENT_SLOT_PAYLOAD_OFFSET + DEVICE_CONTROL_CLIENT_MAX_PAYLOAD_LEN)
+
 void resource_table_init(device_control_t *ctx);
 
 int resource_table_add(device_control_t *ctx,
-                       const control_resid_t resources[],
-                       size_t num_resources,
+                       const device_control_resid_range_t ranges[],
+                       size_t num_ranges,
                        uint8_t servicer);
 
 int resource_table_search(device_control_t *ctx,
                           control_resid_t resid,
                           uint8_t *servicer);
 
+int resource_table_search_next(device_control_t *ctx,
+                               control_resid_t resid,
+                               size_t *iter,
+                               uint8_t *servicer);
+
 control_ret_t device_control_servicer_cmd_recv(device_control_servicer_t *ctx,
                                                DEVICE_CONTROL_CALLBACK_ATTR device_control_read_cmd_cb_t read_cmd_cb,
                                                DEVICE_CONTROL_CALLBACK_ATTR device_control_write_cmd_cb_t write_cmd_cb,
@@ -71,26 +87,17 @@ control_ret_t device_control_servicer_cmd_recv(device_control_servicer_t *ctx,
         } else {
             /* gateway is on another tile */
 
+            /*
+             * The command is in the client thread's command slot, which
+             * it will not reuse until this response has been sent.
+             */
             if (IS_CONTROL_CMD_READ(c_ptr->cmd)) {
-                rtos_intertile_tx_len(device_control_ctx->host_intertile, device_control_ctx->intertile_port, sizeof(ret) + c_ptr->payload_len);
-                rtos_intertile_tx_data(device_control_ctx->host_intertile, &ret, sizeof(ret));
-                rtos_intertile_tx_data(device_control_ctx->host_intertile, c_ptr->payload, c_ptr->payload_len);
-                /*
-                 * the thread that received this over the intertile channel
-                 * malloc'd this buffer, so it must be freed here.
-                 */
-                rtos_osal_free(c_ptr->payload);
+                /* The read payload already follows the space reserved for the status */
+                memcpy(c_ptr->buf, &ret, sizeof(ret));
+                rtos_intertile_tx(device_control_ctx->host_intertile, device_control_ctx->intertile_port, c_ptr->buf, sizeof(ret) + c_ptr->payload_len);
             } else {
                 rtos_intertile_tx(device_control_ctx->host_intertile, device_control_ctx->intertile_port, &ret, sizeof(ret));
             }
-
-            /*
-             * the thread that received this over the intertile channel
-             * malloc'd this buffer, so it must be freed here.
-             * In the above case where it came from the same tile, this
-             * is still owned by the application.
-             */
-            rtos_osal_free(c_ptr);
         }
     }
     return status == RTOS_OSAL_SUCCESS ? CONTROL_SUCCESS : CONTROL_ERROR;
@@ -101,25 +108,32 @@ static void device_control_client_thread(device_control_t *ctx)
     uint32_t msg_length;
     cmd_to_servicer_t *c_ptr;
 
-    for (;;) {
-        msg_length = rtos_intertile_rx(ctx->host_intertile,
-                                       ctx->intertile_port,
-                                       (void **) &c_ptr,
-                                       RTOS_OSAL_WAIT_FOREVER);
+    /*
+     * The transport layer on the host tile waits for the response to each
+     * command before sending the next, so a single slot is sufficient.
+     */
+    c_ptr = rtos_osal_malloc(CLIENT_SLOT_SIZE);
+    xassert(c_ptr != NULL);
 
-        c_ptr->dev_ctrl_ctx = ctx;
+    for (;;) {
+        msg_length = rtos_intertile_rx_len(ctx->host_intertile,
+                                           ctx->intertile_port,
+                                           RTOS_OSAL_WAIT_FOREVER);
 
         if (msg_length != 0) {
+            xassert(msg_length >= sizeof(cmd_to_servicer_t));
+            rtos_intertile_rx_data(ctx->host_intertile, c_ptr, sizeof(cmd_to_servicer_t));
+
+            c_ptr->dev_ctrl_ctx = ctx;
+            c_ptr->payload = &c_ptr->buf[CLIENT_SLOT_PAYLOAD_OFFSET];
+            xassert(c_ptr->payload_len <= DEVICE_CONTROL_CLIENT_MAX_PAYLOAD_LEN);
 
             if (IS_CONTROL_CMD_READ(c_ptr->cmd)) {
                 xassert(msg_length == sizeof(cmd_to_servicer_t));
                 xassert(c_ptr->payload_len > 0);
-                /* Allocate a buffer for the read data to be written to */
-                c_ptr->payload = rtos_osal_malloc(c_ptr->payload_len);
             } else {
-                xassert(msg_length >= sizeof(cmd_to_servicer_t));
                 xassert(c_ptr->payload_len == msg_length - sizeof(cmd_to_servicer_t));
-                c_ptr->payload = c_ptr->buf;
+                rtos_intertile_rx_data(ctx->host_intertile, c_ptr->payload, c_ptr->payload_len);
             }
 
             rtos_osal_queue_send(c_ptr->queue, &c_ptr, RTOS_OSAL_WAIT_FOREVER);
@@ -127,11 +141,54 @@ static void device_control_client_thread(device_control_t *ctx)
     }
 }
 
+static void put_be32(uint8_t *buf, uint32_t val)
+{
+    buf[0] = (uint8_t) (val >> 24);
+    buf[1] = (uint8_t) (val >> 16);
+    buf[2] = (uint8_t) (val >> 8);
+    buf[3] = (uint8_t) val;
+}
+
+static control_ret_t servicer_stats_read(device_control_t *ctx,
+                                         size_t servicer,
+                                         uint8_t payload[],
+                                         unsigned payload_len)
+{
+    device_control_servicer_stats_t stats;
+    uint32_t latency_mean = 0;
+
+    if (payload_len != CONTROL_SERVICER_STATS_SIZE) {
+        rtos_printf("wrong payload size %d for read servicer stats command, need %d\n",
+                payload_len, CONTROL_SERVICER_STATS_SIZE);
+
+        return CONTROL_BAD_COMMAND;
+    }
+
+    if (device_control_servicer_stats_get(ctx, servicer, &stats) != CONTROL_SUCCESS) {
+        return CONTROL_BAD_RESOURCE;
+    }
+
+    if (stats.command_count > 0) {
+        latency_mean = (uint32_t) (stats.latency_total / stats.command_count);
+    }
+
+    put_be32(&payload[0], stats.command_count);
+    put_be32(&payload[4], stats.error_count);
+    put_be32(&payload[8], latency_mean);
+    put_be32(&payload[12], stats.latency_max);
+
+    return CONTROL_SUCCESS;
+}
+
 static control_ret_t special_read_command(device_control_t *ctx,
                                           control_cmd_t cmd,
                                           uint8_t payload[],
                                           unsigned payload_len)
 {
+    if (cmd >= CONTROL_GET_SERVICER_STATS(0)) {
+        return servicer_stats_read(ctx, cmd - CONTROL_GET_SERVICER_STATS(0), payload, payload_len);
+    }
+
     switch (cmd) {
     case CONTROL_GET_VERSION:
         rtos_printf("read version %d\n", CONTROL_VERSION);
@@ -157,12 +214,80 @@ static control_ret_t special_read_command(device_control_t *ctx,
             return CONTROL_SUCCESS;
         }
 
+    case CONTROL_GET_SERVICER_COUNT:
+        if (payload_len != sizeof(uint8_t)) {
+            rtos_printf("wrong payload size %d for read servicer count command, need %d\n",
+                    payload_len, sizeof(uint8_t));
+
+            return CONTROL_BAD_COMMAND;
+        } else {
+            payload[0] = (uint8_t) ctx->servicer_count;
+            return CONTROL_SUCCESS;
+        }
+
+    case CONTROL_GET_BATCH_RESULT:
+        rtos_printf("read batch result of %d bytes\n", ctx->batch_result_len);
+        if (payload_len > ctx->batch_result_len) {
+            rtos_printf("wrong payload size %d for read batch result command, have %d\n",
+                    payload_len, ctx->batch_result_len);
+
+            return CONTROL_DATA_LENGTH_ERROR;
+        } else {
+            memcpy(payload, ctx->batch_result, payload_len);
+            return CONTROL_SUCCESS;
+        }
+
     default:
         rtos_printf("unrecognised special resource command %d\n", cmd);
         return CONTROL_BAD_COMMAND;
     }
 }
 
+static control_ret_t forward_command(device_control_t *ctx,
+                                     control_resid_t resid,
+                                     control_cmd_t cmd,
+                                     uint8_t payload[],
+                                     unsigned payload_len);
+
+DEVICE_CONTROL_BATCH_DISPATCH_ATTR
+static control_ret_t batch_dispatch(void *dispatch_ctx,
+                                    control_resid_t resid,
+                                    control_cmd_t cmd,
+                                    uint8_t *payload,
+                                    size_t payload_len)
+{
+    device_control_t *ctx = dispatch_ctx;
+    uint8_t servicer;
+
+    /* Batches may not be nested, and the special resource is not dispatched from within one */
+    if (resid == CONTROL_SPECIAL_RESID || resource_table_search(ctx, resid, &servicer) != 0) {
+        rtos_printf("resource %d not found in batch\n", resid);
+        return CONTROL_BAD_RESOURCE;
+    }
+
+    return forward_command(ctx, resid, cmd, payload, payload_len);
+}
+
+static control_ret_t special_write_command(device_control_t *ctx,
+                                           control_cmd_t cmd,
+                                           uint8_t payload[],
+                                           unsigned payload_len)
+{
+    switch (cmd) {
+    case CONTROL_BATCH_EXECUTE:
+        rtos_printf("execute batch of %d bytes\n", payload_len);
+        return device_control_batch_execute(payload, payload_len,
+                                            ctx->batch_result, CONTROL_BATCH_MAX_BYTES,
+                                            &ctx->batch_result_len,
+                                            batch_dispatch,
+                                            ctx);
+
+    default:
+        rtos_printf("ignoring write to special resource %d\n", CONTROL_SPECIAL_RESID);
+        return CONTROL_BAD_COMMAND;
+    }
+}
+
 static control_ret_t do_command(device_control_t *ctx,
                                 uint8_t servicer,
                                 control_resid_t resid,
@@ -176,8 +301,7 @@ static control_ret_t do_command(device_control_t *ctx,
         if (IS_CONTROL_CMD_READ(cmd)) {
             return special_read_command(ctx, cmd, payload, payload_len);
         } else {
-            rtos_printf("ignoring write to special resource %d\n", CONTROL_SPECIAL_RESID);
-            return CONTROL_BAD_COMMAND;
+            return special_write_command(ctx, cmd, payload, payload_len);
         }
     } else {
 
@@ -194,6 +318,11 @@ static control_ret_t do_command(device_control_t *ctx,
                 .buf = {}
         };
         cmd_to_servicer_t *c_ptr = &c;
+        device_control_servicer_stats_t *stats = &ctx->servicer_table[servicer].stats;
+        uint32_t start_time;
+        uint32_t latency;
+
+        start_time = get_reference_time();
 
         if (intertile_ctx == NULL) { /* on tile case */
 
@@ -203,6 +332,11 @@ static control_ret_t do_command(device_control_t *ctx,
         } else { /* off tile case */
             size_t xfer_len = sizeof(cmd_to_servicer_t);
 
+            if (payload_len > DEVICE_CONTROL_CLIENT_MAX_PAYLOAD_LEN) {
+                rtos_printf("payload of %d bytes too large for servicer on another tile\n", payload_len);
+                return CONTROL_DATA_LENGTH_ERROR;
+            }
+
             if (!IS_CONTROL_CMD_READ(cmd)) {
                 xfer_len += payload_len;
             }
@@ -230,6 +364,16 @@ static control_ret_t do_command(device_control_t *ctx,
             }
         }
 
+        latency = get_reference_time() - start_time;
+        stats->command_count++;
+        stats->latency_total += latency;
+        if (latency > stats->latency_max) {
+            stats->latency_max = latency;
+        }
+        if (ret != CONTROL_SUCCESS) {
+            stats->error_count++;
+        }
+
         if (IS_CONTROL_CMD_READ(cmd)) {
             rtos_printf("%d read command %d, %d, %d\n", servicer, resid, cmd, payload_len);
         } else {
@@ -240,6 +384,43 @@ static control_ret_t do_command(device_control_t *ctx,
     }
 }
 
+/*
+ * Forwards a command to the servicer that has registered its resource ID.
+ * Write commands to a broadcast resource ID are forwarded to every servicer
+ * that has registered it, and the first error, if any, is returned.
+ */
+static control_ret_t forward_command(device_control_t *ctx,
+                                     control_resid_t resid,
+                                     control_cmd_t cmd,
+                                     uint8_t payload[],
+                                     unsigned payload_len)
+{
+    control_ret_t ret = CONTROL_BAD_RESOURCE;
+    control_ret_t servicer_ret;
+    size_t iter = 0;
+    size_t count = 0;
+    uint8_t servicer;
+
+    if (resid == CONTROL_SPECIAL_RESID) {
+        return do_command(ctx, 0, resid, cmd, payload, payload_len);
+    }
+
+    while (resource_table_search_next(ctx, resid, &iter, &servicer) == 0) {
+        servicer_ret = do_command(ctx, servicer, resid, cmd, payload, payload_len);
+
+        if (count++ == 0 || ret == CONTROL_SUCCESS) {
+            ret = servicer_ret;
+        }
+
+        /* Only one servicer may respond to a read */
+        if (IS_CONTROL_CMD_READ(cmd)) {
+            break;
+        }
+    }
+
+    return ret;
+}
+
 void device_control_payload_transfer_bidir(device_control_t *ctx,
                                               uint8_t *rx_buf,
                                               const size_t rx_size,
@@ -263,14 +444,14 @@ void device_control_payload_transfer_bidir(device_control_t *ctx,
             }
             else
             {
-                ret = do_command(ctx, servicer, requested_resid, requested_cmd, rx_buf, requested_payload_len);
+                ret = forward_command(ctx, requested_resid, requested_cmd, rx_buf, requested_payload_len);
                 tx_buf[0] = ret;
             }
         }
         else // Read command
         {
             rtos_printf("do_read_command(), requested_resid %d, requested_cmd %d, requested_payload_len %d\n", requested_resid, requested_cmd, requested_payload_len);
-            ret = do_command(ctx, servicer, requested_resid, requested_cmd, tx_buf, requested_payload_len);
+            ret = forward_command(ctx, requested_resid, requested_cmd, tx_buf, requested_payload_len);
             //tx_buf[0] = ret;
             *tx_size = requested_payload_len;
         }
@@ -305,7 +486,7 @@ control_ret_t device_control_payload_transfer(device_control_t *ctx,
                 rtos_printf("Write request for write command %d\n", requested_cmd);
                 // Forward the command to the servicer. Save the status
                 if (requested_payload_len <= *buf_size) {
-                    ret = do_command(ctx, servicer, requested_resid, requested_cmd, payload_buf, requested_payload_len);
+                    ret = forward_command(ctx, requested_resid, requested_cmd, payload_buf, requested_payload_len);
                 }
                 else {
                     ret = CONTROL_DATA_LENGTH_ERROR;
@@ -333,7 +514,7 @@ control_ret_t device_control_payload_transfer(device_control_t *ctx,
             {
                 rtos_printf("Read request for read command %d\n", requested_cmd);
                 // Forward the command to the servicer. Update returned status in the first byte of payload
-                ret = do_command(ctx, servicer, requested_resid, requested_cmd, payload_buf, requested_payload_len);
+                ret = forward_command(ctx, requested_resid, requested_cmd, payload_buf, requested_payload_len);
                 //payload_buf[0] = ret;
             }
 
@@ -373,13 +554,13 @@ control_ret_t device_control_request(device_control_t *ctx,
     return ret;
 }
 
-control_ret_t device_control_servicer_register(device_control_servicer_t *ctx,
-                                               device_control_t *device_control_ctx[],
-                                               size_t device_control_ctx_count,
-                                               const control_resid_t resources[],
-                                               size_t num_resources)
+static control_ret_t servicer_init_data_send(device_control_servicer_t *ctx,
+                                             device_control_t *device_control_ctx[],
+                                             size_t device_control_ctx_count,
+                                             const device_control_resid_range_t ranges[],
+                                             size_t num_ranges)
 {
-    const size_t len = sizeof(servicer_init_data_t) + sizeof(control_resid_t) * num_resources;
+    const size_t len = sizeof(servicer_init_data_t) + sizeof(device_control_resid_range_t) * num_ranges;
 
     rtos_osal_queue_create(&ctx->queue, "servicer_q", 1, sizeof(void *));
 
@@ -391,9 +572,9 @@ control_ret_t device_control_servicer_register(device_control_servicer_t *ctx,
     for (int i = 0; i < device_control_ctx_count; i++) {
         servicer_init_data_t *init_data = rtos_osal_malloc(len);
 
-        init_data->num_resources = num_resources;
+        init_data->num_ranges = num_ranges;
         init_data->queue = &ctx->queue;
-        memcpy(init_data->resources, resources, sizeof(control_resid_t) * num_resources);
+        memcpy(init_data->ranges, ranges, sizeof(device_control_resid_range_t) * num_ranges);
 
         if (device_control_ctx[i]->resource_table != NULL) {
 
@@ -410,6 +591,47 @@ control_ret_t device_control_servicer_register(device_control_servicer_t *ctx,
     return CONTROL_SUCCESS;
 }
 
+control_ret_t device_control_servicer_register_ranges(device_control_servicer_t *ctx,
+                                                      device_control_t *device_control_ctx[],
+                                                      size_t device_control_ctx_count,
+                                                      const device_control_resid_range_t ranges[],
+                                                      size_t num_ranges)
+{
+    return servicer_init_data_send(ctx, device_control_ctx, device_control_ctx_count, ranges, num_ranges);
+}
+
+control_ret_t device_control_servicer_register(device_control_servicer_t *ctx,
+                                               device_control_t *device_control_ctx[],
+                                               size_t device_control_ctx_count,
+                                               const control_resid_t resources[],
+                                               size_t num_resources)
+{
+    device_control_resid_range_t *ranges;
+    size_t num_ranges = 0;
+    control_ret_t ret;
+
+    ranges = rtos_osal_malloc(sizeof(device_control_resid_range_t) * (num_resources > 0 ? num_resources : 1));
+
+    /* Consecutive resource IDs are merged into a single range */
+    for (size_t i = 0; i < num_resources; i++) {
+        if (num_ranges > 0 &&
+                ranges[num_ranges - 1].last != CONTROL_MAX_RESOURCE_ID &&
+                ranges[num_ranges - 1].last + 1 == resources[i]) {
+            ranges[num_ranges - 1].last = resources[i];
+        } else {
+            ranges[num_ranges].first = resources[i];
+            ranges[num_ranges].last = resources[i];
+            ranges[num_ranges].flags = 0;
+            num_ranges++;
+        }
+    }
+
+    ret = servicer_init_data_send(ctx, device_control_ctx, device_control_ctx_count, ranges, num_ranges);
+    rtos_osal_free(ranges);
+
+    return ret;
+}
+
 static int servicer_register(device_control_t *ctx,
                               servicer_init_data_t *init_cmd,
                               rtos_intertile_t *intertile_ctx,
@@ -418,7 +640,8 @@ static int servicer_register(device_control_t *ctx,
     int ret;
     ctx->servicer_table[servicer_index].queue = init_cmd->queue;
     ctx->servicer_table[servicer_index].intertile_ctx = intertile_ctx;
-    ret = resource_table_add(ctx, init_cmd->resources, init_cmd->num_resources, servicer_index);
+    memset(&ctx->servicer_table[servicer_index].stats, 0, sizeof(ctx->servicer_table[servicer_index].stats));
+    ret = resource_table_add(ctx, init_cmd->ranges, init_cmd->num_ranges, servicer_index);
     rtos_osal_free(init_cmd);
     return ret;
 }
@@ -459,6 +682,19 @@ control_ret_t device_control_resources_register(device_control_t *ctx,
     }
 }
 
+control_ret_t device_control_servicer_stats_get(device_control_t *ctx,
+                                               size_t servicer_index,
+                                               device_control_servicer_stats_t *stats)
+{
+    if (ctx->resource_table == NULL || ctx->servicer_table == NULL || servicer_index >= ctx->servicer_count) {
+        return CONTROL_BAD_RESOURCE;
+    }
+
+    *stats = ctx->servicer_table[servicer_index].stats;
+
+    return CONTROL_SUCCESS;
+}
+
 control_ret_t device_control_start(device_control_t *ctx,
                                    uint8_t intertile_port,
                                    unsigned priority)
@@ -502,6 +738,10 @@ control_ret_t device_control_init(device_control_t *ctx,
     if (mode == DEVICE_CONTROL_HOST_MODE) {
         memset(ctx, 0, sizeof(device_control_t));
         resource_table_init(ctx);
+        ctx->batch_result = rtos_osal_malloc(CONTROL_BATCH_MAX_BYTES);
+        if (ctx->batch_result == NULL) {
+            return CONTROL_REGISTRATION_FAILED;
+        }
 
         ctx->servicer_count = servicer_count;
 
@@ -0,0 +1,113 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <string.h>
+
+#include "device_control_batch.h"
+
+/*
+ * Walks the batch payload without dispatching anything, to ensure that every
+ * entry is complete and that the result will fit before any command is run.
+ * A batch is either rejected as a whole or executed as a whole.
+ */
+static control_ret_t batch_validate(const uint8_t *request,
+                                    size_t request_len,
+                                    size_t result_size,
+                                    size_t *required_result_len)
+{
+    size_t count;
+    size_t offset;
+    size_t result_len;
+
+    if (request_len < CONTROL_BATCH_HEADER_SIZE) {
+        return CONTROL_MALFORMED_PACKET;
+    }
+
+    count = request[0];
+    offset = CONTROL_BATCH_HEADER_SIZE;
+    result_len = count;
+
+    for (size_t i = 0; i < count; i++) {
+        control_cmd_t cmd;
+        size_t payload_len;
+
+        if (request_len - offset < CONTROL_BATCH_ENTRY_HEADER_SIZE) {
+            return CONTROL_MALFORMED_PACKET;
+        }
+
+        cmd = request[offset + 1];
+        payload_len = request[offset + 2];
+        offset += CONTROL_BATCH_ENTRY_HEADER_SIZE;
+
+        if (IS_CONTROL_CMD_READ(cmd)) {
+            result_len += payload_len;
+        } else {
+            if (request_len - offset < payload_len) {
+                return CONTROL_MALFORMED_PACKET;
+            }
+            offset += payload_len;
+        }
+    }
+
+    if (offset != request_len) {
+        return CONTROL_MALFORMED_PACKET;
+    }
+
+    if (result_len > result_size) {
+        return CONTROL_DATA_LENGTH_ERROR;
+    }
+
+    *required_result_len = result_len;
+    return CONTROL_SUCCESS;
+}
+
+control_ret_t device_control_batch_execute(uint8_t *request,
+                                           size_t request_len,
+                                           uint8_t *result,
+                                           size_t result_size,
+                                           size_t *result_len,
+                                           DEVICE_CONTROL_BATCH_DISPATCH_ATTR device_control_batch_dispatch_t dispatch,
+                                           void *dispatch_ctx)
+{
+    control_ret_t ret;
+    size_t count;
+    size_t offset;
+    size_t read_offset;
+    size_t required_len;
+
+    *result_len = 0;
+
+    ret = batch_validate(request, request_len, result_size, &required_len);
+    if (ret != CONTROL_SUCCESS) {
+        return ret;
+    }
+
+    count = request[0];
+    offset = CONTROL_BATCH_HEADER_SIZE;
+    read_offset = count;
+
+    for (size_t i = 0; i < count; i++) {
+        const control_resid_t resid = request[offset];
+        const control_cmd_t cmd = request[offset + 1];
+        const size_t payload_len = request[offset + 2];
+        control_ret_t cmd_ret;
+
+        offset += CONTROL_BATCH_ENTRY_HEADER_SIZE;
+
+        if (IS_CONTROL_CMD_READ(cmd)) {
+            cmd_ret = dispatch(dispatch_ctx, resid, cmd, &result[read_offset], payload_len);
+            if (cmd_ret != CONTROL_SUCCESS) {
+                memset(&result[read_offset], 0, payload_len);
+            }
+            read_offset += payload_len;
+        } else {
+            cmd_ret = dispatch(dispatch_ctx, resid, cmd, &request[offset], payload_len);
+            offset += payload_len;
+        }
+
+        result[i] = (control_status_t) cmd_ret;
+    }
+
+    *result_len = required_len;
+    return CONTROL_SUCCESS;
+}
@@ -0,0 +1,75 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef DEVICE_CONTROL_BATCH_H_
+#define DEVICE_CONTROL_BATCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "device_control_shared.h"
+
+/**
+ * This attribute must be specified on all functions passed to
+ * device_control_batch_execute() as the dispatch function.
+ */
+#if __xcore__
+#define DEVICE_CONTROL_BATCH_DISPATCH_ATTR __attribute__((fptrgroup("device_control_batch_dispatch_fptr_grp")))
+#else
+#define DEVICE_CONTROL_BATCH_DISPATCH_ATTR
+#endif
+
+/**
+ * Function pointer type used by device_control_batch_execute() to dispatch
+ * each command found in a batch payload.
+ *
+ * \param dispatch_ctx The context pointer given to device_control_batch_execute().
+ * \param resid        The resource ID of the command.
+ * \param cmd          The command code. Bit 7 is set for read commands.
+ * \param payload      For write commands, the payload received from the host.
+ *                     For read commands, the buffer the payload must be written to.
+ * \param payload_len  The length of \p payload in bytes.
+ *
+ * \returns            The status of the command.
+ */
+typedef control_ret_t (*device_control_batch_dispatch_t)(void *dispatch_ctx,
+                                                         control_resid_t resid,
+                                                         control_cmd_t cmd,
+                                                         uint8_t *payload,
+                                                         size_t payload_len);
+
+/**
+ * Unpacks a CONTROL_BATCH_EXECUTE payload and dispatches each command in it,
+ * in order. The status of each command is written to the start of \p result,
+ * followed by the payloads of all read commands.
+ *
+ * Every command is dispatched even if an earlier one fails. The payload space
+ * for a failed read command is still reserved in \p result, and is zeroed.
+ *
+ * This has no dependency on the RTOS so that it may also be built into host
+ * applications that emulate a device.
+ *
+ * \param request      The batch payload received from the host.
+ * \param request_len  The length of \p request in bytes.
+ * \param result       The buffer to write the batch result to.
+ * \param result_size  The size of \p result in bytes.
+ * \param result_len   Updated with the number of bytes written to \p result.
+ * \param dispatch     The function to dispatch each command to.
+ * \param dispatch_ctx A context pointer to pass to \p dispatch.
+ *
+ * \retval CONTROL_SUCCESS if the batch was well formed and every command was dispatched.
+ *         The status of each individual command is found at the start of \p result.
+ * \retval CONTROL_MALFORMED_PACKET if the batch payload could not be parsed. No
+ *         commands are dispatched in this case.
+ * \retval CONTROL_DATA_LENGTH_ERROR if the result does not fit within \p result_size.
+ *         No commands are dispatched in this case.
+ */
+control_ret_t device_control_batch_execute(uint8_t *request,
+                                           size_t request_len,
+                                           uint8_t *result,
+                                           size_t result_size,
+                                           size_t *result_len,
+                                           device_control_batch_dispatch_t dispatch,
+                                           void *dispatch_ctx);
+
+#endif /* DEVICE_CONTROL_BATCH_H_ */
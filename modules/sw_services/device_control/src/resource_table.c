@@ -1,4 +1,4 @@
-// Copyright 2016-2023 XMOS LIMITED.
+// Copyright 2016-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT RESOURCE_TABLE
@@ -6,62 +6,263 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #include "device_control.h"
 
-#define RESOURCE_TABLE_SIZE 256
 #define NO_SERVICER         255
+#define SEARCH_DONE         SIZE_MAX
+
+typedef struct {
+    control_resid_t first;
+    control_resid_t last;
+    uint8_t servicer;
+} device_control_resource_entry_t;
+
+/*
+ * The resource table holds two lists of resource ID ranges. Exclusive ranges
+ * are owned by exactly one servicer, may not overlap, and are kept sorted so
+ * that they may be binary searched. Broadcast ranges may overlap other
+ * broadcast ranges, but never an exclusive range. There are expected to be
+ * very few of these, so they are searched linearly.
+ */
+struct device_control_resource_table_struct {
+    size_t exclusive_count;
+    size_t broadcast_count;
+    device_control_resource_entry_t *exclusive;
+    device_control_resource_entry_t *broadcast;
+};
+
+static int ranges_overlap(const device_control_resource_entry_t *a,
+                          const device_control_resid_range_t *b)
+{
+    return a->first <= b->last && b->first <= a->last;
+}
+
+static int range_check(device_control_resource_table_t *table,
+                       const device_control_resid_range_t *range,
+                       uint8_t servicer)
+{
+    if (range->first > range->last) {
+        rtos_printf("invalid resource range %d-%d for servicer %d\n", range->first, range->last, servicer);
+        return 2;
+    }
+
+    if (range->first == CONTROL_SPECIAL_RESID) {
+        rtos_printf("can't use reserved resource number %d\n", CONTROL_SPECIAL_RESID);
+        return 2;
+    }
+
+    for (size_t i = 0; i < table->exclusive_count; i++) {
+        if (ranges_overlap(&table->exclusive[i], range)) {
+            rtos_printf("resources %d-%d overlap those registered for servicer %d\n",
+                        range->first, range->last, table->exclusive[i].servicer);
+            return 3;
+        }
+    }
+
+    for (size_t i = 0; i < table->broadcast_count; i++) {
+        if (ranges_overlap(&table->broadcast[i], range)) {
+            if (!(range->flags & DEVICE_CONTROL_RESID_BROADCAST) || table->broadcast[i].servicer == servicer) {
+                rtos_printf("resources %d-%d overlap those registered for servicer %d\n",
+                            range->first, range->last, table->broadcast[i].servicer);
+                return 3;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Allocates a copy of a list with room for count more entries. The old
+ * list is left in place, so that the table is unchanged if the copy of
+ * the other list can not be allocated. The table is only modified during
+ * registration, before the transport layer is started.
+ */
+static device_control_resource_entry_t *list_grow(const device_control_resource_entry_t *list,
+                                                  size_t old_count,
+                                                  size_t count)
+{
+    device_control_resource_entry_t *new_list;
+
+    new_list = rtos_osal_malloc(sizeof(*new_list) * (old_count + count));
+    if (new_list != NULL && list != NULL) {
+        memcpy(new_list, list, sizeof(*new_list) * old_count);
+    }
+
+    return new_list;
+}
+
+static void list_replace(device_control_resource_entry_t **list,
+                         device_control_resource_entry_t *new_list)
+{
+    if (new_list != *list) {
+        if (*list != NULL) {
+            rtos_osal_free(*list);
+        }
+        *list = new_list;
+    }
+}
+
+static void exclusive_insert(device_control_resource_table_t *table,
+                             const device_control_resid_range_t *range,
+                             uint8_t servicer)
+{
+    size_t i = table->exclusive_count;
+
+    /* Insertion sort by the first resource ID of each range */
+    while (i > 0 && table->exclusive[i - 1].first > range->first) {
+        table->exclusive[i] = table->exclusive[i - 1];
+        i--;
+    }
+
+    table->exclusive[i].first = range->first;
+    table->exclusive[i].last = range->last;
+    table->exclusive[i].servicer = servicer;
+    table->exclusive_count++;
+}
 
 int resource_table_add(device_control_t *ctx,
-                       const control_resid_t resources[],
-                       size_t num_resources,
+                       const device_control_resid_range_t ranges[],
+                       size_t num_ranges,
                        uint8_t servicer)
 {
-    control_resid_t resid;
+    device_control_resource_table_t *table = ctx->resource_table;
+    device_control_resource_entry_t *exclusive = table->exclusive;
+    device_control_resource_entry_t *broadcast = table->broadcast;
+    size_t num_exclusive = 0;
+    size_t num_broadcast = 0;
+    int ret;
 
     if (servicer == NO_SERVICER) {
         rtos_printf("cannot use reserved servicer number %d\n", NO_SERVICER);
         return 1;
     }
 
-    for (size_t i = 0; i < num_resources; i++) {
-        resid = resources[i];
+    for (size_t i = 0; i < num_ranges; i++) {
+        ret = range_check(table, &ranges[i], servicer);
+        if (ret != 0) {
+            return ret;
+        }
 
-        rtos_printf("register resource %d for servicer %d\n", resid, servicer);
+        /*
+         * The ranges are all from the same servicer, so they may not
+         * overlap each other, even if they are broadcast ranges.
+         */
+        for (size_t j = 0; j < i; j++) {
+            if (ranges[j].first <= ranges[i].last && ranges[i].first <= ranges[j].last) {
+                rtos_printf("resources %d-%d overlap resources %d-%d of servicer %d\n",
+                            ranges[i].first, ranges[i].last, ranges[j].first, ranges[j].last, servicer);
+                return 3;
+            }
+        }
 
-        if (resid == CONTROL_SPECIAL_RESID) {
-            rtos_printf("can't use reserved resource number %d\n", CONTROL_SPECIAL_RESID);
-            return 2;
+        if (ranges[i].flags & DEVICE_CONTROL_RESID_BROADCAST) {
+            num_broadcast++;
+        } else {
+            num_exclusive++;
         }
+    }
 
-        if (ctx->resource_table[resid] != NO_SERVICER) {
-            rtos_printf("resource %d already registered for servicer %d\n", resid, ctx->resource_table[resid]);
-            return 3;
+    /*
+     * Grow both lists before inserting anything, so that a failure
+     * leaves the table as it was.
+     */
+    if (num_exclusive > 0) {
+        exclusive = list_grow(table->exclusive, table->exclusive_count, num_exclusive);
+    }
+    if (num_broadcast > 0) {
+        broadcast = list_grow(table->broadcast, table->broadcast_count, num_broadcast);
+    }
+    if ((num_exclusive > 0 && exclusive == NULL) || (num_broadcast > 0 && broadcast == NULL)) {
+        if (num_exclusive > 0 && exclusive != NULL) {
+            rtos_osal_free(exclusive);
         }
+        if (num_broadcast > 0 && broadcast != NULL) {
+            rtos_osal_free(broadcast);
+        }
+        rtos_printf("out of memory registering resources for servicer %d\n", servicer);
+        return 4;
+    }
+    list_replace(&table->exclusive, exclusive);
+    list_replace(&table->broadcast, broadcast);
 
-        ctx->resource_table[resid] = servicer;
+    for (size_t i = 0; i < num_ranges; i++) {
+        if (ranges[i].flags & DEVICE_CONTROL_RESID_BROADCAST) {
+            table->broadcast[table->broadcast_count].first = ranges[i].first;
+            table->broadcast[table->broadcast_count].last = ranges[i].last;
+            table->broadcast[table->broadcast_count].servicer = servicer;
+            table->broadcast_count++;
+        } else {
+            exclusive_insert(table, &ranges[i], servicer);
+        }
     }
 
     return 0;
 }
 
+int resource_table_search_next(device_control_t *ctx,
+                               control_resid_t resid,
+                               size_t *iter,
+                               uint8_t *servicer)
+{
+    device_control_resource_table_t *table = ctx->resource_table;
+
+    *servicer = NO_SERVICER;
+
+    if (*iter == 0) {
+        size_t lo = 0;
+        size_t hi = table->exclusive_count;
+
+        /* Find the last exclusive range that starts at or before resid */
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (table->exclusive[mid].first <= resid) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        if (lo > 0 && table->exclusive[lo - 1].last >= resid) {
+            *servicer = table->exclusive[lo - 1].servicer;
+            *iter = SEARCH_DONE;
+            return 0;
+        }
+    }
+
+    for (size_t i = *iter; i < table->broadcast_count; i++) {
+        if (table->broadcast[i].first <= resid && table->broadcast[i].last >= resid) {
+            *servicer = table->broadcast[i].servicer;
+            *iter = i + 1;
+            return 0;
+        }
+    }
+
+    *iter = SEARCH_DONE;
+    return 1;
+}
+
 int resource_table_search(device_control_t *ctx,
                           control_resid_t resid,
                           uint8_t *servicer)
 {
-    *servicer = ctx->resource_table[resid];
+    size_t iter = 0;
 
-    if (resid == CONTROL_SPECIAL_RESID || ctx->resource_table[resid] != NO_SERVICER) {
+    if (resid == CONTROL_SPECIAL_RESID) {
+        *servicer = NO_SERVICER;
         return 0;
-    } else {
-        return 1;
     }
+
+    return resource_table_search_next(ctx, resid, &iter, servicer);
 }
 
 void resource_table_init(device_control_t *ctx)
 {
-    ctx->resource_table = rtos_osal_malloc(sizeof(ctx->resource_table[0]) * RESOURCE_TABLE_SIZE);
+    ctx->resource_table = rtos_osal_malloc(sizeof(device_control_resource_table_t));
 
-    for (size_t i = 0; i < RESOURCE_TABLE_SIZE; i++) {
-        ctx->resource_table[i] = NO_SERVICER;
-    }
+    ctx->resource_table->exclusive_count = 0;
+    ctx->resource_table->broadcast_count = 0;
+    ctx->resource_table->exclusive = NULL;
+    ctx->resource_table->broadcast = NULL;
 }
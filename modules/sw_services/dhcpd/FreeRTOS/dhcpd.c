@@ -1,10 +1,9 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT DHCPD
 
 #include "FreeRTOS.h"
-#include "list.h"
 #include "task.h"
 #include "semphr.h"
 #include "queue.h"
@@ -16,12 +15,14 @@
 #include "berkeley_compat.h"
 
 #include "dhcpd.h"
+#include "dhcpd_lease_table.h"
 
 #include <string.h>
 #include <stdint.h>
 
 #define HWADDR_FMT "%02x:%02x:%02x:%02x:%02x:%02x"
-#define HWADDR_ARG(hwaddr) hwaddr.ucBytes[0], hwaddr.ucBytes[1], hwaddr.ucBytes[2], hwaddr.ucBytes[3], hwaddr.ucBytes[4], hwaddr.ucBytes[5]
+#define HWADDR_ARG(hwaddr) HWADDR_BYTES_ARG(hwaddr.ucBytes)
+#define HWADDR_BYTES_ARG(b) b[0], b[1], b[2], b[3], b[4], b[5]
 
 #define DHCP_SERVER_PORT 67
 #define DHCP_CLIENT_PORT 68
@@ -135,11 +136,21 @@ typedef struct {
 #define DHCP_OPTION_REBINDING_TIME_VALUE   59
 #define DHCP_OPTION_END                   255
 
-#define DHCP_IP_STATE_AVAILABLE      0
-#define DHCP_IP_STATE_LEASED         1
-#define DHCP_IP_STATE_OFFERED        2
-#define DHCP_IP_STATE_STATIC         3
-#define DHCP_IP_STATE_UNAVAILABLE    4
+#if DHCPD_PROBE_NEW_IP_ADDRESSES || DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL
+#define DHCPD_PROBING 1
+#else
+#define DHCPD_PROBING 0
+#endif
+
+#if DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL
+#define DHCPD_UNAVAILABLE_EXPIRATION DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL
+#else
+/* Unavailable IP addresses are never probed again, so never expire */
+#define DHCPD_UNAVAILABLE_EXPIRATION INT32_MAX
+#endif
+
+/* How often in milliseconds to check on IP addresses being probed */
+#define DHCPD_PROBE_POLL_INTERVAL 10
 
 static QueueHandle_t ping_reply_queue;
 static SemaphoreHandle_t dhcpd_lock;
@@ -152,15 +163,31 @@ static struct in_addr dhcpd_dns[2];
 static struct in_addr dhcpd_ip_pool_start;
 static struct in_addr dhcpd_ip_pool_end;
 
+static dhcpd_lease_table_t dhcp_lease_table;
+static void *dhcp_lease_arena;
+
+#if DHCPD_PROBING
+/*
+ * An IP address that is being checked to see if it is in use on the
+ * network. Probes run while the server continues to handle other
+ * messages. When a probe was started to answer a DISCOVER message,
+ * the message is kept and handled again once the probe completes.
+ */
 typedef struct {
-    struct in_addr ip;
-    int state;
-    MACAddress_t mac;
-    ListItem_t list_item;
-} dhcp_ip_info_t;
+    dhcpd_lease_t *lease; /* NULL when this probe is not in use */
+    int use_icmp;
+    int attempts;
+    TickType_t deadline;
+    uint16_t ping_number;
+    int has_request;
+    size_t options_length;
+    dhcp_message_t request;
+} dhcpd_probe_t;
+
+static dhcpd_probe_t dhcpd_probes[DHCPD_MAX_CONCURRENT_PROBES];
+#endif
 
-static List_t dhcp_ip_pool;
-static dhcp_ip_info_t *dhcp_ip_infos;
+static void dhcpd_handle_op_request(dhcp_message_t *dhcp_msg, size_t options_length);
 
 
 static int dhcpd_lock_get(void)
@@ -187,186 +214,232 @@ static void dhcpd_lock_release(void)
     }
 }
 
-static void dhcp_client_update(dhcp_ip_info_t *client, int state, uint32_t expiration)
+/*
+ * Lease times are kept in seconds since boot, so that
+ * they are unaffected when the time of day is set.
+ */
+static uint32_t dhcpd_now(void)
 {
-    rtos_time_t now = rtos_time_get();
+    return rtos_time_monotonic_ns() / 1000000000;
+}
 
-    uxListRemove(&client->list_item);
-    listSET_LIST_ITEM_VALUE(&client->list_item, now.seconds + expiration);
-    client->state = state;
-    vListInsert(&dhcp_ip_pool, &client->list_item);
+static struct in_addr dhcp_client_ip(const dhcpd_lease_t *client)
+{
+    struct in_addr ip;
+
+    ip.s_addr = client->ip;
+    return ip;
 }
 
-static dhcp_ip_info_t *dhcp_client_lookup_by_mac(const MACAddress_t *mac)
+static void dhcp_client_update(dhcpd_lease_t *client, int state, uint32_t expiration)
 {
-    int i;
-    dhcp_ip_info_t *client;
-    ListItem_t *item;
+    dhcpd_lease_update(&dhcp_lease_table, client, state, dhcpd_now() + expiration);
+}
 
-    item = listGET_HEAD_ENTRY(&dhcp_ip_pool);
+static void dhcp_client_mac_set(dhcpd_lease_t *client, const MACAddress_t *mac)
+{
+    dhcpd_lease_mac_set(&dhcp_lease_table, client, mac != NULL ? mac->ucBytes : NULL);
+}
 
-    for (i = 0; i < listCURRENT_LIST_LENGTH(&dhcp_ip_pool); i++) {
-        client = listGET_LIST_ITEM_OWNER(item);
-        if (memcmp(&client->mac, mac, sizeof(client->mac)) == 0) {
-            return client;
-        }
-        item = listGET_NEXT(item);
-    }
+static dhcpd_lease_t *dhcp_client_lookup_by_mac(const MACAddress_t *mac)
+{
+    return dhcpd_lease_lookup_by_mac(&dhcp_lease_table, mac->ucBytes);
+}
 
-    return NULL;
+static dhcpd_lease_t *dhcp_client_lookup_by_ip(struct in_addr ip)
+{
+    return dhcpd_lease_lookup_by_ip(&dhcp_lease_table, ip.s_addr);
 }
 
-static dhcp_ip_info_t *dhcp_client_lookup_by_ip(struct in_addr ip)
+static dhcpd_lease_t *dhcp_client_get_oldest_disconnected(void)
 {
-    int i;
-    dhcp_ip_info_t *client;
-    ListItem_t *item;
+    return dhcpd_lease_oldest_available(&dhcp_lease_table);
+}
 
-    item = listGET_HEAD_ENTRY(&dhcp_ip_pool);
+void dhcpd_ping_reply_received(uint16_t ping_number_in)
+{
+    if (ping_reply_queue != NULL) {
+        xQueueSend(ping_reply_queue, &ping_number_in, 0);
+    }
+}
 
-    for (i = 0; i < listCURRENT_LIST_LENGTH(&dhcp_ip_pool); i++) {
-        client = listGET_LIST_ITEM_OWNER(item);
-        if (client->ip.s_addr == ip.s_addr) {
-            return client;
+#if DHCPD_PROBING
+static int dhcpd_probes_active(void)
+{
+    for (int i = 0; i < DHCPD_MAX_CONCURRENT_PROBES; i++) {
+        if (dhcpd_probes[i].lease != NULL) {
+            return 1;
         }
-        item = listGET_NEXT(item);
     }
-
-    return NULL;
+    return 0;
 }
 
-static dhcp_ip_info_t *dhcp_client_get_oldest_disconnected(void)
+static void dhcpd_probe_send(dhcpd_probe_t *probe)
 {
-    int i;
-    dhcp_ip_info_t *client;
-    ListItem_t *item;
+    if (probe->use_icmp) {
+        probe->ping_number = FreeRTOS_SendPingRequest(probe->lease->ip, 48, pdMS_TO_TICKS(100));
+    } else {
+        FreeRTOS_OutputARPRequest(probe->lease->ip);
+    }
+    probe->attempts++;
+    probe->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(DHCPD_IP_PROBE_WAIT_TIME);
+}
 
-    item = listGET_HEAD_ENTRY(&dhcp_ip_pool);
+/*
+ * Starts probing the network to see if a client's IP is in use. When
+ * request is not NULL it is handled again when the probe completes.
+ * The client is set to the probing state until then.
+ *
+ * Returns 0 if the probe is started or already running, or -1 if
+ * DHCPD_MAX_CONCURRENT_PROBES probes are already running.
+ */
+static int dhcpd_probe_start(dhcpd_lease_t *client, const dhcp_message_t *request, size_t options_length)
+{
+    dhcpd_probe_t *probe = NULL;
+    uint32_t arp_ip = client->ip;
+    MACAddress_t mac;
 
-    for (i = 0; i < listCURRENT_LIST_LENGTH(&dhcp_ip_pool); i++) {
-        client = listGET_LIST_ITEM_OWNER(item);
-        if (client->state == DHCP_IP_STATE_AVAILABLE) {
-            return client;
+    for (int i = 0; i < DHCPD_MAX_CONCURRENT_PROBES; i++) {
+        if (dhcpd_probes[i].lease == client) {
+            /* This IP is already being probed. Answer the latest request. */
+            probe = &dhcpd_probes[i];
+            if (request != NULL) {
+                probe->request = *request;
+                probe->options_length = options_length;
+                probe->has_request = 1;
+            }
+            return 0;
+        }
+        if (probe == NULL && dhcpd_probes[i].lease == NULL) {
+            probe = &dhcpd_probes[i];
         }
-        item = listGET_NEXT(item);
     }
 
-    return NULL;
-}
+    if (probe == NULL) {
+        rtos_printf("\tToo many IP addresses are being probed\n");
+        return -1;
+    }
 
-static volatile uint16_t ping_number_out;
+    /*
+     * If this IP has an entry in the ARP table then it may be in use,
+     * so check if it is still around by sending it ICMP requests.
+     * Otherwise probe it using ARP requests. If an entry appears
+     * then the IP is in use.
+     */
+    probe->use_icmp = eARPGetCacheEntry(&arp_ip, &mac) == eARPCacheHit;
+    if (probe->use_icmp) {
+        rtos_printf("\t%s is at " HWADDR_FMT ", will probe using ICMP\n", inet_ntoa(dhcp_client_ip(client)), HWADDR_ARG(mac));
+    } else {
+        rtos_printf("\t%s unknown, will probe using ARP\n", inet_ntoa(dhcp_client_ip(client)));
+    }
 
-void dhcpd_ping_reply_received(uint16_t ping_number_in)
-{
-    if (ping_reply_queue != NULL && ping_number_out != pdFAIL && ping_number_in == ping_number_out) {
-        xQueueOverwrite(ping_reply_queue, &ping_number_in);
+    probe->lease = client;
+    probe->attempts = 0;
+    probe->has_request = request != NULL;
+    if (request != NULL) {
+        probe->request = *request;
+        probe->options_length = options_length;
     }
+
+    dhcp_client_update(client, DHCP_IP_STATE_PROBING, 0);
+    dhcpd_probe_send(probe);
+
+    return 0;
 }
 
-#if DHCPD_PROBE_NEW_IP_ADDRESSES || DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL
-static int dhcpd_ip_address_in_use(struct in_addr ip)
+static void dhcpd_probe_complete(dhcpd_probe_t *probe, int in_use)
 {
-    int in_use = 0;
-    int i;
-    const int tries = 2;
+    dhcpd_lease_t *client = probe->lease;
 
-    uint32_t arp_ip = ip.s_addr;
-    MACAddress_t mac;
+    probe->lease = NULL;
 
-    if (eARPGetCacheEntry(&arp_ip, &mac) != eARPCacheHit) {
-        /*
-         * This IP does not have an entry in the ARP table
-         * so probe it using ARP requests. If an entry appears
-         * then the IP is in use.
-         */
-        const int n = DHCPD_IP_PROBE_WAIT_TIME / 10;
+    if (client->state != DHCP_IP_STATE_PROBING) {
+        /* The client has since been given the IP, for example
+        after sending a REQUEST for it. */
+        return;
+    }
+
+    if (in_use) {
+        rtos_printf("\tIP %s found on the network\n", inet_ntoa(dhcp_client_ip(client)));
+        dhcp_client_mac_set(client, NULL);
+        dhcp_client_update(client, DHCP_IP_STATE_UNAVAILABLE, DHCPD_UNAVAILABLE_EXPIRATION);
+    } else {
+        rtos_printf("\tIP %s is not in use\n", inet_ntoa(dhcp_client_ip(client)));
+        client->probed = 1;
+        dhcp_client_update(client, DHCP_IP_STATE_AVAILABLE, 0);
+    }
 
-        for (i = 0; i < tries; i++) {
-            int j;
-            TickType_t last_wake;
+    if (probe->has_request) {
+        /* The probe may be reused while the request is handled */
+        dhcp_message_t request = probe->request;
 
-            rtos_printf("\t%s unknown, will probe using ARP\n", inet_ntoa(ip));
-            FreeRTOS_OutputARPRequest(arp_ip);
+        probe->has_request = 0;
+        dhcpd_handle_op_request(&request, probe->options_length);
+    }
+}
 
-            last_wake = xTaskGetTickCount();
-            for (j = 0; j < n; j++) {
-                vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(10));
-                if (eARPGetCacheEntry(&arp_ip, &mac) == eARPCacheHit) {
-                    in_use = 1;
-                    break;
-                }
-            }
-            if (in_use) {
-                break;
-            }
-        }
-    } else {
-        /*
-         * This IP has an entry in the ARP table. This suggests
-         * that the IP is in use. Check to see if it is still
-         * around by sending it ICMP requests.
-         */
-        BaseType_t ret = pdFAIL;
-        uint16_t ping_number_in;
-
-        for (i = 0; i < tries; i++) {
-            rtos_printf("\t%s is at " HWADDR_FMT ", will probe using ICMP\n", inet_ntoa(ip), HWADDR_ARG(mac));
-            ping_number_out = FreeRTOS_SendPingRequest(ip.s_addr, 48, pdMS_TO_TICKS(100));
-            if (ping_number_out != pdFAIL) {
-                /* This loop will skip replies to previous pings */
-                do {
-                    ret = xQueueReceive(ping_reply_queue, &ping_number_in, pdMS_TO_TICKS(DHCPD_IP_PROBE_WAIT_TIME));
-                } while (ret == pdPASS && ping_number_out != ping_number_in);
-            }
+static void dhcpd_probes_poll(void)
+{
+    uint16_t ping_number_in;
+    TickType_t now;
 
-            if (ret == pdPASS) {
-                in_use = 1;
+    /* Replies to pings mean that the IPs they were sent to are in use */
+    while (xQueueReceive(ping_reply_queue, &ping_number_in, 0) == pdPASS) {
+        for (int i = 0; i < DHCPD_MAX_CONCURRENT_PROBES; i++) {
+            dhcpd_probe_t *probe = &dhcpd_probes[i];
+            if (probe->lease != NULL && probe->use_icmp && probe->ping_number == ping_number_in) {
+                dhcpd_probe_complete(probe, 1);
                 break;
             }
         }
-
-        ping_number_out = pdFAIL;
     }
 
-    if (in_use) {
-        rtos_printf("\tIP %s found on the network\n", inet_ntoa(ip));
-    }
+    now = xTaskGetTickCount();
+
+    for (int i = 0; i < DHCPD_MAX_CONCURRENT_PROBES; i++) {
+        dhcpd_probe_t *probe = &dhcpd_probes[i];
+        uint32_t arp_ip;
+        MACAddress_t mac;
+
+        if (probe->lease == NULL) {
+            continue;
+        }
 
-    return in_use;
+        arp_ip = probe->lease->ip;
+        if (!probe->use_icmp && eARPGetCacheEntry(&arp_ip, &mac) == eARPCacheHit) {
+            dhcpd_probe_complete(probe, 1);
+        } else if ((int32_t) (now - probe->deadline) >= 0) {
+            if (probe->attempts < DHCPD_IP_PROBE_ATTEMPTS) {
+                dhcpd_probe_send(probe);
+            } else {
+                dhcpd_probe_complete(probe, 0);
+            }
+        }
+    }
 }
 #endif
 
 static void dhcp_client_release_expired_leases(void)
 {
-    int i;
-    dhcp_ip_info_t *client;
-    ListItem_t *item;
-    time_t expiration;
-    rtos_time_t now = rtos_time_get();
-
-    item = listGET_HEAD_ENTRY(&dhcp_ip_pool);
-
-    for (i = 0; i < listCURRENT_LIST_LENGTH(&dhcp_ip_pool); i++) {
-        client = listGET_LIST_ITEM_OWNER(item);
-        expiration = listGET_LIST_ITEM_VALUE(item);
-        if (now.seconds >= expiration) {
-            if (client->state == DHCP_IP_STATE_LEASED || client->state == DHCP_IP_STATE_OFFERED) {
-                client->state = DHCP_IP_STATE_AVAILABLE;
-                rtos_printf("\tLease of %s to " HWADDR_FMT " has expired\n", inet_ntoa(client->ip), HWADDR_ARG(client->mac));
-            }
+    dhcpd_lease_t *client;
+    const uint32_t now = dhcpd_now();
+
+    /* Only the leases that have expired are visited */
+    while ((client = dhcpd_lease_next_expired(&dhcp_lease_table, now)) != NULL) {
+        if (client->state == DHCP_IP_STATE_LEASED || client->state == DHCP_IP_STATE_OFFERED) {
+            rtos_printf("\tLease of %s to " HWADDR_FMT " has expired\n", inet_ntoa(dhcp_client_ip(client)), HWADDR_BYTES_ARG(client->mac));
+            dhcp_client_update(client, DHCP_IP_STATE_AVAILABLE, 0);
+        } else {
+            /* The client is unavailable */
 #if DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL
-            else if (client->state == DHCP_IP_STATE_UNAVAILABLE) {
-                if (dhcpd_ip_address_in_use(client->ip)) {
-                    rtos_printf("\t%s is still in use.\n", inet_ntoa(client->ip));
-                    dhcp_client_update(client, DHCP_IP_STATE_UNAVAILABLE, DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL);
-                } else {
-                    rtos_printf("\t%s is no longer in use, setting as available.\n", inet_ntoa(client->ip));
-                    client->state = DHCP_IP_STATE_AVAILABLE;
-                }
+            if (dhcpd_probe_start(client, NULL, 0) != 0) {
+                /* Try again after the next refresh interval */
+                dhcp_client_update(client, DHCP_IP_STATE_UNAVAILABLE, DHCPD_REFRESH_INTERVAL);
             }
+#else
+            dhcp_client_update(client, DHCP_IP_STATE_UNAVAILABLE, DHCPD_UNAVAILABLE_EXPIRATION);
 #endif
         }
-        item = listGET_NEXT(item);
     }
 }
 
@@ -417,16 +490,16 @@ inline int ip_netmask_compare(struct in_addr addr1, struct in_addr addr2, struct
  * for a renewal, the ARP cache is updated.
  *
  * If DHCPD_PROBE_NEW_IP_ADDRESSES is true then this function will
- * verify that the IP address it hands out is not already in use
+ * verify that the IP address it offers is not already in use
  * on the network by sending out either an ICMP echo request or
- * ARP request (see dhcpd_ip_address_in_use()).
- *
- * \note This function has become a bit messy and difficult to
- * follow. It might be worth restructuring.
+ * ARP request (see dhcpd_probe_start()). This happens in the
+ * background, so an all zero IP is returned in the meantime and
+ * the DISCOVER message is handled again once the probe completes.
  */
-static struct in_addr dhcpd_client_ip_address_lease(const MACAddress_t *mac, struct in_addr requested_ip, int request_type)
+static struct in_addr dhcpd_client_ip_address_lease(const dhcp_message_t *dhcp_msg, size_t options_length, struct in_addr requested_ip, int request_type)
 {
-    dhcp_ip_info_t *dhcp_client;
+    const MACAddress_t *mac = &dhcp_msg->chaddr;
+    dhcpd_lease_t *dhcp_client;
     const struct in_addr zero_ip = {INADDR_ANY};
     const struct in_addr bad_ip = {INADDR_BROADCAST};
 
@@ -435,7 +508,7 @@ static struct in_addr dhcpd_client_ip_address_lease(const MACAddress_t *mac, str
         /* Client was previously assigned an address and is still in the list.
         Return the address it was previously assigned. */
 
-        if (request_type == DHCP_REQUEST && dhcp_client->ip.s_addr != requested_ip.s_addr) {
+        if (request_type == DHCP_REQUEST && dhcp_client->ip != requested_ip.s_addr) {
             /* If the requested IP address in a REQUEST message does not match
             the IP that was already either offered or leased to the client,
             then return the "bad" IP so that a NAK will be sent. */
@@ -446,43 +519,37 @@ static struct in_addr dhcpd_client_ip_address_lease(const MACAddress_t *mac, str
             int state = request_type == DHCP_DISCOVER ? DHCP_IP_STATE_OFFERED : DHCP_IP_STATE_LEASED;
 
 #if DHCPD_PROBE_NEW_IP_ADDRESSES
-            if (request_type == DHCP_DISCOVER && dhcp_client->state != DHCP_IP_STATE_LEASED && dhcpd_ip_address_in_use(dhcp_client->ip)) {
-                /* The IP is in use on the network, even though it is not leased,
-                and not in use by the client since it has sent a discover message. */
-                memset(&dhcp_client->mac, 0, sizeof(dhcp_client->mac));
-                dhcp_client_update(dhcp_client, DHCP_IP_STATE_UNAVAILABLE, DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL);
-                if (requested_ip.s_addr == dhcp_client->ip.s_addr) {
-                    /* Since the IP we had associated with this client's MAC address is
-                    in use elsewhere on the network, if the client is also requesting
-                    this IP then do not attempt to honor the request below. */
-                    requested_ip.s_addr = zero_ip.s_addr;
-                }
-            } else
+            if (request_type == DHCP_DISCOVER && dhcp_client->state != DHCP_IP_STATE_LEASED && !dhcp_client->probed) {
+                /* The IP is not leased, and not in use by the client since it has
+                sent a discover message. Check that nothing else is using it before
+                offering it. */
+                dhcpd_probe_start(dhcp_client, dhcp_msg, options_length);
+                return zero_ip;
+            }
 #endif
-            {
-                dhcp_client_update(dhcp_client, state, expiration);
-                rtos_printf("\tClient found. %s IP %s\n", state == DHCP_IP_STATE_OFFERED ? "Offering" : "Leasing", inet_ntoa(dhcp_client->ip));
-                if (state == DHCP_IP_STATE_LEASED) {
-                    rtos_printf("\tUpdating ARP cache entry (" HWADDR_FMT ")\n", HWADDR_ARG(dhcp_client->mac));
-                    vARPRefreshCacheEntry(&dhcp_client->mac, dhcp_client->ip.s_addr);
-                }
-                return dhcp_client->ip;
+            dhcp_client->probed = 0;
+            dhcp_client_update(dhcp_client, state, expiration);
+            rtos_printf("\tClient found. %s IP %s\n", state == DHCP_IP_STATE_OFFERED ? "Offering" : "Leasing", inet_ntoa(dhcp_client_ip(dhcp_client)));
+            if (state == DHCP_IP_STATE_LEASED) {
+                rtos_printf("\tUpdating ARP cache entry (" HWADDR_FMT ")\n", HWADDR_BYTES_ARG(dhcp_client->mac));
+                vARPRefreshCacheEntry(mac, dhcp_client->ip);
             }
+            return dhcp_client_ip(dhcp_client);
         } else {
             /* This is an inform message */
-            if (dhcp_client->ip.s_addr == requested_ip.s_addr) {
+            if (dhcp_client->ip == requested_ip.s_addr) {
                 /* The client is telling us that its IP address matches what we already knew.
                 Ensure its IP is set to static rather than leased. */
                 dhcp_client_update(dhcp_client, DHCP_IP_STATE_STATIC, 0);
-                rtos_printf("\tClient informing us it is using already assigned IP %s.\n", inet_ntoa(dhcp_client->ip));
-                return dhcp_client->ip;
+                rtos_printf("\tClient informing us it is using already assigned IP %s.\n", inet_ntoa(dhcp_client_ip(dhcp_client)));
+                return dhcp_client_ip(dhcp_client);
             } else {
                 /* The client is telling us that its IP address is something other than what
                 we thought we knew. Ensure the client's MAC address is disassociated with
                 the old IP address. Below we will assign it to the IP address it is informing
                 us with if it is available in the pool. */
                 rtos_printf("\tClient informing us it is using a new IP.\n");
-                memset(&dhcp_client->mac, 0, sizeof(dhcp_client->mac));
+                dhcp_client_mac_set(dhcp_client, NULL);
                 dhcp_client_update(dhcp_client, DHCP_IP_STATE_AVAILABLE, 0);
             }
         }
@@ -495,71 +562,46 @@ static struct in_addr dhcpd_client_ip_address_lease(const MACAddress_t *mac, str
                 dhcp_client->state == DHCP_IP_STATE_AVAILABLE) {
             /* The Client has requested a specific IP address,
             it is in the pool, and it is available. */
-
-            if (request_type == DHCP_DISCOVER) {
-                /* Verify that this IP is not already in use on the network */
-
-#if DHCPD_PROBE_NEW_IP_ADDRESSES
-                if (dhcpd_ip_address_in_use(dhcp_client->ip)) {
-                    /* The IP is in use even though it is not leased */
-                    memset(&dhcp_client->mac, 0, sizeof(dhcp_client->mac));
-                    dhcp_client_update(dhcp_client, DHCP_IP_STATE_UNAVAILABLE, DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL);
-                } else
-#endif
-                {
-                    dhcp_client->mac = *mac;
-                    dhcp_client_update(dhcp_client, DHCP_IP_STATE_OFFERED, DHCPD_OFFER_EXPIRATION_TIME);
-                    rtos_printf("\tClient not found. Offering requested IP %s\n", inet_ntoa(dhcp_client->ip));
-                    return dhcp_client->ip;
-                }
-            } else {
-                dhcp_client->mac = *mac;
-                dhcp_client_update(dhcp_client, request_type == DHCP_IP_STATE_STATIC, 0);
-                rtos_printf("\tClient informing us it is using available IP %s.\n", inet_ntoa(dhcp_client->ip));
-                return dhcp_client->ip;
+            dhcp_client_mac_set(dhcp_client, mac);
+        } else if (request_type == DHCP_DISCOVER) {
+            /* Either the client did not request a specific IP address,
+            it wasn't in our pool, or it has already been assigned or
+            offered to another client. If the IP offered is found to be
+            in use, it is marked as unavailable and the DISCOVER is handled
+            again, so eventually either an IP that is not in use is found
+            or there are none available. */
+            dhcp_client = dhcp_client_get_oldest_disconnected();
+            if (dhcp_client == NULL) {
+                /* There are no IP addresses available for this client. Remain silent. */
+                rtos_printf("\tClient not found. There are no available IP addresses\n");
+                return zero_ip;
             }
+            dhcp_client_mac_set(dhcp_client, mac);
+        } else {
+            /* The IP address the client has informed us it is using is not available,
+            so do not ACK, stay silent */
+            rtos_printf("\tClient informed us it is using an unavailable IP address.\n");
+            return zero_ip;
         }
 
         if (request_type == DHCP_DISCOVER) {
-            /* Either the client did not request a specific IP address,
-            it wasn't in our pool, it has already been assigned or
-            offered to another client, or the IP was found to be in use. */
-
-            /* This forever loop looks dangerous but it is not possible
-            for it to loop forever. Each time the next available IP address
-            is determined to be in use it is marked as unavailable. Eventually
-            either an available IP address will be found that is not in use, or
-            all available IPs will be set as unavailable at which point
-            dhcp_client_get_oldest_disconnected() WILL return NULL and zero_ip
-            will be returned. */
-            for (;;) {
-                dhcp_client = dhcp_client_get_oldest_disconnected();
-                if (dhcp_client != NULL) {
-                    /* Verify that this IP is not already in use on the network */
 #if DHCPD_PROBE_NEW_IP_ADDRESSES
-                    if (dhcpd_ip_address_in_use(dhcp_client->ip)) {
-                        /* The IP is in use even though it is not leased */
-                        memset(&dhcp_client->mac, 0, sizeof(dhcp_client->mac));
-                        dhcp_client_update(dhcp_client, DHCP_IP_STATE_UNAVAILABLE, DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL);
-                    } else
-#endif
-                    {
-                        dhcp_client->mac = *mac;
-                        dhcp_client_update(dhcp_client, DHCP_IP_STATE_OFFERED, DHCPD_OFFER_EXPIRATION_TIME);
-                        rtos_printf("\tClient not found. Offering available IP %s\n", inet_ntoa(dhcp_client->ip));
-                        return dhcp_client->ip;
-                    }
-                } else {
-                    /* There are no IP addresses available for this client. Remain silent. */
-                    rtos_printf("\tClient not found. There are no available IP addresses\n");
-                    return zero_ip;
+            /* Verify that this IP is not already in use on the network */
+            if (!dhcp_client->probed) {
+                if (dhcpd_probe_start(dhcp_client, dhcp_msg, options_length) != 0) {
+                    dhcp_client_mac_set(dhcp_client, NULL);
                 }
+                return zero_ip;
             }
+#endif
+            dhcp_client->probed = 0;
+            dhcp_client_update(dhcp_client, DHCP_IP_STATE_OFFERED, DHCPD_OFFER_EXPIRATION_TIME);
+            rtos_printf("\tClient not found. Offering IP %s\n", inet_ntoa(dhcp_client_ip(dhcp_client)));
+            return dhcp_client_ip(dhcp_client);
         } else {
-            /* The IP address the client has informed us it is using is not available,
-            so do not ACK, stay silent */
-            rtos_printf("\tClient informed us it is using an unavailable IP address.\n");
-            return zero_ip;
+            dhcp_client_update(dhcp_client, DHCP_IP_STATE_STATIC, 0);
+            rtos_printf("\tClient informing us it is using available IP %s.\n", inet_ntoa(dhcp_client_ip(dhcp_client)));
+            return dhcp_client_ip(dhcp_client);
         }
     } else {
         /* If there is no record of a client that is sending
@@ -745,7 +787,7 @@ static int dhcp_option_get_next(const dhcp_message_t *dhcp_msg,
 static void dhcpd_handle_op_request(dhcp_message_t *dhcp_msg, size_t options_length)
 {
     const uint8_t *opt_ptr = NULL;
-    dhcp_ip_info_t *dhcp_client;
+    dhcpd_lease_t *dhcp_client = NULL;
     int opt;
     int dhcp_msg_type = 0;
     int ip_requested = 0;
@@ -891,14 +933,14 @@ static void dhcpd_handle_op_request(dhcp_message_t *dhcp_msg, size_t options_len
     case DHCP_CLIENT_STATE_RELEASING:
         if (dhcp_client != NULL) {
             if (dhcp_msg->ciaddr.s_addr == 0) {
-                rtos_printf("\tDisassociating " HWADDR_FMT " from %s\n", HWADDR_ARG(dhcp_client->mac), inet_ntoa(dhcp_client->ip));
-                memset(&dhcp_client->mac, 0, sizeof(dhcp_client->mac));
+                rtos_printf("\tDisassociating " HWADDR_FMT " from %s\n", HWADDR_BYTES_ARG(dhcp_client->mac), inet_ntoa(dhcp_client_ip(dhcp_client)));
+                dhcp_client_mac_set(dhcp_client, NULL);
             }
             if (state == DHCP_CLIENT_STATE_DECLINING) {
-                rtos_printf("\tMaking %s unavailable\n\n", inet_ntoa(dhcp_client->ip));
-                dhcp_client_update(dhcp_client, DHCP_IP_STATE_UNAVAILABLE, DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL);
+                rtos_printf("\tMaking %s unavailable\n\n", inet_ntoa(dhcp_client_ip(dhcp_client)));
+                dhcp_client_update(dhcp_client, DHCP_IP_STATE_UNAVAILABLE, DHCPD_UNAVAILABLE_EXPIRATION);
             } else {
-                rtos_printf("\tMaking %s available\n\n", inet_ntoa(dhcp_client->ip));
+                rtos_printf("\tMaking %s available\n\n", inet_ntoa(dhcp_client_ip(dhcp_client)));
                 dhcp_client_update(dhcp_client, DHCP_IP_STATE_AVAILABLE, 0);
             }
         } else {
@@ -922,7 +964,7 @@ static void dhcpd_handle_op_request(dhcp_message_t *dhcp_msg, size_t options_len
     default:
         /* All other states should attempt to require a lease for the
         requested IP address. */
-        dhcp_msg->yiaddr = dhcpd_client_ip_address_lease(&dhcp_msg->chaddr, requested_ip, dhcp_msg_type);
+        dhcp_msg->yiaddr = dhcpd_client_ip_address_lease(dhcp_msg, options_length, requested_ip, dhcp_msg_type);
         break;
     }
 
@@ -1101,19 +1143,28 @@ static void dhcpd_handle_op_request(dhcp_message_t *dhcp_msg, size_t options_len
 
 static void dhcpd_listen(void)
 {
-    const TickType_t recv_timeout = pdMS_TO_TICKS(DHCPD_REFRESH_INTERVAL * 1000);
+    const TickType_t refresh_interval = pdMS_TO_TICKS(DHCPD_REFRESH_INTERVAL * 1000);
     TickType_t last_timeout;
     TickType_t now;
 
     last_timeout = xTaskGetTickCount();
-    setsockopt(dhcpd_socket, 0, FREERTOS_SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
 
     while (dhcpd_socket != -1) {
 
         int ret;
         dhcp_message_t dhcp_msg;
+        TickType_t recv_timeout = refresh_interval;
 
-        rtos_printf("DHCPD listening\n");
+#if DHCPD_PROBING
+        if (dhcpd_probes_active()) {
+            /* Wake up often enough to check on the probes */
+            recv_timeout = pdMS_TO_TICKS(DHCPD_PROBE_POLL_INTERVAL);
+        } else
+#endif
+        {
+            rtos_printf("DHCPD listening\n");
+        }
+        setsockopt(dhcpd_socket, 0, FREERTOS_SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
 
         ret = recvfrom(dhcpd_socket, &dhcp_msg, sizeof(dhcp_message_t), 0, NULL, NULL);
 
@@ -1123,16 +1174,26 @@ static void dhcpd_listen(void)
             /* dhcpd_stop() has been called */
             rtos_printf("Closing DHCPD socket\n");
             close(dhcpd_socket);
-            vPortFree(dhcp_ip_infos);
+#if DHCPD_PROBING
+            memset(dhcpd_probes, 0, sizeof(dhcpd_probes));
+#endif
+            vPortFree(dhcp_lease_arena);
+            dhcp_lease_arena = NULL;
             dhcpd_socket = -1;
+            dhcpd_lock_release();
+            break;
         } else if (ret >= DHCP_REQUEST_MIN_LENGTH && dhcp_msg.op == BOOTREQUEST) {
             size_t options_length = ret - (sizeof(dhcp_msg) - sizeof(dhcp_msg.options));
             dhcpd_handle_op_request(&dhcp_msg, options_length);
         }
 
+#if DHCPD_PROBING
+        dhcpd_probes_poll();
+#endif
+
         now = xTaskGetTickCount();
 
-        if (now >= (last_timeout + recv_timeout)) {
+        if (now - last_timeout >= refresh_interval) {
             last_timeout = now;
             rtos_printf("Checking for expired leases\n");
             dhcp_client_release_expired_leases();
@@ -1191,17 +1252,17 @@ static struct in_addr dhcpd_ip_address_pool_next_valid(struct in_addr *pool)
 static void dhcpd_ip_pool_init(void)
 {
     struct in_addr pool = dhcpd_ip_pool_start;
-    size_t ip_pool_count = ntohl(dhcpd_ip_pool_end.s_addr) - ntohl(dhcpd_ip_pool_start.s_addr);
-    size_t ip_pool_size = sizeof(dhcp_ip_info_t) * ip_pool_count;
-
-    dhcp_ip_infos = pvPortMalloc(ip_pool_size);
-    memset(dhcp_ip_infos, 0, ip_pool_size);
+    size_t ip_pool_count = ntohl(dhcpd_ip_pool_end.s_addr) - ntohl(dhcpd_ip_pool_start.s_addr) + 1;
+    int ret;
 
-    vListInitialise(&dhcp_ip_pool);
+    /* Every index in the lease table is allocated up front, sized from the pool */
+    dhcp_lease_arena = pvPortMalloc(dhcpd_lease_table_arena_size(ip_pool_count));
+    configASSERT(dhcp_lease_arena != NULL);
+    ret = dhcpd_lease_table_init(&dhcp_lease_table, dhcp_lease_arena, ip_pool_count);
+    configASSERT(ret == 0);
 
     for (int i = 0; i < ip_pool_count; i++) {
         struct in_addr ip;
-        rtos_time_t now = rtos_time_get();
 
         ip = dhcpd_ip_address_pool_next_valid(&pool);
         if (ip.s_addr == INADDR_ANY) {
@@ -1210,12 +1271,7 @@ static void dhcpd_ip_pool_init(void)
 
         rtos_printf("Adding %s to IP pool\n", inet_ntoa(ip));
 
-        dhcp_ip_infos[i].ip = ip;
-        vListInitialiseItem(&dhcp_ip_infos[i].list_item);
-        listSET_LIST_ITEM_OWNER(&dhcp_ip_infos[i].list_item, &dhcp_ip_infos[i]);
-        listSET_LIST_ITEM_VALUE(&dhcp_ip_infos[i].list_item, now.seconds);
-
-        vListInsert(&dhcp_ip_pool, &dhcp_ip_infos[i].list_item);
+        dhcpd_lease_table_add(&dhcp_lease_table, ip.s_addr);
     }
 }
 
@@ -1248,7 +1304,7 @@ void dhcpd_start(unsigned priority)
     }
 
     if (ping_reply_queue == NULL) {
-        ping_reply_queue = xQueueCreate(1, sizeof(uint16_t));
+        ping_reply_queue = xQueueCreate(DHCPD_MAX_CONCURRENT_PROBES, sizeof(uint16_t));
         configASSERT(ping_reply_queue != NULL);
     }
 
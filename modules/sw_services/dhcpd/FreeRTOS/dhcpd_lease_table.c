@@ -0,0 +1,356 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <string.h>
+
+#include "dhcpd_lease_table.h"
+
+#define NONE 0xFFFF
+
+#define ALIGN4(n) (((n) + 3) & ~(size_t) 3)
+
+/* Times are compared so that they may wrap */
+#define TIME_BEFORE(a, b) ((int32_t) ((a) - (b)) < 0)
+
+static const uint8_t zero_mac[DHCPD_LEASE_MAC_LENGTH];
+
+static size_t bucket_count(size_t capacity)
+{
+    size_t n = 1;
+
+    while (n < capacity) {
+        n <<= 1;
+    }
+    return n;
+}
+
+static uint32_t mac_hash(const uint8_t *mac)
+{
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+
+    for (int i = 0; i < DHCPD_LEASE_MAC_LENGTH; i++) {
+        h ^= mac[i];
+        h *= 16777619u;
+    }
+    return h ^ (h >> 16);
+}
+
+static uint32_t ip_hash(uint32_t ip)
+{
+    /*
+     * The pool is a contiguous range, so in either byte order folding
+     * the halves together spreads it evenly across the buckets.
+     */
+    return ip ^ (ip >> 16) ^ (ip >> 24);
+}
+
+static int mac_is_zero(const uint8_t *mac)
+{
+    return mac == NULL || memcmp(mac, zero_mac, DHCPD_LEASE_MAC_LENGTH) == 0;
+}
+
+static uint16_t lease_index(const dhcpd_lease_table_t *table, const dhcpd_lease_t *lease)
+{
+    return lease - table->leases;
+}
+
+size_t dhcpd_lease_table_arena_size(size_t capacity)
+{
+    const size_t buckets = bucket_count(capacity);
+
+    return ALIGN4(capacity * sizeof(dhcpd_lease_t)) +
+           ALIGN4(buckets * sizeof(uint16_t)) * 2 +
+           ALIGN4(capacity * sizeof(uint16_t));
+}
+
+int dhcpd_lease_table_init(dhcpd_lease_table_t *table, void *arena, size_t capacity)
+{
+    uint8_t *p = arena;
+    size_t buckets;
+
+    if (capacity > DHCPD_LEASE_TABLE_MAX_COUNT) {
+        return -1;
+    }
+    buckets = bucket_count(capacity);
+
+    table->leases = (dhcpd_lease_t *) p;
+    p += ALIGN4(capacity * sizeof(dhcpd_lease_t));
+    table->mac_buckets = (uint16_t *) p;
+    p += ALIGN4(buckets * sizeof(uint16_t));
+    table->ip_buckets = (uint16_t *) p;
+    p += ALIGN4(buckets * sizeof(uint16_t));
+    table->heap = (uint16_t *) p;
+
+    /* All 0xFF bytes makes every index NONE */
+    memset(table->mac_buckets, 0xFF, buckets * sizeof(uint16_t));
+    memset(table->ip_buckets, 0xFF, buckets * sizeof(uint16_t));
+
+    table->capacity = capacity;
+    table->count = 0;
+    table->heap_len = 0;
+    table->bucket_mask = buckets - 1;
+    table->avail_head = NONE;
+    table->avail_tail = NONE;
+    table->avail_count = 0;
+
+    return 0;
+}
+
+/*
+ * The expiry min-heap
+ */
+
+static void heap_place(dhcpd_lease_table_t *table, uint16_t pos, uint16_t i)
+{
+    table->heap[pos] = i;
+    table->leases[i].heap_index = pos;
+}
+
+static void heap_sift_up(dhcpd_lease_table_t *table, uint16_t pos)
+{
+    const uint16_t i = table->heap[pos];
+    const uint32_t expiration = table->leases[i].expiration;
+
+    while (pos > 0) {
+        const uint16_t parent = (pos - 1) / 2;
+        if (!TIME_BEFORE(expiration, table->leases[table->heap[parent]].expiration)) {
+            break;
+        }
+        heap_place(table, pos, table->heap[parent]);
+        pos = parent;
+    }
+    heap_place(table, pos, i);
+}
+
+static void heap_sift_down(dhcpd_lease_table_t *table, uint16_t pos)
+{
+    const uint16_t i = table->heap[pos];
+    const uint32_t expiration = table->leases[i].expiration;
+
+    for (;;) {
+        uint32_t child = 2 * (uint32_t) pos + 1;
+
+        if (child >= table->heap_len) {
+            break;
+        }
+        if (child + 1 < table->heap_len &&
+                TIME_BEFORE(table->leases[table->heap[child + 1]].expiration, table->leases[table->heap[child]].expiration)) {
+            child++;
+        }
+        if (!TIME_BEFORE(table->leases[table->heap[child]].expiration, expiration)) {
+            break;
+        }
+        heap_place(table, pos, table->heap[child]);
+        pos = child;
+    }
+    heap_place(table, pos, i);
+}
+
+static void heap_insert(dhcpd_lease_table_t *table, uint16_t i)
+{
+    heap_place(table, table->heap_len, i);
+    heap_sift_up(table, table->heap_len++);
+}
+
+static void heap_remove(dhcpd_lease_table_t *table, uint16_t i)
+{
+    const uint16_t pos = table->leases[i].heap_index;
+    const uint16_t last = table->heap[--table->heap_len];
+
+    table->leases[i].heap_index = NONE;
+
+    if (pos < table->heap_len) {
+        heap_place(table, pos, last);
+        heap_sift_up(table, pos);
+        heap_sift_down(table, table->leases[last].heap_index);
+    }
+}
+
+/*
+ * The available list
+ */
+
+static void avail_append(dhcpd_lease_table_t *table, uint16_t i)
+{
+    dhcpd_lease_t *lease = &table->leases[i];
+
+    lease->avail_prev = table->avail_tail;
+    lease->avail_next = NONE;
+    if (table->avail_tail != NONE) {
+        table->leases[table->avail_tail].avail_next = i;
+    } else {
+        table->avail_head = i;
+    }
+    table->avail_tail = i;
+    table->avail_count++;
+}
+
+static void avail_remove(dhcpd_lease_table_t *table, uint16_t i)
+{
+    dhcpd_lease_t *lease = &table->leases[i];
+
+    if (lease->avail_prev != NONE) {
+        table->leases[lease->avail_prev].avail_next = lease->avail_next;
+    } else {
+        table->avail_head = lease->avail_next;
+    }
+    if (lease->avail_next != NONE) {
+        table->leases[lease->avail_next].avail_prev = lease->avail_prev;
+    } else {
+        table->avail_tail = lease->avail_prev;
+    }
+    lease->avail_prev = NONE;
+    lease->avail_next = NONE;
+    table->avail_count--;
+}
+
+/*
+ * The hash indexes
+ */
+
+static void mac_index_remove(dhcpd_lease_table_t *table, uint16_t i)
+{
+    uint16_t *link = &table->mac_buckets[mac_hash(table->leases[i].mac) & table->bucket_mask];
+
+    while (*link != NONE) {
+        if (*link == i) {
+            *link = table->leases[i].mac_next;
+            break;
+        }
+        link = &table->leases[*link].mac_next;
+    }
+    table->leases[i].mac_next = NONE;
+}
+
+static void mac_index_insert(dhcpd_lease_table_t *table, uint16_t i)
+{
+    uint16_t *bucket = &table->mac_buckets[mac_hash(table->leases[i].mac) & table->bucket_mask];
+
+    table->leases[i].mac_next = *bucket;
+    *bucket = i;
+}
+
+static int state_expires(int state)
+{
+    return state == DHCP_IP_STATE_LEASED ||
+           state == DHCP_IP_STATE_OFFERED ||
+           state == DHCP_IP_STATE_UNAVAILABLE;
+}
+
+dhcpd_lease_t *dhcpd_lease_table_add(dhcpd_lease_table_t *table, uint32_t ip)
+{
+    uint16_t *bucket;
+    dhcpd_lease_t *lease;
+    uint16_t i;
+
+    if (table->count == table->capacity) {
+        return NULL;
+    }
+
+    i = table->count++;
+    lease = &table->leases[i];
+    memset(lease, 0, sizeof(dhcpd_lease_t));
+    lease->ip = ip;
+    lease->state = DHCP_IP_STATE_AVAILABLE;
+    lease->mac_next = NONE;
+    lease->heap_index = NONE;
+
+    bucket = &table->ip_buckets[ip_hash(ip) & table->bucket_mask];
+    lease->ip_next = *bucket;
+    *bucket = i;
+
+    avail_append(table, i);
+
+    return lease;
+}
+
+dhcpd_lease_t *dhcpd_lease_lookup_by_mac(const dhcpd_lease_table_t *table, const uint8_t *mac)
+{
+    uint16_t i;
+
+    if (mac_is_zero(mac)) {
+        return NULL;
+    }
+
+    for (i = table->mac_buckets[mac_hash(mac) & table->bucket_mask]; i != NONE; i = table->leases[i].mac_next) {
+        if (memcmp(table->leases[i].mac, mac, DHCPD_LEASE_MAC_LENGTH) == 0) {
+            return &table->leases[i];
+        }
+    }
+
+    return NULL;
+}
+
+dhcpd_lease_t *dhcpd_lease_lookup_by_ip(const dhcpd_lease_table_t *table, uint32_t ip)
+{
+    uint16_t i;
+
+    for (i = table->ip_buckets[ip_hash(ip) & table->bucket_mask]; i != NONE; i = table->leases[i].ip_next) {
+        if (table->leases[i].ip == ip) {
+            return &table->leases[i];
+        }
+    }
+
+    return NULL;
+}
+
+dhcpd_lease_t *dhcpd_lease_oldest_available(const dhcpd_lease_table_t *table)
+{
+    return table->avail_head != NONE ? &table->leases[table->avail_head] : NULL;
+}
+
+void dhcpd_lease_mac_set(dhcpd_lease_table_t *table, dhcpd_lease_t *lease, const uint8_t *mac)
+{
+    const uint16_t i = lease_index(table, lease);
+
+    if (!mac_is_zero(lease->mac)) {
+        mac_index_remove(table, i);
+    }
+
+    if (!mac_is_zero(mac)) {
+        memcpy(lease->mac, mac, DHCPD_LEASE_MAC_LENGTH);
+        mac_index_insert(table, i);
+    } else {
+        memset(lease->mac, 0, DHCPD_LEASE_MAC_LENGTH);
+    }
+}
+
+void dhcpd_lease_update(dhcpd_lease_table_t *table, dhcpd_lease_t *lease, int state, uint32_t expiration)
+{
+    const uint16_t i = lease_index(table, lease);
+
+    if (lease->heap_index != NONE) {
+        heap_remove(table, i);
+    }
+    if (lease->state == DHCP_IP_STATE_AVAILABLE) {
+        avail_remove(table, i);
+    }
+
+    lease->state = state;
+    lease->expiration = expiration;
+
+    if (state_expires(state)) {
+        heap_insert(table, i);
+    } else if (state == DHCP_IP_STATE_AVAILABLE) {
+        avail_append(table, i);
+    }
+}
+
+dhcpd_lease_t *dhcpd_lease_next_expired(dhcpd_lease_table_t *table, uint32_t now)
+{
+    dhcpd_lease_t *lease;
+
+    if (table->heap_len == 0) {
+        return NULL;
+    }
+
+    lease = &table->leases[table->heap[0]];
+    if (TIME_BEFORE(now, lease->expiration)) {
+        return NULL;
+    }
+
+    heap_remove(table, table->heap[0]);
+
+    return lease;
+}
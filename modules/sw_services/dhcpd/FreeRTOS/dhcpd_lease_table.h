@@ -0,0 +1,123 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef DHCPD_LEASE_TABLE_H_
+#define DHCPD_LEASE_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The lease table used by dhcpd. It has no dependencies on
+ * FreeRTOS so that it may also be tested on the host.
+ *
+ * Every address in the pool has an entry, held in a single arena
+ * allocated when the server starts. Entries are indexed by hash
+ * tables keyed on both MAC and IP address, so that both lookups
+ * are O(1). Entries whose state expires are kept in a min-heap
+ * ordered by expiration time, so that each expiry sweep only
+ * visits the entries that have expired. Available entries are
+ * kept in a list in the order that they became available, so
+ * that the least recently used address is always at its head.
+ */
+
+#define DHCP_IP_STATE_AVAILABLE      0
+#define DHCP_IP_STATE_LEASED         1
+#define DHCP_IP_STATE_OFFERED        2
+#define DHCP_IP_STATE_STATIC         3
+#define DHCP_IP_STATE_UNAVAILABLE    4
+#define DHCP_IP_STATE_PROBING        5
+
+#define DHCPD_LEASE_MAC_LENGTH 6
+
+/* The largest pool that the table can hold */
+#define DHCPD_LEASE_TABLE_MAX_COUNT 0xFFFE
+
+typedef struct {
+    uint32_t ip;          /* In network byte order */
+    uint32_t expiration;  /* Seconds. Only meaningful for states that expire. */
+    uint8_t mac[DHCPD_LEASE_MAC_LENGTH]; /* All zeros when not associated with a client */
+    uint8_t state;
+    uint8_t probed;       /* Set when a probe has found the IP is not in use */
+
+    /* Links maintained by the table */
+    uint16_t mac_next;
+    uint16_t ip_next;
+    uint16_t heap_index;
+    uint16_t avail_prev;
+    uint16_t avail_next;
+} dhcpd_lease_t;
+
+typedef struct {
+    dhcpd_lease_t *leases;
+    uint16_t *mac_buckets;
+    uint16_t *ip_buckets;
+    uint16_t *heap;
+    uint16_t capacity;
+    uint16_t count;
+    uint16_t heap_len;
+    uint16_t bucket_mask;
+    uint16_t avail_head;
+    uint16_t avail_tail;
+    uint16_t avail_count;
+} dhcpd_lease_table_t;
+
+/**
+ * Returns the size of the arena required for a pool of \p capacity addresses.
+ */
+size_t dhcpd_lease_table_arena_size(size_t capacity);
+
+/**
+ * Initializes an empty lease table in \p arena, which must be at least
+ * dhcpd_lease_table_arena_size(capacity) bytes and aligned to 4 bytes.
+ *
+ * \returns 0 on success, or -1 if \p capacity is greater than
+ *          DHCPD_LEASE_TABLE_MAX_COUNT.
+ */
+int dhcpd_lease_table_init(dhcpd_lease_table_t *table, void *arena, size_t capacity);
+
+/**
+ * Adds an address to the pool as available. The address must not
+ * already be in the table.
+ *
+ * \returns the new entry, or NULL if the table is full.
+ */
+dhcpd_lease_t *dhcpd_lease_table_add(dhcpd_lease_table_t *table, uint32_t ip);
+
+/**
+ * \returns the entry associated with \p mac, or NULL if there is none.
+ */
+dhcpd_lease_t *dhcpd_lease_lookup_by_mac(const dhcpd_lease_table_t *table, const uint8_t *mac);
+
+/**
+ * \returns the entry for \p ip, or NULL if it is not in the pool.
+ */
+dhcpd_lease_t *dhcpd_lease_lookup_by_ip(const dhcpd_lease_table_t *table, uint32_t ip);
+
+/**
+ * \returns the entry that has been available for the longest time,
+ *          or NULL if no addresses are available.
+ */
+dhcpd_lease_t *dhcpd_lease_oldest_available(const dhcpd_lease_table_t *table);
+
+/**
+ * Associates an entry with a client's MAC address. Pass NULL, or an
+ * all zero address, to disassociate it from any client.
+ */
+void dhcpd_lease_mac_set(dhcpd_lease_table_t *table, dhcpd_lease_t *lease, const uint8_t *mac);
+
+/**
+ * Sets the state of an entry. The leased, offered and unavailable
+ * states expire at \p expiration, in seconds.
+ */
+void dhcpd_lease_update(dhcpd_lease_table_t *table, dhcpd_lease_t *lease, int state, uint32_t expiration);
+
+/**
+ * Removes and returns the entry with the earliest expiration time
+ * if it is no later than \p now. The caller must then set a new state
+ * for it with dhcpd_lease_update(). Call repeatedly until NULL is
+ * returned to handle every expired entry.
+ */
+dhcpd_lease_t *dhcpd_lease_next_expired(dhcpd_lease_table_t *table, uint32_t now);
+
+#endif /* DHCPD_LEASE_TABLE_H_ */
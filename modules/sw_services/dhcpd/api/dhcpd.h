@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef DHCPD_H_
@@ -69,7 +69,8 @@
  * DHCPD_IP_PROBE_ATTEMPTS*DHCPD_IP_PROBE_WAIT_TIME
  * milliseconds between the DISCOVER and OFFER messages
  * if the offered IP has not previously been assigned to
- * the client.
+ * the client. The server continues to handle messages
+ * from other clients while probing.
  *
  * Set to 0 to disable initial probing.
  */
@@ -104,6 +105,16 @@
 #define DHCPD_IP_PROBE_WAIT_TIME 250
 #endif
 
+/**
+ * The maximum number of IP addresses that may be
+ * probed at the same time. Clients that send a DISCOVER
+ * message while this many probes are running are not
+ * answered until they retransmit it.
+ */
+#ifndef DHCPD_MAX_CONCURRENT_PROBES
+#define DHCPD_MAX_CONCURRENT_PROBES 4
+#endif
+
 /**
  * If either DHCPD_PROBE_NEW_IP_ADDRESSES or DHCPD_UNAVAILABLE_IP_PROBE_INTERVAL
  * are not set to 0, then this function must be called when a ping reply is
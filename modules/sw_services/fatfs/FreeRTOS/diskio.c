@@ -11,14 +11,7 @@
 #include "diskio.h"        /* Declarations of disk functions */
 
 #include "rtos_qspi_flash.h"
-
-#ifndef QSPI_FLASH_FILESYSTEM_START_ADDRESS
-#define QSPI_FLASH_FILESYSTEM_START_ADDRESS 0x100000
-#endif
-
-#ifndef QSPI_FLASH_SECTOR_SIZE
-#define QSPI_FLASH_SECTOR_SIZE 4096
-#endif
+#include "fs_support.h"
 
 DSTATUS drive_status[FF_VOLUMES] = {
 #if FF_VOLUMES >= 10
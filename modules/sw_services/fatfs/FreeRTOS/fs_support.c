@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <xcore/assert.h>
@@ -26,6 +26,7 @@ rtos_qspi_flash_t *ff_qspi_flash_ctx = NULL;
 #endif
 
 #ifndef FS_SUP_MALLOC
+#include <stdlib.h>
 #define FS_SUP_MALLOC		malloc
 #endif
 
@@ -58,6 +59,126 @@ int rtos_ff_get_file(const char* filename, FIL* outfile, unsigned int* len )
 	return retval;
 }
 
+#if FF_USE_FASTSEEK
+int rtos_ff_direct_open(const char* filename, rtos_ff_direct_file_t* file )
+{
+	xassert(ff_qspi_flash_ctx); // ensure rtos_fatfs_init has been called
+
+	int retval = FS_SUP_FAIL;
+	FIL *fil;
+	/* The cluster link map: its size, a length and start cluster for each extent, and a terminator */
+	DWORD clmt[ 1 + 2 * RTOS_FF_DIRECT_EXTENTS_MAX + 1 ];
+
+	if( ( file == NULL ) || ( filename == NULL ) )
+	{
+		return retval;
+	}
+
+	/* FIL includes a sector buffer, so is too large for the stack */
+	fil = FS_SUP_MALLOC( sizeof( FIL ) );
+	if( fil == NULL )
+	{
+		return retval;
+	}
+
+	if( f_open( fil, filename, FA_READ ) == FR_OK )
+	{
+		FATFS *fs = fil->obj.fs;
+		FRESULT result = FR_OK;
+
+		file->flash = ff_qspi_flash_ctx;
+		file->size = f_size( fil );
+		file->extent_count = 0;
+
+		if( file->size > 0 )
+		{
+			clmt[ 0 ] = sizeof( clmt ) / sizeof( clmt[ 0 ] );
+			fil->cltbl = clmt;
+			result = f_lseek( fil, CREATE_LINKMAP );
+		}
+
+		if( result == FR_OK )
+		{
+			const unsigned cluster_size = fs->csize * QSPI_FLASH_SECTOR_SIZE;
+			unsigned remaining = file->size;
+
+			for( int i = 0; remaining > 0 && clmt[ 1 + 2 * i ] != 0; i++ )
+			{
+				unsigned size = clmt[ 1 + 2 * i ] * cluster_size;
+				LBA_t sector = fs->database + ( LBA_t ) ( clmt[ 2 + 2 * i ] - 2 ) * fs->csize;
+
+				if( size > remaining )
+				{
+					size = remaining;
+				}
+				file->extents[ i ].address = QSPI_FLASH_FILESYSTEM_START_ADDRESS + sector * QSPI_FLASH_SECTOR_SIZE;
+				file->extents[ i ].size = size;
+				file->extent_count++;
+				remaining -= size;
+			}
+
+			if( remaining == 0 )
+			{
+				retval = FS_SUP_SUCCESS;
+			}
+		}
+
+		f_close( fil );
+	}
+
+	FS_SUP_FREE( fil );
+
+	return retval;
+}
+#endif
+
+void rtos_ff_direct_init(rtos_ff_direct_file_t* file, rtos_qspi_flash_t *flash, unsigned address, unsigned size )
+{
+	file->flash = flash;
+	file->size = size;
+	file->extent_count = 1;
+	file->extents[ 0 ].address = address;
+	file->extents[ 0 ].size = size;
+}
+
+size_t rtos_ff_direct_read(const rtos_ff_direct_file_t* file, void* buf, unsigned offset, size_t len )
+{
+	uint8_t *dest = buf;
+	size_t bytes_read = 0;
+
+	if( offset >= file->size )
+	{
+		return 0;
+	}
+	if( len > file->size - offset )
+	{
+		len = file->size - offset;
+	}
+
+	for( int i = 0; i < file->extent_count && bytes_read < len; i++ )
+	{
+		const rtos_ff_extent_t *extent = &file->extents[ i ];
+
+		if( offset >= extent->size )
+		{
+			offset -= extent->size;
+			continue;
+		}
+
+		size_t n = extent->size - offset;
+		if( n > len - bytes_read )
+		{
+			n = len - bytes_read;
+		}
+
+		rtos_qspi_flash_read( file->flash, &dest[ bytes_read ], extent->address + offset, n );
+		bytes_read += n;
+		offset = 0;
+	}
+
+	return bytes_read;
+}
+
 void rtos_fatfs_init( rtos_qspi_flash_t *qspi_flash_ctx )
 {
     FATFS *fs;
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef FS_SUPPORT_H_
@@ -8,6 +8,47 @@
 
 #include "rtos_qspi_flash.h"
 
+/**
+ * The address in flash of the filesystem, as used by the default
+ * implementations of the diskio functions.
+ */
+#ifndef QSPI_FLASH_FILESYSTEM_START_ADDRESS
+#define QSPI_FLASH_FILESYSTEM_START_ADDRESS 0x100000
+#endif
+
+/**
+ * The size of the filesystem's sectors.
+ */
+#ifndef QSPI_FLASH_SECTOR_SIZE
+#define QSPI_FLASH_SECTOR_SIZE 4096
+#endif
+
+/**
+ * The most contiguous extents that a file opened with rtos_ff_direct_open()
+ * may be made up of.
+ */
+#ifndef RTOS_FF_DIRECT_EXTENTS_MAX
+#define RTOS_FF_DIRECT_EXTENTS_MAX 4
+#endif
+
+/**
+ * A contiguous region of a file in flash.
+ */
+typedef struct {
+    unsigned address;   /* The address in flash */
+    unsigned size;      /* The size in bytes */
+} rtos_ff_extent_t;
+
+/**
+ * A file that is read directly from flash, without FatFs.
+ */
+typedef struct {
+    rtos_qspi_flash_t *flash;
+    unsigned size;
+    int extent_count;
+    rtos_ff_extent_t extents[RTOS_FF_DIRECT_EXTENTS_MAX];
+} rtos_ff_direct_file_t;
+
 /**
  * Open a file
  *
@@ -20,6 +61,67 @@
  */
 int rtos_ff_get_file(const char* filename, FIL* outfile, unsigned int* len );
 
+#if FF_USE_FASTSEEK
+/**
+ * Open a read-only file to read it directly from flash
+ *
+ * The file is opened with FatFs and its chain of clusters is walked once,
+ * to find the contiguous regions of flash that it is stored in. Reads with
+ * rtos_ff_direct_read() then go straight to the flash, without copying
+ * through FatFs's buffers. This requires the default diskio functions, and
+ * the file must not be written to while it is being read this way.
+ *
+ * Files in images created by fatfs_mkimage are stored contiguously, so
+ * have a single extent.
+ *
+ * This requires FatFs fast seek, which is disabled by default. Applications
+ * that use it must define FF_USE_FASTSEEK to 1 in their ff_appconf.h.
+ *
+ * \param[in]  filename    Filename to open
+ * \param[out] file        The direct file to set up
+ *
+ * \returns     FS_SUP_SUCCESS on success
+ *              FS_SUP_FAIL if the file could not be opened, or it is made up
+ *              of more than RTOS_FF_DIRECT_EXTENTS_MAX extents
+ */
+int rtos_ff_direct_open(const char* filename, rtos_ff_direct_file_t* file );
+#endif
+
+/**
+ * Set up a file to read directly from a single contiguous region of flash
+ *
+ * This does not use FatFs at all, so may be used with the offsets in a
+ * manifest written by fatfs_mkimage. The file's address is then the
+ * address of the filesystem in flash plus its offset in the manifest.
+ *
+ * \param[out] file        The direct file to set up
+ * \param[in]  flash       The QSPI flash driver instance to read from
+ * \param[in]  address     The address of the file in flash
+ * \param[in]  size        The size of the file
+ */
+void rtos_ff_direct_init(rtos_ff_direct_file_t* file, rtos_qspi_flash_t *flash, unsigned address, unsigned size );
+
+/**
+ * Read from a file directly from flash
+ *
+ * \param[in]  file        The direct file to read from
+ * \param[out] buf         The buffer to read into
+ * \param[in]  offset      The offset in the file to start reading from
+ * \param[in]  len         The number of bytes to read
+ *
+ * \returns     The number of bytes read, which is less than \p len if the
+ *              end of the file is reached
+ */
+size_t rtos_ff_direct_read(const rtos_ff_direct_file_t* file, void* buf, unsigned offset, size_t len );
+
+/**
+ * Get the size of a file opened for direct reads
+ */
+static inline unsigned rtos_ff_direct_size(const rtos_ff_direct_file_t* file )
+{
+    return file->size;
+}
+
 /**
  *  Initialize and mount file system
  *
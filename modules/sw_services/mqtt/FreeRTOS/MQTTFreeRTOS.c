@@ -15,6 +15,8 @@
  *    Ian Craggs - convert to FreeRTOS
  *******************************************************************************/
 
+#include <string.h>
+
 #include "MQTTFreeRTOS.h"
 
 #include "tls_support.h"
@@ -96,26 +98,123 @@ void TimerInit( Timer* timer )
 }
 
 
+/*
+ * Set a socket timeout only when it differs from the one last set.
+ * The socket may have been replaced by the application since then,
+ * in which case both are set again.
+ */
+static void prvSetSocketTimeout( Network* n, int32_t lOptionName, TickType_t xTicksToWait )
+{
+	TickType_t* pxCurrent = ( lOptionName == FREERTOS_SO_RCVTIMEO ) ? &n->rx_timeout : &n->tx_timeout;
+
+	if( n->timeout_socket != n->my_socket )
+	{
+		n->timeout_socket = n->my_socket;
+		FreeRTOS_setsockopt( n->my_socket, 0, FREERTOS_SO_RCVTIMEO, &n->rx_timeout, sizeof( n->rx_timeout ) );
+		FreeRTOS_setsockopt( n->my_socket, 0, FREERTOS_SO_SNDTIMEO, &n->tx_timeout, sizeof( n->tx_timeout ) );
+	}
+
+	if( *pxCurrent != xTicksToWait )
+	{
+		FreeRTOS_setsockopt( n->my_socket, 0, lOptionName, &xTicksToWait, sizeof( xTicksToWait ) );
+		*pxCurrent = xTicksToWait;
+	}
+}
+
+
+/* The parts of an MQTT packet, as tracked by prvPacketTrack() */
+#define PACKET_IDLE			0	/* Waiting for the fixed header byte */
+#define PACKET_LENGTH		1	/* Receiving the remaining length */
+#define PACKET_BODY			2	/* Receiving the body */
+
+static void prvPacketReset( Network* n )
+{
+	n->packet_state = PACKET_IDLE;
+	n->packet_remaining = 0;
+	n->packet_multiplier = 1;
+}
+
+/*
+ * Follows the framing of the MQTT packets received, so that the reads of
+ * a packet after its first byte can be given a grace timeout. The client
+ * reads the stream in order, so every byte received passes through here.
+ */
+static void prvPacketTrack( Network* n, const unsigned char* data, int len )
+{
+	while( len > 0 )
+	{
+		if( n->packet_state == PACKET_IDLE )
+		{
+			n->packet_state = PACKET_LENGTH;
+			n->packet_remaining = 0;
+			n->packet_multiplier = 1;
+			data++;
+			len--;
+		}
+		else if( n->packet_state == PACKET_LENGTH )
+		{
+			n->packet_remaining += ( *data & 127 ) * n->packet_multiplier;
+			n->packet_multiplier *= 128;
+			if( ( *data & 128 ) == 0 )
+			{
+				n->packet_state = n->packet_remaining > 0 ? PACKET_BODY : PACKET_IDLE;
+			}
+			else if( n->packet_multiplier > 128 * 128 * 128 )
+			{
+				/* Not a valid remaining length, which the client will also reject */
+				prvPacketReset( n );
+			}
+			data++;
+			len--;
+		}
+		else
+		{
+			int n_body = len < n->packet_remaining ? len : n->packet_remaining;
+
+			n->packet_remaining -= n_body;
+			if( n->packet_remaining == 0 )
+			{
+				n->packet_state = PACKET_IDLE;
+			}
+			data += n_body;
+			len -= n_body;
+		}
+	}
+}
+
+
 int FreeRTOS_read( Network* n, unsigned char* buffer, int len, int timeout_ms )
 {
 	TickType_t xTicksToWait = timeout_ms / portTICK_PERIOD_MS; /* convert milliseconds to ticks */
 	TimeOut_t xTimeOut;
 	int recvLen = 0;
+	int partial = 0;
+
+	if( n->packet_state != PACKET_IDLE && xTicksToWait < pdMS_TO_TICKS( MQTT_NETWORK_PARTIAL_READ_TIMEOUT_MS ) )
+	{
+		/* The rest of a packet is being read, so wait a little longer for it */
+		partial = 1;
+		xTicksToWait = pdMS_TO_TICKS( MQTT_NETWORK_PARTIAL_READ_TIMEOUT_MS );
+	}
 
 	vTaskSetTimeOutState( &xTimeOut ); /* Record the time at which this function was entered. */
 	do
 	{
 		int rc = 0;
 
-		FreeRTOS_setsockopt( n->my_socket, 0, FREERTOS_SO_RCVTIMEO, &xTicksToWait, sizeof( xTicksToWait ) );
+		prvSetSocketTimeout( n, FREERTOS_SO_RCVTIMEO, xTicksToWait );
 		if( n->ssl_ctx != NULL )
 		{
 			rc = mbedtls_ssl_read( n->ssl_ctx, buffer + recvLen, len - recvLen );
-			if( rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE )
+			if( rc == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE )
 			{
-				/* TODO we must have caller close the ssl ctx */
-				recvLen = rc;
-				break;
+				/* The socket timed out, which is not an error */
+				rc = 0;
+			}
+			else if( rc == 0 )
+			{
+				/* The connection has been closed */
+				rc = -1;
 			}
 		}
 		else
@@ -123,12 +222,24 @@ int FreeRTOS_read( Network* n, unsigned char* buffer, int len, int timeout_ms )
 			rc = FreeRTOS_recv( n->my_socket, buffer + recvLen, len - recvLen, 0 );
 		}
 		if( rc > 0 )
+		{
+			prvPacketTrack( n, buffer + recvLen, rc );
 			recvLen += rc;
+		}
 		else if( rc < 0 )
 		{
+			prvPacketReset( n );
 			recvLen = rc;
 			break;
 		}
+
+		if( n->packet_state != PACKET_IDLE && recvLen < len && !partial && xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdTRUE )
+		{
+			/* Part of a packet has arrived, so wait a little longer for the rest */
+			partial = 1;
+			xTicksToWait = pdMS_TO_TICKS( MQTT_NETWORK_PARTIAL_READ_TIMEOUT_MS );
+			vTaskSetTimeOutState( &xTimeOut );
+		}
 	} while( recvLen < len && xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE );
 
 	return recvLen;
@@ -146,20 +257,24 @@ int FreeRTOS_write( Network* n, unsigned char* buffer, int len, int timeout_ms )
 	{
 		int rc = 0;
 
-		FreeRTOS_setsockopt( n->my_socket, 0, FREERTOS_SO_RCVTIMEO, &xTicksToWait, sizeof( xTicksToWait ) );
+		prvSetSocketTimeout( n, FREERTOS_SO_SNDTIMEO, xTicksToWait );
 		if( n->ssl_ctx != NULL )
 		{
 			rc = mbedtls_ssl_write( n->ssl_ctx, buffer + sentLen, len - sentLen );
-			if( rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE )
+			if( rc == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE )
 			{
-				/* TODO we must have caller close the ssl ctx */
-				sentLen = rc;
-				break;
+				/* The socket timed out, which is not an error */
+				rc = 0;
 			}
 		}
 		else
 		{
 			rc = FreeRTOS_send( n->my_socket, buffer + sentLen, len - sentLen, 0 );
+			if( rc == -pdFREERTOS_ERRNO_ENOSPC )
+			{
+				/* The send buffer stayed full until the socket timed out */
+				rc = 0;
+			}
 		}
 		if( rc > 0 )
 			sentLen += rc;
@@ -176,6 +291,7 @@ int FreeRTOS_write( Network* n, unsigned char* buffer, int len, int timeout_ms )
 
 void FreeRTOS_disconnect( Network* n )
 {
+	prvPacketReset( n );
 	if( n->ssl_ctx == NULL )
 	{
 		FreeRTOS_closesocket( n->my_socket );
@@ -190,6 +306,10 @@ void NetworkInit( Network* n)
 	n->mqttwrite = FreeRTOS_write;
 	n->disconnect = FreeRTOS_disconnect;
 	n->ssl_ctx = NULL;
+	n->timeout_socket = NULL;
+	n->rx_timeout = 0;
+	n->tx_timeout = 0;
+	prvPacketReset( n );
 }
 
 
@@ -199,6 +319,8 @@ int NetworkConnect( Network* n, char* addr, int port )
 	int retVal = -1;
 	uint32_t ipAddress = 0;
 
+	prvPacketReset( n );
+
 	do
 	{
 		if( ( ipAddress = FreeRTOS_gethostbyname( addr ) ) == 0 )
@@ -236,6 +358,8 @@ int NetworkConnectIP( Network* n, uint32_t addr, int port )
 	sAddr.sin_port = FreeRTOS_htons( port );
 	sAddr.sin_addr = addr;
 
+	prvPacketReset( n );
+
 	do
 	{
 		if( ( n->my_socket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_STREAM, FREERTOS_IPPROTO_TCP ) ) < 0 )
@@ -254,3 +378,225 @@ int NetworkConnectIP( Network* n, uint32_t addr, int port )
 
 	return retVal;
 }
+
+
+/*
+ * Serializes the header of a QoS 0 PUBLISH packet, up to and including
+ * the topic length, and returns its length. buf must be at least
+ * 7 bytes.
+ */
+static int prvPublishHeader( unsigned char* buf, size_t topic_len, size_t payload_len, int retain )
+{
+	size_t rem_len = 2 + topic_len + payload_len;
+	int len = 0;
+
+	buf[ len++ ] = 0x30 | ( retain ? 0x01 : 0x00 );
+	do
+	{
+		unsigned char d = rem_len % 128;
+		rem_len /= 128;
+		if( rem_len > 0 )
+			d |= 0x80;
+		buf[ len++ ] = d;
+	} while( rem_len > 0 );
+	buf[ len++ ] = ( unsigned char ) ( topic_len >> 8 );
+	buf[ len++ ] = ( unsigned char ) topic_len;
+
+	return len;
+}
+
+/* The largest remaining length that MQTT can encode */
+#define MQTT_MAX_REMAINING_LENGTH	268435455
+
+
+static int prvWriteAll( Network* n, const void* buf, size_t len, int timeout_ms )
+{
+	return FreeRTOS_write( n, ( unsigned char* ) buf, len, timeout_ms ) == ( int ) len ? 0 : -1;
+}
+
+
+int NetworkPublish( Network* n, const char* topic, const void* payload, size_t payload_len, int retain, int timeout_ms )
+{
+	unsigned char header[ 7 + MQTT_NETWORK_PUBLISH_TOPIC_MAX ];
+	size_t topic_len = strlen( topic );
+	int header_len;
+
+	if( topic_len > 0xFFFF || 2 + topic_len + payload_len > MQTT_MAX_REMAINING_LENGTH )
+	{
+		return -1;
+	}
+
+	header_len = prvPublishHeader( header, topic_len, payload_len, retain );
+
+	if( topic_len <= MQTT_NETWORK_PUBLISH_TOPIC_MAX )
+	{
+		/* Copying a short topic saves a write, which over TLS is a record */
+		memcpy( header + header_len, topic, topic_len );
+		header_len += topic_len;
+		topic_len = 0;
+	}
+
+	if( prvWriteAll( n, header, header_len, timeout_ms ) != 0 ||
+		( topic_len > 0 && prvWriteAll( n, topic, topic_len, timeout_ms ) != 0 ) ||
+		( payload_len > 0 && prvWriteAll( n, payload, payload_len, timeout_ms ) != 0 ) )
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int NetworkPublishBatch( Network* n, const NetworkPublishMessage* msgs, size_t count,
+						 unsigned char* stage, size_t stage_len, int timeout_ms )
+{
+	size_t used = 0;
+	size_t sent = 0;
+	size_t staged = 0;
+
+	for( size_t i = 0; i < count; i++ )
+	{
+		const NetworkPublishMessage* msg = &msgs[ i ];
+		size_t topic_len = strlen( msg->topic );
+		size_t msg_len = 7 + topic_len + msg->payload_len;
+
+		if( used > 0 && used + msg_len > stage_len )
+		{
+			if( prvWriteAll( n, stage, used, timeout_ms ) != 0 )
+			{
+				return sent;
+			}
+			sent += staged;
+			used = 0;
+			staged = 0;
+		}
+
+		if( msg_len <= stage_len && topic_len <= 0xFFFF )
+		{
+			used += prvPublishHeader( stage + used, topic_len, msg->payload_len, msg->retain );
+			memcpy( stage + used, msg->topic, topic_len );
+			used += topic_len;
+			memcpy( stage + used, msg->payload, msg->payload_len );
+			used += msg->payload_len;
+			staged++;
+		}
+		else
+		{
+			/* Too large to stage, so the stage is empty here */
+			if( NetworkPublish( n, msg->topic, msg->payload, msg->payload_len, msg->retain, timeout_ms ) != 0 )
+			{
+				return sent;
+			}
+			sent++;
+		}
+	}
+
+	if( used > 0 && prvWriteAll( n, stage, used, timeout_ms ) == 0 )
+	{
+		sent += staged;
+	}
+
+	return sent;
+}
+
+
+#if ( ipconfigSUPPORT_SELECT_FUNCTION == 1 )
+
+int NetworkSetInit( NetworkSet* set )
+{
+	memset( set, 0, sizeof( NetworkSet ) );
+	set->socket_set = FreeRTOS_CreateSocketSet();
+
+	return set->socket_set != NULL ? pdPASS : pdFAIL;
+}
+
+
+void NetworkSetDeinit( NetworkSet* set )
+{
+	while( set->count > 0 )
+	{
+		NetworkSetRemove( set, set->networks[ 0 ] );
+	}
+	FreeRTOS_DeleteSocketSet( set->socket_set );
+	set->socket_set = NULL;
+}
+
+
+int NetworkSetAdd( NetworkSet* set, Network* n )
+{
+	if( set->count == MQTT_NETWORK_SET_MAX )
+	{
+		return pdFAIL;
+	}
+
+	set->networks[ set->count++ ] = n;
+	FreeRTOS_FD_SET( n->my_socket, set->socket_set, eSELECT_READ | eSELECT_EXCEPT );
+
+	return pdPASS;
+}
+
+
+void NetworkSetRemove( NetworkSet* set, Network* n )
+{
+	for( int i = 0; i < set->count; i++ )
+	{
+		if( set->networks[ i ] == n )
+		{
+			FreeRTOS_FD_CLR( n->my_socket, set->socket_set, eSELECT_ALL );
+			set->networks[ i ] = set->networks[ --set->count ];
+			if( set->next >= set->count )
+			{
+				set->next = 0;
+			}
+			break;
+		}
+	}
+}
+
+
+static Network* prvNetworkSetNext( NetworkSet* set, int i )
+{
+	/* Start with the following network next time, so all get a turn */
+	set->next = ( i + 1 ) % set->count;
+	return set->networks[ i ];
+}
+
+
+Network* NetworkSetWait( NetworkSet* set, int timeout_ms )
+{
+	int i;
+
+	if( set->count == 0 )
+	{
+		vTaskDelay( pdMS_TO_TICKS( timeout_ms ) );
+		return NULL;
+	}
+
+	/* TLS may already hold decrypted data that the socket set cannot see */
+	for( int k = 0; k < set->count; k++ )
+	{
+		i = ( set->next + k ) % set->count;
+		if( set->networks[ i ]->ssl_ctx != NULL && mbedtls_ssl_get_bytes_avail( set->networks[ i ]->ssl_ctx ) > 0 )
+		{
+			return prvNetworkSetNext( set, i );
+		}
+	}
+
+	if( FreeRTOS_select( set->socket_set, pdMS_TO_TICKS( timeout_ms ) ) == 0 )
+	{
+		return NULL;
+	}
+
+	for( int k = 0; k < set->count; k++ )
+	{
+		i = ( set->next + k ) % set->count;
+		if( FreeRTOS_FD_ISSET( set->networks[ i ]->my_socket, set->socket_set ) & ( eSELECT_READ | eSELECT_EXCEPT ) )
+		{
+			return prvNetworkSetNext( set, i );
+		}
+	}
+
+	return NULL;
+}
+
+#endif
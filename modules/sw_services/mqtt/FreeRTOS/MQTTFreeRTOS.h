@@ -47,8 +47,66 @@ struct Network
 	int (*mqttwrite) (Network*, unsigned char*, int, int);	/**< Network send function pointer */
 	void (*disconnect) (Network*);							/**< Network disconnect function pointer */
 	mbedtls_ssl_context* ssl_ctx;							/**< TLS context */
+	xSocket_t timeout_socket;								/**< Socket that rx_timeout and tx_timeout apply to */
+	TickType_t rx_timeout;									/**< Last receive timeout set on the socket */
+	TickType_t tx_timeout;									/**< Last send timeout set on the socket */
+	int packet_state;										/**< Part of the MQTT packet being received */
+	int packet_remaining;									/**< Bytes of the packet's remaining length or body still to receive */
+	int packet_multiplier;									/**< Multiplier of the next remaining length byte */
 };
 
+/**
+ * Time to wait for each read of an MQTT packet once its first byte has
+ * been received, even when the caller's timeout is shorter or has
+ * expired. The client reads a packet's header byte, each byte of its
+ * remaining length and its body separately, so this is applied to every
+ * read until the packet's body has been received in full. This allows a
+ * client to be polled with a zero timeout without a packet that arrives
+ * in more than one TCP segment or TLS record being split between polls.
+ */
+#ifndef MQTT_NETWORK_PARTIAL_READ_TIMEOUT_MS
+#define MQTT_NETWORK_PARTIAL_READ_TIMEOUT_MS	100
+#endif
+
+/**
+ * Maximum number of networks in a NetworkSet
+ */
+#ifndef MQTT_NETWORK_SET_MAX
+#define MQTT_NETWORK_SET_MAX	4
+#endif
+
+/**
+ * Maximum topic length for which NetworkPublish() sends the topic
+ * in the same write as the header
+ */
+#ifndef MQTT_NETWORK_PUBLISH_TOPIC_MAX
+#define MQTT_NETWORK_PUBLISH_TOPIC_MAX	64
+#endif
+
+/**
+ * A QoS 0 message to be published by NetworkPublishBatch()
+ */
+typedef struct NetworkPublishMessage
+{
+	const char* topic;		/**< Topic name */
+	const void* payload;	/**< Payload */
+	size_t payload_len;		/**< Payload length in bytes */
+	int retain;				/**< Set to publish with the retain flag */
+} NetworkPublishMessage;
+
+#if ( ipconfigSUPPORT_SELECT_FUNCTION == 1 )
+/**
+ * A set of networks that may be serviced by a single task.
+ */
+typedef struct NetworkSet
+{
+	SocketSet_t socket_set;							/**< FreeRTOS socket set */
+	Network* networks[ MQTT_NETWORK_SET_MAX ];		/**< Networks in the set */
+	int count;										/**< Number of networks in the set */
+	int next;										/**< Network to check first on the next wait */
+} NetworkSet;
+#endif
+
 /**
  * Create a new timer
  *
@@ -203,5 +261,116 @@ int NetworkConnect( Network*, char*, int );
  */
 int NetworkConnectIP( Network*, uint32_t, int );
 
+/**
+ * Publish a QoS 0 message directly from the caller's buffers.
+ *
+ * The payload is written to the network without being copied into
+ * the MQTT client's send buffer, so it is not limited by its size.
+ * The client's mutex must be held, or this must be called from the
+ * only task that uses the client, as the writes must not be
+ * interleaved with the client's own.
+ *
+ * \param[in]     n		     Connected network pointer
+ * \param[in]     topic       Topic name
+ * \param[in]     payload     Payload
+ * \param[in]     payload_len Payload length in bytes
+ * \param[in]     retain      Set to publish with the retain flag
+ * \param[in]     timeout_ms  Send timeout in ms
+ *
+ * \returns       0 on success
+ * 				  negative value on failure
+ */
+int NetworkPublish( Network* n, const char* topic, const void* payload, size_t payload_len, int retain, int timeout_ms );
+
+/**
+ * Publish several QoS 0 messages, gathered into as few network writes
+ * as possible.
+ *
+ * Messages are gathered in the staging buffer, which is written each
+ * time it fills. Over TLS each write is a single record, so many
+ * small messages cost a fraction of the records that publishing them
+ * one at a time would. Messages too large for the staging buffer are
+ * written as by NetworkPublish(). The same locking rules apply.
+ *
+ * \param[in]     n		     Connected network pointer
+ * \param[in]     msgs        Messages to publish
+ * \param[in]     count       Number of messages
+ * \param[in]     stage       Staging buffer
+ * \param[in]     stage_len   Size of the staging buffer in bytes
+ * \param[in]     timeout_ms  Send timeout in ms, for each write
+ *
+ * \returns       Number of messages published. If this is less than
+ * 				  count then the network has failed.
+ */
+int NetworkPublishBatch( Network* n, const NetworkPublishMessage* msgs, size_t count,
+						 unsigned char* stage, size_t stage_len, int timeout_ms );
+
+#if ( ipconfigSUPPORT_SELECT_FUNCTION == 1 )
+/**
+ * Initialize a network set
+ *
+ * \param[in/out] set		     Network set pointer
+ *
+ * \returns       pdPASS on success
+ * 				  pdFAIL if the socket set could not be created
+ */
+int NetworkSetInit( NetworkSet* set );
+
+/**
+ * Delete a network set. The networks in it are not affected.
+ *
+ * \param[in]     set		     Network set pointer
+ */
+void NetworkSetDeinit( NetworkSet* set );
+
+/**
+ * Add a connected network to a set
+ *
+ * \param[in]     set		     Network set pointer
+ * \param[in]     n		     Connected network pointer
+ *
+ * \returns       pdPASS on success
+ * 				  pdFAIL if the set is full
+ */
+int NetworkSetAdd( NetworkSet* set, Network* n );
+
+/**
+ * Remove a network from a set. This must be done before the
+ * network's socket is closed.
+ *
+ * \param[in]     set		     Network set pointer
+ * \param[in]     n		     Network pointer
+ */
+void NetworkSetRemove( NetworkSet* set, Network* n );
+
+/**
+ * Wait until a network in the set has data to read, or has been
+ * disconnected. The networks are checked in turn, so that a busy
+ * network cannot starve the others.
+ *
+ * This allows one task to service many MQTT clients, by calling
+ * MQTTYield() with a zero timeout on the client of each network
+ * returned, instead of each client needing its own task. Once the first
+ * byte of a packet has been read, the rest of it is waited for for up to
+ * MQTT_NETWORK_PARTIAL_READ_TIMEOUT_MS per read:
+ *
+ *     while( 1 )
+ *     {
+ *         Network* n = NetworkSetWait( &set, 1000 );
+ *         if( n != NULL )
+ *         {
+ *             MQTTYield( client_of( n ), 0 );
+ *         }
+ *         ... send keepalives, publish ...
+ *     }
+ *
+ * \param[in]     set		     Network set pointer
+ * \param[in]     timeout_ms  Time to wait in ms
+ *
+ * \returns       A network that is ready to read
+ * 				  NULL if none became ready before the timeout
+ */
+Network* NetworkSetWait( NetworkSet* set, int timeout_ms );
+#endif
 
 #endif
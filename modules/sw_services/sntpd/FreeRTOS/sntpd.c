@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include "FreeRTOS.h"
@@ -9,86 +9,29 @@
 #include "FreeRTOS_Sockets.h"
 
 #include "sntpd.h"
+#include "sntpd_clock.h"
+#include "rtos_time.h"
 
 #include <string.h>
 #include <stdint.h>
-#include <limits.h>
 #include <time.h>
-/**
- * NTP Timestamp format as defined in RFC5905
- *
- *     0                   1                   2                   3
- *     0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                            Seconds                            |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                            Fraction                           |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- */
+
+#if( SNTPD_USER_TIME_SERVER == 0 )
+#define sntpd_time_servers default_time_servers
+#else
+#define sntpd_time_servers user_time_servers
+#endif
+
+#define SNTPD_SERVER_LIST_COUNT ( sizeof( sntpd_time_servers ) / sizeof( sntpd_time_servers[0] ) )
+#define SNTPD_SERVER_COUNT ( SNTPD_SERVER_LIST_COUNT < SNTPD_MAX_SERVERS ? SNTPD_SERVER_LIST_COUNT : SNTPD_MAX_SERVERS )
 
 typedef struct {
-  uint32_t seconds;		/* Seconds passed since Jan 1, 1990 */
-  uint32_t fraction;	/* Fractional field */
-} sntp_timestamp_t;
-
-/**
- * NTP packet format as defined in RFC4330
- *
- *                         1                   2                   3
- *     0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9  0  1
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |LI | VN  |Mode |    Stratum    |     Poll      |   Precision    |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                          Root  Delay                           |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                       Root  Dispersion                         |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                     Reference Identifier                       |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                                                                |
- *    |                    Reference Timestamp (64)                    |
- *    |                                                                |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                                                                |
- *    |                    Originate Timestamp (64)                    |
- *    |                                                                |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                                                                |
- *    |                     Receive Timestamp (64)                     |
- *    |                                                                |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                                                                |
- *    |                     Transmit Timestamp (64)                    |
- *    |                                                                |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                 Key Identifier (optional) (32)                 |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |                                                                |
- *    |                                                                |
- *    |                 Message Digest (optional) (128)                |
- *    |                                                                |
- *    |                                                                |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- */
+	const char *name;
+	uint32_t ip;		/* 0 until resolved */
+	int failures;		/* Consecutive polls without a valid sample */
+} sntpd_server_t;
 
-typedef struct __attribute__ ((__packed__)) {
-  uint8_t flags; 							/* Flags: 0:1 Leap indicator, 2:4 Version Number,
-   	   	   	   	   	   	   	   	   	   	   	   5:7 Mode */
-  uint8_t stratum; 							/* Stratum */
-  uint8_t poll;  							/* Maximum successive message interval in log2
-  	  	  	  	  	  	  	  	  	  	  	   seconds */
-  int8_t precision; 						/* Precision of system clock in log2 seconds */
-  int32_t rootDelay; 						/* Total round trip delay to primary reference */
-  uint32_t rootDispersion; 					/* Maximum error due to clock freq tolerance */
-  int8_t referenceID[4]; 					/* Reference source identifier */
-  sntp_timestamp_t referenceTimestamp; 		/* Time the system clock was last set or corrected */
-  sntp_timestamp_t originateTimestamp; 		/* Time the request departed the client for the
-  	  	  	  	  	  	  	  	  	  	  	   server */
-  sntp_timestamp_t receiveTimestamp; 		/* Time the request arrived at the server or reply
-  	  	  	  	  	  	  	  	  	  	  	   arrived at client */
-  sntp_timestamp_t transmitTimestamp; 		/* Time the request departed the client or the
-   	   	   	   	   	   	   	   	   	   	   	   reply departed the server */
-} sntp_packet_t;
+static sntpd_server_t servers[ SNTPD_MAX_SERVERS ];
 
 static int time_synced = pdFALSE;
 
@@ -97,135 +40,231 @@ int is_time_synced( void )
 	return time_synced;
 }
 
-static void sntpd_task( void *args )
+static int64_t local_time_ns( void )
+{
+	rtos_time_t now = rtos_time_get();
+
+	return ( int64_t ) now.seconds * 1000000000 + ( int64_t ) now.microseconds * 1000;
+}
+
+/*
+ * Sends one request to a server and waits for its response.
+ */
+static int sntpd_query( Socket_t sntp_socket, sntpd_server_t *server, sntpd_sample_t *sample )
 {
-	int failed_attempts = 0;
-	uint32_t ip = 0;
 	struct freertos_sockaddr ntp_addr;
-	uint32_t addr_len = sizeof( ntp_addr );
+	struct freertos_sockaddr from_addr;
+	uint32_t addr_len = sizeof( from_addr );
 	sntp_packet_t packet;
-	Socket_t sntp_socket = NULL;
+	sntp_timestamp_t sent;
+	int64_t t1;
+	int64_t t4;
+
+	ntp_addr.sin_addr = server->ip;
+	ntp_addr.sin_port = FreeRTOS_htons( SNTPD_PORT );
+
+	t1 = local_time_ns();
+	sntpd_request_build( &packet, t1 );
+	memcpy( &sent, &packet.transmitTimestamp, sizeof( sent ) );
+
+	FreeRTOS_sendto( sntp_socket, &packet, sizeof( sntp_packet_t ), 0, &ntp_addr, sizeof( ntp_addr ) );
 
 	while( 1 )
 	{
-		while( FreeRTOS_IsNetworkUp() != pdTRUE )
+		sntp_packet_t* rxpacket = NULL;
+		BaseType_t rx_len;
+		int ret;
+
+		rx_len = FreeRTOS_recvfrom( sntp_socket,
+									&rxpacket,
+									0,
+									FREERTOS_ZERO_COPY,
+									&from_addr,
+									&addr_len );
+		t4 = local_time_ns();
+
+		if( rx_len < 0 )
 		{
-			vTaskDelay( pdMS_TO_TICKS(100) );
+			return SNTPD_SAMPLE_INVALID;
 		}
 
-#if( SNTPD_USER_TIME_SERVER == 0 )
-		/* Search default list, use first server resolved */
-		for( int i=0; i<(sizeof( default_time_servers ) / sizeof( default_time_servers[0] )); i++ )
+		ret = SNTPD_SAMPLE_INVALID;
+		if( from_addr.sin_addr == server->ip )
 		{
-			ip = FreeRTOS_gethostbyname( default_time_servers[i] );
-#else
-		for( int i=0; i<(sizeof( user_time_servers ) / sizeof( user_time_servers[0] )); i++ )
+			ret = sntpd_response_parse( rxpacket, rx_len, &sent, t1, t4, sample );
+		}
+
+		FreeRTOS_ReleaseUDPPayloadBuffer( ( void * )rxpacket );
+
+		/*
+		 * An invalid response may be a late reply to an earlier request,
+		 * so wait for the reply to this one until the socket times out.
+		 */
+		if( ret != SNTPD_SAMPLE_INVALID )
 		{
-			ip = FreeRTOS_gethostbyname( user_time_servers[i] );
-#endif
-//			char buf[16];
-//			FreeRTOS_inet_ntoa( ip, buf );
-//			rtos_printf( "%s is %s\n", default_time_servers[i], buf );
+			return ret;
+		}
+	}
+}
+
+/*
+ * Measures the offset to every server, with a burst of requests to each.
+ * One sample is filtered from each server's burst, and the servers that
+ * agree with each other are combined, so that a bad server cannot pull
+ * the time away.
+ */
+static int sntpd_poll( Socket_t sntp_socket, int64_t *offset_ns )
+{
+	sntpd_sample_t server_samples[ SNTPD_MAX_SERVERS ];
+	int server_count = 0;
+
+	for( int i = 0; i < SNTPD_SERVER_COUNT; i++ )
+	{
+		sntpd_server_t *server = &servers[ i ];
+		sntpd_sample_t samples[ SNTPD_SAMPLES ];
+		int count = 0;
+
+		if( server->ip == 0 )
+		{
+			server->ip = FreeRTOS_gethostbyname( server->name );
+			if( server->ip == 0 )
+			{
+				continue;
+			}
+		}
+
+		for( int j = 0; j < SNTPD_SAMPLES; j++ )
+		{
+			int ret = sntpd_query( sntp_socket, server, &samples[ count ] );
 
-			if( ip > 0)
+			if( ret == SNTPD_SAMPLE_OK )
 			{
+				count++;
+			}
+			else if( ret == SNTPD_SAMPLE_KISS_OF_DEATH )
+			{
+				/* Stop using this address, and resolve another next time */
+				rtos_printf( "sntpd: %s sent kiss-o'-death\n", server->name );
+				server->ip = 0;
 				break;
 			}
+
+			if( j < SNTPD_SAMPLES - 1 )
+			{
+				vTaskDelay( pdMS_TO_TICKS( SNTPD_SAMPLE_INTERVAL_MS ) );
+			}
 		}
 
-		ntp_addr.sin_addr = ip;
-		ntp_addr.sin_port = FreeRTOS_htons( SNTPD_PORT );
+		if( count > 0 )
+		{
+			server_samples[ server_count++ ] = sntpd_filter_samples( samples, count );
+			server->failures = 0;
+		}
+		else if( ++server->failures >= SNTPD_RESET_AFTER_X_FAILURES )
+		{
+			/* Resolve the server again next time, as its address may have changed */
+			server->ip = 0;
+			server->failures = 0;
+		}
+	}
+
+	if( server_count == 0 )
+	{
+		return pdFAIL;
+	}
+
+	*offset_ns = sntpd_select_offset( server_samples, server_count );
+
+	return pdPASS;
+}
+
+static void sntpd_clock_update( sntpd_discipline_t *discipline, int64_t offset_ns )
+{
+	if( sntpd_discipline_update( discipline, offset_ns, rtos_time_monotonic_ns() ) == SNTPD_CLOCK_STEP )
+	{
+		int64_t ns = local_time_ns() + offset_ns;
+		rtos_time_t now;
+
+		now.seconds = ns / 1000000000;
+		now.microseconds = ( ns % 1000000000 ) / 1000;
+		rtos_time_set( now );
+
+		struct tm *info;
+		info = gmtime( (time_t * )(&now.seconds) );
+		rtos_printf( "NTP time: %d/%d/%02d %2d:%02d:%02d\n",
+					 (int)info->tm_mday,
+					 (int)info->tm_mon + 1,
+					 (int)info->tm_year + 1900,
+					 (int)info->tm_hour,
+					 (int)info->tm_min,
+					 (int)info->tm_sec) ;
+	}
+	else
+	{
+		rtos_time_adjust( discipline->slew_ns );
+	}
+
+	rtos_time_frequency_set( discipline->frequency_ppb );
+	time_synced = pdTRUE;
+}
+
+static void sntpd_task( void *args )
+{
+	sntpd_discipline_t discipline;
+	Socket_t sntp_socket = FREERTOS_INVALID_SOCKET;
 
-		packet.flags = SNTPD_FLAGS_LI_NOT_SYNCHRONIZED | SNTPD_FLAGS_VN_4 | SNTPD_FLAGS_MODE_CLIENT;
-		packet.poll = 0;						/* Server significant only */
-		packet.precision = 0x00;				/* Server significant only */
-		packet.rootDelay = 0x0000;				/* Server significant only */
-		packet.rootDispersion = 0x00000000;		/* Server significant only */
+	sntpd_discipline_init( &discipline );
 
-		sntp_socket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_DGRAM, FREERTOS_IPPROTO_UDP );
+	for( int i = 0; i < SNTPD_SERVER_COUNT; i++ )
+	{
+		servers[ i ].name = sntpd_time_servers[ i ];
+	}
+
+	while( 1 )
+	{
+		TickType_t poll_delay = pdMS_TO_TICKS( SNTPD_POLL_RATE_MS );
+		int64_t offset_ns;
+
+		while( FreeRTOS_IsNetworkUp() != pdTRUE )
+		{
+			vTaskDelay( pdMS_TO_TICKS(100) );
+		}
+
+		if( sntp_socket == FREERTOS_INVALID_SOCKET )
+		{
+			/* A single socket, bound to any local port, is used for all servers */
+			sntp_socket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_DGRAM, FREERTOS_IPPROTO_UDP );
+
+			if( sntp_socket != FREERTOS_INVALID_SOCKET )
+			{
+				struct freertos_sockaddr local_addr;
+				TickType_t xReceiveTimeOut = pdMS_TO_TICKS( SNTPD_RX_TIMEOUT_MS );
 
-		if( sntp_socket != FREERTOS_INVALID_SOCKET )
+				memset( &local_addr, 0, sizeof( local_addr ) );
+				FreeRTOS_bind( sntp_socket, &local_addr, sizeof( local_addr ) );
+				FreeRTOS_setsockopt( sntp_socket, 0, FREERTOS_SO_RCVTIMEO, &xReceiveTimeOut, sizeof( xReceiveTimeOut ) );
+			}
+			else
+			{
+				vTaskDelay( poll_delay );
+				continue;
+			}
+		}
+
+		if( sntpd_poll( sntp_socket, &offset_ns ) == pdPASS )
 		{
-			BaseType_t xReceiveTimeOut = pdMS_TO_TICKS( SNTPD_RX_TIMEOUT_MS );
+			int was_synced = discipline.synced;
 
-			FreeRTOS_bind( sntp_socket, &ntp_addr, sizeof( ntp_addr ) );
-			FreeRTOS_setsockopt( sntp_socket, 0, FREERTOS_SO_RCVTIMEO, &xReceiveTimeOut, sizeof( xReceiveTimeOut ) );
+			sntpd_clock_update( &discipline, offset_ns );
 
-			while( 1 )
+			if( !was_synced )
 			{
-//				rtos_printf("send ntp packet.\n");
-
-				rtos_time_t cur = rtos_time_get();
-
-				packet.referenceTimestamp.seconds = FreeRTOS_htonl( cur.seconds + EPOCH );
-				packet.referenceTimestamp.fraction = FreeRTOS_htonl( 0 );	/* fractional resolution not needed for now */
-
-				packet.transmitTimestamp.seconds = FreeRTOS_htonl( cur.seconds + EPOCH );
-				packet.transmitTimestamp.fraction = FreeRTOS_htonl( 0 );	/* fractional resolution not needed for now */
-
-				FreeRTOS_sendto( sntp_socket, &packet, sizeof( sntp_packet_t ), 0, &ntp_addr, addr_len );
-
-				BaseType_t rx_len = 0;
-				sntp_packet_t* rxpacket = NULL;
-				rx_len = FreeRTOS_recvfrom( sntp_socket,
-											&rxpacket,
-											0,
-											FREERTOS_ZERO_COPY,
-											&ntp_addr,
-											&addr_len );
-
-				if( rx_len < 0 )
-				{
-					failed_attempts++;
-	//				rtos_printf("sntpd packet ret:%d\n", rx_len);
-				}
-				else
-				{
-					if( rx_len < sizeof( rxpacket ) )
-					{
-						failed_attempts++;
-	//					rtos_printf("sntpd bad response to ntp packet.\n");
-					}
-					else
-					{
-	//					rtos_printf("got response from ntp server %d\n", rx_len);
-
-						rtos_time_t now;
-						now.seconds = FreeRTOS_htonl( rxpacket->receiveTimestamp.seconds ) - EPOCH;
-						now.microseconds = FreeRTOS_htonl( rxpacket->receiveTimestamp.fraction ) / UINT_MAX;
-						rtos_time_set( now );
-
-						time_synced = pdTRUE;
-
-						struct tm *info;
-						info = gmtime( (time_t * )(&now.seconds) );
-						rtos_printf( "NTP time: %d/%d/%02d %2d:%02d:%02d\n",
-									 (int)info->tm_mday,
-									 (int)info->tm_mon + 1,
-									 (int)info->tm_year + 1900,
-									 (int)info->tm_hour,
-									 (int)info->tm_min,
-									 (int)info->tm_sec) ;
-
-						if( ( ( uint8_t ) rxpacket->stratum ) == SNTPD_STRATUM_KISS_OF_DEATH )
-						{
-							failed_attempts = SNTPD_RESET_AFTER_X_FAILURES; /* for a reset */
-						}
-					}
-
-					FreeRTOS_ReleaseUDPPayloadBuffer( ( void * )rxpacket );
-				}
-
-				if( failed_attempts >= SNTPD_RESET_AFTER_X_FAILURES )
-				{
-				    FreeRTOS_closesocket( sntp_socket );
-				    failed_attempts = 0;
-					sntp_socket = NULL;
-					break;
-				}
-				vTaskDelay( pdMS_TO_TICKS( SNTPD_POLL_RATE_MS ) );
+				/* Measure again soon after the first step, to start estimating the frequency */
+				poll_delay = pdMS_TO_TICKS( SNTPD_SAMPLE_INTERVAL_MS );
 			}
 		}
+
+		vTaskDelay( poll_delay );
 	}
 }
 
@@ -233,5 +272,3 @@ void sntp_create( UBaseType_t priority )
 {
     xTaskCreate( sntpd_task, SNTPD_TASK_NAME, SNTPD_TASK_STACKSIZE, NULL, priority, NULL );
 }
-
-
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef SRC_SNTPD_SNTPD_H_
@@ -22,12 +22,30 @@
 #define SNTPD_RX_TIMEOUT_MS	5000
 #endif
 
-/* SNTPD will close the socket and try to find a valid time server after
- * x failed attempts */
+/* SNTPD will resolve a time server's address again after it has failed
+ * to respond to x polls in a row */
 #ifndef SNTPD_RESET_AFTER_X_FAILURES
 #define SNTPD_RESET_AFTER_X_FAILURES 10
 #endif
 
+/* The number of requests sent to each server in each poll. The offset
+ * is taken from the response with the shortest round trip delay. */
+#ifndef SNTPD_SAMPLES
+#define SNTPD_SAMPLES	4
+#endif
+
+/* The interval between requests to a server within a poll */
+#ifndef SNTPD_SAMPLE_INTERVAL_MS
+#define SNTPD_SAMPLE_INTERVAL_MS	500
+#endif
+
+/* The most time servers that are polled. Servers that disagree with the
+ * majority are ignored, so at least three are needed for one bad server
+ * to be outvoted. This may be at most SNTPD_SELECT_MAX_SERVERS. */
+#ifndef SNTPD_MAX_SERVERS
+#define SNTPD_MAX_SERVERS	4
+#endif
+
 /* User may provide time servers list by defining SNTPD_USER_TIME_SERVER
  * and providing a list of time servers */
 #ifndef SNTPD_USER_TIME_SERVER
@@ -184,6 +202,11 @@ static const char* default_time_servers[] = {
 
 /**
  * Create SNTP task to update rtos_clock
+ *
+ * The time is set when it is first synchronized, or if it is found to be
+ * more than SNTPD_STEP_THRESHOLD_US out. Otherwise it is slewed with
+ * rtos_time_adjust(), and the frequency of the local clock is corrected
+ * with rtos_time_frequency_set(), so that it never jumps.
  */
 void sntp_create( UBaseType_t priority );
 
@@ -0,0 +1,296 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <string.h>
+
+#include "sntpd_clock.h"
+
+#define NS_PER_SECOND 1000000000LL
+
+/* Flags used in requests and checked in responses */
+#define FLAGS_LI_MASK               0xC0
+#define FLAGS_LI_NOT_SYNCHRONIZED   0xC0
+#define FLAGS_VN_MASK               0x38
+#define FLAGS_VN_4                  0x20
+#define FLAGS_MODE_MASK             0x07
+#define FLAGS_MODE_CLIENT           0x03
+#define FLAGS_MODE_SERVER           0x04
+
+/* NTP seconds below this are in era 1, which begins in 2036 */
+#define ERA_PIVOT                   0x80000000UL
+
+static uint32_t load32(const void *p)
+{
+    const uint8_t *b = p;
+    return ((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) | ((uint32_t) b[2] << 8) | b[3];
+}
+
+static void store32(void *p, uint32_t v)
+{
+    uint8_t *b = p;
+    b[0] = v >> 24;
+    b[1] = v >> 16;
+    b[2] = v >> 8;
+    b[3] = v;
+}
+
+/* Timestamps in packets may be unaligned, so are accessed a byte at a time */
+static sntp_timestamp_t timestamp_load(const void *p)
+{
+    sntp_timestamp_t t;
+    t.seconds = load32(p);
+    t.fraction = load32((const uint8_t *) p + 4);
+    return t;
+}
+
+static void timestamp_store(void *p, sntp_timestamp_t t)
+{
+    store32(p, t.seconds);
+    store32((uint8_t *) p + 4, t.fraction);
+}
+
+/* Converts an unsigned NTP short format value, 16.16 seconds */
+static int64_t short_to_ns(uint32_t v)
+{
+    return ((uint64_t) v * NS_PER_SECOND) >> 16;
+}
+
+sntp_timestamp_t sntpd_timestamp_from_ns(int64_t ns)
+{
+    sntp_timestamp_t ts;
+    int64_t seconds = ns / NS_PER_SECOND;
+    int64_t remainder = ns % NS_PER_SECOND;
+
+    if (remainder < 0) {
+        remainder += NS_PER_SECOND;
+        seconds--;
+    }
+
+    /* Truncated to 32 bits, which wraps into the next era as required */
+    ts.seconds = (uint32_t) (seconds + SNTPD_NTP_UNIX_OFFSET);
+    ts.fraction = (uint32_t) (((uint64_t) remainder << 32) / NS_PER_SECOND);
+
+    return ts;
+}
+
+int64_t sntpd_timestamp_to_ns(sntp_timestamp_t ts)
+{
+    int64_t seconds = ts.seconds;
+
+    if (ts.seconds < ERA_PIVOT) {
+        seconds += 1LL << 32;
+    }
+    seconds -= SNTPD_NTP_UNIX_OFFSET;
+
+    return seconds * NS_PER_SECOND + (int64_t) (((uint64_t) ts.fraction * NS_PER_SECOND) >> 32);
+}
+
+void sntpd_request_build(sntp_packet_t *packet, int64_t t1)
+{
+    memset(packet, 0, sizeof(sntp_packet_t));
+    packet->flags = FLAGS_LI_NOT_SYNCHRONIZED | FLAGS_VN_4 | FLAGS_MODE_CLIENT;
+
+    /*
+     * Only the transmit timestamp is significant in a request. The
+     * server copies it to the originate timestamp of its response.
+     */
+    timestamp_store(&packet->transmitTimestamp, sntpd_timestamp_from_ns(t1));
+}
+
+int sntpd_response_parse(const sntp_packet_t *packet, size_t len, const sntp_timestamp_t *sent,
+                         int64_t t1, int64_t t4, sntpd_sample_t *sample)
+{
+    sntp_timestamp_t transmit;
+    int64_t t2;
+    int64_t t3;
+
+    if (len < sizeof(sntp_packet_t)) {
+        return SNTPD_SAMPLE_INVALID;
+    }
+
+    if ((packet->flags & FLAGS_MODE_MASK) != FLAGS_MODE_SERVER) {
+        return SNTPD_SAMPLE_INVALID;
+    }
+
+    /* A response to an earlier request, or not to us at all */
+    if (memcmp(&packet->originateTimestamp, sent, sizeof(sntp_timestamp_t)) != 0) {
+        return SNTPD_SAMPLE_INVALID;
+    }
+
+    if (packet->stratum == 0) {
+        return SNTPD_SAMPLE_KISS_OF_DEATH;
+    }
+
+    if (packet->stratum > 15 || (packet->flags & FLAGS_LI_MASK) == FLAGS_LI_NOT_SYNCHRONIZED) {
+        return SNTPD_SAMPLE_INVALID;
+    }
+
+    transmit = timestamp_load(&packet->transmitTimestamp);
+    if (transmit.seconds == 0 && transmit.fraction == 0) {
+        return SNTPD_SAMPLE_INVALID;
+    }
+
+    t2 = sntpd_timestamp_to_ns(timestamp_load(&packet->receiveTimestamp));
+    t3 = sntpd_timestamp_to_ns(transmit);
+
+    /* RFC 5905 section 8 */
+    sample->offset_ns = ((t2 - t1) + (t3 - t4)) / 2;
+    sample->delay_ns = (t4 - t1) - (t3 - t2);
+
+    if (sample->delay_ns < 0) {
+        return SNTPD_SAMPLE_INVALID;
+    }
+
+    /*
+     * The root distance. Half of the round trip is the most that the
+     * offset can be out due to asymmetry in the network, to which is
+     * added how far the server itself may be from its reference.
+     */
+    sample->distance_ns = (sample->delay_ns + short_to_ns(load32(&packet->rootDelay))) / 2 +
+                          short_to_ns(load32(&packet->rootDispersion));
+
+    return SNTPD_SAMPLE_OK;
+}
+
+static void sort(int64_t *values, int count)
+{
+    /* Insertion sort, as there are only ever a few values */
+    for (int i = 1; i < count; i++) {
+        int64_t v = values[i];
+        int j = i;
+        while (j > 0 && values[j - 1] > v) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = v;
+    }
+}
+
+int64_t sntpd_median(int64_t *values, int count)
+{
+    sort(values, count);
+
+    if (count & 1) {
+        return values[count / 2];
+    } else {
+        return values[count / 2 - 1] + (values[count / 2] - values[count / 2 - 1]) / 2;
+    }
+}
+
+sntpd_sample_t sntpd_filter_samples(const sntpd_sample_t *samples, int count)
+{
+    int best = 0;
+
+    for (int i = 1; i < count; i++) {
+        if (samples[i].delay_ns < samples[best].delay_ns) {
+            best = i;
+        }
+    }
+
+    return samples[best];
+}
+
+static int sample_contains(const sntpd_sample_t *sample, int64_t ns)
+{
+    return ns >= sample->offset_ns - sample->distance_ns && ns <= sample->offset_ns + sample->distance_ns;
+}
+
+int64_t sntpd_select_offset(const sntpd_sample_t *samples, int count)
+{
+    int64_t offsets[SNTPD_SELECT_MAX_SERVERS];
+    int64_t best_point = samples[0].offset_ns;
+    int best_count = 0;
+    int n = 0;
+
+    if (count > SNTPD_SELECT_MAX_SERVERS) {
+        count = SNTPD_SELECT_MAX_SERVERS;
+    }
+
+    /*
+     * The most intervals intersect at the lower end of one of them. There
+     * are only ever a few servers, so each is simply tried in turn.
+     */
+    for (int i = 0; i < count; i++) {
+        const int64_t point = samples[i].offset_ns - samples[i].distance_ns;
+        int k = 0;
+
+        for (int j = 0; j < count; j++) {
+            k += sample_contains(&samples[j], point);
+        }
+        if (k > best_count) {
+            best_count = k;
+            best_point = point;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (sample_contains(&samples[i], best_point)) {
+            offsets[n++] = samples[i].offset_ns;
+        }
+    }
+
+    return sntpd_median(offsets, n);
+}
+
+void sntpd_discipline_init(sntpd_discipline_t *d)
+{
+    memset(d, 0, sizeof(sntpd_discipline_t));
+}
+
+/*
+ * Returns the part of a slew of offset_ns that will not yet have been
+ * applied after elapsed_ns, as the time is slewed at a limited rate.
+ */
+static int64_t slew_remaining(int64_t offset_ns, int64_t elapsed_ns)
+{
+    const int64_t slewed = elapsed_ns / 1000000 * SNTPD_SLEW_MAX_PPM;
+
+    if (offset_ns > slewed) {
+        return offset_ns - slewed;
+    } else if (offset_ns < -slewed) {
+        return offset_ns + slewed;
+    }
+    return 0;
+}
+
+int sntpd_discipline_update(sntpd_discipline_t *d, int64_t offset_ns, uint64_t now_ns)
+{
+    const int64_t elapsed_ns = now_ns - d->last_update_ns;
+    const int64_t last_offset_ns = d->last_offset_ns;
+    const int64_t last_slew_ns = d->slew_ns;
+
+    d->last_update_ns = now_ns;
+    d->last_offset_ns = offset_ns;
+
+    if (!d->synced || offset_ns > SNTPD_STEP_THRESHOLD_US * 1000LL || offset_ns < -SNTPD_STEP_THRESHOLD_US * 1000LL) {
+        /*
+         * The offset is too large to slew in reasonable time. A step also
+         * says nothing about the frequency, so it is left as it is.
+         */
+        d->synced = 1;
+        d->slew_ns = 0;
+        d->last_offset_ns = 0;
+        return SNTPD_CLOCK_STEP;
+    }
+
+    if (elapsed_ns >= NS_PER_SECOND) {
+        /*
+         * Of the previous offset, what was not slewed away is still there.
+         * Anything more has built up since, due to the frequency error.
+         */
+        const int64_t slewed_ns = last_slew_ns - slew_remaining(last_slew_ns, elapsed_ns);
+        const int64_t error_ns = offset_ns - (last_offset_ns - slewed_ns);
+        int64_t frequency_ppb = d->frequency_ppb + error_ns * NS_PER_SECOND / elapsed_ns / (1 << SNTPD_FREQUENCY_GAIN_SHIFT);
+
+        if (frequency_ppb > SNTPD_FREQUENCY_MAX_PPB) {
+            frequency_ppb = SNTPD_FREQUENCY_MAX_PPB;
+        } else if (frequency_ppb < -SNTPD_FREQUENCY_MAX_PPB) {
+            frequency_ppb = -SNTPD_FREQUENCY_MAX_PPB;
+        }
+        d->frequency_ppb = frequency_ppb;
+    }
+
+    d->slew_ns = offset_ns / (1 << SNTPD_PHASE_GAIN_SHIFT);
+
+    return SNTPD_CLOCK_SLEW;
+}
@@ -0,0 +1,237 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef SNTPD_CLOCK_H_
+#define SNTPD_CLOCK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The NTP protocol and clock discipline used by sntpd. It has no
+ * dependencies on FreeRTOS so that it may also be tested on the host.
+ *
+ * Times are handled as signed 64-bit nanoseconds since the Unix epoch,
+ * which is the epoch of rtos_time_t.
+ */
+
+/**
+ * NTP Timestamp format as defined in RFC5905
+ *
+ *     0                   1                   2                   3
+ *     0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                            Seconds                            |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                            Fraction                           |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+
+typedef struct {
+  uint32_t seconds;		/* Seconds passed since Jan 1, 1900 */
+  uint32_t fraction;	/* Fractional field */
+} sntp_timestamp_t;
+
+/**
+ * NTP packet format as defined in RFC4330
+ *
+ *                         1                   2                   3
+ *     0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9  0  1
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |LI | VN  |Mode |    Stratum    |     Poll      |   Precision    |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                          Root  Delay                           |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                       Root  Dispersion                         |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                     Reference Identifier                       |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                                                                |
+ *    |                    Reference Timestamp (64)                    |
+ *    |                                                                |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                                                                |
+ *    |                    Originate Timestamp (64)                    |
+ *    |                                                                |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                                                                |
+ *    |                     Receive Timestamp (64)                     |
+ *    |                                                                |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                                                                |
+ *    |                     Transmit Timestamp (64)                    |
+ *    |                                                                |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                 Key Identifier (optional) (32)                 |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                                                                |
+ *    |                                                                |
+ *    |                 Message Digest (optional) (128)                |
+ *    |                                                                |
+ *    |                                                                |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+
+typedef struct __attribute__ ((__packed__)) {
+  uint8_t flags; 							/* Flags: 0:1 Leap indicator, 2:4 Version Number,
+   	   	   	   	   	   	   	   	   	   	   	   5:7 Mode */
+  uint8_t stratum; 							/* Stratum */
+  uint8_t poll;  							/* Maximum successive message interval in log2
+  	  	  	  	  	  	  	  	  	  	  	   seconds */
+  int8_t precision; 						/* Precision of system clock in log2 seconds */
+  int32_t rootDelay; 						/* Total round trip delay to primary reference */
+  uint32_t rootDispersion; 					/* Maximum error due to clock freq tolerance */
+  int8_t referenceID[4]; 					/* Reference source identifier */
+  sntp_timestamp_t referenceTimestamp; 		/* Time the system clock was last set or corrected */
+  sntp_timestamp_t originateTimestamp; 		/* Time the request departed the client for the
+  	  	  	  	  	  	  	  	  	  	  	   server */
+  sntp_timestamp_t receiveTimestamp; 		/* Time the request arrived at the server or reply
+  	  	  	  	  	  	  	  	  	  	  	   arrived at client */
+  sntp_timestamp_t transmitTimestamp; 		/* Time the request departed the client or the
+   	   	   	   	   	   	   	   	   	   	   	   reply departed the server */
+} sntp_packet_t;
+
+/* Seconds from the NTP epoch, Jan 1 1900, to the Unix epoch */
+#define SNTPD_NTP_UNIX_OFFSET		2208988800ULL
+
+/* The largest offset that is slewed rather than stepped */
+#ifndef SNTPD_STEP_THRESHOLD_US
+#define SNTPD_STEP_THRESHOLD_US		128000
+#endif
+
+/* Each offset that is slewed is 1 / 2^SNTPD_PHASE_GAIN_SHIFT of the one measured */
+#ifndef SNTPD_PHASE_GAIN_SHIFT
+#define SNTPD_PHASE_GAIN_SHIFT		3
+#endif
+
+/* The frequency estimate is updated by 1 / 2^SNTPD_FREQUENCY_GAIN_SHIFT of its measured error */
+#ifndef SNTPD_FREQUENCY_GAIN_SHIFT
+#define SNTPD_FREQUENCY_GAIN_SHIFT	4
+#endif
+
+/* The largest frequency correction that will be applied */
+#define SNTPD_FREQUENCY_MAX_PPB		500000
+
+/* The rate at which the local time is slewed. This is RTOS_TIME_SLEW_MAX_PPM. */
+#define SNTPD_SLEW_MAX_PPM			500
+
+/* The most servers that sntpd_select_offset() will consider */
+#define SNTPD_SELECT_MAX_SERVERS	8
+
+/* Results of sntpd_response_parse() */
+#define SNTPD_SAMPLE_OK				0
+#define SNTPD_SAMPLE_INVALID		-1
+#define SNTPD_SAMPLE_KISS_OF_DEATH	-2
+
+/* Results of sntpd_discipline_update() */
+#define SNTPD_CLOCK_STEP			0
+#define SNTPD_CLOCK_SLEW			1
+
+/**
+ * A single measurement against a server
+ */
+typedef struct {
+    int64_t offset_ns;      /* The server's time minus the local time */
+    int64_t delay_ns;       /* The round trip delay to the server */
+    int64_t distance_ns;    /* The most that offset_ns can be from the true time */
+} sntpd_sample_t;
+
+/**
+ * The state of the clock discipline
+ */
+typedef struct {
+    int synced;
+    int32_t frequency_ppb;      /* The frequency correction to apply */
+    int64_t slew_ns;            /* The offset to slew by */
+    uint64_t last_update_ns;    /* The monotonic time of the last update */
+    int64_t last_offset_ns;     /* The offset measured at the last update */
+} sntpd_discipline_t;
+
+/**
+ * Converts a time in nanoseconds since the Unix epoch to an NTP timestamp
+ * in host byte order.
+ */
+sntp_timestamp_t sntpd_timestamp_from_ns(int64_t ns);
+
+/**
+ * Converts an NTP timestamp in host byte order to nanoseconds since the
+ * Unix epoch. Timestamps before 1968 are taken to be in the next NTP era,
+ * which begins in 2036.
+ */
+int64_t sntpd_timestamp_to_ns(sntp_timestamp_t ts);
+
+/**
+ * Builds a client request. \p t1 is the local time that it is sent,
+ * which the server will return as the originate timestamp. The caller
+ * must keep the transmit timestamp written to \p packet to pass to
+ * sntpd_response_parse().
+ */
+void sntpd_request_build(sntp_packet_t *packet, int64_t t1);
+
+/**
+ * Checks a server's response and computes the offset and delay from the
+ * four timestamps of the exchange.
+ *
+ * \param[in]  packet   The response, in network byte order
+ * \param[in]  len      The length of the response
+ * \param[in]  sent     The transmit timestamp of the request, as written
+ *                      by sntpd_request_build()
+ * \param[in]  t1       The local time that the request was sent
+ * \param[in]  t4       The local time that the response was received
+ * \param[out] sample   The offset and delay
+ *
+ * \returns SNTPD_SAMPLE_OK, SNTPD_SAMPLE_INVALID, or
+ *          SNTPD_SAMPLE_KISS_OF_DEATH if the server asks not to be
+ *          sent any more requests.
+ */
+int sntpd_response_parse(const sntp_packet_t *packet, size_t len, const sntp_timestamp_t *sent,
+                         int64_t t1, int64_t t4, sntpd_sample_t *sample);
+
+/**
+ * Returns the median of \p count values, reordering them.
+ */
+int64_t sntpd_median(int64_t *values, int count);
+
+/**
+ * Returns the sample of a burst from one server to use. As in the clock
+ * filter of RFC 5905, this is the sample with the shortest delay, which
+ * is the least affected by queuing in the network. \p count must be at
+ * least 1.
+ */
+sntpd_sample_t sntpd_filter_samples(const sntpd_sample_t *samples, int count);
+
+/**
+ * Returns the offset to correct the local time by, from one filtered
+ * sample from each of \p count servers.
+ *
+ * As in the selection algorithm of RFC 5905, the true time lies within
+ * each correct server's offset plus or minus its distance. The point
+ * at which the most of these intervals intersect is found, and the
+ * median offset of the servers whose intervals contain it is returned.
+ * Servers that disagree with the majority are ignored. Only the first
+ * SNTPD_SELECT_MAX_SERVERS samples are used. \p count must be at least 1.
+ */
+int64_t sntpd_select_offset(const sntpd_sample_t *samples, int count);
+
+/**
+ * Initializes the clock discipline.
+ */
+void sntpd_discipline_init(sntpd_discipline_t *d);
+
+/**
+ * Updates the clock discipline with a new measured offset.
+ *
+ * \param[in] d         The clock discipline state
+ * \param[in] offset_ns The measured offset
+ * \param[in] now_ns    The current monotonic time
+ *
+ * \returns SNTPD_CLOCK_STEP if the clock should be set to correct
+ *          \p offset_ns, or SNTPD_CLOCK_SLEW if it should be slewed by
+ *          d->slew_ns. Only part of a small offset is slewed, so that
+ *          the noise in each measurement is averaged out over several.
+ *          In either case d->frequency_ppb holds the frequency
+ *          correction to apply.
+ */
+int sntpd_discipline_update(sntpd_discipline_t *d, int64_t offset_ns, uint64_t now_ns);
+
+#endif /* SNTPD_CLOCK_H_ */
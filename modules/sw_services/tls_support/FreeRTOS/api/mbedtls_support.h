@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef FREERTOS_TLS_SUPPORT_H_
@@ -16,11 +16,19 @@
 /**
  * Context required for sending and receiving in the
  * FreeRTOS+TCP and mbedtls setup
+ *
+ * The context also holds the session from the last successful
+ * handshake, so that it may be resumed when reconnecting to the
+ * same server. The context should therefore be kept for as long
+ * as the application reconnects to that server, with only the
+ * socket replaced.
  */
 typedef struct tls_ctx
 {
 	Socket_t socket;
 	int flags;
+	mbedtls_ssl_session session;	/**< Session saved by tls_session_save() */
+	int session_valid;				/**< Set when session may be resumed */
 } tls_ctx_t;
 
 /**
@@ -29,6 +37,50 @@ typedef struct tls_ctx
  */
 void tls_ctx_init( tls_ctx_t* ctx );
 
+/**
+ * Free any resources held by a tls_ctx_t, including its saved session
+ */
+void tls_ctx_free( tls_ctx_t* ctx );
+
+/**
+ * Save the session of a connection, so that it may be resumed by
+ * tls_session_resume() on the next connection to the same server.
+ * Call this after each successful mbedtls_ssl_handshake().
+ *
+ * The session ticket is saved if the server issued one, otherwise
+ * the session ID.
+ *
+ * \param[in/out] ctx		     Context to save the session in
+ * \param[in]     ssl		     SSL context that has completed its handshake
+ *
+ * \returns       0 on success
+ * 				  mbedtls error code otherwise
+ */
+int tls_session_save( tls_ctx_t* ctx, const mbedtls_ssl_context* ssl );
+
+/**
+ * Offer the session saved in ctx, if any, in the next handshake
+ * of ssl. Call this after mbedtls_ssl_setup() and before
+ * mbedtls_ssl_handshake(). If the server accepts it the handshake
+ * takes a single round trip and needs no public key operations.
+ * If it does not, a full handshake is performed as normal.
+ *
+ * \param[in/out] ctx		     Context holding the saved session
+ * \param[in/out] ssl		     SSL context about to perform its handshake
+ *
+ * \returns       0 on success, including when there is no saved session
+ * 				  mbedtls error code otherwise
+ */
+int tls_session_resume( tls_ctx_t* ctx, mbedtls_ssl_context* ssl );
+
+/**
+ * Forget the session saved in ctx, for example when connecting
+ * to a different server.
+ *
+ * \param[in/out] ctx		     Context holding the saved session
+ */
+void tls_session_clear( tls_ctx_t* ctx );
+
 /**
  * Get the platform shared entropy context
  *
@@ -60,7 +112,11 @@ void default_mbedtls_debug( void *ctx, int level,
 							const char *str );
 
 /**
- * Populate an mbedtls certificate, found at filepath
+ * Populate an mbedtls certificate, found at filepath.
+ *
+ * The file may contain one or more certificates, either in PEM
+ * format or in DER format one after the other. DER is quicker
+ * to load as it needs no base64 decoding.
  *
  * \param[in/out] cert            Pointer to the cert to populate
  * \param[in]     filepath    	  Filepath that cert is located at
@@ -71,7 +127,9 @@ void default_mbedtls_debug( void *ctx, int level,
 int get_cert( mbedtls_x509_crt* cert, const char* filepath );
 
 /**
- * Populate an mbedtls key, found at filepath
+ * Populate an mbedtls key, found at filepath.
+ *
+ * The file may be in either PEM or DER format.
  *
  * \param[in/out] key             Pointer to the key to populate
  * \param[in]     filepath    	  Filepath that key is located at
@@ -130,6 +188,67 @@ int get_device_cert( mbedtls_x509_crt* cert );
  */
 int get_device_prvkey( mbedtls_pk_context* prvkey );
 
+/**
+ * Get the certificate chain at filepath from the credential cache.
+ *
+ * The file is read and parsed by get_cert() the first time it is
+ * requested. After that the same parsed chain is returned without
+ * accessing the filesystem, so it may be shared by every connection,
+ * for example with mbedtls_ssl_conf_ca_chain().
+ *
+ * The chain must not be modified or freed by the caller. It remains
+ * valid until tls_credential_cache_clear() is called.
+ *
+ * \param[in]     filepath    	  Filepath that cert is located at
+ *
+ * \returns       pointer to the cached cert on success
+ * 				  NULL on failure
+ */
+mbedtls_x509_crt* get_cached_cert( const char* filepath );
+
+/**
+ * Get the key at filepath from the credential cache.
+ *
+ * As get_cached_cert(), but for keys parsed by get_key().
+ *
+ * \param[in]     filepath    	  Filepath that key is located at
+ *
+ * \returns       pointer to the cached key on success
+ * 				  NULL on failure
+ */
+mbedtls_pk_context* get_cached_key( const char* filepath );
+
+/**
+ * Get the default CA certificate chain from the credential cache.
+ *
+ * \returns       pointer to the cached cert on success
+ * 				  NULL on failure
+ */
+mbedtls_x509_crt* get_cached_ca_cert( void );
+
+/**
+ * Get the default device certificate from the credential cache.
+ *
+ * \returns       pointer to the cached cert on success
+ * 				  NULL on failure
+ */
+mbedtls_x509_crt* get_cached_device_cert( void );
+
+/**
+ * Get the default device private key from the credential cache.
+ *
+ * \returns       pointer to the cached key on success
+ * 				  NULL on failure
+ */
+mbedtls_pk_context* get_cached_device_prvkey( void );
+
+/**
+ * Free every certificate and key in the credential cache, for
+ * example after they have been updated on the filesystem. This
+ * must not be called while any connection is using them.
+ */
+void tls_credential_cache_clear( void );
+
 #define DRBG_SEED_STRING_DEFAULT "XCOREAI"
 
 #ifdef DRBG_SEED_STRING
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT MBEDTLS_SUPPORT
@@ -12,6 +12,7 @@
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/certs.h"
 #include "mbedtls/x509_crt.h"
+#include "mbedtls/asn1.h"
 #include "mbedtls/error.h"
 #include "mbedtls/platform_util.h"
 #include "mbedtls/platform_time.h"
@@ -34,6 +35,8 @@ static random_generator_t ring_oscillator = 0;
 
 static int platform_ready = 0;
 
+static SemaphoreHandle_t credential_cache_lock = NULL;
+
 int tls_platform_ready( void )
 {
 	return platform_ready;
@@ -142,6 +145,53 @@ static int freertos_mutex_unlock( mbedtls_threading_mutex_t* mutex )
 void tls_ctx_init( tls_ctx_t* ctx )
 {
     memset( ctx, 0, sizeof( tls_ctx_t ) );
+    mbedtls_ssl_session_init( &ctx->session );
+}
+
+void tls_ctx_free( tls_ctx_t* ctx )
+{
+    tls_session_clear( ctx );
+}
+
+int tls_session_save( tls_ctx_t* ctx, const mbedtls_ssl_context* ssl )
+{
+	int ret;
+
+	/* Any ticket held by the previous session is freed first */
+	tls_session_clear( ctx );
+
+	if( ( ret = mbedtls_ssl_get_session( ssl, &ctx->session ) ) == 0 )
+	{
+		ctx->session_valid = 1;
+	}
+	else
+	{
+		mbedtls_ssl_session_free( &ctx->session );
+	}
+
+	return ret;
+}
+
+int tls_session_resume( tls_ctx_t* ctx, mbedtls_ssl_context* ssl )
+{
+	int ret = 0;
+
+	if( ctx->session_valid )
+	{
+		if( ( ret = mbedtls_ssl_set_session( ssl, &ctx->session ) ) != 0 )
+		{
+			/* Fall back to a full handshake from now on */
+			tls_session_clear( ctx );
+		}
+	}
+
+	return ret;
+}
+
+void tls_session_clear( tls_ctx_t* ctx )
+{
+	mbedtls_ssl_session_free( &ctx->session );
+	ctx->session_valid = 0;
 }
 
 void tls_platform_init( void )
@@ -156,6 +206,12 @@ void tls_platform_init( void )
     mbedtls_ctr_drbg_init( &drbg_ctx );
     mbedtls_entropy_init( &entrp_ctx );
 
+    if( credential_cache_lock == NULL )
+    {
+        credential_cache_lock = xSemaphoreCreateMutex();
+        configASSERT( credential_cache_lock != NULL );
+    }
+
     if( ( mbedtls_ctr_drbg_seed( &drbg_ctx,
 								 mbedtls_entropy_func,
 								 &entrp_ctx,
@@ -171,6 +227,7 @@ void tls_platform_init( void )
 
 void tls_platform_free( void )
 {
+	tls_credential_cache_clear();
 	mbedtls_ctr_drbg_free( &drbg_ctx );
 	mbedtls_entropy_free( &entrp_ctx );
 	platform_ready = 0;
@@ -179,82 +236,147 @@ void tls_platform_free( void )
 int tls_send( void* ctx, const unsigned char* buf, size_t len)
 {
 	tls_ctx_t* tls_ctx = ( tls_ctx_t* ) ctx;
-	return FreeRTOS_send( tls_ctx->socket, buf, len, tls_ctx->flags );
+	int ret = FreeRTOS_send( tls_ctx->socket, buf, len, tls_ctx->flags );
+
+	/* The socket timed out, which mbedtls must not treat as an error */
+	if( ret == 0 || ret == -pdFREERTOS_ERRNO_ENOSPC || ret == -pdFREERTOS_ERRNO_EWOULDBLOCK )
+	{
+		ret = MBEDTLS_ERR_SSL_WANT_WRITE;
+	}
+	return ret;
 }
 
 int tls_recv( void* ctx, unsigned char* buf, size_t len)
 {
 	tls_ctx_t* tls_ctx = ( tls_ctx_t* ) ctx;
-	return FreeRTOS_recv( tls_ctx->socket, buf, len, tls_ctx->flags );
+	int ret = FreeRTOS_recv( tls_ctx->socket, buf, len, tls_ctx->flags );
+
+	/*
+	 * FreeRTOS_recv() returns 0 when the socket times out, which
+	 * mbedtls would otherwise take to mean the connection was closed.
+	 */
+	if( ret == 0 || ret == -pdFREERTOS_ERRNO_EWOULDBLOCK )
+	{
+		ret = MBEDTLS_ERR_SSL_WANT_READ;
+	}
+	return ret;
 }
 
 
 extern int rtos_ff_get_file(const char* filename, FIL* outfile, unsigned int* len );
 
-
-int get_cert( mbedtls_x509_crt* cert, const char* filepath )
+/*
+ * Reads a whole file into a newly allocated buffer. The buffer is
+ * terminated with 0x00, as mbedtls requires for PEM data, so it is
+ * one byte longer than *len. The caller must zeroize and free it.
+ */
+static int read_file( const char* filepath, unsigned char** data, size_t* len )
 {
 	int retval = pdFAIL;
 	FIL prvfile;
 	unsigned int prvfile_len = 0;
-	unsigned char * data;
+	unsigned char * buf;
 	unsigned bytes_read;
-	FRESULT result;
 
-	do
+	if( rtos_ff_get_file( filepath, &prvfile, &prvfile_len ) == pdFAIL )
+	{
+		rtos_printf("Get file %s failed\n", filepath);
+		return pdFAIL;
+	}
+
+	buf = pvPortMalloc( sizeof( unsigned char ) * ( prvfile_len + 1) );
+
+	if( buf != NULL )
 	{
-		/* Check that a valid pointer was passed */
-		if( cert == NULL )
+		if( f_read( &prvfile, buf, prvfile_len, &bytes_read ) == FR_OK && bytes_read == prvfile_len )
 		{
-			break;
+			buf[ prvfile_len ] = 0x00;
+			*data = buf;
+			*len = prvfile_len;
+			retval = pdPASS;
 		}
-
-		if( rtos_ff_get_file( filepath, &prvfile, &prvfile_len ) == pdFAIL )
+		else
 		{
-			rtos_printf("Get cert file failed\n");
-			break;
+			rtos_printf("failed to read %s\n", filepath);
+			mbedtls_platform_zeroize( buf, prvfile_len );
+			vPortFree( buf );
 		}
+	}
+	else
+	{
+		rtos_printf("failed to allocate buffer for %s\n", filepath);
+	}
 
-		/* 0x00 must be at the end of data to parsed as a PEM certificate
-		 * by mbedtls, so malloc an extra byte
-		 * See mbedtls_x509_crt_parse_file */
-		data = pvPortMalloc( sizeof( unsigned char ) * ( prvfile_len + 1) );
+	f_close( &prvfile );
 
-		if( data != NULL )
-		{
-			data[ prvfile_len ] = 0x00;
+	return retval;
+}
+
+static int is_der( const unsigned char* data, size_t len )
+{
+	/* DER certificates and keys always begin with a SEQUENCE, PEM with '-' */
+	return len > 0 && data[0] == ( MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE );
+}
+
+static int parse_cert( mbedtls_x509_crt* cert, const unsigned char* data, size_t len )
+{
+	int ret;
+
+	if( is_der( data, len ) )
+	{
+		/* One or more DER certificates, one after the other */
+		unsigned char* p = ( unsigned char* ) data;
+		const unsigned char* end = data + len;
 
-			result = f_read( &prvfile, data, prvfile_len, &bytes_read );
-			rtos_printf("cert %d bytes\n%s\n", prvfile_len, data);
+		while( p < end )
+		{
+			unsigned char* crt = p;
+			size_t crt_len;
 
-			if( bytes_read == prvfile_len )
+			if( ( ret = mbedtls_asn1_get_tag( &p, end, &crt_len, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
 			{
-				int ret;
-				if( ( ret = mbedtls_x509_crt_parse( cert, ( const unsigned char* ) data, prvfile_len + 1 ) ) < 0 )
-				{
-					rtos_printf("failed mbedtls_x509_crt_parse ret:-0x%x\n", ( unsigned int )-ret );
-				}
-				else
-				{
-					retval = pdPASS;
-				}
+				return ret;
 			}
-			else
+			crt_len += p - crt;
+			if( ( ret = mbedtls_x509_crt_parse_der( cert, crt, crt_len ) ) != 0 )
 			{
-				rtos_printf("failed to read cert file\n");
+				return ret;
 			}
-			mbedtls_platform_zeroize( data, prvfile_len );
-			vPortFree( data );
-			f_close( &prvfile );
-			break;
+			p = crt + crt_len;
+		}
+		return 0;
+	}
+
+	/* The terminating 0x00 is included in the length of PEM data */
+	return mbedtls_x509_crt_parse( cert, data, len + 1 );
+}
+
+static int parse_key( mbedtls_pk_context* key, const unsigned char* data, size_t len )
+{
+	return mbedtls_pk_parse_key( key, data, is_der( data, len ) ? len : len + 1, NULL, 0 );
+}
+
+int get_cert( mbedtls_x509_crt* cert, const char* filepath )
+{
+	int retval = pdFAIL;
+	unsigned char * data;
+	size_t len;
+
+	/* Check that a valid pointer was passed */
+	if( cert != NULL && read_file( filepath, &data, &len ) == pdPASS )
+	{
+		int ret;
+		if( ( ret = parse_cert( cert, data, len ) ) < 0 )
+		{
+			rtos_printf("failed mbedtls_x509_crt_parse ret:-0x%x\n", ( unsigned int )-ret );
 		}
 		else
 		{
-			rtos_printf("failed to allocate buffer for cert\n");
+			retval = pdPASS;
 		}
-
-		f_close( &prvfile );
-	} while(0);
+		mbedtls_platform_zeroize( data, len );
+		vPortFree( data );
+	}
 
 	return retval;
 }
@@ -262,71 +384,175 @@ int get_cert( mbedtls_x509_crt* cert, const char* filepath )
 int get_key( mbedtls_pk_context* key, const char* filepath )
 {
 	int retval = pdFAIL;
-	FIL prvfile;
-	unsigned int prvfile_len = 0;
 	unsigned char * data;
-	unsigned bytes_read;
-	FRESULT result;
+	size_t len;
 
-	do
+	/* Check that a valid pointer was passed */
+	if( key != NULL && read_file( filepath, &data, &len ) == pdPASS )
 	{
-		/* Check that a valid pointer was passed */
-		if( key == NULL )
+		int ret;
+		if( ( ret = parse_key( key, data, len ) ) < 0 )
 		{
-			break;
+			rtos_printf("failed mbedtls_pk_parse_key ret:-0x%x\n", ( unsigned int )-ret );
 		}
+		else
+		{
+			retval = pdPASS;
+		}
+		mbedtls_platform_zeroize( data, len );
+		vPortFree( data );
+	}
+
+	return retval;
+}
+
+/*
+ * The credential cache. Each entry holds a certificate chain or key
+ * parsed from a file, so that they are read and parsed only once no
+ * matter how many times connections are made.
+ */
+typedef struct
+{
+	char* filepath;		/* NULL when the entry is unused */
+	int is_key;
+	union
+	{
+		mbedtls_x509_crt cert;
+		mbedtls_pk_context key;
+	} u;
+} credential_cache_entry_t;
+
+static credential_cache_entry_t credential_cache[ TLS_CREDENTIAL_CACHE_SIZE ];
+
+static void credential_cache_entry_free( credential_cache_entry_t* entry )
+{
+	if( entry->is_key )
+	{
+		mbedtls_pk_free( &entry->u.key );
+	}
+	else
+	{
+		mbedtls_x509_crt_free( &entry->u.cert );
+	}
+	vPortFree( entry->filepath );
+	entry->filepath = NULL;
+}
+
+static void* get_cached( const char* filepath, int is_key )
+{
+	credential_cache_entry_t* entry = NULL;
+	void* retval = NULL;
+
+	configASSERT( credential_cache_lock != NULL ); /* tls_platform_init() has not been called */
+
+	if( filepath == NULL )
+	{
+		return NULL;
+	}
 
-		if( rtos_ff_get_file( filepath, &prvfile, &prvfile_len ) == pdFAIL )
+	xSemaphoreTake( credential_cache_lock, portMAX_DELAY );
+
+	for( int i = 0; i < TLS_CREDENTIAL_CACHE_SIZE; i++ )
+	{
+		if( credential_cache[ i ].filepath == NULL )
+		{
+			if( entry == NULL )
+			{
+				entry = &credential_cache[ i ];
+			}
+		}
+		else if( credential_cache[ i ].is_key == is_key && strcmp( credential_cache[ i ].filepath, filepath ) == 0 )
 		{
-			rtos_printf("Get key file failed\n");
+			retval = &credential_cache[ i ].u;
 			break;
 		}
+	}
 
-		/* 0x00 must be at the end of data to parsed as a PEM certificate
-		 * by mbedtls, so malloc an extra byte.
-		 * See mbedtls_x509_crt_parse_file
-		 */
-		data = pvPortMalloc( sizeof( unsigned char ) * ( prvfile_len + 1) );
-
-		if( data != NULL )
+	if( retval == NULL )
+	{
+		if( entry == NULL )
 		{
-			data[ prvfile_len ] = 0x00;
+			rtos_printf("credential cache full, increase TLS_CREDENTIAL_CACHE_SIZE\n");
+		}
+		else if( ( entry->filepath = pvPortMalloc( strlen( filepath ) + 1 ) ) != NULL )
+		{
+			int ret;
 
-			result = f_read( &prvfile, data, prvfile_len, &bytes_read );
-			rtos_printf("key %d bytes\n%s\n", prvfile_len, data);
+			strcpy( entry->filepath, filepath );
+			entry->is_key = is_key;
 
-			if( bytes_read == prvfile_len )
+			if( is_key )
 			{
-				int ret;
-				if( ( ret = mbedtls_pk_parse_key( key, ( const unsigned char* ) data, prvfile_len + 1, NULL, 0 ) ) < 0 )
-				{
-					rtos_printf("failed mbedtls_pk_parse_key ret:-0x%x\n", ( unsigned int )-ret );
-				}
-				else
-				{
-					retval = pdPASS;
-				}
+				mbedtls_pk_init( &entry->u.key );
+				ret = get_key( &entry->u.key, filepath );
 			}
 			else
 			{
-				rtos_printf("failed to read key file\n");
+				mbedtls_x509_crt_init( &entry->u.cert );
+				ret = get_cert( &entry->u.cert, filepath );
+			}
+
+			if( ret == pdPASS )
+			{
+				retval = &entry->u;
+			}
+			else
+			{
+				credential_cache_entry_free( entry );
 			}
-			mbedtls_platform_zeroize( data, prvfile_len );
-			vPortFree( data );
-			f_close( &prvfile );
-			break;
-		}
-		else
-		{
-			rtos_printf("failed to allocate buffer for key\n");
 		}
+	}
 
-		f_close( &prvfile );
-	} while(0);
+	xSemaphoreGive( credential_cache_lock );
 
 	return retval;
 }
 
+mbedtls_x509_crt* get_cached_cert( const char* filepath )
+{
+	return ( mbedtls_x509_crt* ) get_cached( filepath, 0 );
+}
+
+mbedtls_pk_context* get_cached_key( const char* filepath )
+{
+	return ( mbedtls_pk_context* ) get_cached( filepath, 1 );
+}
+
+mbedtls_x509_crt* get_cached_ca_cert( void )
+{
+	return get_cached_cert( ca_chain_filepath );
+}
+
+mbedtls_x509_crt* get_cached_device_cert( void )
+{
+	return get_cached_cert( cert_filepath );
+}
+
+mbedtls_pk_context* get_cached_device_prvkey( void )
+{
+	return get_cached_key( prvkey_filepath );
+}
+
+void tls_credential_cache_clear( void )
+{
+	if( credential_cache_lock == NULL )
+	{
+		return;
+	}
+
+	xSemaphoreTake( credential_cache_lock, portMAX_DELAY );
+
+	for( int i = 0; i < TLS_CREDENTIAL_CACHE_SIZE; i++ )
+	{
+		if( credential_cache[ i ].filepath != NULL )
+		{
+			credential_cache_entry_free( &credential_cache[ i ] );
+		}
+	}
+
+	xSemaphoreGive( credential_cache_lock );
+}
+
 int get_ca_cert( mbedtls_x509_crt* ca_cert )
 {
 	int retval = pdFAIL;
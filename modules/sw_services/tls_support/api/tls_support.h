@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef TLS_SUPPORT_H_
@@ -8,6 +8,14 @@
 #define DEVICE_CERT_FILEPATH_DEFAULT		"/flash/crypto/cert.pem"
 #define DEVICE_PRV_KEY_FILEPATH_DEFAULT		"/flash/crypto/key.pem"
 
+/**
+ * The number of certificate chains and keys that may be held
+ * in the credential cache at once.
+ */
+#ifndef TLS_CREDENTIAL_CACHE_SIZE
+#define TLS_CREDENTIAL_CACHE_SIZE	4
+#endif
+
 /**
  *  Perform TLS platform required setup
  */
@@ -34,7 +42,8 @@ int tls_platform_ready( void );
  * \param[in]     buf            Pointer to the buffer to send
  * \param[in]     len    		 Number of bytes buffer to send
  *
- * \returns       return value of configured network send function
+ * \returns       return value of configured network send function, or
+ * 				 MBEDTLS_ERR_SSL_WANT_WRITE if it timed out
  */
 int tls_send( void* ctx, const unsigned char* buf, size_t len);
 
@@ -46,7 +55,8 @@ int tls_send( void* ctx, const unsigned char* buf, size_t len);
  * \param[in/out] buf            Pointer to the buffer to receive into
  * \param[in]     len    		 Maximum number of bytes to read
  *
- * \returns       return value of configured network receive function
+ * \returns       return value of configured network receive function, or
+ * 				 MBEDTLS_ERR_SSL_WANT_READ if it timed out
  */
 int tls_recv( void* ctx, unsigned char* buf, size_t len);
 
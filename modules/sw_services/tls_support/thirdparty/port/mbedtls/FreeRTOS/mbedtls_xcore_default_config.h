@@ -1,4 +1,4 @@
-// Copyright 2021 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 /* This file provides a default configuration for the mbed TLS library for xcore */
@@ -66,6 +66,10 @@
 #define MBEDTLS_SSL_ALPN
 #define MBEDTLS_SSL_SERVER_NAME_INDICATION
 
+/* Enable session tickets, so that clients may resume sessions
+ * with servers that do not keep a session cache. */
+#define MBEDTLS_SSL_SESSION_TICKETS
+
 /* Enable TLS v1.2 only. */
 #define MBEDTLS_SSL_PROTO_TLS1_2
 
@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT TUSB_DCD
@@ -186,7 +186,7 @@ static void dcd_xcore_int_handler(rtos_usb_t *ctx,
                     dest_ctrl_buffer = NULL;
                 }
             } else {
-                rtos_printf("xfer %d bytes on %02x complete\n", xfer_len, ep_address);
+                rtos_printf_debug("xfer %d bytes on %02x complete\n", xfer_len, ep_address);
             }
         } else {
             rtos_printf("xfer on %02x failed with status %d\n", ep_address, res);
@@ -479,10 +479,10 @@ bool dcd_edpt_xfer(uint8_t rhport,
         * lib_xud crashes if a NULL buffer is provided when
         * transferring a zero length buffer.
         */
-        rtos_printf("xfer ZLP on %02x\n", ep_addr);
+        rtos_printf_debug("xfer ZLP on %02x\n", ep_addr);
         buffer = (uint8_t *) &dummy_zlp_word;
     } else {
-        rtos_printf("xfer %d bytes on %02x\n", total_bytes, ep_addr);
+        rtos_printf_debug("xfer %d bytes on %02x\n", total_bytes, ep_addr);
     }
 
     dest_ctrl_buffer_len = total_bytes;
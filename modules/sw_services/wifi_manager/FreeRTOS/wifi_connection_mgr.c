@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #define DEBUG_UNIT WIFI_CONN_MGR
@@ -48,6 +48,8 @@
 
 static TaskHandle_t wifi_conn_mgr_task_handle;
 
+static wifi_conn_mgr_stats_t wifi_conn_mgr_stats;
+
 typedef struct {
     /*
      * 0 if this entry is inactive.
@@ -81,6 +83,10 @@ typedef struct {
     int ap_cache_count;
     sl_wfx_ssid_def_t ssid_scan_search_list[MAX_SCAN_COUNT];
     WIFINetworkProfile_t saved_profiles[MAX_SCAN_COUNT];
+    int8_t saved_channels[MAX_SCAN_COUNT]; /* The channel each profile last connected on, or 0 */
+    int known_channel_count;
+    uint8_t known_channels[MAX_SCAN_COUNT]; /* The channels of saved_channels, without repeats */
+    WIFIScanResult_t scan_results[MAX_SCAN_COUNT];
     ap_info_t cached_aps[CACHED_AP_COUNT];
     ap_info_t *sorted_aps[CACHED_AP_COUNT];
 } scan_list_t;
@@ -121,17 +127,44 @@ static void build_scan_search_list(scan_list_t *scan_list)
 {
     sl_wfx_ssid_def_t *list = scan_list->ssid_scan_search_list;
     WIFINetworkProfile_t *profile = scan_list->saved_profiles;
+    int8_t *channel = scan_list->saved_channels;
 
     int profile_count = 0;
 
-    while (WIFI_NetworkGet(profile, profile_count) == eWiFiSuccess) {
+    for (;;) {
+        /*
+         * When the profiles are kept in the profile store, they are loaded
+         * most recently connected first, along with the AP they connected to.
+         */
+        WIFIReturnCode_t ret = WIFI_NetworkGetRecent(profile, channel, profile_count);
+        if (ret == eWiFiNotSupported) {
+            *channel = 0;
+            ret = WIFI_NetworkGet(profile, profile_count);
+        }
+        if (ret != eWiFiSuccess) {
+            break;
+        }
+
         /* This is a correct usage of strncpy(). list->ssid does not need to be null terminiated. */
         strncpy((char *) list->ssid, profile->cSSID, SL_WFX_SSID_SIZE);
         list->ssid_length = strnlen((char *) list->ssid, SL_WFX_SSID_SIZE);
 
+        if (*channel > 0) {
+            int i;
+            for (i = 0; i < scan_list->known_channel_count; i++) {
+                if (scan_list->known_channels[i] == *channel) {
+                    break;
+                }
+            }
+            if (i == scan_list->known_channel_count) {
+                scan_list->known_channels[scan_list->known_channel_count++] = *channel;
+            }
+        }
+
         profile_count++;
         list++;
         profile++;
+        channel++;
         if (profile_count == MAX_SCAN_COUNT) {
             break;
         }
@@ -239,13 +272,20 @@ static void add_ap_to_cache(scan_list_t *scan_list, WIFIScanResult_t *scan_resul
     }
 }
 
-static int scan_networks(scan_list_t *scan_list)
+static int scan_networks(scan_list_t *scan_list, int known_channels_only)
 {
     int ret = 0;
     int scan_count;
     int ap_cache_count;
     int i;
-    WIFIScanResult_t scan_results[MAX_SCAN_COUNT];
+    WIFIScanResult_t *scan_results = scan_list->scan_results;
+
+    if (known_channels_only) {
+        WIFI_ScanSetChannels(scan_list->known_channels, scan_list->known_channel_count);
+        wifi_conn_mgr_stats.channel_scans++;
+    } else {
+        wifi_conn_mgr_stats.full_scans++;
+    }
 
     if (WIFI_Scan(scan_results, MAX_SCAN_COUNT) != eWiFiSuccess) {
         rtos_printf("WiFi scan failed\n");
@@ -321,7 +361,27 @@ static int scan_networks(scan_list_t *scan_list)
     return ret;
 }
 
-static int connect_to_network(ap_info_t *ap)
+/*
+ * Scans for the saved networks, retrying a few times if the scan fails.
+ */
+static void scan_for_networks(scan_list_t *scan_list, int known_channels_only)
+{
+    int scan_attempts = 0;
+
+    if (scan_list->profile_count == 0) {
+        return;
+    }
+
+    while (scan_networks(scan_list, known_channels_only) != 0) {
+        scan_attempts++;
+        if (scan_attempts >= MAX_SCAN_ATTEMPTS) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+}
+
+static int connect_to_network(ap_info_t *ap, int attempts)
 {
     int ret = -1;
     int i;
@@ -353,7 +413,7 @@ static int connect_to_network(ap_info_t *ap)
         network_params.xSecurity = network_profile->xSecurity;
         network_params.cChannel = ap->channel;
 
-        for (i = 0; connected != eWiFiSuccess && i < MAX_CONNECTION_ATTEMPTS; i++) {
+        for (i = 0; connected != eWiFiSuccess && i < attempts; i++) {
             WIFI_ConnectAPSetBSSID(ap->bssid);
             connected = WIFI_ConnectAP(&network_params);
             rtos_printf("WIFI_ConnectAP() returned %x\n", connected);
@@ -389,6 +449,135 @@ static int connect_to_network(ap_info_t *ap)
     return ret;
 }
 
+/*
+ * Records the AP that has just been connected to, so that it is the one
+ * that reconnect_to_last_ap() tries when the connection is next lost.
+ */
+static void last_ap_set(WIFIScanResult_t *last_ap, const ap_info_t *ap)
+{
+    memset(last_ap, 0, sizeof(*last_ap));
+    strncpy(last_ap->cSSID, ap->associated_profile->cSSID, wificonfigMAX_SSID_LEN);
+    memcpy(last_ap->ucBSSID, ap->bssid, SL_WFX_BSSID_SIZE);
+    last_ap->cChannel = ap->channel;
+}
+
+/*
+ * Sets the last AP to the one that the most recently connected profile
+ * last joined, as saved before a reset. This is left unset if the saved
+ * profiles do not record it.
+ */
+static void last_ap_load(WIFIScanResult_t *last_ap, const scan_list_t *scan_list)
+{
+    memset(last_ap, 0, sizeof(*last_ap));
+    if (scan_list->profile_count > 0 && scan_list->saved_channels[0] != 0) {
+        strncpy(last_ap->cSSID, scan_list->saved_profiles[0].cSSID, wificonfigMAX_SSID_LEN);
+        memcpy(last_ap->ucBSSID, scan_list->saved_profiles[0].ucBSSID, SL_WFX_BSSID_SIZE);
+        last_ap->cChannel = scan_list->saved_channels[0];
+    }
+}
+
+/*
+ * Attempts to connect directly to the AP of the last successful
+ * connection, on the channel it was on then, without first scanning.
+ * After a reset, or when the connection is briefly lost, this is the AP
+ * most likely to still be in range.
+ *
+ * Returns the AP that was connected to, or NULL.
+ */
+static ap_info_t *reconnect_to_last_ap(scan_list_t *scan_list, const WIFIScanResult_t *last_connected)
+{
+    WIFIScanResult_t last_ap;
+    ap_info_t *ap;
+    int i;
+
+    if (last_connected->cChannel == 0) {
+        return NULL;
+    }
+
+    /* Its profile may have been removed since */
+    for (i = 0; i < scan_list->profile_count; i++) {
+        if (strncmp(last_connected->cSSID, scan_list->saved_profiles[i].cSSID, wificonfigMAX_SSID_LEN) == 0) {
+            break;
+        }
+    }
+    if (i == scan_list->profile_count) {
+        return NULL;
+    }
+
+    last_ap = *last_connected;
+
+    /* Its signal strength is not known until it is scanned */
+    last_ap.cRSSI = POOR_CONNECTION_RSSI_THRESHOLD;
+
+    i = find_ap_in_cache(scan_list, &last_ap);
+    if (i == -1) {
+        if (scan_list->ap_cache_count == CACHED_AP_COUNT) {
+            return NULL;
+        }
+        /* The first AP in the sorted cache that is not active is the one added */
+        add_ap_to_cache(scan_list, &last_ap);
+        i = scan_list->ap_cache_count++;
+    }
+    ap = scan_list->sorted_aps[i];
+
+    rtos_printf("Reconnecting to %s at " HWADDR_FMT " on channel %d\n", last_ap.cSSID, HWADDR_ARG(ap->bssid), (int) ap->channel);
+    if (connect_to_network(ap, 1) == 0) {
+        return ap;
+    }
+
+    /* Unless the next scan finds it, it is removed from the cache */
+    ap->age = AP_CACHE_ENTRY_MAX_AGE;
+
+    return NULL;
+}
+
+/*
+ * Attempts to connect to the APs that were found by the last scan, the
+ * strongest first.
+ *
+ * Returns the AP that was connected to, or NULL.
+ */
+static ap_info_t *connect_to_found_ap(scan_list_t *scan_list)
+{
+    int i;
+
+    for (i = 0; i < scan_list->ap_cache_count; i++) {
+        ap_info_t *ap = scan_list->sorted_aps[i];
+        if (ap->age == 1 && connect_to_network(ap, MAX_CONNECTION_ATTEMPTS) != -1) {
+            return ap;
+        }
+    }
+
+    return NULL;
+}
+
+static void connected_stats_update(int method, TickType_t lost_ticks)
+{
+    const uint32_t time_ms = (xTaskGetTickCount() - lost_ticks) * portTICK_PERIOD_MS;
+
+    wifi_conn_mgr_stats.connections++;
+    if (method == WIFI_CONN_MGR_CONNECT_DIRECT) {
+        wifi_conn_mgr_stats.direct_connections++;
+    } else if (method == WIFI_CONN_MGR_CONNECT_CHANNEL_SCAN) {
+        wifi_conn_mgr_stats.channel_scan_connections++;
+    } else {
+        wifi_conn_mgr_stats.full_scan_connections++;
+    }
+    wifi_conn_mgr_stats.last_connect_method = method;
+    wifi_conn_mgr_stats.last_connect_time_ms = time_ms;
+    wifi_conn_mgr_stats.total_connect_time_ms += time_ms;
+    if (time_ms > wifi_conn_mgr_stats.max_connect_time_ms) {
+        wifi_conn_mgr_stats.max_connect_time_ms = time_ms;
+    }
+
+    rtos_printf("Connected %u ms after the connection was lost\n", (unsigned) time_ms);
+}
+
+void wifi_conn_mgr_stats_get(wifi_conn_mgr_stats_t *stats)
+{
+    *stats = wifi_conn_mgr_stats;
+}
+
 static void reset_scan_search_list_and_ap_cache(scan_list_t *scan_list)
 {
     int i;
@@ -484,10 +673,15 @@ static inline int event_callback(int state, char *ssid_out, char *ssid_in, char
 
 static void wifi_conn_mgr(void *arg)
 {
-    scan_list_t scan_list;
+    /* Static rather than on the stack, as it is large */
+    static scan_list_t scan_list;
+    WIFIScanResult_t last_ap;
     ap_info_t *connected_ap = NULL;
     int i;
     int failed_connection_attempts = 0;
+    int reconnect_to_last = 1;
+    int connect_method = WIFI_CONN_MGR_CONNECT_FULL_SCAN;
+    TickType_t lost_ticks = xTaskGetTickCount();
     int mode = WIFI_CONN_MGR_MODE_STATION;
     WIFINetworkParams_t soft_ap_params;
 
@@ -505,6 +699,7 @@ static void wifi_conn_mgr(void *arg)
     }
 
     reset_scan_search_list_and_ap_cache(&scan_list);
+    last_ap_load(&last_ap, &scan_list);
 
     /*
      * Wait for FreeRTOS IP task to initialize before attempting to
@@ -527,17 +722,29 @@ static void wifi_conn_mgr(void *arg)
             int perform_connection = connected_ap == NULL;
             int poor_signal = !perform_connection && connected_ap->stable && connected_ap->rssi < POOR_CONNECTION_RSSI_THRESHOLD;
 
-            if (perform_connection || poor_signal) {
-                if (scan_list.profile_count > 0) {
-                    int scan_attempts = 0;
-                    while (scan_networks(&scan_list) != 0) {
-                        scan_attempts++;
-                        if (scan_attempts >= MAX_SCAN_ATTEMPTS) {
-                            break;
-                        }
-                        vTaskDelay(pdMS_TO_TICKS(1000));
-                    }
-                }
+            /*
+             * Once each time the connection is lost, try the AP that was
+             * last connected to before scanning for the others.
+             */
+            if (perform_connection && reconnect_to_last) {
+                reconnect_to_last = 0;
+                connect_method = WIFI_CONN_MGR_CONNECT_DIRECT;
+                connected_ap = reconnect_to_last_ap(&scan_list, &last_ap);
+            }
+
+            /*
+             * Then scan just the channels that the saved networks have been
+             * found on before, which is much quicker than scanning them all.
+             */
+            if (perform_connection && connected_ap == NULL && scan_list.known_channel_count > 0) {
+                connect_method = WIFI_CONN_MGR_CONNECT_CHANNEL_SCAN;
+                scan_for_networks(&scan_list, 1);
+                connected_ap = connect_to_found_ap(&scan_list);
+            }
+
+            if ((perform_connection && connected_ap == NULL) || poor_signal) {
+                connect_method = WIFI_CONN_MGR_CONNECT_FULL_SCAN;
+                scan_for_networks(&scan_list, 0);
             }
 
             if (poor_signal) {
@@ -548,6 +755,7 @@ static void wifi_conn_mgr(void *arg)
                         perform_connection = 1;
                         initiate_disconnect = 1;
                         connected_ap = NULL;
+                        lost_ticks = xTaskGetTickCount();
                         break;
                     } else {
                         if (ap->rssi <= connected_ap->rssi) {
@@ -558,10 +766,10 @@ static void wifi_conn_mgr(void *arg)
             }
 
             if (perform_connection) {
-                for (i = 0; i < scan_list.ap_cache_count; i++) {
+                for (i = 0; connected_ap == NULL && i < scan_list.ap_cache_count; i++) {
                     ap = scan_list.sorted_aps[i];
                     rtos_printf("ATTEMPTING NEW CONNECTION\n");
-                    if (connect_to_network(ap) != -1) {
+                    if (connect_to_network(ap, MAX_CONNECTION_ATTEMPTS) != -1) {
                         connected_ap = ap;
                         break;
                     }
@@ -575,6 +783,12 @@ static void wifi_conn_mgr(void *arg)
                     }
                 } else {
                     failed_connection_attempts = 0;
+                    connected_stats_update(connect_method, lost_ticks);
+                    last_ap_set(&last_ap, connected_ap);
+                    WIFI_NetworkConnected(connected_ap->associated_profile->cSSID,
+                                          connected_ap->associated_profile->ucSSIDLength,
+                                          connected_ap->bssid,
+                                          connected_ap->channel);
                     event_callback(WIFI_CONN_MGR_EVENT_CONNECTED, connected_ap->associated_profile->cSSID, NULL, NULL);
                 }
             } else {
@@ -644,6 +858,8 @@ static void wifi_conn_mgr(void *arg)
                     vTaskDelay(pdMS_TO_TICKS(100));
                 }
                 connected_ap = NULL;
+                reconnect_to_last = 1;
+                lost_ticks = xTaskGetTickCount();
             } else {
                 if (bits & NOTIFY_WIFI_PROFILES_UPDATED_BM) {
                     reset_scan_search_list_and_ap_cache(&scan_list);
@@ -674,6 +890,8 @@ static void wifi_conn_mgr(void *arg)
                              * that a reconnection is attempted.
                              */
                             connected_ap = NULL;
+                            reconnect_to_last = 1;
+                            lost_ticks = xTaskGetTickCount();
                         }
                     } else if (mode == WIFI_CONN_MGR_MODE_SOFT_AP) {
                         if (!WIFI_IsConnected()) {
@@ -688,6 +906,8 @@ static void wifi_conn_mgr(void *arg)
                                  * that a reconnection is attempted.
                                  */
                                 connected_ap = NULL;
+                                reconnect_to_last = 1;
+                                lost_ticks = xTaskGetTickCount();
                             }
                         } else {
                             rtos_printf("Unexpected superfluous WiFi disconnect event, ignoring\n");
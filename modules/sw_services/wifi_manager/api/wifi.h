@@ -1,9 +1,11 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef WIFI_H_
 #define WIFI_H_
 
+#include <stdint.h>
+
 #define WIFI_CONN_MGR_MODE_STATION 0
 #define WIFI_CONN_MGR_MODE_SOFT_AP 1
 
@@ -14,6 +16,30 @@
 #define WIFI_CONN_MGR_EVENT_SOFT_AP_STARTED 4
 #define WIFI_CONN_MGR_EVENT_SOFT_AP_STOPPED 5
 
+/* How a connection was made, see wifi_conn_mgr_stats_t */
+#define WIFI_CONN_MGR_CONNECT_DIRECT       0
+#define WIFI_CONN_MGR_CONNECT_CHANNEL_SCAN 1
+#define WIFI_CONN_MGR_CONNECT_FULL_SCAN    2
+
+/**
+ * Connection statistics, kept by the WiFi connection manager task. Connection
+ * times are measured from when the connection was lost, or from when the task
+ * started, until the next connection is made. They include any time spent in
+ * soft AP mode in between.
+ */
+typedef struct {
+    uint32_t connections;              /**< Connections made to an AP */
+    uint32_t direct_connections;       /**< Made to the last AP on its last channel, without scanning */
+    uint32_t channel_scan_connections; /**< Made after scanning only the channels of known APs */
+    uint32_t full_scan_connections;    /**< Made after scanning all channels */
+    uint32_t channel_scans;            /**< Scans of only the channels of known APs */
+    uint32_t full_scans;               /**< Scans of all channels */
+    uint32_t last_connect_method;      /**< How the last connection was made, WIFI_CONN_MGR_CONNECT_* */
+    uint32_t last_connect_time_ms;     /**< How long the last connection took to make */
+    uint32_t max_connect_time_ms;      /**< The longest any connection took to make */
+    uint32_t total_connect_time_ms;    /**< The sum of the times of all connections */
+} wifi_conn_mgr_stats_t;
+
 /**
  * The application may provide this function. It is called once by the WiFi
  * connection manager task during various events. The application may use this
@@ -130,6 +156,12 @@ int wifi_conn_mgr_stop_soft_ap(int wifi_profiles_updated);
  * WIFI_NetworkAdd() function, and are retrievable with the WIFI_NetworkGet()
  * function.
  *
+ * When the profiles are kept in flash with WIFI_NetworkStoreInit(), they are tried
+ * in the order they last connected. Each time the connection is lost, the AP that
+ * was last connected to is tried on its last channel without scanning. Failing that,
+ * only the channels that the saved networks have been found on before are scanned,
+ * and all channels are scanned only if none of those APs can be connected to.
+ *
  * It can also start a soft AP if requested by the application.
  *
  * \param manager_priority The priority to use for the WiFi manager task.
@@ -138,4 +170,13 @@ int wifi_conn_mgr_stop_soft_ap(int wifi_profiles_updated);
  */
 void wifi_conn_mgr_start(unsigned manager_priority, unsigned dhcpd_priority);
 
+/**
+ * Gets a copy of the connection statistics. As they are updated by the
+ * connection manager task without any locking, the copy may be made part
+ * way through an update.
+ *
+ * \param stats Pointer to the structure to copy the statistics into.
+ */
+void wifi_conn_mgr_stats_get(wifi_conn_mgr_stats_t *stats);
+
 #endif /* WIFI_H_ */
@@ -0,0 +1,265 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "data_partition.h"
+
+/*
+ * Creates a data partition table with datapartition_mkimage, then reads it
+ * back with the device's reader over an emulated flash. Every entry must
+ * decompress to its input with a matching CRC, and corrupting any entry
+ * must make the read of that entry fail.
+ *
+ * Usage: test_data_partition_host <datapartition_mkimage> <work dir>
+ */
+
+#define ALIGNMENT   256
+#define READ_LEN    1000    /* Not a factor of the chunk size */
+#define PATH_LEN    1024
+
+typedef struct {
+    const char *name;
+    int lz4;
+    uint8_t *data;
+    size_t size;
+} input_t;
+
+static input_t inputs[] = {
+    /* Compressible, over several chunks */
+    { .name = "text.txt", .lz4 = 1, .data = NULL, .size = 0 },
+    /* Incompressible, so stored as raw chunks */
+    { .name = "noise.bin", .lz4 = 1, .data = NULL, .size = 0 },
+    { .name = "plain.bin", .lz4 = 0, .data = NULL, .size = 0 },
+    { .name = "empty.bin", .lz4 = 1, .data = NULL, .size = 0 },
+};
+
+#define INPUT_COUNT (sizeof(inputs) / sizeof(inputs[0]))
+
+static char work_dir[PATH_LEN];
+
+static const char *work_path(const char *name)
+{
+    static char path[PATH_LEN + DATA_PARTITION_NAME_LEN];
+
+    snprintf(path, sizeof(path), "%s/%s", work_dir, name);
+    return path;
+}
+
+static void inputs_create(void)
+{
+    uint32_t seed = 1;
+
+    for (size_t i = 0; i < INPUT_COUNT; i++) {
+        input_t *in = &inputs[i];
+        FILE *f;
+
+        if (strcmp(in->name, "text.txt") == 0) {
+            in->size = 3 * DATA_PARTITION_CHUNK_SIZE + 123;
+        } else if (strcmp(in->name, "empty.bin") == 0) {
+            in->size = 0;
+        } else {
+            in->size = DATA_PARTITION_CHUNK_SIZE + 17;
+        }
+
+        in->data = malloc(in->size + 1);
+        for (size_t j = 0; j < in->size; j++) {
+            if (strcmp(in->name, "text.txt") == 0) {
+                in->data[j] = "The quick brown fox jumps over the lazy dog. "[j % 45] + (j / 1000) % 2;
+            } else {
+                seed = seed * 1103515245 + 12345;
+                in->data[j] = seed >> 16;
+            }
+        }
+
+        f = fopen(work_path(in->name), "wb");
+        if (f == NULL || fwrite(in->data, 1, in->size, f) != in->size) {
+            FAIL("could not write %s", work_path(in->name));
+        }
+        if (f != NULL) {
+            fclose(f);
+        }
+    }
+}
+
+static uint8_t *image_create(const char *tool, size_t *size)
+{
+    char cmd[4 * PATH_LEN];
+    int n;
+    uint8_t *image;
+    long len;
+    FILE *f;
+
+    n = snprintf(cmd, sizeof(cmd), "\"%s\" -a %d -p", tool, ALIGNMENT);
+    for (size_t i = 0; i < INPUT_COUNT; i++) {
+        n += snprintf(&cmd[n], sizeof(cmd) - n, " \"%s%s\"",
+                      work_path(inputs[i].name), inputs[i].lz4 ? ":lz4" : "");
+    }
+    snprintf(&cmd[n], sizeof(cmd) - n, " -o \"%s\"", work_path("image.bin"));
+
+    remove(work_path("image.bin"));
+    if (system(cmd) != 0) {
+        FAIL("%s failed", cmd);
+        return NULL;
+    }
+
+    f = fopen(work_path("image.bin"), "rb");
+    if (f == NULL) {
+        FAIL("could not open %s", work_path("image.bin"));
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    image = malloc(len);
+    if (fread(image, 1, len, f) != (size_t) len) {
+        FAIL("could not read %s", work_path("image.bin"));
+    }
+    fclose(f);
+
+    *size = len;
+    return image;
+}
+
+/*
+ * Reads the whole of an entry. Returns 0 if it matches its input, 1 if it
+ * does not, or -1 if the reader reports that the entry is corrupt.
+ */
+static int entry_read(data_partition_t *dp, const data_partition_entry_t *entry, const input_t *in)
+{
+    static data_partition_reader_t reader;
+    uint8_t buf[READ_LEN];
+    size_t pos = 0;
+    int match = 1;
+    int n;
+
+    if (data_partition_reader_init(&reader, dp, entry) != 0) {
+        return -1;
+    }
+
+    while ((n = data_partition_read(&reader, buf, sizeof(buf))) > 0) {
+        if (pos + n > in->size || memcmp(buf, &in->data[pos], n) != 0) {
+            match = 0;
+        }
+        pos += n;
+    }
+
+    if (n < 0) {
+        return -1;
+    }
+
+    return match && pos == in->size ? 0 : 1;
+}
+
+static void check_entries(data_partition_t *dp)
+{
+    for (size_t i = 0; i < INPUT_COUNT; i++) {
+        const input_t *in = &inputs[i];
+        data_partition_entry_t entry;
+
+        CHECK(data_partition_find(dp, in->name, &entry) == (int) i);
+        CHECK(entry.size == in->size);
+        CHECK(entry.offset % ALIGNMENT == 0);
+        CHECK(entry.crc == data_partition_crc32(0, in->data, in->size));
+        CHECK(entry_read(dp, &entry, in) == 0);
+
+        if (in->lz4) {
+            CHECK(entry.flags & DATA_PARTITION_ENTRY_LZ4);
+            CHECK(data_partition_entry_address(dp, &entry) == 0);
+        } else {
+            CHECK(entry.stored_size == entry.size);
+            CHECK(data_partition_entry_address(dp, &entry) == dp->base + entry.offset);
+        }
+    }
+}
+
+/* Flips a bit in every 7th byte of the stored data of each entry in turn */
+static void check_corruption(uint8_t *image, size_t size)
+{
+    rtos_qspi_flash_t flash = { .image = image, .size = size };
+    data_partition_t dp;
+
+    for (size_t i = 0; i < INPUT_COUNT; i++) {
+        data_partition_entry_t entry;
+        int undetected = 0;
+
+        data_partition_open(&dp, &flash, 0);
+        data_partition_entry_get(&dp, i, &entry);
+
+        for (uint32_t j = 0; j < entry.stored_size; j += 7) {
+            uint8_t *p = &image[entry.offset + j];
+
+            *p ^= 1 << (j % 8);
+            if (entry_read(&dp, &entry, &inputs[i]) != -1) {
+                undetected++;
+            }
+            *p ^= 1 << (j % 8);
+        }
+
+        if (undetected) {
+            FAIL("%s: %d corruptions not detected", inputs[i].name, undetected);
+        }
+    }
+
+    /* The header and table are checked when the partition is opened */
+    for (size_t j = 0; j < sizeof(data_partition_header_t) + INPUT_COUNT * sizeof(data_partition_entry_t); j++) {
+        image[j] ^= 0x10;
+        if (data_partition_open(&dp, &flash, 0) == 0) {
+            FAIL("corruption of byte %zu of the table not detected", j);
+        }
+        image[j] ^= 0x10;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    rtos_qspi_flash_t flash;
+    data_partition_t dp;
+    data_partition_entry_t entry;
+    uint8_t *image;
+    size_t size;
+
+    if (argc != 3) {
+        printf("Usage: %s <datapartition_mkimage> <work dir>\n", argv[0]);
+        return 1;
+    }
+    snprintf(work_dir, sizeof(work_dir), "%s", argv[2]);
+
+    inputs_create();
+    image = image_create(argv[1], &size);
+    if (image == NULL) {
+        return host_test_result();
+    }
+
+    flash.image = image;
+    flash.size = size;
+
+    CHECK(data_partition_open(&dp, &flash, 0) == 0);
+    CHECK(data_partition_entry_count(&dp) == INPUT_COUNT);
+    CHECK(data_partition_entry_get(&dp, INPUT_COUNT, &entry) == -1);
+    CHECK(data_partition_find(&dp, "missing", &entry) == -1);
+
+    check_entries(&dp);
+
+    /* The text is the only input that compresses */
+    data_partition_find(&dp, "text.txt", &entry);
+    CHECK(entry.stored_size < entry.size);
+    data_partition_find(&dp, "noise.bin", &entry);
+    CHECK(entry.stored_size > entry.size);
+
+    check_corruption(image, size);
+
+    /* There is no table in erased flash */
+    CHECK(data_partition_open(&dp, &flash, size) == -1);
+
+    free(image);
+    for (size_t i = 0; i < INPUT_COUNT; i++) {
+        free(inputs[i].data);
+    }
+
+    return host_test_result();
+}
@@ -0,0 +1,29 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_QSPI_FLASH_H_
+#define RTOS_QSPI_FLASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* The flash is emulated by an image in memory, which reads as erased past its end */
+typedef struct {
+    const uint8_t *image;
+    size_t size;
+} rtos_qspi_flash_t;
+
+static inline void rtos_qspi_flash_read(rtos_qspi_flash_t *ctx,
+                                        uint8_t *data,
+                                        unsigned address,
+                                        size_t len)
+{
+    memset(data, 0xFF, len);
+    if (address < ctx->size) {
+        size_t n = ctx->size - address;
+        memcpy(data, &ctx->image[address], n < len ? n : len);
+    }
+}
+
+#endif /* RTOS_QSPI_FLASH_H_ */
@@ -0,0 +1,248 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "device_control_host.h"
+#include "device_control_batch.h"
+
+/*
+ * An emulated device with a few resources, each of which is a small
+ * register file. Writes store the payload at the start of the register
+ * file, reads return it.
+ */
+#define NUM_RESOURCES 4
+#define REGISTER_BYTES 16
+
+typedef struct {
+    uint8_t regs[NUM_RESOURCES][REGISTER_BYTES];
+    uint8_t batch_result[CONTROL_BATCH_MAX_BYTES];
+    size_t batch_result_len;
+    unsigned transactions;
+    unsigned dispatched;
+} emulated_device_t;
+
+DEVICE_CONTROL_BATCH_DISPATCH_ATTR
+static control_ret_t device_dispatch(void *dispatch_ctx,
+                                     control_resid_t resid,
+                                     control_cmd_t cmd,
+                                     uint8_t *payload,
+                                     size_t payload_len)
+{
+    emulated_device_t *dev = dispatch_ctx;
+
+    dev->dispatched++;
+
+    if (resid == CONTROL_SPECIAL_RESID || resid >= NUM_RESOURCES) {
+        return CONTROL_BAD_RESOURCE;
+    }
+    if (payload_len > REGISTER_BYTES) {
+        return CONTROL_DATA_LENGTH_ERROR;
+    }
+
+    if (IS_CONTROL_CMD_READ(cmd)) {
+        memcpy(payload, dev->regs[resid], payload_len);
+    } else {
+        memcpy(dev->regs[resid], payload, payload_len);
+    }
+
+    return CONTROL_SUCCESS;
+}
+
+static control_ret_t device_write(control_resid_t resid, control_cmd_t cmd,
+                                  const uint8_t payload[], size_t payload_len,
+                                  void *app_data)
+{
+    emulated_device_t *dev = app_data;
+    uint8_t buf[CONTROL_BATCH_MAX_BYTES];
+
+    dev->transactions++;
+
+    if (resid == CONTROL_SPECIAL_RESID) {
+        if (cmd != CONTROL_BATCH_EXECUTE) {
+            return CONTROL_BAD_COMMAND;
+        }
+        memcpy(buf, payload, payload_len);
+        return device_control_batch_execute(buf, payload_len,
+                                            dev->batch_result, sizeof(dev->batch_result),
+                                            &dev->batch_result_len,
+                                            device_dispatch, dev);
+    }
+
+    memcpy(buf, payload, payload_len);
+    return device_dispatch(dev, resid, cmd, buf, payload_len);
+}
+
+static control_ret_t device_read(control_resid_t resid, control_cmd_t cmd,
+                                 uint8_t payload[], size_t payload_len,
+                                 void *app_data)
+{
+    emulated_device_t *dev = app_data;
+
+    dev->transactions++;
+
+    if (resid == CONTROL_SPECIAL_RESID) {
+        if (cmd == CONTROL_GET_VERSION && payload_len == sizeof(control_version_t)) {
+            payload[0] = CONTROL_VERSION;
+            return CONTROL_SUCCESS;
+        }
+        if (cmd == CONTROL_GET_BATCH_RESULT && payload_len <= dev->batch_result_len) {
+            memcpy(payload, dev->batch_result, payload_len);
+            return CONTROL_SUCCESS;
+        }
+        return CONTROL_BAD_COMMAND;
+    }
+
+    return device_dispatch(dev, resid, cmd, payload, payload_len);
+}
+
+static void test_mixed_batch(emulated_device_t *dev)
+{
+    control_batch_t batch;
+    control_status_t status[4];
+    uint8_t w1[4] = { 0x12, 0x34, 0x56, 0x78 };
+    uint8_t w2[2] = { 0xAB, 0xCD };
+    uint8_t r1[4] = { 0 };
+    uint8_t r2[2] = { 0 };
+
+    memset(dev, 0, sizeof(*dev));
+
+    control_batch_begin(&batch);
+    CHECK(control_batch_add(&batch, 1, CONTROL_CMD_SET_WRITE(0x10), w1, sizeof(w1)) == CONTROL_SUCCESS);
+    CHECK(control_batch_add(&batch, 2, CONTROL_CMD_SET_WRITE(0x10), w2, sizeof(w2)) == CONTROL_SUCCESS);
+    CHECK(control_batch_add(&batch, 1, CONTROL_CMD_SET_READ(0x10), r1, sizeof(r1)) == CONTROL_SUCCESS);
+    CHECK(control_batch_add(&batch, 2, CONTROL_CMD_SET_READ(0x10), r2, sizeof(r2)) == CONTROL_SUCCESS);
+
+    CHECK(control_batch_commit(&batch, status) == CONTROL_SUCCESS);
+
+    for (int i = 0; i < 4; i++) {
+        CHECK(status[i] == CONTROL_SUCCESS);
+    }
+    CHECK(memcmp(r1, w1, sizeof(w1)) == 0);
+    CHECK(memcmp(r2, w2, sizeof(w2)) == 0);
+
+    /* One write of the batch and one read of its result */
+    CHECK(dev->transactions == 2);
+    CHECK(dev->dispatched == 4);
+}
+
+static void test_failed_command(emulated_device_t *dev)
+{
+    control_batch_t batch;
+    control_status_t status[3];
+    uint8_t w[1] = { 0x55 };
+    uint8_t r_bad[3] = { 0xFF, 0xFF, 0xFF };
+    uint8_t r[1] = { 0 };
+
+    memset(dev, 0, sizeof(*dev));
+
+    control_batch_begin(&batch);
+    CHECK(control_batch_add(&batch, 3, CONTROL_CMD_SET_WRITE(0), w, sizeof(w)) == CONTROL_SUCCESS);
+    CHECK(control_batch_add(&batch, NUM_RESOURCES, CONTROL_CMD_SET_READ(0), r_bad, sizeof(r_bad)) == CONTROL_SUCCESS);
+    CHECK(control_batch_add(&batch, 3, CONTROL_CMD_SET_READ(0), r, sizeof(r)) == CONTROL_SUCCESS);
+
+    CHECK(control_batch_commit(&batch, status) == CONTROL_ERROR);
+
+    /* The failure of one command must not prevent later ones from running */
+    CHECK(status[0] == CONTROL_SUCCESS);
+    CHECK(status[1] == CONTROL_BAD_RESOURCE);
+    CHECK(status[2] == CONTROL_SUCCESS);
+    CHECK(r_bad[0] == 0 && r_bad[1] == 0 && r_bad[2] == 0);
+    CHECK(r[0] == 0x55);
+}
+
+static void test_split_batch(emulated_device_t *dev)
+{
+    control_batch_t batch;
+    control_status_t status[CONTROL_BATCH_MAX_COMMANDS];
+    uint8_t w[CONTROL_BATCH_MAX_COMMANDS][REGISTER_BYTES];
+    uint8_t r[REGISTER_BYTES];
+    const size_t n = CONTROL_BATCH_MAX_COMMANDS - 1;
+
+    memset(dev, 0, sizeof(*dev));
+
+    /* Far more than will fit in a single transaction */
+    control_batch_begin(&batch);
+    for (size_t i = 0; i < n; i++) {
+        memset(w[i], (int)i, REGISTER_BYTES);
+        CHECK(control_batch_add(&batch, 1, CONTROL_CMD_SET_WRITE(0), w[i], REGISTER_BYTES) == CONTROL_SUCCESS);
+    }
+    CHECK(control_batch_add(&batch, 1, CONTROL_CMD_SET_READ(0), r, REGISTER_BYTES) == CONTROL_SUCCESS);
+    CHECK(control_batch_add(&batch, 1, CONTROL_CMD_SET_READ(0), r, REGISTER_BYTES) == CONTROL_ERROR);
+
+    CHECK(control_batch_commit(&batch, status) == CONTROL_SUCCESS);
+
+    /* Commands must be executed in order, so the read sees the last write */
+    CHECK(memcmp(r, w[n - 1], REGISTER_BYTES) == 0);
+    CHECK(dev->dispatched == n + 1);
+    CHECK(dev->transactions > 2);
+    CHECK(dev->transactions < n);
+}
+
+static void test_oversized_command(void)
+{
+    control_batch_t batch;
+    uint8_t big[CONTROL_BATCH_MAX_BYTES];
+
+    control_batch_begin(&batch);
+    CHECK(control_batch_add(&batch, 1, CONTROL_CMD_SET_WRITE(0), big, sizeof(big)) == CONTROL_DATA_LENGTH_ERROR);
+    CHECK(control_batch_add(&batch, 1, CONTROL_CMD_SET_READ(0), big, sizeof(big)) == CONTROL_DATA_LENGTH_ERROR);
+}
+
+static void test_malformed_batch(emulated_device_t *dev)
+{
+    uint8_t result[CONTROL_BATCH_MAX_BYTES];
+    size_t result_len;
+
+    /* Count claims two commands but only one is present */
+    uint8_t truncated[] = { 2, 1, CONTROL_CMD_SET_WRITE(0), 1, 0xAA };
+    /* Write payload length runs past the end of the batch */
+    uint8_t short_payload[] = { 1, 1, CONTROL_CMD_SET_WRITE(0), 4, 0xAA };
+    /* Trailing bytes after the last command */
+    uint8_t trailing[] = { 1, 1, CONTROL_CMD_SET_READ(0), 1, 0xAA };
+    /* Result larger than the result buffer */
+    uint8_t big_read[] = { 1, 1, CONTROL_CMD_SET_READ(0), 200 };
+
+    memset(dev, 0, sizeof(*dev));
+
+    CHECK(device_control_batch_execute(truncated, sizeof(truncated), result, sizeof(result),
+                                       &result_len, device_dispatch, dev) == CONTROL_MALFORMED_PACKET);
+    CHECK(device_control_batch_execute(short_payload, sizeof(short_payload), result, sizeof(result),
+                                       &result_len, device_dispatch, dev) == CONTROL_MALFORMED_PACKET);
+    CHECK(device_control_batch_execute(trailing, sizeof(trailing), result, sizeof(result),
+                                       &result_len, device_dispatch, dev) == CONTROL_MALFORMED_PACKET);
+    CHECK(device_control_batch_execute(big_read, sizeof(big_read), result, 100,
+                                       &result_len, device_dispatch, dev) == CONTROL_DATA_LENGTH_ERROR);
+    CHECK(device_control_batch_execute(truncated, 0, result, sizeof(result),
+                                       &result_len, device_dispatch, dev) == CONTROL_MALFORMED_PACKET);
+
+    /* A rejected batch must not dispatch anything */
+    CHECK(dev->dispatched == 0);
+    CHECK(result_len == 0);
+}
+
+int main(void)
+{
+    static emulated_device_t dev;
+    control_version_t version = 0;
+
+    if (control_init_loopback(device_write, device_read, &dev) != CONTROL_SUCCESS) {
+        printf("FAIL: could not initialize loopback transport\n");
+        return 1;
+    }
+
+    CHECK(control_query_version(&version) == CONTROL_SUCCESS);
+    CHECK(version == CONTROL_VERSION);
+
+    test_mixed_batch(&dev);
+    test_failed_command(&dev);
+    test_split_batch(&dev);
+    test_oversized_command();
+    test_malformed_batch(&dev);
+
+    control_cleanup_loopback();
+
+    return host_test_result();
+}
@@ -0,0 +1,284 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "rtos_dfu_writer.h"
+
+/*
+ * Writes an image with the DFU writer to an emulated NOR flash that starts
+ * out holding random data. The power is cut after each of many numbers of
+ * flash operations, and the update is then resumed from its checkpoint and
+ * must complete with the image intact. The writer must never touch flash
+ * outside of its region and checkpoint sector, and must detect an image
+ * that does not read back as it was written.
+ */
+
+/* Emits the external definition of the inline function from the header */
+extern size_t rtos_dfu_writer_size_get(rtos_dfu_writer_t *writer);
+
+#define SECTOR_SIZE         4096
+#define FLASH_SIZE          (2 * 1024 * 1024)
+#define REGION_START        0x100000
+#define REGION_SIZE         0xA0000
+#define CHECKPOINT_ADDRESS  0x1F0000
+#define IMAGE_SIZE          600123
+#define IMAGE_ID            0x12345678
+
+struct rtos_qspi_flash_struct {
+    uint8_t data[FLASH_SIZE];
+    int ops_left;           /* Until the power is cut, or -1 for never */
+    unsigned stuck_address; /* A byte with bit 0 stuck at 0, or 0 for none */
+};
+
+static rtos_qspi_flash_t flash;
+static uint8_t flash_initial[FLASH_SIZE];
+static uint8_t image[IMAGE_SIZE];
+static rtos_dfu_writer_t writer;
+static uint32_t seed = 1;
+
+static uint32_t random_next(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        }
+    }
+
+    return ~crc;
+}
+
+/* Returns 1 if the operation may go ahead, and how much of it if the power is cut during it */
+static int power_check(size_t *len, size_t partial_len)
+{
+    if (flash.ops_left == 0) {
+        return 0;
+    }
+    if (flash.ops_left > 0 && --flash.ops_left == 0) {
+        *len = partial_len;
+    }
+    return 1;
+}
+
+void rtos_qspi_flash_read(rtos_qspi_flash_t *ctx, uint8_t *data, unsigned address, size_t len)
+{
+    CHECK(address + len <= FLASH_SIZE);
+    memcpy(data, &ctx->data[address], len);
+}
+
+void rtos_qspi_flash_write(rtos_qspi_flash_t *ctx, const uint8_t *data, unsigned address, size_t len)
+{
+    CHECK(address + len <= FLASH_SIZE);
+    if (!power_check(&len, len / 2)) {
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        ctx->data[address + i] &= data[i];
+    }
+}
+
+void rtos_qspi_flash_erase(rtos_qspi_flash_t *ctx, unsigned address, size_t len)
+{
+    CHECK(address % SECTOR_SIZE == 0 && len % SECTOR_SIZE == 0);
+    CHECK(address + len <= FLASH_SIZE);
+    if (!power_check(&len, SECTOR_SIZE)) {
+        return;
+    }
+    memset(&ctx->data[address], 0xFF, len);
+    if (ctx->stuck_address >= address && ctx->stuck_address < address + len) {
+        ctx->data[ctx->stuck_address] &= ~1;
+    }
+}
+
+static void flash_reset(void)
+{
+    memcpy(flash.data, flash_initial, FLASH_SIZE);
+    flash.ops_left = -1;
+    flash.stuck_address = 0;
+}
+
+/* Checks that nothing outside of the region and checkpoint sector has changed */
+static void check_untouched(const char *step)
+{
+    for (unsigned i = 0; i < FLASH_SIZE; i++) {
+        if (i == REGION_START) {
+            i += REGION_SIZE - 1;
+        } else if (i == CHECKPOINT_ADDRESS) {
+            i += SECTOR_SIZE - 1;
+        } else if (flash.data[i] != flash_initial[i]) {
+            FAIL("%s: flash at 0x%x changed outside of the region", step, i);
+            return;
+        }
+    }
+}
+
+/* Gives the writer the image from offset in chunks of random sizes */
+static int image_send(size_t offset)
+{
+    while (offset < IMAGE_SIZE) {
+        size_t len = 1 + random_next() % 3000;
+
+        if (len > IMAGE_SIZE - offset) {
+            len = IMAGE_SIZE - offset;
+        }
+        if (rtos_dfu_writer_write(&writer, &image[offset], len) != 0) {
+            return -1;
+        }
+        offset += len;
+        if (rtos_dfu_writer_size_get(&writer) != offset) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Completes an update, resuming it if possible, and checks the image in flash */
+static size_t update_complete(const char *step, int resume)
+{
+    size_t offset;
+    uint32_t crc;
+
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, REGION_SIZE, CHECKPOINT_ADDRESS) == 0);
+    offset = rtos_dfu_writer_begin(&writer, IMAGE_ID, resume);
+    CHECK(offset % SECTOR_SIZE == 0 && offset <= IMAGE_SIZE);
+
+    CHECK(image_send(offset) == 0);
+    if (rtos_dfu_writer_finish(&writer, &crc) != 0) {
+        FAIL("%s: verification failed after resuming at %zu", step, offset);
+    }
+    CHECK(crc == crc32(image, IMAGE_SIZE));
+    if (memcmp(&flash.data[REGION_START], image, IMAGE_SIZE) != 0) {
+        FAIL("%s: image in flash does not match after resuming at %zu", step, offset);
+    }
+    check_untouched(step);
+
+    return offset;
+}
+
+static int total_ops(void)
+{
+    flash_reset();
+    flash.ops_left = 1 << 30;
+    update_complete("uninterrupted", 0);
+    return (1 << 30) - flash.ops_left;
+}
+
+static void check_power_cuts(int ops)
+{
+    int resumed = 0;
+    int runs = 0;
+
+    for (int cut = 1; cut < ops; cut++) {
+        char step[32];
+
+        flash_reset();
+        flash.ops_left = cut;
+
+        CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, REGION_SIZE, CHECKPOINT_ADDRESS) == 0);
+        CHECK(rtos_dfu_writer_begin(&writer, IMAGE_ID, 1) == 0);
+        image_send(0);
+
+        /* The device restarts, with the flash as it was when the power was cut */
+        flash.ops_left = -1;
+        snprintf(step, sizeof(step), "power cut at op %d", cut);
+        if (update_complete(step, 1) > 0) {
+            resumed++;
+        }
+        runs++;
+    }
+
+    /* Most cuts happen after at least one checkpoint */
+    if (resumed < runs / 2) {
+        FAIL("only %d of %d interrupted updates were resumed", resumed, runs);
+    }
+}
+
+static void check_resume_other_image(void)
+{
+    flash_reset();
+    flash.ops_left = 100;
+
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, REGION_SIZE, CHECKPOINT_ADDRESS) == 0);
+    rtos_dfu_writer_begin(&writer, IMAGE_ID, 1);
+    image_send(0);
+
+    flash.ops_left = -1;
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, REGION_SIZE, CHECKPOINT_ADDRESS) == 0);
+    CHECK(rtos_dfu_writer_begin(&writer, IMAGE_ID + 1, 1) == 0);
+
+    /* Starting again discards the checkpoint of the other image */
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, REGION_SIZE, CHECKPOINT_ADDRESS) == 0);
+    CHECK(rtos_dfu_writer_begin(&writer, IMAGE_ID, 1) == 0);
+}
+
+static void check_verify_failure(void)
+{
+    uint32_t crc;
+
+    flash_reset();
+    flash.stuck_address = REGION_START + 5000;
+
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, REGION_SIZE, CHECKPOINT_ADDRESS) == 0);
+    CHECK(rtos_dfu_writer_begin(&writer, IMAGE_ID, 0) == 0);
+    CHECK(image_send(0) == 0);
+    CHECK(rtos_dfu_writer_finish(&writer, &crc) == -1);
+    CHECK(crc == crc32(image, IMAGE_SIZE));
+
+    /* A corrupt image is not resumed */
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, REGION_SIZE, CHECKPOINT_ADDRESS) == 0);
+    CHECK(rtos_dfu_writer_begin(&writer, IMAGE_ID, 1) == 0);
+}
+
+static void check_limits(void)
+{
+    static uint8_t too_much[SECTOR_SIZE];
+
+    flash_reset();
+
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START + 1, REGION_SIZE, CHECKPOINT_ADDRESS) == -1);
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, REGION_SIZE - 1, CHECKPOINT_ADDRESS) == -1);
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, REGION_SIZE, CHECKPOINT_ADDRESS + 32) == -1);
+
+    CHECK(rtos_dfu_writer_init(&writer, &flash, REGION_START, 2 * SECTOR_SIZE, 0) == 0);
+    CHECK(rtos_dfu_writer_begin(&writer, IMAGE_ID, 1) == 0);
+    CHECK(rtos_dfu_writer_write(&writer, too_much, SECTOR_SIZE) == 0);
+    CHECK(rtos_dfu_writer_write(&writer, too_much, SECTOR_SIZE) == 0);
+    CHECK(rtos_dfu_writer_write(&writer, too_much, 1) == -1);
+    CHECK(rtos_dfu_writer_finish(&writer, NULL) == 0);
+    check_untouched("limits");
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+
+    for (size_t i = 0; i < FLASH_SIZE; i++) {
+        flash_initial[i] = random_next();
+    }
+    for (size_t i = 0; i < IMAGE_SIZE; i++) {
+        image[i] = random_next();
+    }
+    /* So that the stuck bit changes the image */
+    image[5000] |= 1;
+
+    check_power_cuts(total_ops());
+    check_resume_other_image();
+    check_verify_failure();
+    check_limits();
+
+    return host_test_result();
+}
@@ -0,0 +1,19 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_PRINTF_H_
+#define RTOS_PRINTF_H_
+
+/*
+ * The messages are not printed, as the test causes many of them, but
+ * their formats are still checked against their arguments.
+ */
+__attribute__((format(printf, 1, 2)))
+static inline void rtos_printf(const char *fmt, ...)
+{
+    (void) fmt;
+}
+
+#define rtos_printf_debug rtos_printf
+
+#endif /* RTOS_PRINTF_H_ */
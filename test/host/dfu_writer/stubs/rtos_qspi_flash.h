@@ -0,0 +1,20 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_QSPI_FLASH_H_
+#define RTOS_QSPI_FLASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * An emulated NOR flash. Erases set whole sectors to 0xFF, and writes can
+ * only clear bits. The flash operations are defined by the test.
+ */
+typedef struct rtos_qspi_flash_struct rtos_qspi_flash_t;
+
+void rtos_qspi_flash_read(rtos_qspi_flash_t *ctx, uint8_t *data, unsigned address, size_t len);
+void rtos_qspi_flash_write(rtos_qspi_flash_t *ctx, const uint8_t *data, unsigned address, size_t len);
+void rtos_qspi_flash_erase(rtos_qspi_flash_t *ctx, unsigned address, size_t len);
+
+#endif /* RTOS_QSPI_FLASH_H_ */
@@ -0,0 +1,396 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "dhcpd_lease_table.h"
+
+/*
+ * Replays DHCP traffic against the dhcpd lease table, using the same
+ * address selection rules as dhcpd (without probing), and checks the
+ * table's indexes against a linear scan of every entry after each step.
+ */
+
+#define OFFER_EXPIRATION_TIME 10
+#define LEASE_TIME            600
+#define UNAVAILABLE_TIME      300
+
+#define OCTETS_TO_IP(O0, O1, O2, O3) \
+    ((((uint32_t)(O3)) << 24) | (((uint32_t)(O2)) << 16) | (((uint32_t)(O1)) << 8) | ((uint32_t)(O0)))
+
+typedef struct {
+    dhcpd_lease_table_t table;
+    void *arena;
+    uint32_t now;
+    /* The order in which each entry last became available */
+    uint32_t *avail_seq;
+    uint32_t next_avail_seq;
+} server_t;
+
+static const char *ip_str(uint32_t ip)
+{
+    static char s[4][16];
+    static int n;
+
+    n = (n + 1) % 4;
+    snprintf(s[n], sizeof(s[n]), "%u.%u.%u.%u", ip & 0xFF, (ip >> 8) & 0xFF, (ip >> 16) & 0xFF, ip >> 24);
+    return s[n];
+}
+
+static void mac_from_id(uint8_t *mac, uint32_t id)
+{
+    mac[0] = 0x02;
+    mac[1] = 0x00;
+    mac[2] = id >> 24;
+    mac[3] = id >> 16;
+    mac[4] = id >> 8;
+    mac[5] = id;
+}
+
+static void server_init(server_t *server, uint32_t first_ip, size_t count)
+{
+    memset(server, 0, sizeof(server_t));
+    server->arena = malloc(dhcpd_lease_table_arena_size(count));
+    server->avail_seq = calloc(count, sizeof(uint32_t));
+    CHECK(dhcpd_lease_table_init(&server->table, server->arena, count) == 0);
+
+    for (size_t i = 0; i < count; i++) {
+        /* Increment the last octet, which is the most significant byte */
+        dhcpd_lease_t *lease = dhcpd_lease_table_add(&server->table, first_ip + ((uint32_t) i << 24));
+        CHECK(lease != NULL);
+        server->avail_seq[i] = server->next_avail_seq++;
+    }
+}
+
+static void server_free(server_t *server)
+{
+    free(server->arena);
+    free(server->avail_seq);
+}
+
+static void lease_update(server_t *server, dhcpd_lease_t *lease, int state, uint32_t duration)
+{
+    dhcpd_lease_update(&server->table, lease, state, server->now + duration);
+    if (state == DHCP_IP_STATE_AVAILABLE) {
+        server->avail_seq[lease - server->table.leases] = server->next_avail_seq++;
+    }
+}
+
+static void server_sweep(server_t *server)
+{
+    dhcpd_lease_t *lease;
+    uint32_t last = 0;
+    int first = 1;
+
+    while ((lease = dhcpd_lease_next_expired(&server->table, server->now)) != NULL) {
+        /* Entries must come out in order of expiration */
+        CHECK(first || (int32_t) (lease->expiration - last) >= 0);
+        CHECK((int32_t) (server->now - lease->expiration) >= 0);
+        first = 0;
+        last = lease->expiration;
+
+        if (lease->state == DHCP_IP_STATE_UNAVAILABLE) {
+            /* Assume the probe finds it is no longer in use */
+            lease_update(server, lease, DHCP_IP_STATE_AVAILABLE, 0);
+        } else {
+            CHECK(lease->state == DHCP_IP_STATE_LEASED || lease->state == DHCP_IP_STATE_OFFERED);
+            lease_update(server, lease, DHCP_IP_STATE_AVAILABLE, 0);
+        }
+    }
+}
+
+static uint32_t server_discover(server_t *server, const uint8_t *mac, uint32_t requested_ip)
+{
+    dhcpd_lease_t *lease = dhcpd_lease_lookup_by_mac(&server->table, mac);
+
+    if (lease == NULL || lease->state == DHCP_IP_STATE_UNAVAILABLE) {
+        lease = NULL;
+        if (requested_ip != 0) {
+            lease = dhcpd_lease_lookup_by_ip(&server->table, requested_ip);
+            if (lease != NULL && lease->state != DHCP_IP_STATE_AVAILABLE) {
+                lease = NULL;
+            }
+        }
+        if (lease == NULL) {
+            lease = dhcpd_lease_oldest_available(&server->table);
+        }
+        if (lease == NULL) {
+            return 0;
+        }
+        dhcpd_lease_mac_set(&server->table, lease, mac);
+    } else if (lease->state == DHCP_IP_STATE_LEASED || lease->state == DHCP_IP_STATE_STATIC) {
+        return lease->ip;
+    }
+
+    lease_update(server, lease, DHCP_IP_STATE_OFFERED, OFFER_EXPIRATION_TIME);
+    return lease->ip;
+}
+
+/* Returns the IP to ACK, or 0xFFFFFFFF to NAK, or 0 to stay silent */
+static uint32_t server_request(server_t *server, const uint8_t *mac, uint32_t requested_ip)
+{
+    dhcpd_lease_t *lease = dhcpd_lease_lookup_by_mac(&server->table, mac);
+
+    if (lease == NULL) {
+        return 0;
+    }
+    if (lease->ip != requested_ip) {
+        lease_update(server, lease, DHCP_IP_STATE_AVAILABLE, 0);
+        return 0xFFFFFFFF;
+    }
+    lease_update(server, lease, DHCP_IP_STATE_LEASED, LEASE_TIME);
+    return lease->ip;
+}
+
+static void server_release(server_t *server, const uint8_t *mac, uint32_t ip, int decline)
+{
+    dhcpd_lease_t *lease = dhcpd_lease_lookup_by_ip(&server->table, ip);
+
+    if (lease == NULL) {
+        return;
+    }
+    if (decline) {
+        dhcpd_lease_mac_set(&server->table, lease, NULL);
+        lease_update(server, lease, DHCP_IP_STATE_UNAVAILABLE, UNAVAILABLE_TIME);
+    } else if (memcmp(lease->mac, mac, DHCPD_LEASE_MAC_LENGTH) == 0) {
+        lease_update(server, lease, DHCP_IP_STATE_AVAILABLE, 0);
+    }
+}
+
+/*
+ * Checks every index against a linear scan of the entries.
+ */
+static void server_check(server_t *server)
+{
+    static const uint8_t zero_mac[DHCPD_LEASE_MAC_LENGTH];
+    dhcpd_lease_table_t *table = &server->table;
+    dhcpd_lease_t *oldest = dhcpd_lease_oldest_available(table);
+    int available = 0;
+    int expiring = 0;
+
+    for (int i = 0; i < table->count; i++) {
+        dhcpd_lease_t *lease = &table->leases[i];
+
+        CHECK(dhcpd_lease_lookup_by_ip(table, lease->ip) == lease);
+
+        if (memcmp(lease->mac, zero_mac, sizeof(zero_mac)) != 0) {
+            dhcpd_lease_t *found = dhcpd_lease_lookup_by_mac(table, lease->mac);
+            /* A MAC is only ever associated with one entry */
+            CHECK(found == lease);
+        }
+
+        switch (lease->state) {
+        case DHCP_IP_STATE_AVAILABLE:
+            available++;
+            CHECK(oldest != NULL);
+            if (oldest != NULL) {
+                CHECK(server->avail_seq[oldest - table->leases] <= server->avail_seq[i]);
+            }
+            break;
+        case DHCP_IP_STATE_LEASED:
+        case DHCP_IP_STATE_OFFERED:
+        case DHCP_IP_STATE_UNAVAILABLE:
+            expiring++;
+            CHECK(lease->heap_index < table->heap_len && table->heap[lease->heap_index] == i);
+            break;
+        }
+    }
+
+    CHECK(available == table->avail_count);
+    CHECK(expiring == table->heap_len);
+    if (available == 0) {
+        CHECK(oldest == NULL);
+    }
+
+    /* The heap property */
+    for (int pos = 1; pos < table->heap_len; pos++) {
+        const dhcpd_lease_t *parent = &table->leases[table->heap[(pos - 1) / 2]];
+        const dhcpd_lease_t *child = &table->leases[table->heap[pos]];
+        CHECK((int32_t) (child->expiration - parent->expiration) >= 0);
+    }
+}
+
+static int parse_ip(const char *s, uint32_t *ip)
+{
+    unsigned o[4];
+
+    if (strcmp(s, "-") == 0) {
+        *ip = 0;
+        return 0;
+    }
+    if (strcmp(s, "NAK") == 0) {
+        *ip = 0xFFFFFFFF;
+        return 0;
+    }
+    if (sscanf(s, "%u.%u.%u.%u", &o[0], &o[1], &o[2], &o[3]) != 4) {
+        return -1;
+    }
+    *ip = OCTETS_TO_IP(o[0], o[1], o[2], o[3]);
+    return 0;
+}
+
+/*
+ * Each line of a trace is:
+ *   <seconds> <DISCOVER|REQUEST|RELEASE|DECLINE|SWEEP> <client id> <ip or -> [expected reply]
+ * The first line is:
+ *   POOL <first ip> <count>
+ */
+static void replay_trace(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    int line_number = 0;
+    int messages = 0;
+    server_t server;
+    int initialized = 0;
+
+    if (f == NULL) {
+        FAIL("cannot open %s", path);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char op[16], ip_s[20], expect_s[20];
+        unsigned t, id;
+        uint32_t ip, expect, reply = 0;
+        uint8_t mac[DHCPD_LEASE_MAC_LENGTH];
+        int n;
+
+        line_number++;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+
+        if (!initialized) {
+            unsigned count;
+            if (sscanf(line, "POOL %19s %u", ip_s, &count) != 2 || parse_ip(ip_s, &ip) != 0) {
+                FAIL("%s:%d: expected POOL", path, line_number);
+                break;
+            }
+            server_init(&server, ip, count);
+            initialized = 1;
+            continue;
+        }
+
+        n = sscanf(line, "%u %15s %u %19s %19s", &t, op, &id, ip_s, expect_s);
+        if (n < 4 || parse_ip(ip_s, &ip) != 0 || (n == 5 && parse_ip(expect_s, &expect) != 0)) {
+            FAIL("%s:%d: malformed line", path, line_number);
+            continue;
+        }
+
+        server.now = t;
+        mac_from_id(mac, id);
+        messages++;
+
+        if (strcmp(op, "DISCOVER") == 0) {
+            reply = server_discover(&server, mac, ip);
+        } else if (strcmp(op, "REQUEST") == 0) {
+            reply = server_request(&server, mac, ip);
+        } else if (strcmp(op, "RELEASE") == 0) {
+            server_release(&server, mac, ip, 0);
+        } else if (strcmp(op, "DECLINE") == 0) {
+            server_release(&server, mac, ip, 1);
+        } else if (strcmp(op, "SWEEP") == 0) {
+            server_sweep(&server);
+        } else {
+            FAIL("%s:%d: unknown message %s", path, line_number, op);
+        }
+
+        if (n == 5 && reply != expect) {
+            FAIL("%s:%d: %s from client %u got %s, expected %s",
+                 path, line_number, op, id,
+                 reply == 0xFFFFFFFF ? "NAK" : ip_str(reply),
+                 expect == 0xFFFFFFFF ? "NAK" : ip_str(expect));
+        }
+
+        server_check(&server);
+    }
+
+    fclose(f);
+    if (initialized) {
+        server_free(&server);
+    }
+    printf("Replayed %d messages from %s\n", messages, path);
+}
+
+/*
+ * Many clients joining, renewing, leaving and vanishing without
+ * releasing their leases, against a pool too small for all of them.
+ */
+static void replay_churn(void)
+{
+    const int pool_size = 250;
+    const int clients = 1000;
+    const int steps = 50000;
+    server_t server;
+    uint32_t *client_ip = calloc(clients, sizeof(uint32_t));
+    unsigned seed = 1;
+    int offers = 0;
+
+    server_init(&server, OCTETS_TO_IP(10, 0, 0, 2), pool_size);
+
+    for (int step = 0; step < steps; step++) {
+        uint8_t mac[DHCPD_LEASE_MAC_LENGTH];
+        int id;
+
+        seed = seed * 1103515245 + 12345;
+        id = (seed >> 8) % clients;
+        mac_from_id(mac, id);
+
+        if (step % 10 == 0) {
+            server.now++;
+        }
+
+        switch ((seed >> 20) % 8) {
+        case 0: case 1: case 2:
+            client_ip[id] = server_discover(&server, mac, client_ip[id]);
+            if (client_ip[id] != 0) {
+                offers++;
+            }
+            break;
+        case 3: case 4: case 5:
+            if (client_ip[id] != 0 && server_request(&server, mac, client_ip[id]) != client_ip[id]) {
+                client_ip[id] = 0;
+            }
+            break;
+        case 6:
+            if (client_ip[id] != 0) {
+                server_release(&server, mac, client_ip[id], 0);
+                client_ip[id] = 0;
+            }
+            break;
+        case 7:
+            if ((seed & 0xF) == 0 && client_ip[id] != 0) {
+                server_release(&server, mac, client_ip[id], 1);
+                client_ip[id] = 0;
+            } else {
+                server_sweep(&server);
+            }
+            break;
+        }
+
+        if (step % 97 == 0) {
+            server_check(&server);
+        }
+    }
+
+    server_check(&server);
+    CHECK(offers > 0);
+
+    server_free(&server);
+    free(client_ip);
+    printf("Replayed %d messages from %d clients to a pool of %d\n", steps, clients, pool_size);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        replay_trace(argv[i]);
+    }
+    replay_churn();
+
+    return host_test_result();
+}
@@ -0,0 +1,186 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "fs_support.h"
+
+/*
+ * Formats a FatFs volume on an emulated flash and writes files to it in
+ * turn, a chunk at a time, so that their clusters are interleaved. The
+ * files are then opened with rtos_ff_direct_open() and read directly from
+ * the flash at many offsets, including across the ends of their extents,
+ * and each read must match the data written.
+ */
+
+#define FS_SIZE         (1024 * 1024)
+#define CLUSTER_SIZE    QSPI_FLASH_SECTOR_SIZE
+#define RANDOM_READS    2000
+
+static rtos_qspi_flash_t flash;
+static uint8_t buf[8 * CLUSTER_SIZE];
+static uint32_t seed = 1;
+
+DWORD get_fattime(void)
+{
+    return 0;
+}
+
+static uint32_t random_next(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+/* The content of each file, which differs between its clusters and between files */
+static uint8_t content(int file, unsigned offset)
+{
+    return ((offset * 2654435761u) >> 13) ^ (file * 31);
+}
+
+/* Writes the files in turn, a chunk at a time */
+static void files_write(const char *names[], int count, size_t chunk, int chunks)
+{
+    FIL files[4];
+    UINT n;
+
+    for (int i = 0; i < count; i++) {
+        CHECK(f_open(&files[i], names[i], FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+    }
+
+    for (int c = 0; c < chunks; c++) {
+        for (int i = 0; i < count; i++) {
+            for (size_t j = 0; j < chunk; j++) {
+                buf[j] = content(names[i][0], c * chunk + j);
+            }
+            CHECK(f_write(&files[i], buf, chunk, &n) == FR_OK && n == chunk);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        CHECK(f_close(&files[i]) == FR_OK);
+    }
+}
+
+/* Reads from a file, and checks the length read and the data against its content */
+static void check_read(const char *name, const rtos_ff_direct_file_t *file, unsigned offset, size_t len)
+{
+    size_t expected = 0;
+    size_t n;
+
+    if (offset < file->size) {
+        expected = file->size - offset < len ? file->size - offset : len;
+    }
+
+    n = rtos_ff_direct_read(file, buf, offset, len);
+    if (n != expected) {
+        FAIL("%s: read of %zu at %u returned %zu, expected %zu", name, len, offset, n, expected);
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (buf[i] != content(name[0], offset + i)) {
+            FAIL("%s: read of %zu at %u differs at %u", name, len, offset, (unsigned) (offset + i));
+            return;
+        }
+    }
+}
+
+static void check_file(const char *name, unsigned size, int extent_count)
+{
+    rtos_ff_direct_file_t file;
+    unsigned extent_offset = 0;
+
+    if (rtos_ff_direct_open(name, &file) != 1) {
+        FAIL("%s: could not be opened", name);
+        return;
+    }
+    CHECK(rtos_ff_direct_size(&file) == size);
+    CHECK(file.extent_count == extent_count);
+
+    check_read(name, &file, 0, size);
+    check_read(name, &file, 0, 1);
+    check_read(name, &file, 1, CLUSTER_SIZE);
+    check_read(name, &file, CLUSTER_SIZE - 1, 2);
+    check_read(name, &file, size - 1, 100);
+    check_read(name, &file, size, 100);
+    check_read(name, &file, size + 1, 100);
+
+    /* Around the end of each extent */
+    for (int i = 0; i < file.extent_count; i++) {
+        unsigned end = extent_offset + file.extents[i].size;
+
+        check_read(name, &file, end - 1, 1);
+        check_read(name, &file, end - 1, 2);
+        check_read(name, &file, end, CLUSTER_SIZE + 1);
+
+        /* A read within an extent is a single read of the flash, and one across extents is one more */
+        flash.reads = 0;
+        rtos_ff_direct_read(&file, buf, extent_offset, file.extents[i].size);
+        CHECK(flash.reads == 1);
+        if (i + 1 < file.extent_count) {
+            flash.reads = 0;
+            rtos_ff_direct_read(&file, buf, end - 1, 2);
+            CHECK(flash.reads == 2);
+        }
+        extent_offset = end;
+    }
+
+    for (int i = 0; i < RANDOM_READS && size > 0; i++) {
+        check_read(name, &file, random_next() % size, random_next() % sizeof(buf));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const MKFS_PARM format = {
+        .fmt = FM_FAT | FM_SFD,
+        .n_fat = 1,
+        .align = 0,
+        .n_root = 0,
+        .au_size = CLUSTER_SIZE,
+    };
+    const char *contiguous[] = { "contig.bin" };
+    const char *fragmented[] = { "frag.bin", "other.bin" };
+    const char *too_many[] = { "many.bin", "gaps.bin" };
+    const char *empty[] = { "empty.bin" };
+    rtos_ff_direct_file_t file;
+
+    (void) argc;
+    (void) argv;
+
+    flash.size = FS_SIZE;
+    flash.data = malloc(QSPI_FLASH_FILESYSTEM_START_ADDRESS + FS_SIZE);
+    memset(flash.data, 0xFF, QSPI_FLASH_FILESYSTEM_START_ADDRESS + FS_SIZE);
+
+    rtos_fatfs_init(&flash);
+    CHECK(f_mkfs("", &format, buf, sizeof(buf)) == FR_OK);
+
+    files_write(contiguous, 1, CLUSTER_SIZE + 100, 3);
+    /* The chunks do not fill whole clusters, so each file has runs of one and two clusters */
+    files_write(fragmented, 2, 5000, 4);
+    files_write(too_many, 2, CLUSTER_SIZE, RTOS_FF_DIRECT_EXTENTS_MAX + 1);
+    files_write(empty, 1, 0, 1);
+
+    check_file("contig.bin", 3 * (CLUSTER_SIZE + 100), 1);
+    check_file("frag.bin", 4 * 5000, 4);
+    check_file("other.bin", 4 * 5000, 4);
+    check_file("empty.bin", 0, 0);
+
+    CHECK(rtos_ff_direct_open("many.bin", &file) == 0);
+    CHECK(rtos_ff_direct_open("missing.bin", &file) == 0);
+
+    /* A file set up from its address, as from a fatfs_mkimage manifest */
+    CHECK(rtos_ff_direct_open("contig.bin", &file) == 1);
+    rtos_ff_direct_init(&file, &flash, file.extents[0].address, file.size);
+    CHECK(file.extent_count == 1);
+    check_read("contig.bin", &file, 0, file.size);
+    check_read("contig.bin", &file, 1000, 5000);
+
+    free(flash.data);
+
+    return host_test_result();
+}
@@ -0,0 +1,14 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef FF_APPCONF_H_
+#define FF_APPCONF_H_
+
+/* Required by rtos_ff_direct_open() */
+#define FF_USE_FASTSEEK     1
+
+/* The test formats the volume, and runs without an RTOS */
+#define FF_USE_MKFS         1
+#define FF_FS_REENTRANT     0
+
+#endif /* FF_APPCONF_H_ */
@@ -0,0 +1,63 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_QSPI_FLASH_H_
+#define RTOS_QSPI_FLASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The flash is emulated in memory, and counts the reads made of it. The
+ * default diskio functions take the size of the flash as the size of the
+ * filesystem that starts part way into it, so that is the size given.
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    unsigned reads;
+} rtos_qspi_flash_t;
+
+static inline void rtos_qspi_flash_lock(rtos_qspi_flash_t *ctx)
+{
+    (void) ctx;
+}
+
+static inline void rtos_qspi_flash_unlock(rtos_qspi_flash_t *ctx)
+{
+    (void) ctx;
+}
+
+static inline void rtos_qspi_flash_read(rtos_qspi_flash_t *ctx,
+                                        uint8_t *data,
+                                        unsigned address,
+                                        size_t len)
+{
+    memcpy(data, &ctx->data[address], len);
+    ctx->reads++;
+}
+
+static inline void rtos_qspi_flash_write(rtos_qspi_flash_t *ctx,
+                                         const uint8_t *data,
+                                         unsigned address,
+                                         size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        ctx->data[address + i] &= data[i];
+    }
+}
+
+static inline void rtos_qspi_flash_erase(rtos_qspi_flash_t *ctx,
+                                         unsigned address,
+                                         size_t len)
+{
+    memset(&ctx->data[address], 0xFF, len);
+}
+
+static inline size_t rtos_qspi_flash_size_get(rtos_qspi_flash_t *ctx)
+{
+    return ctx->size;
+}
+
+#endif /* RTOS_QSPI_FLASH_H_ */
@@ -0,0 +1,11 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef XCORE_ASSERT_H_
+#define XCORE_ASSERT_H_
+
+#include <assert.h>
+
+#define xassert(e) assert(e)
+
+#endif /* XCORE_ASSERT_H_ */
@@ -0,0 +1,162 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "device_control.h"
+
+/*
+ * Registers resource ranges with the device control resource table and
+ * checks every resource ID against a simple model of the table after each
+ * registration. A registration that fails must leave the table as it was.
+ */
+
+void resource_table_init(device_control_t *ctx);
+int resource_table_add(device_control_t *ctx,
+                       const device_control_resid_range_t ranges[],
+                       size_t num_ranges,
+                       uint8_t servicer);
+int resource_table_search(device_control_t *ctx,
+                          control_resid_t resid,
+                          uint8_t *servicer);
+int resource_table_search_next(device_control_t *ctx,
+                               control_resid_t resid,
+                               size_t *iter,
+                               uint8_t *servicer);
+
+#define NO_SERVICER     255
+#define RESID_COUNT     256
+#define MAX_SERVICERS   8
+
+#define EXCLUSIVE(first, last)  { (first), (last), 0 }
+#define BROADCAST(first, last)  { (first), (last), DEVICE_CONTROL_RESID_BROADCAST }
+
+static device_control_t ctx;
+
+/* The owner of each exclusive resource ID, and the broadcast servicers in order */
+static uint8_t model_exclusive[RESID_COUNT];
+static uint8_t model_broadcast[RESID_COUNT][MAX_SERVICERS];
+static size_t model_broadcast_count[RESID_COUNT];
+
+/* The allocation that fails, counting down from 1, or 0 for none */
+static int malloc_fail_countdown;
+static int allocations;
+
+void *rtos_osal_malloc(size_t size)
+{
+    if (malloc_fail_countdown > 0 && --malloc_fail_countdown == 0) {
+        return NULL;
+    }
+    allocations++;
+    return malloc(size);
+}
+
+void rtos_osal_free(void *ptr)
+{
+    allocations--;
+    free(ptr);
+}
+
+static void model_add(const device_control_resid_range_t ranges[], size_t num_ranges, uint8_t servicer)
+{
+    for (size_t i = 0; i < num_ranges; i++) {
+        for (int resid = ranges[i].first; resid <= ranges[i].last; resid++) {
+            if (ranges[i].flags & DEVICE_CONTROL_RESID_BROADCAST) {
+                model_broadcast[resid][model_broadcast_count[resid]++] = servicer;
+            } else {
+                model_exclusive[resid] = servicer;
+            }
+        }
+    }
+}
+
+static void check_table(const char *step)
+{
+    for (int resid = 1; resid < RESID_COUNT; resid++) {
+        uint8_t servicer;
+        size_t iter = 0;
+        size_t count = 0;
+
+        if (model_exclusive[resid] != NO_SERVICER) {
+            if (resource_table_search(&ctx, resid, &servicer) != 0 || servicer != model_exclusive[resid]) {
+                FAIL("%s: resource %d is not owned by servicer %d", step, resid, model_exclusive[resid]);
+            }
+            continue;
+        }
+
+        while (resource_table_search_next(&ctx, resid, &iter, &servicer) == 0) {
+            if (count >= model_broadcast_count[resid] || servicer != model_broadcast[resid][count]) {
+                FAIL("%s: resource %d is registered by servicer %d", step, resid, servicer);
+            }
+            count++;
+        }
+        if (count != model_broadcast_count[resid]) {
+            FAIL("%s: resource %d has %zu servicers, expected %zu", step, resid, count, model_broadcast_count[resid]);
+        }
+    }
+}
+
+/* Registers ranges, expecting ret, and checks that only a success changed the table */
+static void add(const char *step,
+                const device_control_resid_range_t ranges[],
+                size_t num_ranges,
+                uint8_t servicer,
+                int expected)
+{
+    int live = allocations;
+    int ret = resource_table_add(&ctx, ranges, num_ranges, servicer);
+
+    if (ret != expected) {
+        FAIL("%s: returned %d, expected %d", step, ret, expected);
+    }
+    if (ret == 0) {
+        model_add(ranges, num_ranges, servicer);
+    } else if (allocations != live) {
+        FAIL("%s: %d allocations leaked", step, allocations - live);
+    }
+    check_table(step);
+}
+
+#define ADD(step, servicer, expected, ...) do { \
+    const device_control_resid_range_t r[] = { __VA_ARGS__ }; \
+    add(step, r, sizeof(r) / sizeof(r[0]), servicer, expected); \
+} while (0)
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+
+    memset(model_exclusive, NO_SERVICER, sizeof(model_exclusive));
+    resource_table_init(&ctx);
+
+    ADD("exclusive", 0, 0, EXCLUSIVE(1, 10), EXCLUSIVE(20, 29));
+    ADD("unsorted", 1, 0, EXCLUSIVE(200, 210), EXCLUSIVE(150, 160), EXCLUSIVE(180, 185));
+
+    ADD("overlap registered", 2, 3, EXCLUSIVE(40, 49), EXCLUSIVE(5, 6));
+    ADD("overlap in call", 2, 3, EXCLUSIVE(40, 49), EXCLUSIVE(60, 69), EXCLUSIVE(45, 50));
+    ADD("overlap broadcast in call", 2, 3, EXCLUSIVE(40, 49), BROADCAST(60, 69), BROADCAST(65, 70));
+    ADD("overlap exclusive and broadcast in call", 2, 3, BROADCAST(40, 49), EXCLUSIVE(49, 49));
+
+    ADD("broadcast", 2, 0, EXCLUSIVE(40, 49), BROADCAST(100, 110));
+    ADD("shared broadcast", 3, 0, BROADCAST(105, 120), EXCLUSIVE(121, 121));
+    ADD("broadcast overlap same servicer", 3, 3, BROADCAST(110, 110));
+    ADD("exclusive overlap broadcast", 4, 3, EXCLUSIVE(110, 110));
+    ADD("broadcast overlap exclusive", 4, 3, BROADCAST(121, 125));
+
+    ADD("invalid range", 4, 2, EXCLUSIVE(130, 131), EXCLUSIVE(133, 132));
+    ADD("reserved resource", 4, 2, EXCLUSIVE(CONTROL_SPECIAL_RESID, 1));
+    ADD("reserved servicer", NO_SERVICER, 1, EXCLUSIVE(130, 131));
+
+    malloc_fail_countdown = 1;
+    ADD("exclusive out of memory", 4, 4, EXCLUSIVE(130, 139), BROADCAST(140, 140));
+    malloc_fail_countdown = 2;
+    ADD("broadcast out of memory", 4, 4, EXCLUSIVE(130, 139), BROADCAST(140, 140));
+    malloc_fail_countdown = 0;
+    ADD("after out of memory", 4, 0, EXCLUSIVE(130, 139), BROADCAST(140, 140));
+
+    return host_test_result();
+}
@@ -0,0 +1,9 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_INTERTILE_H_
+#define RTOS_INTERTILE_H_
+
+typedef struct rtos_intertile_struct rtos_intertile_t;
+
+#endif /* RTOS_INTERTILE_H_ */
@@ -0,0 +1,17 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_OSAL_H_
+#define RTOS_OSAL_H_
+
+#include <stddef.h>
+
+/* Only the allocator is used by the resource table */
+typedef struct {
+    void *handle;
+} rtos_osal_queue_t;
+
+void *rtos_osal_malloc(size_t size);
+void rtos_osal_free(void *ptr);
+
+#endif /* RTOS_OSAL_H_ */
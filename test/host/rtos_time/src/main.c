@@ -0,0 +1,105 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+
+#include "host_test.h"
+#include "rtos_time.h"
+
+/*
+ * Drives rtos_time with a simulated tick and reference timer. The time
+ * is kept with its microseconds in Q12 format, so that a second only
+ * just fits in 32 bits, and sums of two times near the end of a second
+ * must not overflow.
+ */
+
+#define REF_TICKS_PER_US    100
+#define Q12_US(us)          ((uint32_t) (us) << 12)
+
+static uint32_t ref_now;
+
+uint32_t get_reference_time(void)
+{
+    return ref_now;
+}
+
+/* Advances the reference timer by us microseconds, then ticks */
+static void tick(uint32_t us)
+{
+    ref_now += us * REF_TICKS_PER_US;
+    rtos_time_increment(Q12_US(us));
+}
+
+static int time_before(rtos_time_t a, rtos_time_t b)
+{
+    return a.seconds < b.seconds || (a.seconds == b.seconds && a.microseconds < b.microseconds);
+}
+
+/*
+ * Both the uptime and the offset from rtos_time_set() end 1 us short of
+ * a second, so each is nearly ONE_SECOND_US in Q12 and their sum is
+ * nearly twice what fits in 32 bits.
+ */
+static void check_offset_near_one_second(void)
+{
+    rtos_time_t t;
+
+    for (int i = 0; i < 999; i++) {
+        tick(1000);
+    }
+    tick(999);
+
+    /* The uptime is now 0.999999 s, so the offset is 99.999999 s */
+    rtos_time_set((rtos_time_t) {100, 999998});
+
+    t = rtos_time_get();
+    CHECK(t.seconds == 100);
+    CHECK(t.microseconds == 999998);
+
+    /* The interpolated time takes the same sum across the second */
+    ref_now += 3 * REF_TICKS_PER_US;
+    t = rtos_time_get();
+    CHECK(t.seconds == 101);
+    CHECK(t.microseconds == 1);
+}
+
+/*
+ * The time from a slow tick is interpolated by up to nearly a whole
+ * tick, which also carries into the next second.
+ */
+static void check_slow_tick(void)
+{
+    rtos_time_t last;
+    rtos_time_t t;
+
+    rtos_time_set((rtos_time_t) {200, 995000});
+    last = rtos_time_get();
+
+    for (int i = 0; i < 10; i++) {
+        for (int j = 0; j < 10; j++) {
+            ref_now += 1000 * REF_TICKS_PER_US;
+            t = rtos_time_get();
+            CHECK(!time_before(t, last));
+            last = t;
+        }
+        rtos_time_increment(RTOS_TICK_PERIOD_100_HZ);
+        t = rtos_time_get();
+        CHECK(!time_before(t, last));
+        last = t;
+    }
+
+    t = rtos_time_get();
+    CHECK(t.seconds == 201);
+    CHECK(t.microseconds == 95000);
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+
+    check_offset_near_one_second();
+    check_slow_tick();
+
+    return host_test_result();
+}
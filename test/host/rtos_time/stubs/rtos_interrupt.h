@@ -0,0 +1,20 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_INTERRUPT_H_
+#define RTOS_INTERRUPT_H_
+
+#include <stdint.h>
+
+/* The test has a single thread, so there is nothing to mask */
+static inline uint32_t rtos_interrupt_mask_all(void)
+{
+    return 0;
+}
+
+static inline void rtos_interrupt_mask_set(uint32_t mask)
+{
+    (void) mask;
+}
+
+#endif /* RTOS_INTERRUPT_H_ */
@@ -0,0 +1,18 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_LOCKS_H_
+#define RTOS_LOCKS_H_
+
+/* The test has a single thread, so there is nothing to lock */
+static inline void rtos_lock_acquire(int lock_id)
+{
+    (void) lock_id;
+}
+
+static inline void rtos_lock_release(int lock_id)
+{
+    (void) lock_id;
+}
+
+#endif /* RTOS_LOCKS_H_ */
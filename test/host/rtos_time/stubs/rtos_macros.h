@@ -0,0 +1,9 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_MACROS_H_
+#define RTOS_MACROS_H_
+
+#define RTOS_MEMORY_BARRIER() asm volatile( "" ::: "memory" )
+
+#endif /* RTOS_MACROS_H_ */
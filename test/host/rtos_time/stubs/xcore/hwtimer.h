@@ -0,0 +1,12 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef HWTIMER_H_
+#define HWTIMER_H_
+
+#include <stdint.h>
+
+/* The 100 MHz reference timer, which the test advances */
+uint32_t get_reference_time(void);
+
+#endif /* HWTIMER_H_ */
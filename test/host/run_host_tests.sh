@@ -0,0 +1,21 @@
+#!/bin/bash
+# Copyright 2024 XMOS LIMITED.
+# This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+set -e
+
+REPO_ROOT=`git rev-parse --show-toplevel`
+BUILD_DIR=${REPO_ROOT}/build_host_tests
+
+# setup configurations
+if [ -z "$1" ] || [ "$1" == "all" ]
+then
+    CTEST_ARGS=()
+else
+    # run only the tests matching the given name, eg. dhcpd
+    CTEST_ARGS=(-R "$1")
+fi
+
+cmake -S ${REPO_ROOT}/test/host -B ${BUILD_DIR}
+cmake --build ${BUILD_DIR}
+ctest --test-dir ${BUILD_DIR} --output-on-failure "${CTEST_ARGS[@]}"
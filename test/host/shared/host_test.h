@@ -0,0 +1,39 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+/*
+ * The checks shared by the host tests. Each test is a single source file
+ * that includes this header, and returns host_test_result() from main().
+ */
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define FAIL(...) do { \
+    printf("FAIL: " __VA_ARGS__); \
+    printf("\n"); \
+    failures++; \
+} while (0)
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        FAIL("%s:%d: %s", __FILE__, __LINE__, #cond); \
+    } \
+} while (0)
+
+static inline int host_test_result(void)
+{
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
+
+#endif /* HOST_TEST_H_ */
@@ -0,0 +1,499 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "sntpd_clock.h"
+
+/*
+ * Drives the sntpd protocol and clock discipline against stand-in NTP
+ * servers on the loopback interface. Time is simulated: the servers
+ * stamp their responses with the simulated true time, and the device
+ * clock is modelled as rtos_time is, with a frequency error, a
+ * frequency correction and a slew limited to 500 ppm.
+ */
+
+#define NS_PER_SECOND   1000000000LL
+#define NS_PER_MS       1000000LL
+
+#define SERVER_COUNT    4
+#define SAMPLES         4       /* SNTPD_SAMPLES */
+#define SAMPLE_INTERVAL (500 * NS_PER_MS)
+#define POLL_INTERVAL   (15 * NS_PER_SECOND)
+#define POLLS           480     /* Two hours */
+
+/*
+ * The simulation. The client thread only advances the time while the
+ * server thread is waiting, and vice versa, with a socket between them.
+ */
+typedef struct {
+    volatile int64_t true_ns;       /* The true time since the Unix epoch */
+
+    /* The device clock */
+    double device_error_ns;         /* The device time minus the true time */
+    double drift_ppm;               /* Frequency error of the crystal */
+    int32_t frequency_ppb;          /* Correction set by rtos_time_frequency_set() */
+    double slew_remaining_ns;       /* Set by rtos_time_adjust() */
+    double monotonic_ns;            /* rtos_time_monotonic_ns(), uncorrected */
+} sim_t;
+
+static sim_t sim;
+
+static uint64_t rng_state = 0x243F6A8885A308D3ULL;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t) (rng_state >> 32);
+}
+
+static int64_t random_between(int64_t lo, int64_t hi)
+{
+    return lo + (int64_t) (rng() % (uint32_t) (hi - lo + 1));
+}
+
+/* Advances the true time, and the device clock with it */
+static void sim_advance(int64_t ns)
+{
+    const double oscillator_ns = ns * (1.0 + sim.drift_ppm * 1e-6);
+    const double max_slew = oscillator_ns * 500e-6;
+    double slew = sim.slew_remaining_ns;
+
+    if (slew > max_slew) {
+        slew = max_slew;
+    } else if (slew < -max_slew) {
+        slew = -max_slew;
+    }
+    sim.slew_remaining_ns -= slew;
+
+    sim.true_ns += ns;
+    sim.monotonic_ns += oscillator_ns;
+    sim.device_error_ns += oscillator_ns * (1.0 + sim.frequency_ppb * 1e-9) + slew - ns;
+}
+
+/* A delay on the network, mostly short with occasional queuing */
+static int64_t network_delay(void)
+{
+    if (rng() % 16 == 0) {
+        return random_between(20 * NS_PER_MS, 80 * NS_PER_MS);
+    }
+    return random_between(1 * NS_PER_MS, 5 * NS_PER_MS);
+}
+
+/*
+ * The stand-in NTP servers
+ */
+
+typedef struct {
+    int fd;
+    uint16_t port;
+    int64_t error_ns;       /* How far this server's time is from the true time */
+    int kiss_of_death;      /* Set to send a kiss-o'-death to the next request */
+} server_t;
+
+static server_t servers[SERVER_COUNT];
+static volatile int servers_stop;
+
+static void put32(void *p, uint32_t v)
+{
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+static void put_timestamp(void *ts, int64_t ns)
+{
+    sntp_timestamp_t t = sntpd_timestamp_from_ns(ns);
+    put32(ts, t.seconds);
+    put32((uint8_t *) ts + 4, t.fraction);
+}
+
+static void server_respond(server_t *server)
+{
+    sntp_packet_t packet;
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    ssize_t len;
+
+    len = recvfrom(server->fd, &packet, sizeof(packet), 0, (struct sockaddr *) &from, &from_len);
+    if (len < (ssize_t) sizeof(packet) || (packet.flags & 0x07) != 3) {
+        return;
+    }
+
+    /* The request's transmit timestamp becomes the response's originate timestamp */
+    packet.originateTimestamp = packet.transmitTimestamp;
+    packet.flags = 0x00 | 0x20 | 0x04; /* No warning, version 4, server */
+    packet.stratum = server->kiss_of_death ? 0 : 2;
+    packet.poll = 4;
+    packet.precision = -20;
+    memcpy(packet.referenceID, "TEST", 4);
+    put32(&packet.rootDelay, 0);
+    put32(&packet.rootDispersion, 0x0008); /* About 120 us */
+
+    /* The request has travelled to the server */
+    sim_advance(network_delay());
+    put_timestamp(&packet.receiveTimestamp, sim.true_ns + server->error_ns);
+    sim_advance(random_between(10000, 100000));
+    put_timestamp(&packet.transmitTimestamp, sim.true_ns + server->error_ns);
+    put_timestamp(&packet.referenceTimestamp, sim.true_ns + server->error_ns - 60 * NS_PER_SECOND);
+
+    server->kiss_of_death = 0;
+
+    sendto(server->fd, &packet, sizeof(packet), 0, (struct sockaddr *) &from, from_len);
+}
+
+static void *server_thread(void *arg)
+{
+    struct pollfd fds[SERVER_COUNT];
+
+    (void) arg;
+
+    for (int i = 0; i < SERVER_COUNT; i++) {
+        fds[i].fd = servers[i].fd;
+        fds[i].events = POLLIN;
+    }
+
+    while (!servers_stop) {
+        if (poll(fds, SERVER_COUNT, 100) <= 0) {
+            continue;
+        }
+        for (int i = 0; i < SERVER_COUNT; i++) {
+            if (fds[i].revents & POLLIN) {
+                server_respond(&servers[i]);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int open_udp(uint16_t *port)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    struct timeval tv = { 1, 0 };
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (fd < 0) {
+        perror("socket");
+        exit(1);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        perror("bind");
+        exit(1);
+    }
+    getsockname(fd, (struct sockaddr *) &addr, &addr_len);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (port != NULL) {
+        *port = ntohs(addr.sin_port);
+    }
+
+    return fd;
+}
+
+/*
+ * The client, following sntpd's poll
+ */
+
+static int64_t local_time_ns(void)
+{
+    return sim.true_ns + (int64_t) sim.device_error_ns;
+}
+
+static int query(int fd, server_t *server, sntpd_sample_t *sample)
+{
+    struct sockaddr_in addr;
+    sntp_packet_t packet;
+    sntp_packet_t response;
+    sntp_timestamp_t sent;
+    int64_t t1;
+    int64_t t4;
+    ssize_t len;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(server->port);
+
+    t1 = local_time_ns();
+    sntpd_request_build(&packet, t1);
+    memcpy(&sent, &packet.transmitTimestamp, sizeof(sent));
+
+    sendto(fd, &packet, sizeof(packet), 0, (struct sockaddr *) &addr, sizeof(addr));
+    len = recv(fd, &response, sizeof(response), 0);
+
+    /* The response has travelled back to the device */
+    sim_advance(network_delay());
+    t4 = local_time_ns();
+
+    if (len < 0) {
+        return SNTPD_SAMPLE_INVALID;
+    }
+
+    return sntpd_response_parse(&response, len, &sent, t1, t4, sample);
+}
+
+static int poll_servers(int fd, int64_t *offset_ns)
+{
+    sntpd_sample_t server_samples[SERVER_COUNT];
+    int server_count = 0;
+
+    for (int i = 0; i < SERVER_COUNT; i++) {
+        sntpd_sample_t samples[SAMPLES];
+        int count = 0;
+
+        for (int j = 0; j < SAMPLES; j++) {
+            int ret = query(fd, &servers[i], &samples[count]);
+            if (ret == SNTPD_SAMPLE_OK) {
+                count++;
+            } else if (ret == SNTPD_SAMPLE_KISS_OF_DEATH) {
+                break;
+            }
+            sim_advance(SAMPLE_INTERVAL);
+        }
+
+        if (count > 0) {
+            server_samples[server_count++] = sntpd_filter_samples(samples, count);
+        }
+    }
+
+    if (server_count == 0) {
+        return -1;
+    }
+    *offset_ns = sntpd_select_offset(server_samples, server_count);
+    return 0;
+}
+
+static void clock_update(sntpd_discipline_t *d, int64_t offset_ns)
+{
+    if (sntpd_discipline_update(d, offset_ns, (uint64_t) sim.monotonic_ns) == SNTPD_CLOCK_STEP) {
+        /* rtos_time_set() */
+        sim.device_error_ns += offset_ns;
+        sim.slew_remaining_ns = 0;
+    } else {
+        /* rtos_time_adjust() */
+        sim.slew_remaining_ns = d->slew_ns;
+    }
+    sim.frequency_ppb = d->frequency_ppb;
+}
+
+/*
+ * Runs the client for POLLS polls from true_start with the device clock
+ * at device_start, and checks that it holds the time to within
+ * max_error_ns once it has settled.
+ */
+static void run_sync(const char *name, int64_t true_start, int64_t device_start, double drift_ppm, int64_t max_error_ns)
+{
+    sntpd_discipline_t d;
+    int fd = open_udp(NULL);
+    int64_t worst = 0;
+    int steps = 0;
+    int64_t offset_ns;
+
+    sntpd_discipline_init(&d);
+    sim.true_ns = true_start;
+    sim.device_error_ns = device_start - true_start;
+    sim.drift_ppm = drift_ppm;
+    sim.frequency_ppb = 0;
+    sim.slew_remaining_ns = 0;
+    sim.monotonic_ns = 1 * NS_PER_SECOND;
+
+    for (int i = 0; i < POLLS; i++) {
+        int was_synced = d.synced;
+
+        if (poll_servers(fd, &offset_ns) == 0) {
+            if (!was_synced || offset_ns > SNTPD_STEP_THRESHOLD_US * 1000LL || offset_ns < -SNTPD_STEP_THRESHOLD_US * 1000LL) {
+                steps++;
+            }
+            clock_update(&d, offset_ns);
+        }
+
+        sim_advance(was_synced ? POLL_INTERVAL : SAMPLE_INTERVAL);
+
+        if (i >= POLLS / 2) {
+            int64_t error = (int64_t) sim.device_error_ns;
+            if (error < 0) {
+                error = -error;
+            }
+            if (error > worst) {
+                worst = error;
+            }
+        }
+    }
+
+    printf("%s: worst error %lld us, frequency correction %d ppb for %+.1f ppm, %d step(s)\n",
+           name, (long long) (worst / 1000), (int) d.frequency_ppb, drift_ppm, steps);
+
+    CHECK(steps == 1);
+    CHECK(worst <= max_error_ns);
+    /* The correction should cancel the drift to within a few ppm */
+    CHECK(d.frequency_ppb > -drift_ppm * 1000 - 5000 && d.frequency_ppb < -drift_ppm * 1000 + 5000);
+
+    close(fd);
+}
+
+/*
+ * Unit checks of the protocol
+ */
+
+static void check_timestamps(void)
+{
+    const int64_t times[] = {
+        0,
+        1700000000LL * NS_PER_SECOND + 123456789,
+        2085978495LL * NS_PER_SECOND,                   /* The last second of NTP era 0 */
+        2085978496LL * NS_PER_SECOND + 500000000,       /* The first of era 1 */
+        2200000000LL * NS_PER_SECOND + 999999999,
+    };
+
+    for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); i++) {
+        int64_t back = sntpd_timestamp_to_ns(sntpd_timestamp_from_ns(times[i]));
+        /* The fraction has a resolution of about 0.23 ns */
+        CHECK(back <= times[i] && times[i] - back <= 1);
+    }
+
+    CHECK(sntpd_timestamp_from_ns(2085978496LL * NS_PER_SECOND).seconds == 0);
+    CHECK(sntpd_timestamp_from_ns(0).seconds == 2208988800UL);
+    CHECK(sntpd_timestamp_from_ns(500000000).fraction == 0x80000000UL);
+}
+
+static void check_parse(void)
+{
+    const int64_t t1 = 1700000000LL * NS_PER_SECOND;
+    sntp_packet_t request;
+    sntp_packet_t response;
+    sntp_timestamp_t sent;
+    sntpd_sample_t sample;
+
+    sntpd_request_build(&request, t1);
+    memcpy(&sent, &request.transmitTimestamp, sizeof(sent));
+    CHECK((request.flags & 0x07) == 3);
+
+    /* The server is 10 ms ahead, and each direction takes 2 ms */
+    response = request;
+    response.originateTimestamp = request.transmitTimestamp;
+    response.flags = 0x24;
+    response.stratum = 1;
+    put_timestamp(&response.receiveTimestamp, t1 + 12 * NS_PER_MS);
+    put_timestamp(&response.transmitTimestamp, t1 + 13 * NS_PER_MS);
+
+    CHECK(sntpd_response_parse(&response, sizeof(response), &sent, t1, t1 + 5 * NS_PER_MS, &sample) == SNTPD_SAMPLE_OK);
+    CHECK(sample.offset_ns >= 10 * NS_PER_MS - 1 && sample.offset_ns <= 10 * NS_PER_MS + 1);
+    CHECK(sample.delay_ns >= 4 * NS_PER_MS - 1 && sample.delay_ns <= 4 * NS_PER_MS + 1);
+    CHECK(sample.distance_ns >= 2 * NS_PER_MS - 1 && sample.distance_ns <= 2 * NS_PER_MS + 1);
+
+    CHECK(sntpd_response_parse(&response, sizeof(response) - 1, &sent, t1, t1 + 5 * NS_PER_MS, &sample) == SNTPD_SAMPLE_INVALID);
+
+    /* A reply to a different request */
+    response.originateTimestamp.fraction ^= 1;
+    CHECK(sntpd_response_parse(&response, sizeof(response), &sent, t1, t1 + 5 * NS_PER_MS, &sample) == SNTPD_SAMPLE_INVALID);
+    response.originateTimestamp = request.transmitTimestamp;
+
+    /* An unsynchronized server */
+    response.flags = 0xE4;
+    CHECK(sntpd_response_parse(&response, sizeof(response), &sent, t1, t1 + 5 * NS_PER_MS, &sample) == SNTPD_SAMPLE_INVALID);
+    response.flags = 0x24;
+
+    response.stratum = 0;
+    CHECK(sntpd_response_parse(&response, sizeof(response), &sent, t1, t1 + 5 * NS_PER_MS, &sample) == SNTPD_SAMPLE_KISS_OF_DEATH);
+}
+
+static void check_filter(void)
+{
+    int64_t odd[] = { 5, -3, 9, 1, 7 };
+    int64_t even[] = { 10, 2, 8, 4 };
+    sntpd_sample_t samples[] = {
+        { 1000, 40 * NS_PER_MS, 0 },    /* Queued, so its offset is off */
+        { 10, 3 * NS_PER_MS, 0 },
+        { 14, 4 * NS_PER_MS, 0 },
+        { -500, 30 * NS_PER_MS, 0 },
+        { 12, 2 * NS_PER_MS, 0 },
+    };
+
+    CHECK(sntpd_median(odd, 5) == 5);
+    CHECK(sntpd_median(even, 4) == 6);
+    CHECK(sntpd_filter_samples(samples, 5).offset_ns == 12);
+}
+
+static void check_select(void)
+{
+    /* Three servers that agree, and one that is 30 ms out */
+    const sntpd_sample_t samples[] = {
+        { 1000, 0, 2000 },
+        { 30000, 0, 2000 },
+        { 1500, 0, 1000 },
+        { 900, 0, 500 },
+    };
+    /* Two that disagree, where neither is preferred */
+    const sntpd_sample_t split[] = {
+        { -5000, 0, 1000 },
+        { 5000, 0, 1000 },
+    };
+    int64_t offset;
+
+    CHECK(sntpd_select_offset(samples, 4) == 1000);
+    CHECK(sntpd_select_offset(samples, 1) == 1000);
+    CHECK(sntpd_select_offset(&samples[1], 1) == 30000);
+
+    offset = sntpd_select_offset(split, 2);
+    CHECK(offset == -5000 || offset == 5000);
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t thread;
+
+    (void) argc;
+    (void) argv;
+
+    check_timestamps();
+    check_parse();
+    check_filter();
+    check_select();
+
+    /* Three good servers, one of them slightly off, and one 25 ms out */
+    servers[0].error_ns = 0;
+    servers[1].error_ns = 40000;
+    servers[2].error_ns = -25000;
+    servers[3].error_ns = 25 * NS_PER_MS;
+    for (int i = 0; i < SERVER_COUNT; i++) {
+        servers[i].fd = open_udp(&servers[i].port);
+    }
+    pthread_create(&thread, NULL, server_thread, NULL);
+
+    /* An unset clock, as after power on */
+    run_sync("power on", 1790000000LL * NS_PER_SECOND, 0, 47.0, 500000);
+
+    /* A clock that is 3 s slow, across the end of NTP era 0 */
+    run_sync("era rollover", 2085977000LL * NS_PER_SECOND, 2085976997LL * NS_PER_SECOND, -23.5, 500000);
+
+    /* A kiss-o'-death must not be used as a sample */
+    {
+        int fd = open_udp(NULL);
+        sntpd_sample_t sample;
+        servers[0].kiss_of_death = 1;
+        CHECK(query(fd, &servers[0], &sample) == SNTPD_SAMPLE_KISS_OF_DEATH);
+        close(fd);
+    }
+
+    servers_stop = 1;
+    pthread_join(thread, NULL);
+    for (int i = 0; i < SERVER_COUNT; i++) {
+        close(servers[i].fd);
+    }
+
+    return host_test_result();
+}
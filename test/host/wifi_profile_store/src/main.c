@@ -0,0 +1,511 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "wifi_profile_store.h"
+
+/*
+ * Exercises the WiFi profile store against an emulated NOR flash, which
+ * can only clear bits when written and can be made to lose power part
+ * way through a write or erase. Its contents are checked against a
+ * simple model after every operation, and after reinitializing from the
+ * flash.
+ */
+
+#define SECTOR_SIZE     4096
+#define SECTOR_COUNT    3
+#define BASE            (2 * SECTOR_SIZE)
+#define FLASH_SIZE      (BASE + SECTOR_COUNT * SECTOR_SIZE)
+
+/*
+ * The emulated flash
+ */
+
+typedef struct {
+    uint8_t data[FLASH_SIZE];
+    unsigned erase_count[FLASH_SIZE / SECTOR_SIZE];
+    unsigned write_count;
+    int bad_writes;         /* Writes that tried to set bits that were clear */
+    long budget;            /* Bytes that may be changed before power is lost, or -1 */
+} flash_t;
+
+static int powered(flash_t *flash)
+{
+    if (flash->budget == 0) {
+        return 0;
+    }
+    if (flash->budget > 0) {
+        flash->budget--;
+    }
+    return 1;
+}
+
+static void flash_read(void *ctx, unsigned address, void *data, size_t len)
+{
+    flash_t *flash = ctx;
+
+    if (address + len > FLASH_SIZE) {
+        FAIL("read out of range");
+        return;
+    }
+    memcpy(data, &flash->data[address], len);
+}
+
+static void flash_write(void *ctx, unsigned address, const void *data, size_t len)
+{
+    flash_t *flash = ctx;
+    const uint8_t *p = data;
+
+    if (address < BASE || address + len > FLASH_SIZE) {
+        FAIL("write out of range");
+        return;
+    }
+
+    flash->write_count++;
+    for (size_t i = 0; i < len && powered(flash); i++) {
+        if ((p[i] & ~flash->data[address + i]) != 0) {
+            flash->bad_writes++;
+        }
+        flash->data[address + i] &= p[i];
+    }
+}
+
+static void flash_erase(void *ctx, unsigned address, size_t len)
+{
+    flash_t *flash = ctx;
+
+    if (address % SECTOR_SIZE != 0 || len != SECTOR_SIZE || address < BASE || address + len > FLASH_SIZE) {
+        FAIL("erase of %u bytes at 0x%x", (unsigned) len, address);
+        return;
+    }
+
+    flash->erase_count[address / SECTOR_SIZE]++;
+    for (size_t i = 0; i < len && powered(flash); i++) {
+        flash->data[address + i] = 0xFF;
+    }
+}
+
+static void flash_reset(flash_t *flash, uint8_t fill)
+{
+    memset(flash, 0, sizeof(flash_t));
+    memset(flash->data, fill, sizeof(flash->data));
+    flash->budget = -1;
+}
+
+static void store_open(wifi_profile_store_t *store, flash_t *flash)
+{
+    CHECK(wifi_profile_store_init(store, flash_read, flash_write, flash_erase, flash,
+                                  BASE, SECTOR_SIZE, SECTOR_COUNT) == 0);
+}
+
+/*
+ * The model
+ */
+
+typedef struct {
+    char key[WIFI_PROFILE_STORE_KEY_MAX_LEN + 1];
+    uint8_t value[WIFI_PROFILE_STORE_VALUE_MAX_LEN];
+    size_t value_len;
+    uint8_t bssid[WIFI_PROFILE_STORE_BSSID_LEN];
+    int8_t channel;
+    unsigned connected;     /* When it last connected, 0 if never */
+} model_entry_t;
+
+typedef struct {
+    int count;
+    unsigned clock;
+    model_entry_t entries[WIFI_PROFILE_STORE_MAX_PROFILES];
+} model_t;
+
+static int model_find(const model_t *model, const char *key)
+{
+    for (int i = 0; i < model->count; i++) {
+        if (strcmp(model->entries[i].key, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int model_put(model_t *model, const char *key, const uint8_t *value, size_t value_len)
+{
+    int i = model_find(model, key);
+
+    if (i < 0) {
+        if (model->count == WIFI_PROFILE_STORE_MAX_PROFILES) {
+            return -1;
+        }
+        i = model->count++;
+        memset(&model->entries[i], 0, sizeof(model_entry_t));
+        strcpy(model->entries[i].key, key);
+    }
+    memcpy(model->entries[i].value, value, value_len);
+    model->entries[i].value_len = value_len;
+    return i;
+}
+
+static void model_delete(model_t *model, int index)
+{
+    memmove(&model->entries[index], &model->entries[index + 1], (model->count - index - 1) * sizeof(model_entry_t));
+    model->count--;
+}
+
+static void model_connected(model_t *model, int index, const uint8_t *bssid, int8_t channel)
+{
+    memcpy(model->entries[index].bssid, bssid, WIFI_PROFILE_STORE_BSSID_LEN);
+    model->entries[index].channel = channel;
+    model->entries[index].connected = ++model->clock;
+}
+
+/* Returns non-zero if the store holds exactly what the model does */
+static int store_matches(const wifi_profile_store_t *store, const model_t *model)
+{
+    int last = -1;
+
+    if (wifi_profile_store_count(store) != model->count) {
+        return 0;
+    }
+
+    for (int i = 0; i < model->count; i++) {
+        const model_entry_t *m = &model->entries[i];
+        const wifi_profile_store_entry_t *e = wifi_profile_store_entry(store, i);
+        uint8_t value[WIFI_PROFILE_STORE_VALUE_MAX_LEN];
+
+        if (e == NULL || strcmp(e->key, m->key) != 0) {
+            return 0;
+        }
+        if (wifi_profile_store_value_get(store, i, value, sizeof(value)) != (int) m->value_len ||
+                memcmp(value, m->value, m->value_len) != 0) {
+            return 0;
+        }
+        if (wifi_profile_store_find(store, m->key, strlen(m->key)) != i) {
+            return 0;
+        }
+        if ((e->connected_seq != 0) != (m->connected != 0)) {
+            return 0;
+        }
+        if (m->connected && (e->channel != m->channel || memcmp(e->bssid, m->bssid, WIFI_PROFILE_STORE_BSSID_LEN) != 0)) {
+            return 0;
+        }
+    }
+
+    /* Most recently connected first, then those never connected in the order added */
+    for (int rank = 0; rank < model->count; rank++) {
+        const int i = wifi_profile_store_recent(store, rank);
+        const model_entry_t *m;
+
+        if (i < 0 || i >= model->count) {
+            return 0;
+        }
+        m = &model->entries[i];
+        if (rank > 0) {
+            const model_entry_t *prev = &model->entries[last];
+            if (prev->connected == 0 && m->connected != 0) {
+                return 0;
+            }
+            if (prev->connected != 0 && m->connected != 0 && prev->connected < m->connected) {
+                return 0;
+            }
+            if (prev->connected == 0 && m->connected == 0 && last > i) {
+                return 0;
+            }
+        }
+        last = i;
+    }
+
+    return wifi_profile_store_recent(store, model->count) == -1;
+}
+
+/*
+ * Operations
+ */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t) (rng_state >> 32);
+}
+
+typedef struct {
+    int type;       /* 0 put, 1 delete, 2 connected */
+    char key[WIFI_PROFILE_STORE_KEY_MAX_LEN + 1];
+    uint8_t value[WIFI_PROFILE_STORE_VALUE_MAX_LEN];
+    size_t value_len;
+    int index;
+    uint8_t bssid[WIFI_PROFILE_STORE_BSSID_LEN];
+    int8_t channel;
+} op_t;
+
+static void op_random(op_t *op, const model_t *model)
+{
+    const int r = rng() % 10;
+
+    memset(op, 0, sizeof(op_t));
+
+    if (model->count == 0 || r < 4) {
+        /* SSIDs from a small pool, so that some are replaced */
+        size_t key_len = 1 + rng() % WIFI_PROFILE_STORE_KEY_MAX_LEN;
+        int n = rng() % (WIFI_PROFILE_STORE_MAX_PROFILES + 4);
+        op->type = 0;
+        for (size_t i = 0; i < key_len; i++) {
+            op->key[i] = 'a' + (n + i) % 26;
+        }
+        op->key[0] = 'A' + n;
+        op->value_len = rng() % (WIFI_PROFILE_STORE_VALUE_MAX_LEN + 1);
+        for (size_t i = 0; i < op->value_len; i++) {
+            op->value[i] = rng();
+        }
+    } else if (r < 6) {
+        op->type = 1;
+        op->index = rng() % model->count;
+    } else {
+        op->type = 2;
+        op->index = rng() % model->count;
+        /* A few APs per network, so the same one is often reconnected to */
+        memset(op->bssid, 0x10 + op->index, WIFI_PROFILE_STORE_BSSID_LEN);
+        op->bssid[5] = rng() % 3;
+        op->channel = 1 + op->bssid[5] * 5;
+    }
+}
+
+static void op_store(wifi_profile_store_t *store, const op_t *op, int *ret)
+{
+    switch (op->type) {
+    case 0:
+        *ret = wifi_profile_store_put(store, op->key, strlen(op->key), op->value, op->value_len);
+        break;
+    case 1:
+        *ret = wifi_profile_store_delete(store, op->index);
+        break;
+    case 2:
+        *ret = wifi_profile_store_connected(store, op->index, op->bssid, op->channel);
+        break;
+    }
+}
+
+static int op_model(model_t *model, const op_t *op)
+{
+    switch (op->type) {
+    case 0:
+        return model_put(model, op->key, op->value, op->value_len);
+    case 1:
+        model_delete(model, op->index);
+        return 0;
+    default:
+        model_connected(model, op->index, op->bssid, op->channel);
+        return 0;
+    }
+}
+
+/*
+ * Tests
+ */
+
+static flash_t flash;
+static flash_t crashed;
+
+static void check_basic(void)
+{
+    static const uint8_t bssid_a[6] = { 1, 2, 3, 4, 5, 6 };
+    static const uint8_t bssid_b[6] = { 6, 5, 4, 3, 2, 1 };
+    wifi_profile_store_t store;
+    uint8_t value[WIFI_PROFILE_STORE_VALUE_MAX_LEN];
+    unsigned writes;
+
+    flash_reset(&flash, 0x5A);
+
+    /* Whatever was in the region before is formatted */
+    store_open(&store, &flash);
+    CHECK(wifi_profile_store_count(&store) == 0);
+    CHECK(wifi_profile_store_recent(&store, 0) == -1);
+
+    CHECK(wifi_profile_store_put(&store, "home", 4, "secret", 6) == 0);
+    CHECK(wifi_profile_store_put(&store, "office", 6, "password", 8) == 1);
+    CHECK(wifi_profile_store_put(&store, "cafe", 4, "", 0) == 2);
+
+    CHECK(wifi_profile_store_find(&store, "office", 6) == 1);
+    CHECK(wifi_profile_store_find(&store, "offic", 5) == -1);
+    CHECK(wifi_profile_store_value_get(&store, 1, value, sizeof(value)) == 8 && memcmp(value, "password", 8) == 0);
+    CHECK(wifi_profile_store_value_get(&store, 1, value, 4) == -1);
+    CHECK(wifi_profile_store_recent(&store, 0) == 0);
+
+    CHECK(wifi_profile_store_connected(&store, 2, bssid_a, 6) == 0);
+    CHECK(wifi_profile_store_connected(&store, 1, bssid_b, 11) == 0);
+    CHECK(wifi_profile_store_recent(&store, 0) == 1);
+    CHECK(wifi_profile_store_recent(&store, 1) == 2);
+    CHECK(wifi_profile_store_recent(&store, 2) == 0);
+
+    /* Nothing is written when nothing changes */
+    writes = flash.write_count;
+    CHECK(wifi_profile_store_connected(&store, 1, bssid_b, 11) == 0);
+    CHECK(wifi_profile_store_put(&store, "home", 4, "secret", 6) == 0);
+    CHECK(flash.write_count == writes);
+
+    /* A replaced profile keeps its place and its last connection */
+    CHECK(wifi_profile_store_put(&store, "cafe", 4, "latte", 5) == 2);
+    CHECK(wifi_profile_store_recent(&store, 1) == 2);
+    CHECK(wifi_profile_store_entry(&store, 2)->channel == 6);
+
+    CHECK(wifi_profile_store_delete(&store, 0) == 0);
+    CHECK(wifi_profile_store_delete(&store, 2) == -1);
+    CHECK(wifi_profile_store_find(&store, "cafe", 4) == 1);
+
+    /* Everything is as it was after reading it back */
+    store_open(&store, &flash);
+    CHECK(wifi_profile_store_count(&store) == 2);
+    CHECK(strcmp(wifi_profile_store_entry(&store, 0)->key, "office") == 0);
+    CHECK(wifi_profile_store_value_get(&store, 1, value, sizeof(value)) == 5 && memcmp(value, "latte", 5) == 0);
+    CHECK(wifi_profile_store_recent(&store, 0) == 0);
+    CHECK(wifi_profile_store_entry(&store, 0)->channel == 11);
+    CHECK(memcmp(wifi_profile_store_entry(&store, 1)->bssid, bssid_a, 6) == 0);
+
+    /* Too long, or too many */
+    CHECK(wifi_profile_store_put(&store, "k", 1, value, WIFI_PROFILE_STORE_VALUE_MAX_LEN + 1) == -1);
+    CHECK(wifi_profile_store_put(&store, "0123456789012345678901234567890123", 33, "", 0) == -1);
+    for (int i = 2; i < WIFI_PROFILE_STORE_MAX_PROFILES; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "net%d", i);
+        CHECK(wifi_profile_store_put(&store, key, strlen(key), key, strlen(key)) == i);
+    }
+    CHECK(wifi_profile_store_put(&store, "one more", 8, "", 0) == -1);
+
+    /* A region that is too small is refused */
+    CHECK(wifi_profile_store_init(&store, flash_read, flash_write, flash_erase, &flash, BASE, 1024, 8) == -1);
+    CHECK(wifi_profile_store_init(&store, flash_read, flash_write, flash_erase, &flash, BASE, SECTOR_SIZE, 1) == -1);
+
+    CHECK(flash.bad_writes == 0);
+}
+
+static void check_churn(void)
+{
+    wifi_profile_store_t store;
+    model_t model;
+    unsigned min_erases;
+    unsigned max_erases;
+
+    flash_reset(&flash, 0xFF);
+    memset(&model, 0, sizeof(model));
+
+    store_open(&store, &flash);
+
+    for (int n = 0; n < 20000; n++) {
+        op_t op;
+        int ret;
+
+        op_random(&op, &model);
+        op_store(&store, &op, &ret);
+        CHECK(ret == op_model(&model, &op));
+
+        if (!store_matches(&store, &model)) {
+            FAIL("store differs from the model after operation %d", n);
+            return;
+        }
+
+        if (n % 97 == 0) {
+            store_open(&store, &flash);
+            if (!store_matches(&store, &model)) {
+                FAIL("store differs from the model when reopened after operation %d", n);
+                return;
+            }
+        }
+    }
+
+    min_erases = max_erases = flash.erase_count[BASE / SECTOR_SIZE];
+    for (int i = 0; i < SECTOR_COUNT; i++) {
+        unsigned e = flash.erase_count[BASE / SECTOR_SIZE + i];
+        min_erases = e < min_erases ? e : min_erases;
+        max_erases = e > max_erases ? e : max_erases;
+    }
+    printf("churn: %u to %u erases per sector\n", min_erases, max_erases);
+
+    CHECK(min_erases > 0);
+    CHECK(max_erases - min_erases <= 2);
+    CHECK(flash.bad_writes == 0);
+}
+
+/*
+ * Loses power at every point of a series of operations, and checks that
+ * the store then holds what it did either before or after the operation
+ * that was interrupted.
+ */
+static void check_power_loss(void)
+{
+    wifi_profile_store_t store;
+    wifi_profile_store_t reopened;
+    model_t model;
+    int cuts = 0;
+
+    flash_reset(&flash, 0xFF);
+    memset(&model, 0, sizeof(model));
+    store_open(&store, &flash);
+
+    for (int n = 0; n < 600; n++) {
+        model_t after = model;
+        op_t op;
+        int ret;
+
+        op_random(&op, &model);
+        op_model(&after, &op);
+
+        for (long budget = rng() % 7; ; budget += 1 + rng() % 23) {
+            crashed = flash;
+            crashed.budget = -1;
+            store_open(&store, &crashed);
+            crashed.budget = budget;
+            op_store(&store, &op, &ret);
+            cuts++;
+
+            if (crashed.budget != 0) {
+                break;
+            }
+
+            /* Power was lost, so read back what reached the flash */
+            crashed.budget = -1;
+            store_open(&reopened, &crashed);
+            if (store_matches(&reopened, &model)) {
+                /* And it must carry on working from there */
+                op_store(&reopened, &op, &ret);
+            } else if (!store_matches(&reopened, &after)) {
+                FAIL("power lost during operation %d left the store inconsistent", n);
+                return;
+            }
+
+            if (!store_matches(&reopened, &after) || crashed.bad_writes != 0) {
+                FAIL("store did not recover from power lost during operation %d", n);
+                return;
+            }
+        }
+
+        /* The operation completed, so carry on from it */
+        flash = crashed;
+        flash.budget = -1;
+        model = after;
+        store_open(&store, &flash);
+        if (!store_matches(&store, &model)) {
+            FAIL("store differs from the model after operation %d", n);
+            return;
+        }
+    }
+
+    printf("power loss: %d cuts\n", cuts);
+}
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+
+    check_basic();
+    check_churn();
+    check_power_loss();
+
+    return host_test_result();
+}
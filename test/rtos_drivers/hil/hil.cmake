@@ -8,6 +8,8 @@ set(SWMEM_TEST      1)
 set(QSPI_FLASH_TEST 1)
 set(I2S_TEST        1)
 set(MIC_ARRAY_TEST  1)
+set(MRSW_LOCK_TEST  1)
+set(RTOS_IRQ_TEST   1)
 
 #**********************
 # Gather Sources
@@ -47,6 +49,8 @@ set(APP_COMPILE_DEFINITIONS
     RUN_QSPI_FLASH_TESTS=${QSPI_FLASH_TEST}
     RUN_I2S_TESTS=${I2S_TEST}
     RUN_MIC_ARRAY_TESTS=${MIC_ARRAY_TEST}
+    RUN_MRSW_LOCK_TESTS=${MRSW_LOCK_TEST}
+    RUN_RTOS_IRQ_TESTS=${RTOS_IRQ_TEST}
 
     MIC_ARRAY_CONFIG_MCLK_FREQ=24576000
     MIC_ARRAY_CONFIG_PDM_FREQ=3072000
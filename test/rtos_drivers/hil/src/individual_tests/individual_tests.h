@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef INDIVIDUAL_TESTS_H_
@@ -13,5 +13,7 @@
 #include "individual_tests/qspi_flash/qspi_flash_test.h"
 #include "individual_tests/i2s/i2s_test.h"
 #include "individual_tests/mic_array/mic_array_test.h"
+#include "individual_tests/mrsw_lock/mrsw_lock_test.h"
+#include "individual_tests/rtos_irq/rtos_irq_test.h"
 
 #endif /* INDIVIDUAL_TESTS_H_ */
@@ -0,0 +1,162 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+/* System headers */
+#include <platform.h>
+#include <xs1.h>
+#include <string.h>
+
+/* FreeRTOS headers */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Library headers */
+#include "rtos_osal.h"
+#include "concurrency_support.h"
+
+/* App headers */
+#include "app_conf.h"
+#include "individual_tests/mrsw_lock/mrsw_lock_test.h"
+
+static const char* test_name = "nested_read_test";
+
+#define local_printf( FMT, ... )    mrsw_lock_printf("%s|" FMT, test_name, ##__VA_ARGS__)
+
+#define MRSW_LOCK_TEST_READERS          4
+#define MRSW_LOCK_TEST_READER_ITERS     1000
+#define MRSW_LOCK_TEST_NESTED_TIMEOUT   100
+#define MRSW_LOCK_TEST_TASK_PRIORITY    (configMAX_PRIORITIES/2)
+
+/*
+ * With a reader preferred lock, a reader that already holds the lock must
+ * be able to take it again while a writer is waiting. Otherwise the reader
+ * waits for the writer, which waits for the reader to finish.
+ *
+ * Each reader task takes the lock, takes it again, and releases it twice,
+ * while a writer task repeatedly waits for the lock. The readers finishing
+ * keep waking the writer to check for readers again. A nested read that
+ * times out is counted as an error.
+ */
+typedef struct test_state {
+    mrsw_lock_t lock;
+    rtos_osal_semaphore_t done;
+    volatile int readers_running;
+    volatile int in_write;
+    volatile int errors;
+    volatile int writes;
+} test_state_t;
+
+static void reader_task(test_state_t *state)
+{
+    for (int i = 0; i < MRSW_LOCK_TEST_READER_ITERS; i++) {
+        if (mrsw_lock_reader_get(&state->lock, RTOS_OSAL_WAIT_FOREVER) != RTOS_OSAL_SUCCESS) {
+            state->errors++;
+            break;
+        }
+
+        if (mrsw_lock_reader_get(&state->lock, MRSW_LOCK_TEST_NESTED_TIMEOUT) != RTOS_OSAL_SUCCESS) {
+            local_printf("Nested read timed out on iteration %d", i);
+            state->errors++;
+        } else {
+            if (state->in_write) {
+                state->errors++;
+            }
+            mrsw_lock_reader_put(&state->lock);
+        }
+
+        mrsw_lock_reader_put(&state->lock);
+    }
+
+    taskENTER_CRITICAL();
+    {
+        state->readers_running--;
+    }
+    taskEXIT_CRITICAL();
+
+    rtos_osal_semaphore_put(&state->done);
+    vTaskDelete(NULL);
+}
+
+static void writer_task(test_state_t *state)
+{
+    while (state->readers_running > 0) {
+        if (mrsw_lock_writer_get(&state->lock, RTOS_OSAL_WAIT_FOREVER) != RTOS_OSAL_SUCCESS) {
+            state->errors++;
+            break;
+        }
+
+        state->in_write = 1;
+        state->writes++;
+        state->in_write = 0;
+
+        mrsw_lock_writer_put(&state->lock);
+        taskYIELD();
+    }
+
+    rtos_osal_semaphore_put(&state->done);
+    vTaskDelete(NULL);
+}
+
+MRSW_LOCK_MAIN_TEST_ATTR
+static int main_test(mrsw_lock_test_ctx_t *ctx)
+{
+    static test_state_t state;
+    const int task_count = MRSW_LOCK_TEST_READERS + 1;
+
+    local_printf("Start");
+
+    memset(&state, 0, sizeof(test_state_t));
+    state.readers_running = MRSW_LOCK_TEST_READERS;
+
+    if (mrsw_lock_create(&state.lock, "mrsw_test", MRSW_READER_PREFERRED) != RTOS_OSAL_SUCCESS) {
+        local_printf("Failed to create lock");
+        return -1;
+    }
+    rtos_osal_semaphore_create(&state.done, "mrsw_test_done", task_count, 0);
+
+    for (int i = 0; i < MRSW_LOCK_TEST_READERS; i++) {
+        xTaskCreate((TaskFunction_t) reader_task,
+                    "mrsw_reader",
+                    RTOS_THREAD_STACK_SIZE(reader_task),
+                    &state,
+                    MRSW_LOCK_TEST_TASK_PRIORITY,
+                    NULL);
+    }
+    xTaskCreate((TaskFunction_t) writer_task,
+                "mrsw_writer",
+                RTOS_THREAD_STACK_SIZE(writer_task),
+                &state,
+                MRSW_LOCK_TEST_TASK_PRIORITY,
+                NULL);
+
+    for (int i = 0; i < task_count; i++) {
+        rtos_osal_semaphore_get(&state.done, RTOS_OSAL_WAIT_FOREVER);
+    }
+
+    rtos_osal_semaphore_delete(&state.done);
+    mrsw_lock_delete(&state.lock);
+
+    local_printf("%d writes", state.writes);
+
+    if (state.errors != 0) {
+        local_printf("%d errors", state.errors);
+        return -1;
+    }
+
+    local_printf("Done");
+    return 0;
+}
+
+void register_mrsw_lock_nested_read_test(mrsw_lock_test_ctx_t *test_ctx)
+{
+    uint32_t this_test_num = test_ctx->test_cnt;
+
+    local_printf("Register to test num %d", this_test_num);
+
+    test_ctx->name[this_test_num] = (char*)test_name;
+    test_ctx->main_test[this_test_num] = main_test;
+
+    test_ctx->test_cnt++;
+}
+
+#undef local_printf
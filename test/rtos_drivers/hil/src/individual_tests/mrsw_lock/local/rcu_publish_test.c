@@ -0,0 +1,257 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+/* System headers */
+#include <platform.h>
+#include <xs1.h>
+#include <string.h>
+#include <xcore/hwtimer.h>
+
+/* FreeRTOS headers */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Library headers */
+#include "rtos_osal.h"
+#include "concurrency_support.h"
+
+/* App headers */
+#include "app_conf.h"
+#include "individual_tests/mrsw_lock/mrsw_lock_test.h"
+
+static const char* test_name = "rcu_publish_test";
+
+#define local_printf( FMT, ... )    mrsw_lock_printf("%s|" FMT, test_name, ##__VA_ARGS__)
+
+#define RCU_TEST_WRITER_CORE        0
+#define RCU_TEST_READERS            (configNUM_CORES - 1)
+#define RCU_TEST_WRITES             500
+#define RCU_TEST_WRITE_TIMEOUT      100
+#define RCU_TEST_HOLD_TICKS_MAX     800     /* Reference clock ticks */
+#define RCU_TEST_DATA_WORDS         8
+#define RCU_TEST_POISON             0xDEADBEEF
+#define RCU_TEST_TASK_PRIORITY      (configMAX_PRIORITIES/2)
+
+/*
+ * A writer task on one core publishes new data repeatedly, while a reader
+ * task on each of the other cores acquires the published data and holds it
+ * for a varying time. Before filling in a copy the writer poisons it, as
+ * if the copy had been freed and reused, so a reader that sees the data it
+ * acquired change before it releases it has found a copy that was reused
+ * during its grace period.
+ */
+typedef struct test_data {
+    uint32_t generation;
+    uint32_t words[RCU_TEST_DATA_WORDS];
+} test_data_t;
+
+typedef struct test_state {
+    rcu_publish_t publish;
+    rtos_osal_semaphore_t done;
+    volatile int writer_done;
+    volatile int errors;
+    volatile uint32_t acquires;
+} test_state_t;
+
+/* Returns non-zero if the data is not the whole of a single generation */
+static int data_check(const volatile test_data_t *data, uint32_t generation)
+{
+    if (data->generation != generation) {
+        return 1;
+    }
+    for (int j = 0; j < RCU_TEST_DATA_WORDS; j++) {
+        if (data->words[j] != generation) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void reader_task(test_state_t *state)
+{
+    uint32_t last = 0;
+    uint32_t acquires = 0;
+
+    while (!state->writer_done) {
+        const volatile test_data_t *data;
+        unsigned token;
+        uint32_t generation;
+        uint32_t start;
+
+        data = rcu_publish_acquire(&state->publish, &token);
+        generation = data->generation;
+
+        if (generation < last) {
+            state->errors++;
+        }
+        last = generation;
+
+        /* The data must not change until it is released */
+        start = get_reference_time();
+        do {
+            if (data_check(data, generation)) {
+                state->errors++;
+                break;
+            }
+        } while (get_reference_time() - start < (acquires % 8) * (RCU_TEST_HOLD_TICKS_MAX / 8));
+
+        rcu_publish_release(&state->publish, token);
+        acquires++;
+    }
+
+    taskENTER_CRITICAL();
+    {
+        state->acquires += acquires;
+    }
+    taskEXIT_CRITICAL();
+
+    rtos_osal_semaphore_put(&state->done);
+    vTaskDelete(NULL);
+}
+
+static void writer_task(test_state_t *state)
+{
+    for (uint32_t i = 1; i <= RCU_TEST_WRITES; i++) {
+        test_data_t *data = rcu_publish_write_begin(&state->publish, RCU_TEST_WRITE_TIMEOUT);
+
+        if (data == NULL) {
+            state->errors++;
+            break;
+        }
+
+        /* Starts as a copy of the published data */
+        if (data_check(data, i - 1)) {
+            state->errors++;
+        }
+
+        for (int j = 0; j < RCU_TEST_DATA_WORDS; j++) {
+            data->words[j] = RCU_TEST_POISON;
+        }
+        data->generation = RCU_TEST_POISON;
+
+        for (int j = 0; j < RCU_TEST_DATA_WORDS; j++) {
+            data->words[j] = i;
+        }
+        data->generation = i;
+
+        rcu_publish_write_end(&state->publish);
+    }
+
+    state->writer_done = 1;
+
+    rtos_osal_semaphore_put(&state->done);
+    vTaskDelete(NULL);
+}
+
+/*
+ * While a copy is held, the writer may publish the other copy, but must
+ * then time out waiting to write the held copy until it is released.
+ */
+static int grace_period_test(test_state_t *state)
+{
+    const test_data_t *held;
+    test_data_t *data;
+    unsigned token;
+    int retval = 0;
+
+    held = rcu_publish_acquire(&state->publish, &token);
+
+    data = rcu_publish_write_begin(&state->publish, RCU_TEST_WRITE_TIMEOUT);
+    if (data == NULL || data == held) {
+        local_printf("Could not write the copy that is not held");
+        rcu_publish_release(&state->publish, token);
+        return -1;
+    }
+    rcu_publish_write_end(&state->publish);
+
+    if (rcu_publish_write_begin(&state->publish, 1) != NULL) {
+        local_printf("Wrote the held copy");
+        retval = -1;
+    }
+
+    rcu_publish_release(&state->publish, token);
+
+    if (rcu_publish_write_begin(&state->publish, 0) != held) {
+        local_printf("Could not write the released copy");
+        retval = -1;
+    }
+
+    return retval;
+}
+
+MRSW_LOCK_MAIN_TEST_ATTR
+static int main_test(mrsw_lock_test_ctx_t *ctx)
+{
+    static test_state_t state;
+    const int task_count = RCU_TEST_READERS + 1;
+    TaskHandle_t task;
+    int core = 0;
+    int retval = 0;
+
+    local_printf("Start");
+
+    memset(&state, 0, sizeof(test_state_t));
+    if (rcu_publish_create(&state.publish, sizeof(test_data_t), NULL) != RTOS_OSAL_SUCCESS) {
+        local_printf("Failed to create publish object");
+        return -1;
+    }
+    rtos_osal_semaphore_create(&state.done, "rcu_test_done", task_count, 0);
+
+    /* Each reader runs on its own core, other than the writer's */
+    for (int i = 0; i < RCU_TEST_READERS; i++, core++) {
+        if (core == RCU_TEST_WRITER_CORE) {
+            core++;
+        }
+        xTaskCreate((TaskFunction_t) reader_task,
+                    "rcu_reader",
+                    RTOS_THREAD_STACK_SIZE(reader_task),
+                    &state,
+                    RCU_TEST_TASK_PRIORITY,
+                    &task);
+        vTaskCoreAffinitySet(task, 1 << core);
+    }
+    xTaskCreate((TaskFunction_t) writer_task,
+                "rcu_writer",
+                RTOS_THREAD_STACK_SIZE(writer_task),
+                &state,
+                RCU_TEST_TASK_PRIORITY,
+                &task);
+    vTaskCoreAffinitySet(task, 1 << RCU_TEST_WRITER_CORE);
+
+    for (int i = 0; i < task_count; i++) {
+        rtos_osal_semaphore_get(&state.done, RTOS_OSAL_WAIT_FOREVER);
+    }
+
+    local_printf("%d writes, %u acquires", RCU_TEST_WRITES, state.acquires);
+
+    if (state.errors != 0) {
+        local_printf("%d errors", state.errors);
+        retval = -1;
+    }
+
+    if (grace_period_test(&state) != 0) {
+        retval = -1;
+    }
+
+    rtos_osal_semaphore_delete(&state.done);
+    rcu_publish_delete(&state.publish);
+
+    if (retval == 0) {
+        local_printf("Done");
+    }
+    return retval;
+}
+
+void register_mrsw_lock_rcu_publish_test(mrsw_lock_test_ctx_t *test_ctx)
+{
+    uint32_t this_test_num = test_ctx->test_cnt;
+
+    local_printf("Register to test num %d", this_test_num);
+
+    test_ctx->name[this_test_num] = (char*)test_name;
+    test_ctx->main_test[this_test_num] = main_test;
+
+    test_ctx->test_cnt++;
+}
+
+#undef local_printf
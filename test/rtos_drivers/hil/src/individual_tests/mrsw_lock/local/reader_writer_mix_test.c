@@ -0,0 +1,213 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+/* System headers */
+#include <platform.h>
+#include <xs1.h>
+#include <string.h>
+#include <xcore/hwtimer.h>
+
+/* FreeRTOS headers */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Library headers */
+#include "rtos_osal.h"
+#include "concurrency_support.h"
+
+/* App headers */
+#include "app_conf.h"
+#include "individual_tests/mrsw_lock/mrsw_lock_test.h"
+
+static const char* test_name = "reader_writer_mix_test";
+
+#define local_printf( FMT, ... )    mrsw_lock_printf("%s|" FMT, test_name, ##__VA_ARGS__)
+
+#define MRSW_LOCK_TEST_READERS          4
+#define MRSW_LOCK_TEST_READER_ITERS     2000
+#define MRSW_LOCK_TEST_SHARED_WORDS     4
+#define MRSW_LOCK_TEST_TASK_PRIORITY    (configMAX_PRIORITIES/2)
+
+/*
+ * Each mix runs MRSW_LOCK_TEST_READERS reader tasks alongside a writer
+ * task that performs write_count writes, pausing for write_delay_ticks
+ * between each one.
+ */
+typedef struct test_mix {
+    const char *name;
+    mrsw_lock_type_t type;
+    int write_count;
+    int write_delay_ticks;
+} test_mix_t;
+
+static const test_mix_t test_mixes[] = {
+    {"read only, reader preferred", MRSW_READER_PREFERRED, 0,  0},
+    {"read only, writer preferred", MRSW_WRITER_PREFERRED, 0,  0},
+    {"few writes, reader preferred", MRSW_READER_PREFERRED, 10, 1},
+    {"few writes, writer preferred", MRSW_WRITER_PREFERRED, 10, 1},
+    {"many writes, reader preferred", MRSW_READER_PREFERRED, 500, 0},
+    {"many writes, writer preferred", MRSW_WRITER_PREFERRED, 500, 0},
+};
+
+typedef struct test_state {
+    mrsw_lock_t lock;
+    rtos_osal_semaphore_t done;
+    const test_mix_t *mix;
+    volatile uint32_t shared[MRSW_LOCK_TEST_SHARED_WORDS];
+    volatile int errors;
+    volatile uint32_t reader_ticks;
+    volatile uint32_t reader_ticks_max;
+} test_state_t;
+
+static void reader_task(test_state_t *state)
+{
+    uint32_t total = 0;
+    uint32_t max = 0;
+
+    for (int i = 0; i < MRSW_LOCK_TEST_READER_ITERS; i++) {
+        uint32_t start = get_reference_time();
+
+        if (mrsw_lock_reader_get(&state->lock, RTOS_OSAL_WAIT_FOREVER) != RTOS_OSAL_SUCCESS) {
+            state->errors++;
+            break;
+        }
+
+        /* The writer updates all of the words together */
+        for (int j = 1; j < MRSW_LOCK_TEST_SHARED_WORDS; j++) {
+            if (state->shared[j] != state->shared[0]) {
+                state->errors++;
+            }
+        }
+
+        mrsw_lock_reader_put(&state->lock);
+
+        uint32_t ticks = get_reference_time() - start;
+        total += ticks;
+        if (ticks > max) {
+            max = ticks;
+        }
+    }
+
+    taskENTER_CRITICAL();
+    {
+        state->reader_ticks += total;
+        if (max > state->reader_ticks_max) {
+            state->reader_ticks_max = max;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    rtos_osal_semaphore_put(&state->done);
+    vTaskDelete(NULL);
+}
+
+static void writer_task(test_state_t *state)
+{
+    for (int i = 0; i < state->mix->write_count; i++) {
+        if (mrsw_lock_writer_get(&state->lock, RTOS_OSAL_WAIT_FOREVER) != RTOS_OSAL_SUCCESS) {
+            state->errors++;
+            break;
+        }
+
+        for (int j = 0; j < MRSW_LOCK_TEST_SHARED_WORDS; j++) {
+            state->shared[j] = state->shared[j] + 1;
+        }
+
+        mrsw_lock_writer_put(&state->lock);
+
+        if (state->mix->write_delay_ticks > 0) {
+            vTaskDelay(state->mix->write_delay_ticks);
+        } else {
+            taskYIELD();
+        }
+    }
+
+    rtos_osal_semaphore_put(&state->done);
+    vTaskDelete(NULL);
+}
+
+static int run_mix(test_state_t *state, const test_mix_t *mix)
+{
+    const int task_count = MRSW_LOCK_TEST_READERS + 1;
+
+    memset(state, 0, sizeof(test_state_t));
+    state->mix = mix;
+
+    if (mrsw_lock_create(&state->lock, "mrsw_test", mix->type) != RTOS_OSAL_SUCCESS) {
+        local_printf("Failed to create lock");
+        return -1;
+    }
+    rtos_osal_semaphore_create(&state->done, "mrsw_test_done", task_count, 0);
+
+    for (int i = 0; i < MRSW_LOCK_TEST_READERS; i++) {
+        xTaskCreate((TaskFunction_t) reader_task,
+                    "mrsw_reader",
+                    RTOS_THREAD_STACK_SIZE(reader_task),
+                    state,
+                    MRSW_LOCK_TEST_TASK_PRIORITY,
+                    NULL);
+    }
+    xTaskCreate((TaskFunction_t) writer_task,
+                "mrsw_writer",
+                RTOS_THREAD_STACK_SIZE(writer_task),
+                state,
+                MRSW_LOCK_TEST_TASK_PRIORITY,
+                NULL);
+
+    for (int i = 0; i < task_count; i++) {
+        rtos_osal_semaphore_get(&state->done, RTOS_OSAL_WAIT_FOREVER);
+    }
+
+    local_printf("%s: %d writes, reader get/put mean %u max %u ref clock ticks",
+                 mix->name,
+                 mix->write_count,
+                 state->reader_ticks / (MRSW_LOCK_TEST_READERS * MRSW_LOCK_TEST_READER_ITERS),
+                 state->reader_ticks_max);
+
+    rtos_osal_semaphore_delete(&state->done);
+    mrsw_lock_delete(&state->lock);
+
+    if (state->errors != 0) {
+        local_printf("%s: %d errors", mix->name, state->errors);
+        return -1;
+    }
+
+    if (state->shared[0] != mix->write_count) {
+        local_printf("%s: got %u writes expected %d", mix->name, state->shared[0], mix->write_count);
+        return -1;
+    }
+
+    return 0;
+}
+
+MRSW_LOCK_MAIN_TEST_ATTR
+static int main_test(mrsw_lock_test_ctx_t *ctx)
+{
+    static test_state_t state;
+    int retval = 0;
+
+    local_printf("Start");
+
+    for (int i = 0; i < sizeof(test_mixes) / sizeof(test_mixes[0]); i++) {
+        if (run_mix(&state, &test_mixes[i]) != 0) {
+            retval = -1;
+        }
+    }
+
+    local_printf("Done");
+    return retval;
+}
+
+void register_mrsw_lock_reader_writer_mix_test(mrsw_lock_test_ctx_t *test_ctx)
+{
+    uint32_t this_test_num = test_ctx->test_cnt;
+
+    local_printf("Register to test num %d", this_test_num);
+
+    test_ctx->name[this_test_num] = (char*)test_name;
+    test_ctx->main_test[this_test_num] = main_test;
+
+    test_ctx->test_cnt++;
+}
+
+#undef local_printf
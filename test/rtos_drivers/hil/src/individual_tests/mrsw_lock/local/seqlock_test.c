@@ -0,0 +1,181 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+/* System headers */
+#include <platform.h>
+#include <xs1.h>
+#include <string.h>
+
+/* FreeRTOS headers */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Library headers */
+#include "rtos_osal.h"
+#include "concurrency_support.h"
+
+/* App headers */
+#include "app_conf.h"
+#include "individual_tests/mrsw_lock/mrsw_lock_test.h"
+
+static const char* test_name = "seqlock_test";
+
+#define local_printf( FMT, ... )    mrsw_lock_printf("%s|" FMT, test_name, ##__VA_ARGS__)
+
+#define SEQLOCK_TEST_WRITER_CORE    0
+#define SEQLOCK_TEST_READERS        (configNUM_CORES - 1)
+#define SEQLOCK_TEST_WRITES         100000
+#define SEQLOCK_TEST_SHARED_WORDS   32
+#define SEQLOCK_TEST_TASK_PRIORITY  (configMAX_PRIORITIES/2)
+
+/*
+ * A writer task on one core repeatedly writes a new value to each of the
+ * shared words in turn, while a reader task on each of the other cores
+ * copies them. A copy that seqlock_read_retry() accepts must have every
+ * word equal, and must never be older than the reader's previous copy.
+ */
+typedef struct test_state {
+    seqlock_t lock;
+    rtos_osal_semaphore_t done;
+    volatile uint32_t shared[SEQLOCK_TEST_SHARED_WORDS];
+    volatile int writer_done;
+    volatile int errors;
+    volatile uint32_t reads;
+    volatile uint32_t retries;
+} test_state_t;
+
+static void reader_task(test_state_t *state)
+{
+    uint32_t copy[SEQLOCK_TEST_SHARED_WORDS];
+    uint32_t last = 0;
+    uint32_t reads = 0;
+    uint32_t retries = 0;
+    int writer_done;
+
+    do {
+        uint32_t seq;
+
+        writer_done = state->writer_done;
+
+        seq = seqlock_read_begin(&state->lock);
+        for (;;) {
+            for (int j = 0; j < SEQLOCK_TEST_SHARED_WORDS; j++) {
+                copy[j] = state->shared[j];
+            }
+            if (!seqlock_read_retry(&state->lock, seq)) {
+                break;
+            }
+            retries++;
+            seq = seqlock_read_begin(&state->lock);
+        }
+
+        for (int j = 1; j < SEQLOCK_TEST_SHARED_WORDS; j++) {
+            if (copy[j] != copy[0]) {
+                state->errors++;
+                break;
+            }
+        }
+        if (copy[0] < last) {
+            state->errors++;
+        }
+        last = copy[0];
+        reads++;
+    } while (!writer_done);
+
+    /* The last read started after the writer finished, so must see its last write */
+    if (last != SEQLOCK_TEST_WRITES) {
+        state->errors++;
+    }
+
+    taskENTER_CRITICAL();
+    {
+        state->reads += reads;
+        state->retries += retries;
+    }
+    taskEXIT_CRITICAL();
+
+    rtos_osal_semaphore_put(&state->done);
+    vTaskDelete(NULL);
+}
+
+static void writer_task(test_state_t *state)
+{
+    for (uint32_t i = 1; i <= SEQLOCK_TEST_WRITES; i++) {
+        seqlock_write_begin(&state->lock);
+        for (int j = 0; j < SEQLOCK_TEST_SHARED_WORDS; j++) {
+            state->shared[j] = i;
+        }
+        seqlock_write_end(&state->lock);
+    }
+
+    state->writer_done = 1;
+
+    rtos_osal_semaphore_put(&state->done);
+    vTaskDelete(NULL);
+}
+
+MRSW_LOCK_MAIN_TEST_ATTR
+static int main_test(mrsw_lock_test_ctx_t *ctx)
+{
+    static test_state_t state;
+    const int task_count = SEQLOCK_TEST_READERS + 1;
+    TaskHandle_t task;
+    int core = 0;
+
+    local_printf("Start");
+
+    memset(&state, 0, sizeof(test_state_t));
+    seqlock_init(&state.lock);
+    rtos_osal_semaphore_create(&state.done, "seqlock_test_done", task_count, 0);
+
+    /* Each reader runs on its own core, other than the writer's */
+    for (int i = 0; i < SEQLOCK_TEST_READERS; i++, core++) {
+        if (core == SEQLOCK_TEST_WRITER_CORE) {
+            core++;
+        }
+        xTaskCreate((TaskFunction_t) reader_task,
+                    "seqlock_reader",
+                    RTOS_THREAD_STACK_SIZE(reader_task),
+                    &state,
+                    SEQLOCK_TEST_TASK_PRIORITY,
+                    &task);
+        vTaskCoreAffinitySet(task, 1 << core);
+    }
+    xTaskCreate((TaskFunction_t) writer_task,
+                "seqlock_writer",
+                RTOS_THREAD_STACK_SIZE(writer_task),
+                &state,
+                SEQLOCK_TEST_TASK_PRIORITY,
+                &task);
+    vTaskCoreAffinitySet(task, 1 << SEQLOCK_TEST_WRITER_CORE);
+
+    for (int i = 0; i < task_count; i++) {
+        rtos_osal_semaphore_get(&state.done, RTOS_OSAL_WAIT_FOREVER);
+    }
+
+    rtos_osal_semaphore_delete(&state.done);
+
+    local_printf("%d writes, %u reads, %u retries", SEQLOCK_TEST_WRITES, state.reads, state.retries);
+
+    if (state.errors != 0) {
+        local_printf("%d errors", state.errors);
+        return -1;
+    }
+
+    local_printf("Done");
+    return 0;
+}
+
+void register_mrsw_lock_seqlock_test(mrsw_lock_test_ctx_t *test_ctx)
+{
+    uint32_t this_test_num = test_ctx->test_cnt;
+
+    local_printf("Register to test num %d", this_test_num);
+
+    test_ctx->name[this_test_num] = (char*)test_name;
+    test_ctx->main_test[this_test_num] = main_test;
+
+    test_ctx->test_cnt++;
+}
+
+#undef local_printf
@@ -0,0 +1,73 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+/* System headers */
+#include <platform.h>
+#include <xs1.h>
+#include <string.h>
+
+/* FreeRTOS headers */
+#include "FreeRTOS.h"
+
+/* App headers */
+#include "app_conf.h"
+#include "individual_tests/mrsw_lock/mrsw_lock_test.h"
+
+static int run_mrsw_lock_tests(mrsw_lock_test_ctx_t *test_ctx, chanend_t c)
+{
+    int retval = 0;
+
+    do
+    {
+        sync(c);
+        if (test_ctx->main_test[test_ctx->cur_test] != NULL)
+        {
+            MRSW_LOCK_MAIN_TEST_ATTR mrsw_lock_main_test_t fn;
+            fn = test_ctx->main_test[test_ctx->cur_test];
+            int tmp = fn(test_ctx);
+            retval = (retval != -1) ? tmp : retval;
+        } else {
+            mrsw_lock_printf("Missing main_test callback on test %d", test_ctx->cur_test);
+            retval = -1;
+        }
+    } while (++test_ctx->cur_test < test_ctx->test_cnt);
+
+    return retval;
+}
+
+static void register_mrsw_lock_tests(mrsw_lock_test_ctx_t *test_ctx)
+{
+    register_mrsw_lock_reader_writer_mix_test(test_ctx);
+    register_mrsw_lock_nested_read_test(test_ctx);
+    register_mrsw_lock_seqlock_test(test_ctx);
+    register_mrsw_lock_rcu_publish_test(test_ctx);
+}
+
+static void mrsw_lock_init_tests(mrsw_lock_test_ctx_t *test_ctx)
+{
+    memset(test_ctx, 0, sizeof(mrsw_lock_test_ctx_t));
+
+    test_ctx->cur_test = 0;
+    test_ctx->test_cnt = 0;
+
+    register_mrsw_lock_tests(test_ctx);
+    configASSERT(test_ctx->test_cnt <= MRSW_LOCK_MAX_TESTS);
+}
+
+int mrsw_lock_device_tests(chanend_t c)
+{
+    mrsw_lock_test_ctx_t test_ctx;
+    int res = 0;
+
+    sync(c);
+    mrsw_lock_printf("Init test context");
+    mrsw_lock_init_tests(&test_ctx);
+    mrsw_lock_printf("Test context init");
+
+    sync(c);
+    mrsw_lock_printf("Start tests");
+    res = run_mrsw_lock_tests(&test_ctx, c);
+
+    sync(c);   // Sync before return
+    return res;
+}
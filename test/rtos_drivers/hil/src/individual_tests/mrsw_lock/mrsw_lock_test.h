@@ -0,0 +1,35 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef MRSW_LOCK_TEST_H_
+#define MRSW_LOCK_TEST_H_
+
+#include "rtos_test/rtos_test_utils.h"
+
+#define mrsw_lock_printf( FMT, ... )       module_printf("MRSW_LOCK", FMT, ##__VA_ARGS__)
+
+#define MRSW_LOCK_MAX_TESTS   4
+
+#define MRSW_LOCK_MAIN_TEST_ATTR      __attribute__((fptrgroup("rtos_test_mrsw_lock_main_test_fptr_grp")))
+
+typedef struct mrsw_lock_test_ctx mrsw_lock_test_ctx_t;
+
+struct mrsw_lock_test_ctx {
+    uint32_t cur_test;
+    uint32_t test_cnt;
+    char *name[MRSW_LOCK_MAX_TESTS];
+
+    MRSW_LOCK_MAIN_TEST_ATTR int (*main_test[MRSW_LOCK_MAX_TESTS])(mrsw_lock_test_ctx_t *ctx);
+};
+
+typedef int (*mrsw_lock_main_test_t)(mrsw_lock_test_ctx_t *ctx);
+
+int mrsw_lock_device_tests(chanend_t c);
+
+/* Local Tests */
+void register_mrsw_lock_reader_writer_mix_test(mrsw_lock_test_ctx_t *test_ctx);
+void register_mrsw_lock_nested_read_test(mrsw_lock_test_ctx_t *test_ctx);
+void register_mrsw_lock_seqlock_test(mrsw_lock_test_ctx_t *test_ctx);
+void register_mrsw_lock_rcu_publish_test(mrsw_lock_test_ctx_t *test_ctx);
+
+#endif /* MRSW_LOCK_TEST_H_ */
@@ -0,0 +1,149 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+/* System headers */
+#include <platform.h>
+#include <xs1.h>
+#include <string.h>
+#include <xcore/hwtimer.h>
+
+/* FreeRTOS headers */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Library headers */
+#include "rtos_osal.h"
+#include "rtos_support.h"
+
+/* App headers */
+#include "app_conf.h"
+#include "individual_tests/rtos_irq/rtos_irq_test.h"
+
+static const char* test_name = "ipi_rate_test";
+
+#define local_printf( FMT, ... )    rtos_irq_printf("%s|" FMT, test_name, ##__VA_ARGS__)
+
+#define IPI_RATE_TEST_DURATION_TICKS    (100 * 1000 * 100)  /* 100 ms of the 100 MHz reference clock */
+#define IPI_RATE_TEST_TASK_PRIORITY     (configMAX_PRIORITIES/2)
+
+typedef struct test_state {
+    rtos_osal_semaphore_t done;
+    uint32_t deadline;
+    volatile uint32_t irq_count;
+    volatile uint32_t irq_ticks;
+} test_state_t;
+
+/*
+ * Repeatedly sends yield IRQs from whichever core this task is running
+ * on to each of the other RTOS cores in turn until the deadline passes.
+ */
+static void sender_task(test_state_t *state)
+{
+    const int num_cores = rtos_core_count();
+    uint32_t count = 0;
+    uint32_t ticks = 0;
+    int target = 0;
+
+    while ((int32_t) (get_reference_time() - state->deadline) < 0) {
+        uint32_t mask;
+        uint32_t start;
+        int core_id;
+
+        /* The source ID must be the core that rtos_irq() is called on */
+        mask = rtos_interrupt_mask_all();
+        core_id = rtos_core_id_get();
+        target = (target + 1) % num_cores;
+        if (target == core_id) {
+            target = (target + 1) % num_cores;
+        }
+
+        start = get_reference_time();
+        rtos_irq(target, core_id);
+        ticks += get_reference_time() - start;
+        rtos_interrupt_mask_set(mask);
+
+        count++;
+    }
+
+    taskENTER_CRITICAL();
+    {
+        state->irq_count += count;
+        state->irq_ticks += ticks;
+    }
+    taskEXIT_CRITICAL();
+
+    rtos_osal_semaphore_put(&state->done);
+    vTaskDelete(NULL);
+}
+
+static int run_senders(test_state_t *state, int sender_count)
+{
+    memset(state, 0, sizeof(test_state_t));
+    rtos_osal_semaphore_create(&state->done, "ipi_test_done", sender_count, 0);
+    state->deadline = get_reference_time() + IPI_RATE_TEST_DURATION_TICKS;
+
+    for (int i = 0; i < sender_count; i++) {
+        xTaskCreate((TaskFunction_t) sender_task,
+                    "ipi_sender",
+                    RTOS_THREAD_STACK_SIZE(sender_task),
+                    state,
+                    IPI_RATE_TEST_TASK_PRIORITY,
+                    NULL);
+    }
+
+    for (int i = 0; i < sender_count; i++) {
+        rtos_osal_semaphore_get(&state->done, RTOS_OSAL_WAIT_FOREVER);
+    }
+    rtos_osal_semaphore_delete(&state->done);
+
+    if (state->irq_count == 0) {
+        local_printf("%d senders: no IRQs were sent", sender_count);
+        return -1;
+    }
+
+    local_printf("%d senders: %u IRQs/s, rtos_irq() mean %u ref clock ticks",
+                 sender_count,
+                 state->irq_count * (100000000 / IPI_RATE_TEST_DURATION_TICKS),
+                 state->irq_ticks / state->irq_count);
+
+    return 0;
+}
+
+RTOS_IRQ_MAIN_TEST_ATTR
+static int main_test(rtos_irq_test_ctx_t *ctx)
+{
+    static test_state_t state;
+    int retval = 0;
+
+    local_printf("Start");
+
+    if (rtos_core_count() < 2) {
+        local_printf("Skipped, at least 2 RTOS cores are required");
+        return 0;
+    }
+
+    /* Uncontended, then with a sender for every RTOS core */
+    if (run_senders(&state, 1) != 0) {
+        retval = -1;
+    }
+    if (run_senders(&state, rtos_core_count()) != 0) {
+        retval = -1;
+    }
+
+    local_printf("Done");
+    return retval;
+}
+
+void register_rtos_irq_ipi_rate_test(rtos_irq_test_ctx_t *test_ctx)
+{
+    uint32_t this_test_num = test_ctx->test_cnt;
+
+    local_printf("Register to test num %d", this_test_num);
+
+    test_ctx->name[this_test_num] = (char*)test_name;
+    test_ctx->main_test[this_test_num] = main_test;
+
+    test_ctx->test_cnt++;
+}
+
+#undef local_printf
@@ -0,0 +1,70 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+/* System headers */
+#include <platform.h>
+#include <xs1.h>
+#include <string.h>
+
+/* FreeRTOS headers */
+#include "FreeRTOS.h"
+
+/* App headers */
+#include "app_conf.h"
+#include "individual_tests/rtos_irq/rtos_irq_test.h"
+
+static int run_rtos_irq_tests(rtos_irq_test_ctx_t *test_ctx, chanend_t c)
+{
+    int retval = 0;
+
+    do
+    {
+        sync(c);
+        if (test_ctx->main_test[test_ctx->cur_test] != NULL)
+        {
+            RTOS_IRQ_MAIN_TEST_ATTR rtos_irq_main_test_t fn;
+            fn = test_ctx->main_test[test_ctx->cur_test];
+            int tmp = fn(test_ctx);
+            retval = (retval != -1) ? tmp : retval;
+        } else {
+            rtos_irq_printf("Missing main_test callback on test %d", test_ctx->cur_test);
+            retval = -1;
+        }
+    } while (++test_ctx->cur_test < test_ctx->test_cnt);
+
+    return retval;
+}
+
+static void register_rtos_irq_tests(rtos_irq_test_ctx_t *test_ctx)
+{
+    register_rtos_irq_ipi_rate_test(test_ctx);
+}
+
+static void rtos_irq_init_tests(rtos_irq_test_ctx_t *test_ctx)
+{
+    memset(test_ctx, 0, sizeof(rtos_irq_test_ctx_t));
+
+    test_ctx->cur_test = 0;
+    test_ctx->test_cnt = 0;
+
+    register_rtos_irq_tests(test_ctx);
+    configASSERT(test_ctx->test_cnt <= RTOS_IRQ_MAX_TESTS);
+}
+
+int rtos_irq_device_tests(chanend_t c)
+{
+    rtos_irq_test_ctx_t test_ctx;
+    int res = 0;
+
+    sync(c);
+    rtos_irq_printf("Init test context");
+    rtos_irq_init_tests(&test_ctx);
+    rtos_irq_printf("Test context init");
+
+    sync(c);
+    rtos_irq_printf("Start tests");
+    res = run_rtos_irq_tests(&test_ctx, c);
+
+    sync(c);   // Sync before return
+    return res;
+}
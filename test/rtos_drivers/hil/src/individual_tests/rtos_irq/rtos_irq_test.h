@@ -0,0 +1,32 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef RTOS_IRQ_TEST_H_
+#define RTOS_IRQ_TEST_H_
+
+#include "rtos_test/rtos_test_utils.h"
+
+#define rtos_irq_printf( FMT, ... )       module_printf("RTOS_IRQ", FMT, ##__VA_ARGS__)
+
+#define RTOS_IRQ_MAX_TESTS   1
+
+#define RTOS_IRQ_MAIN_TEST_ATTR      __attribute__((fptrgroup("rtos_test_rtos_irq_main_test_fptr_grp")))
+
+typedef struct rtos_irq_test_ctx rtos_irq_test_ctx_t;
+
+struct rtos_irq_test_ctx {
+    uint32_t cur_test;
+    uint32_t test_cnt;
+    char *name[RTOS_IRQ_MAX_TESTS];
+
+    RTOS_IRQ_MAIN_TEST_ATTR int (*main_test[RTOS_IRQ_MAX_TESTS])(rtos_irq_test_ctx_t *ctx);
+};
+
+typedef int (*rtos_irq_main_test_t)(rtos_irq_test_ctx_t *ctx);
+
+int rtos_irq_device_tests(chanend_t c);
+
+/* Local Tests */
+void register_rtos_irq_ipi_rate_test(rtos_irq_test_ctx_t *test_ctx);
+
+#endif /* RTOS_IRQ_TEST_H_ */
@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 /* System headers */
@@ -140,6 +140,28 @@ void vApplicationDaemonTaskStartup(void *arg)
         test_printf("SKIP MIC_ARRAY");
     }
 
+    if (RUN_MRSW_LOCK_TESTS) {
+        if (mrsw_lock_device_tests(other_tile_c) != 0)
+        {
+            test_printf("FAIL MRSW_LOCK");
+        } else {
+            test_printf("PASS MRSW_LOCK");
+        }
+    } else {
+        test_printf("SKIP MRSW_LOCK");
+    }
+
+    if (RUN_RTOS_IRQ_TESTS) {
+        if (rtos_irq_device_tests(other_tile_c) != 0)
+        {
+            test_printf("FAIL RTOS_IRQ");
+        } else {
+            test_printf("PASS RTOS_IRQ");
+        }
+    } else {
+        test_printf("SKIP RTOS_IRQ");
+    }
+
     _Exit(0);
 
     chanend_free(other_tile_c);
@@ -19,6 +19,7 @@ mkdir -p ${DIST_DIR}
 applications=(
     "fatfs_mkimage   tools/fatfs_mkimage"
     "datapartition_mkimage   tools/datapartition_mkimage"
+    "wf200_mkimage   tools/wf200_mkimage"
 )
 
 # perform builds
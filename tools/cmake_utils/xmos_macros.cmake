@@ -1,5 +1,7 @@
 include_guard(DIRECTORY)
 
+set(RTOS_PRINTF_DECODE_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/../rtos_printf/rtos_printf_decode.py)
+
 ## merge_binaries combines multiple xcore applications into one by extracting
 ## a tile elf and recombining it into another binary.
 ##
@@ -88,6 +90,30 @@ macro(create_debug_target _EXECUTABLE_TARGET_NAME)
     )
 endmacro()
 
+## Creates a target that extracts the rtos_printf format string table of each
+## tile of a provided binary. These are used to decode the messages sent when
+## RTOS_PRINTF_DEFERRED_BINARY is set, with tools/rtos_printf/rtos_printf_decode.py.
+##   The tables are named <_EXECUTABLE_TARGET_NAME>_tile<N>_printf.json
+macro(create_printf_table_target _EXECUTABLE_TARGET_NAME)
+    find_package(Python3 COMPONENTS Interpreter REQUIRED)
+    add_custom_target(printf_table_${_EXECUTABLE_TARGET_NAME} ALL
+      COMMAND ${CMAKE_COMMAND} -E make_directory ${_EXECUTABLE_TARGET_NAME}_printf_split
+      COMMAND xobjdump --split --split-dir ${_EXECUTABLE_TARGET_NAME}_printf_split ${_EXECUTABLE_TARGET_NAME}.xe > ${_EXECUTABLE_TARGET_NAME}_printf_split/output.log
+      COMMAND ${Python3_EXECUTABLE} ${RTOS_PRINTF_DECODE_SCRIPT} extract ${_EXECUTABLE_TARGET_NAME}_printf_split/image_n0c0_2.elf -o ${_EXECUTABLE_TARGET_NAME}_tile0_printf.json
+      COMMAND ${Python3_EXECUTABLE} ${RTOS_PRINTF_DECODE_SCRIPT} extract ${_EXECUTABLE_TARGET_NAME}_printf_split/image_n0c1_2.elf -o ${_EXECUTABLE_TARGET_NAME}_tile1_printf.json
+      DEPENDS ${_EXECUTABLE_TARGET_NAME}
+      BYPRODUCTS
+        ${_EXECUTABLE_TARGET_NAME}_tile0_printf.json
+        ${_EXECUTABLE_TARGET_NAME}_tile1_printf.json
+      COMMENT
+        "Extract rtos_printf format strings"
+      VERBATIM
+    )
+    set_target_properties(printf_table_${_EXECUTABLE_TARGET_NAME} PROPERTIES
+      ADDITIONAL_CLEAN_FILES ${_EXECUTABLE_TARGET_NAME}_printf_split
+    )
+endmacro()
+
 ## Creates a filesystem file for a provided binary
 ##   filename must end in "_fat.fs"
 ## Optional arguments can be used to specify other dependency targets, such as filesystem generators
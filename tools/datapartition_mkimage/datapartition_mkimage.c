@@ -1,4 +1,4 @@
-// Copyright 2023 XMOS LIMITED.
+// Copyright 2023-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <stdio.h>
@@ -9,7 +9,10 @@
 #include <limits.h>
 #include <string.h>
 
-#define VERSION "1.0.3"
+#include "data_partition_format.h"
+#include "lz4_block.h"
+
+#define VERSION "1.1.0"
 
 // Abstractions for portability
 #ifdef __GNUC__
@@ -58,12 +61,14 @@ typedef enum error_code {
     ERROR_ARG_UNKOWN,
     ERROR_ARG_ORDER,
     ERROR_ARG_SINGLE_INSTANCE,
+    ERROR_ARG_EXCLUSIVE,
     ERROR_ARG_VALUE_MISSING,
     ERROR_ARG_VALUE_PARSING_FAILURE,
     ERROR_ARG_VALUE_OUT_OF_RANGE,
     ERROR_FILE_SYSTEM,
     ERROR_OUT_OF_RESOURCES,
-    ERROR_OVERLAPPING_INPUT_DATA
+    ERROR_OVERLAPPING_INPUT_DATA,
+    ERROR_INVALID_INPUT_DATA
 } error_code_t;
 
 typedef enum log_level {
@@ -78,6 +83,17 @@ typedef struct file_entry {
     uint32_t offset;
 } file_entry_t;
 
+typedef struct table_entry {
+    char *filename;
+    bool lz4;
+    char name[DATA_PARTITION_NAME_LEN];
+    uint8_t *data;
+    uint32_t size;
+    uint8_t *stored;
+    uint32_t stored_size;
+    uint32_t offset;
+} table_entry_t;
+
 /*
  * The available command line argument flags/options.
  */
@@ -90,6 +106,8 @@ static const char *seek_arg[] = { "-s", "--seek" };
 static const char *block_size_arg[] = { "-b", "--block-size" };
 static const char *fill_byte_arg[] = { "-f", "--fill-byte" };
 static const char *truncate_arg[] = { "-t", "--truncate" };
+static const char *partition_table_arg[] = { "-p", "--partition-table" };
+static const char *align_arg[] = { "-a", "--align" };
 
 /*
  * Variables set by command line arguments.
@@ -103,8 +121,11 @@ static uint32_t block_size = 512;
 static uint8_t fill_value = 0xFF;
 static file_entry_t *input_files = NULL;
 static bool truncate_out_file = false;
+static table_entry_t *table_files = NULL;
+static uint32_t table_alignment = 4096;
 
 static int input_file_count = 0;
+static int table_file_count = 0;
 
 static void print_help(char *arg0)
 {
@@ -114,8 +135,11 @@ static void print_help(char *arg0)
            arg0);
     printf("    cat <IN_FILE> | %s [-v] [-s <N>] [-b <BSIZE>] [-t] [-i <IN_FILE>:<N> ...] -o <OUT_FILE>\n\n",
            arg0);
+    printf("    %s [-v] [-a <ALIGN>] [-f <FBYTE>] -p <IN_FILE>[:lz4] [<IN_FILE>[:lz4] ...] -o <OUT_FILE>\n\n",
+           arg0);
     printf("Data partition image creation tool.\n\n");
-    printf("A utility for copying binary data from one or more files into another.\n\n");
+    printf("A utility for copying binary data from one or more files into another,\n"
+           "or for creating a data partition table of one or more files.\n\n");
     printf("Options:\n");
     printf("    -h, --help                  This help menu.\n");
     printf("        --version               Print the version of this tool.\n");
@@ -140,6 +164,18 @@ static void print_help(char *arg0)
            "                                the filename. N is the offset in blocks, of size\n"
            "                                BSIZE, to start writing to in OUT_FILE. Multiple\n"
            "                                input files are to be separated by a space.\n");
+    printf("    -p, --partition-table <IN_FILE>[:lz4]\n"
+           "                                The file(s) to create a data partition table\n"
+           "                                of, which replaces the contents of OUT_FILE.\n"
+           "                                The table lists the name, offset, size and\n"
+           "                                CRC-32 of each file, and is followed by the\n"
+           "                                data of each file. Files suffixed with :lz4\n"
+           "                                are stored with LZ4 compression. Each entry\n"
+           "                                is named after its file, without the path.\n"
+           "                                Can not be used with --in-file or stdin.\n");
+    printf("    -a, --align <ALIGN>         The alignment in bytes of the data of each\n"
+           "                                partition table entry. This is normally the\n"
+           "                                flash erase block size. Default = 4096.\n");
     printf("    -o, --out-file <OUT_FILE>   The file to write the output to. If the file\n"
            "                                already exists, the state of the file will be\n"
            "                                used; regions where the input data is being\n"
@@ -201,6 +237,11 @@ static error_code_t write_arg_error(error_code_t error_code, ...)
         printf(ERR_STR "%s : Argument must only be specified once.\n",
                va_arg(args, char *));
         break;
+    case ERROR_ARG_EXCLUSIVE:
+        printf(ERR_STR "%s : ", va_arg(args, char *));
+        printf("Argument can not be used with %s.\n",
+               va_arg(args, char *));
+        break;
     default:
         printf(ERR_STR "Application encountered an error (%d).\n",
                error_code);
@@ -390,6 +431,7 @@ static error_code_t process_args(int argc, char *argv[])
     bool in_file_piped = false;
     bool in_file_present = false;
     bool out_file_present = false;
+    bool table_present = false;
 
     in_file_piped = !ISATTY(FILENO(stdin));
 
@@ -517,11 +559,74 @@ static error_code_t process_args(int argc, char *argv[])
             }
 
             fill_value = (uint8_t)tmp;
+        } else if (is_matching_arg(argv[i], partition_table_arg,
+                                   NUM_ELEMS(partition_table_arg))) {
+            if (table_present) {
+                return write_arg_error(ERROR_ARG_SINGLE_INSTANCE, argv[i]);
+            }
+
+            table_file_count = num_arg_values(argc, argv, i);
+            if (table_file_count == 0) {
+                return write_arg_error(ERROR_ARG_VALUE_MISSING, argv[i]);
+            } else if (table_file_count > UINT16_MAX) {
+                return write_arg_error(ERROR_ARG_VALUE_OUT_OF_RANGE,
+                                       partition_table_arg[0], argv[i + 1]);
+            }
+
+            table_files = calloc(table_file_count, sizeof(table_entry_t));
+            if (table_files == NULL)
+                return ERROR_OUT_OF_RESOURCES;
+
+            /* Parse each argument in the form of "<FILENAME>[:lz4]". */
+            for (int j = 0; j < table_file_count; j++) {
+                next_arg_value(argc, argv, &i);
+
+                char *token = strrchr(argv[i], ':');
+
+                if ((token != NULL) && (strcmp(token, ":lz4") == 0)) {
+                    *token = '\0';
+                    table_files[j].lz4 = true;
+                }
+                table_files[j].filename = argv[i];
+            }
+
+            table_present = true;
+        } else if (is_matching_arg(argv[i], align_arg, NUM_ELEMS(align_arg))) {
+            if (next_arg_value(argc, argv, &i) != ERROR_NONE)
+                return ERROR_ARG_VALUE_MISSING;
+
+            if (!parse_number(argv[i], &tmp)) {
+                return write_arg_error(ERROR_ARG_VALUE_PARSING_FAILURE,
+                                       align_arg[0], argv[i]);
+            }
+
+            if ((tmp <= 0) || (tmp > UINT32_MAX)) {
+                return write_arg_error(ERROR_ARG_VALUE_OUT_OF_RANGE,
+                                       align_arg[0], argv[i]);
+            }
+
+            table_alignment = (uint32_t)tmp;
         } else {
             return write_arg_error(ERROR_ARG_UNKOWN, argv[i]);
         }
     }
 
+    if (table_present) {
+        /* The partition table replaces the whole output file, so it can not
+         * be combined with other input. Piped stdin is ignored. */
+        if (in_file_present) {
+            return write_arg_error(ERROR_ARG_EXCLUSIVE,
+                                   partition_table_arg[0], input_file_arg[0]);
+        }
+
+        if (!out_file_present) {
+            write_log(LOG_ERR, "Missing required %s argument.\n", output_file_arg[0]);
+            return ERROR_ARG_MISSING;
+        }
+
+        return ERROR_NONE;
+    }
+
     if (in_file_piped) {
         /* If "--in-file" was specified, space should have been
          * pre-allocated for "in_file_piped". Simply update the
@@ -553,6 +658,220 @@ static error_code_t process_args(int argc, char *argv[])
     }
 }
 
+static void put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t value)
+{
+    put_u16(p, value & 0xFFFF);
+    put_u16(p + 2, value >> 16);
+}
+
+static error_code_t table_entry_read(table_entry_t *entry)
+{
+    FILE *file = NULL;
+    const char *name = entry->filename;
+    long size;
+
+    FOPEN(file, entry->filename, "rb");
+    if (file == NULL) {
+        write_log(LOG_ERR, "Failed to open file (%s).\n", entry->filename);
+        return ERROR_FILE_SYSTEM;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    if ((size < 0) || ((unsigned long)size > UINT32_MAX)) {
+        write_log(LOG_ERR, "File is too large (%s).\n", entry->filename);
+        fclose(file);
+        return ERROR_INVALID_INPUT_DATA;
+    }
+
+    entry->size = (uint32_t)size;
+    entry->data = malloc(size > 0 ? size : 1);
+    if (entry->data == NULL) {
+        fclose(file);
+        return ERROR_OUT_OF_RESOURCES;
+    }
+
+    if (FREAD(entry->data, entry->size, 1, entry->size, file) != entry->size) {
+        write_log(LOG_ERR, "Failed to read file (%s).\n", entry->filename);
+        fclose(file);
+        return ERROR_FILE_SYSTEM;
+    }
+    fclose(file);
+
+    /* The entry is named after the file, without its path. */
+    for (const char *p = entry->filename; *p != '\0'; p++) {
+        if ((*p == '/') || (*p == '\\'))
+            name = p + 1;
+    }
+
+    if (strlen(name) >= DATA_PARTITION_NAME_LEN) {
+        write_log(LOG_WRN, "Entry name truncated to %d characters (%s).\n",
+                  DATA_PARTITION_NAME_LEN - 1, name);
+    }
+    strncpy(entry->name, name, DATA_PARTITION_NAME_LEN - 1);
+
+    return ERROR_NONE;
+}
+
+/*
+ * Compresses an entry a chunk at a time, so that the device can decompress
+ * it with a buffer of a single chunk. Chunks that do not get smaller are
+ * stored uncompressed.
+ */
+static error_code_t table_entry_compress(table_entry_t *entry)
+{
+    uint32_t chunk_count = (entry->size + DATA_PARTITION_CHUNK_SIZE - 1) / DATA_PARTITION_CHUNK_SIZE;
+    uint32_t stored_size = 0;
+
+    entry->stored = malloc(entry->size + chunk_count * sizeof(uint32_t) + 1);
+    if (entry->stored == NULL)
+        return ERROR_OUT_OF_RESOURCES;
+
+    for (uint32_t pos = 0; pos < entry->size; pos += DATA_PARTITION_CHUNK_SIZE) {
+        uint32_t len = entry->size - pos;
+        uint8_t *word = &entry->stored[stored_size];
+        uint8_t *chunk = word + sizeof(uint32_t);
+        size_t n;
+
+        if (len > DATA_PARTITION_CHUNK_SIZE)
+            len = DATA_PARTITION_CHUNK_SIZE;
+
+        n = lz4_block_compress(&entry->data[pos], len, chunk, len - 1);
+        if (n == 0) {
+            memcpy(chunk, &entry->data[pos], len);
+            put_u32(word, DATA_PARTITION_CHUNK_RAW | len);
+            n = len;
+        } else {
+            put_u32(word, (uint32_t)n);
+        }
+
+        stored_size += sizeof(uint32_t) + (uint32_t)n;
+    }
+
+    entry->stored_size = stored_size;
+
+    return ERROR_NONE;
+}
+
+static error_code_t write_partition_table(FILE *out_file)
+{
+    size_t table_size = table_file_count * sizeof(data_partition_entry_t);
+    uint8_t header[sizeof(data_partition_header_t)];
+    uint8_t *table;
+    uint64_t offset;
+    error_code_t exit_code = ERROR_NONE;
+
+    for (int i = 0; i < table_file_count; i++) {
+        table_entry_t *entry = &table_files[i];
+
+        if ((exit_code = table_entry_read(entry)) != ERROR_NONE)
+            return exit_code;
+
+        for (int j = 0; j < i; j++) {
+            if (strcmp(table_files[j].name, entry->name) == 0) {
+                write_log(LOG_ERR, "Duplicate entry name (%s).\n", entry->name);
+                return ERROR_INVALID_INPUT_DATA;
+            }
+        }
+
+        if (entry->lz4) {
+            if ((exit_code = table_entry_compress(entry)) != ERROR_NONE)
+                return exit_code;
+        } else {
+            entry->stored_size = entry->size;
+        }
+    }
+
+    table = calloc(1, table_size);
+    if (table == NULL)
+        return ERROR_OUT_OF_RESOURCES;
+
+    /* Lay out the data of each entry after the table, aligned. */
+    offset = sizeof(header) + table_size;
+
+    for (int i = 0; i < table_file_count; i++) {
+        table_entry_t *entry = &table_files[i];
+        uint8_t *p = &table[i * sizeof(data_partition_entry_t)];
+
+        offset = ((offset + table_alignment - 1) / table_alignment) * table_alignment;
+        if (offset + entry->stored_size > UINT32_MAX) {
+            write_log(LOG_ERR, "Partition table exceeds 4 GiB.\n");
+            free(table);
+            return ERROR_INVALID_INPUT_DATA;
+        }
+        entry->offset = (uint32_t)offset;
+        offset += entry->stored_size;
+
+        memcpy(p, entry->name, DATA_PARTITION_NAME_LEN);
+        p += DATA_PARTITION_NAME_LEN;
+        put_u32(&p[0], entry->offset);
+        put_u32(&p[4], entry->stored_size);
+        put_u32(&p[8], entry->size);
+        put_u32(&p[12], data_partition_crc32(0, entry->data, entry->size));
+        put_u32(&p[16], entry->lz4 ? DATA_PARTITION_ENTRY_LZ4 : 0);
+    }
+
+    put_u32(&header[0], DATA_PARTITION_MAGIC);
+    put_u16(&header[4], DATA_PARTITION_VERSION);
+    put_u16(&header[6], (uint16_t)table_file_count);
+    put_u32(&header[8], table_alignment);
+    put_u32(&header[12], DATA_PARTITION_CHUNK_SIZE);
+    put_u32(&header[16], data_partition_crc32(0, table, table_size));
+    put_u32(&header[20], data_partition_crc32(0, header, 20));
+
+    fwrite(header, 1, sizeof(header), out_file);
+    fwrite(table, 1, table_size, out_file);
+    free(table);
+
+    write_log(LOG_INF, "Offset\t\tSize\t\tStored\t\tName\n");
+    write_log(LOG_INF, "--------------------------------------------------------\n");
+
+    for (int i = 0; i < table_file_count && exit_code == ERROR_NONE; i++) {
+        table_entry_t *entry = &table_files[i];
+
+        exit_code = fill_data(out_file, entry->offset - ftell(out_file));
+        if (exit_code == ERROR_NONE) {
+            const uint8_t *data = entry->lz4 ? entry->stored : entry->data;
+
+            if (fwrite(data, 1, entry->stored_size, out_file) != entry->stored_size)
+                exit_code = ERROR_FILE_SYSTEM;
+        }
+
+        write_log(LOG_INF, "0x%08X\t%u\t\t%u\t\t%s\n",
+                  entry->offset,
+                  entry->size,
+                  entry->stored_size,
+                  entry->name);
+    }
+
+    if (exit_code == ERROR_NONE) {
+        write_log(LOG_INF, "\nFilesize (new): %ld Bytes\n", ftell(out_file));
+    } else if (exit_code == ERROR_OUT_OF_RESOURCES) {
+        write_log(LOG_ERR, "Failed to allocate memory.\n");
+    } else {
+        write_log(LOG_ERR, "Failed to write file (%s).\n", output_filename);
+    }
+
+    return exit_code;
+}
+
+static void free_partition_table(void)
+{
+    for (int i = 0; i < table_file_count; i++) {
+        free(table_files[i].data);
+        free(table_files[i].stored);
+    }
+    free(table_files);
+}
+
 static int fpeek(FILE *in_file)
 {
     int c = fgetc(in_file);
@@ -579,6 +898,24 @@ int main(int argc, char *argv[])
         if (input_files)
             free(input_files);
 
+        if (table_files)
+            free_partition_table();
+
+        return exit_code;
+    }
+
+    if (table_files) {
+        FOPEN(out_file, output_filename, "wb");
+
+        if (out_file == NULL) {
+            write_log(LOG_ERR, "Failed to open file (%s).\n", output_filename);
+            exit_code = ERROR_FILE_SYSTEM;
+        } else {
+            exit_code = write_partition_table(out_file);
+            fclose(out_file);
+        }
+
+        free_partition_table();
         return exit_code;
     }
 
@@ -0,0 +1,123 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <string.h>
+#include "lz4_block.h"
+
+/*
+ * A simple greedy LZ4 block compressor. It finds matches of at least four
+ * bytes with a single entry hash table, which is enough for the small
+ * independent chunks that the data partition table is made of.
+ */
+
+#define HASH_BITS       12
+#define MIN_MATCH       4
+#define MAX_OFFSET      65535
+#define LAST_LITERALS   5   /* The block must end with at least this many literals */
+#define MF_LIMIT        12  /* The last match must start this far from the end */
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint32_t hash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+static size_t length_write(uint8_t *dst, size_t len)
+{
+    size_t n = 0;
+
+    len -= 15;
+    while (len >= 255) {
+        dst[n++] = 255;
+        len -= 255;
+    }
+    dst[n++] = (uint8_t) len;
+
+    return n;
+}
+
+/*
+ * Writes a sequence of lit_len literals followed by a match, or only the
+ * literals when match_len is 0.
+ */
+static size_t sequence_write(uint8_t *dst, size_t dst_size,
+                             const uint8_t *literals, size_t lit_len,
+                             size_t offset, size_t match_len)
+{
+    size_t n = 1;
+
+    /* The worst case size of the sequence */
+    if (1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1 > dst_size) {
+        return 0;
+    }
+
+    dst[0] = (uint8_t) ((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15) {
+        n += length_write(&dst[n], lit_len);
+    }
+    memcpy(&dst[n], literals, lit_len);
+    n += lit_len;
+
+    if (match_len > 0) {
+        match_len -= MIN_MATCH;
+        dst[0] |= match_len < 15 ? match_len : 15;
+        dst[n++] = offset & 0xFF;
+        dst[n++] = offset >> 8;
+        if (match_len >= 15) {
+            n += length_write(&dst[n], match_len);
+        }
+    }
+
+    return n;
+}
+
+size_t lz4_block_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_size)
+{
+    long table[1 << HASH_BITS];
+    size_t anchor = 0;
+    size_t ip = 0;
+    size_t op = 0;
+    size_t n;
+
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+        table[i] = -1;
+    }
+
+    while (len >= MF_LIMIT + 1 && ip <= len - MF_LIMIT) {
+        uint32_t sequence = read_u32(&src[ip]);
+        uint32_t h = hash(sequence);
+        long ref = table[h];
+        size_t match_len;
+
+        table[h] = (long) ip;
+
+        if (ref < 0 || ip - ref > MAX_OFFSET || read_u32(&src[ref]) != sequence) {
+            ip++;
+            continue;
+        }
+
+        match_len = MIN_MATCH;
+        while (ip + match_len < len - LAST_LITERALS && src[ref + match_len] == src[ip + match_len]) {
+            match_len++;
+        }
+
+        n = sequence_write(&dst[op], dst_size - op, &src[anchor], ip - anchor, ip - ref, match_len);
+        if (n == 0) {
+            return 0;
+        }
+        op += n;
+        ip += match_len;
+        anchor = ip;
+    }
+
+    n = sequence_write(&dst[op], dst_size - op, &src[anchor], len - anchor, 0, 0);
+    if (n == 0) {
+        return 0;
+    }
+
+    return op + n;
+}
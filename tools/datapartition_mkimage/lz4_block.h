@@ -0,0 +1,19 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef LZ4_BLOCK_H_
+#define LZ4_BLOCK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Compresses len bytes of src into a single LZ4 block in dst, which has
+ * room for dst_size bytes. The block does not reference any data outside
+ * of src, so it may be decompressed on its own.
+ *
+ * Returns the size of the block, or 0 if it does not fit in dst_size bytes.
+ */
+size_t lz4_block_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_size);
+
+#endif /* LZ4_BLOCK_H_ */
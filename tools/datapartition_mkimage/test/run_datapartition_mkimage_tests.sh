@@ -228,3 +228,89 @@ if [ "$result_errors" -ne 1 ]; then
     echo "COMMAND #$cmd_count FAIL"
     exit 1
 fi
+
+#
+# TEST CASE
+# Verify a partition table of raw and LZ4 compressed entries, with
+# non-default alignment. Piped stdin is ignored.
+#
+
+alignment=512
+cmd="echo -n \"\" | $APP -v -a $alignment -p \"$TEST_FILE_A\" \"$TEST_FILE_B:lz4\" $TEST_FILE_C -o \"$OUT_FILE\""
+run_command
+
+# Each entry's data is aligned after the header and table. The LZ4 entry is
+# stored as a single uncompressed chunk, with its 4 byte chunk header.
+in_offsets=(0x200 0x400 0x600)
+in_stored_extra=(0 4 0)
+in_files=("$TEST_FILE_A" "$TEST_FILE_B" "$TEST_FILE_C")
+i=0
+
+for in_file in "${in_files[@]}"
+do :
+    file_size=$(stat -c%s "$in_file")
+    stored_size=$((file_size + ${in_stored_extra[$i]}))
+    expected_file_log_entry=$(printf "0x%08X\s*%d\s*%d\s*%s" "${in_offsets[$i]}" "$file_size" "$stored_size" "$(basename "$in_file")")
+    verify_file_entry_log
+
+    ((i++)) || true
+done
+
+result_size=$(grep -c "Filesize (new): $((${in_offsets[2]} + file_size)) Bytes" $APP_LOG || true)
+if [ "$result_size" -ne 1 ]; then
+    echo "COMMAND #$cmd_count FAIL: Unexpected filesize."
+    exit 1
+fi
+
+verify_no_error_log
+verify_no_warning_log
+
+EXPECTED_OUT_FILE_SHA512="2dba55ee204d39219bced46d3e134f5ad78df0cf3a45a0bd5170113c0bc6d251080a9cbedf903390ed132b27102fc0e05c3638fc76aad745a201ce6af7ff973a"
+verify_sha512
+
+#
+# TEST CASE
+# Verify that a compressible LZ4 entry, which spans more than one chunk, is
+# stored in fewer bytes than its input.
+#
+
+TEST_FILE_LZ4="compressible.txt"
+for i in $(seq 1 256)
+do :
+    echo "$i: The quick brown fox jumps over the lazy dog."
+done > $TEST_FILE_LZ4
+
+cmd="$APP -v -p $TEST_FILE_LZ4:lz4 -o \"$OUT_FILE\""
+run_command
+
+file_size=$(stat -c%s "$TEST_FILE_LZ4")
+entry=$(grep -E "^0x[0-9A-F]{8}\s+[0-9]+\s+[0-9]+\s+$TEST_FILE_LZ4$" $APP_LOG || true)
+entry_size=$(echo "$entry" | awk '{print $2}')
+entry_stored=$(echo "$entry" | awk '{print $3}')
+
+if [ -z "$entry" ] || [ "$entry_size" -ne "$file_size" ]; then
+    echo "COMMAND #$cmd_count FAIL: Unexpected file entry."
+    exit 1
+fi
+
+if [ "$entry_stored" -ge "$file_size" ]; then
+    echo "COMMAND #$cmd_count FAIL: LZ4 entry was not compressed ($entry_stored of $file_size Bytes)."
+    exit 1
+fi
+
+verify_no_error_log
+verify_no_warning_log
+
+#
+# TEST CASE
+# Verify that a partition table can not be combined with --in-file.
+#
+
+cmd="$APP -p $TEST_FILE_C -i $TEST_FILE_A:0 -o \"$OUT_FILE\""
+run_command
+
+result_errors=$(grep -c "ERROR: -p : Argument can not be used with -i." $APP_LOG || true)
+if [ "$result_errors" -ne 1 ]; then
+    echo "COMMAND #$cmd_count FAIL"
+    exit 1
+fi
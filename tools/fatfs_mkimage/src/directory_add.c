@@ -1,65 +1,221 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "tinydir.h"
 #include "fatfs_ops.h"
+#include "file_reader.h"
+#include "directory_add.h"
 
-static int dir_recurse(tinydir_dir dir)
+/* The most file data that is read ahead of being written to the image */
+#define READ_WINDOW_SIZE (64 * 1024 * 1024)
+
+typedef struct {
+    char *fat_path;
+    int is_dir;
+} entry_t;
+
+static entry_t *entries;
+static file_reader_entry_t *files;
+static size_t entry_count;
+static size_t file_count;
+static size_t entries_allocated;
+
+static char *path_join(const char *parent, const char *name)
+{
+    size_t len = strlen(parent) + 1 + strlen(name) + 1;
+    char *path = malloc(len);
+
+    if (path != NULL) {
+        snprintf(path, len, "%s%s%s", parent, parent[0] != '\0' ? "/" : "", name);
+    }
+
+    return path;
+}
+
+/*
+ * Returns non-zero if name is a valid 8.3 name, which FatFs can open
+ * without long filename support. Case is ignored, as FatFs converts names
+ * to upper case when long filenames are not supported.
+ */
+static int short_name_valid(const char *name)
+{
+    const char *dot = strchr(name, '.');
+    size_t base_len = dot != NULL ? (size_t) (dot - name) : strlen(name);
+
+    if (base_len == 0 || base_len > 8) {
+        return 0;
+    }
+    if (dot != NULL && (strlen(dot + 1) == 0 || strlen(dot + 1) > 3 || strchr(dot + 1, '.') != NULL)) {
+        return 0;
+    }
+
+    for (const char *c = name; *c != '\0'; c++) {
+        if (c == dot) {
+            continue;
+        }
+        if ((unsigned char) *c <= ' ' || (unsigned char) *c >= 0x7F || strchr("\"*+,/:;<=>?[\\]|", *c) != NULL) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int entry_append(const char *fat_path, const char *host_path, int is_dir)
+{
+    if (entry_count == entries_allocated) {
+        size_t n = entries_allocated > 0 ? 2 * entries_allocated : 64;
+        entry_t *e = realloc(entries, n * sizeof(entry_t));
+        file_reader_entry_t *f = realloc(files, n * sizeof(file_reader_entry_t));
+
+        if (e != NULL) {
+            entries = e;
+        }
+        if (f != NULL) {
+            files = f;
+        }
+        if (e == NULL || f == NULL) {
+            return -1;
+        }
+        entries_allocated = n;
+    }
+
+    entries[entry_count].fat_path = strdup(fat_path);
+    entries[entry_count].is_dir = is_dir;
+    if (entries[entry_count].fat_path == NULL) {
+        return -1;
+    }
+    entry_count++;
+
+    if (!is_dir) {
+        files[file_count].path = strdup(host_path);
+        if (files[file_count].path == NULL) {
+            return -1;
+        }
+        file_count++;
+    }
+
+    return 0;
+}
+
+static int dir_collect(const char *host_path, const char *fat_path, int long_names)
 {
+    tinydir_dir dir;
     int ret = 0;
 
-    while (dir.has_next) {
+    if (tinydir_open_sorted(&dir, host_path) != 0) {
+        fprintf(stderr, "Error opening directory %s\n", host_path);
+        return -1;
+    }
+
+    for (size_t i = 0; i < dir.n_files && ret == 0; i++) {
         tinydir_file file;
-        if (tinydir_readfile(&dir, &file) != 0) {
-            return -1;
+        char *path;
+
+        if (tinydir_readfile_n(&dir, &file, i) != 0) {
+            ret = -1;
+            break;
         }
 
-        if (file.is_dir) {
-            if (strcmp(file.name, ".") != 0 && strcmp(file.name, "..") != 0) {
-                tinydir_dir subdir;
-                if (tinydir_open(&subdir, file.path) != 0 ||
-                    fatfs_dir_enter(file.name) != 0       ||
-                    dir_recurse(subdir) != 0              ||
-                    fatfs_dir_up()) {
-                    ret = -1;
-                    break;
-                }
-            }
-
-        } else if (file.is_reg) {
-            FILE *fp = fopen(file.path, "rb");
-            if (fp == NULL) {
-                ret = -1;
-            }
-
-            if (ret == 0) {
-                ret = fatfs_file_copy(file.name, fp);
-                fclose(fp);
-            }
-
-            if (ret != 0) {
-                break;
-            }
+        if (file.is_dir && (strcmp(file.name, ".") == 0 || strcmp(file.name, "..") == 0)) {
+            continue;
+        }
+        if (!file.is_dir && !file.is_reg) {
+            continue;
+        }
+
+        if (!long_names && !short_name_valid(file.name)) {
+            fprintf(stderr, "%s is not an 8.3 name. Rename it, or use --long_names if FatFs on the device is built with FF_USE_LFN enabled.\n", file.path);
+            ret = -1;
+            break;
         }
 
-        tinydir_next(&dir);
+        path = path_join(fat_path, file.name);
+        if (path == NULL || entry_append(path, file.path, file.is_dir) != 0) {
+            fprintf(stderr, "Failed to allocate memory\n");
+            ret = -1;
+        } else if (file.is_dir) {
+            ret = dir_collect(file.path, path, long_names);
+        }
+        free(path);
     }
 
+    tinydir_close(&dir);
+
     return ret;
 }
 
-int directory_add(const char *dirname)
+static int files_write(int jobs, FILE *manifest)
 {
+    size_t file_index = 0;
     int ret;
-    tinydir_dir dir;
 
-    if ((ret = tinydir_open(&dir, dirname)) == 0) {
-        ret = dir_recurse(dir);
-    } else {
-        fprintf(stderr, "Error opening specified directory %s\n", dirname);
+    if (file_count == 0) {
+        return 0;
+    }
+
+    if ((ret = file_reader_start(files, file_count, jobs, READ_WINDOW_SIZE)) != 0) {
+        return ret;
+    }
+
+    for (size_t i = 0; i < entry_count && ret == 0; i++) {
+        file_reader_entry_t *file;
+        uint32_t offset;
+
+        if (entries[i].is_dir) {
+            continue;
+        }
+
+        file = &files[file_index];
+        if (file_reader_wait(file_index) != 0 ||
+            fatfs_file_write(entries[i].fat_path, file->data, file->size, &offset) != 0) {
+            ret = -1;
+        } else if (manifest != NULL && file->size > 0) {
+            /* Empty files have no data in the image, so have no offset */
+            fprintf(manifest, "0x%08lX %lu /%s\n",
+                    (unsigned long) offset, (unsigned long) file->size, entries[i].fat_path);
+        }
+        file_reader_release(file_index++);
+    }
+
+    file_reader_stop();
+
+    return ret;
+}
+
+int directory_add(const char *dirname, int jobs, int long_names, FILE *manifest)
+{
+    int ret;
+
+    ret = dir_collect(dirname, "", long_names);
+
+    for (size_t i = 0; i < entry_count && ret == 0; i++) {
+        if (entries[i].is_dir) {
+            ret = fatfs_dir_create(entries[i].fat_path);
+        }
+    }
+
+    if (ret == 0) {
+        if (manifest != NULL) {
+            fprintf(manifest, "# offset size path\n");
+        }
+        ret = files_write(jobs, manifest);
+    }
+
+    for (size_t i = 0; i < entry_count; i++) {
+        free(entries[i].fat_path);
+    }
+    for (size_t i = 0; i < file_count; i++) {
+        free((char *) files[i].path);
     }
+    free(entries);
+    free(files);
+    entries = NULL;
+    files = NULL;
+    entry_count = file_count = entries_allocated = 0;
 
     return ret;
 }
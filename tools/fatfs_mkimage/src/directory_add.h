@@ -1,11 +1,23 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef DIRECTORY_ADD_H_
 #define DIRECTORY_ADD_H_
 
+#include <stdio.h>
 
-int directory_add(const char *dirname);
+/*
+ * Adds the contents of a directory to the image. Entries are added in
+ * order of their names, each directory's subdirectories before its
+ * files, so that the layout of the image only depends on its contents.
+ * All directories are created first, followed by the files, each of
+ * which is contiguous.
+ *
+ * Files are read by jobs threads. Unless long_names is set, every name
+ * must be in 8.3 format. If manifest is not NULL, the offset in the
+ * image, size and path of each file that is not empty is written to it.
+ */
+int directory_add(const char *dirname, int jobs, int long_names, FILE *manifest);
 
 
 #endif /* DIRECTORY_ADD_H_ */
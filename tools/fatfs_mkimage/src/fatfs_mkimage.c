@@ -1,4 +1,4 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include <stdio.h>
@@ -7,11 +7,12 @@
 #include "fatfs_ops.h"
 #include "directory_add.h"
 
-#define VERSION "1.0.0"
+#define VERSION "1.1.0"
 
 #define IMAGE_SIZE_DEFAULT          1024*1024
 #define SECTOR_SIZE_DEFAULT         4096
 #define SECTORS_PER_CLUSTER_DEFAULT 1
+#define JOBS_DEFAULT                4
 
 size_t image_size_g;
 size_t image_sector_size_g;
@@ -21,10 +22,11 @@ int main(int argc, char **argv)
     int ret = 0;
     void *image;
     size_t image_size_actual;
+    FILE *manifest = NULL;
 
-    struct arg_lit *help, *version;
-    struct arg_int *image_size, *sector_size, *sectors_per_cluster;
-    struct arg_file *output_file, *input_dir;
+    struct arg_lit *help, *version, *long_names;
+    struct arg_int *image_size, *sector_size, *sectors_per_cluster, *jobs;
+    struct arg_file *output_file, *input_dir, *manifest_file;
     struct arg_end *end;
 
     void *argtable[] = {
@@ -37,6 +39,9 @@ int main(int argc, char **argv)
         image_size = arg_int0("s", "image_size", "<n>", "The size in bytes of the file system image. Default is 1048576."),
         sector_size = arg_int0("S", "sector_size", "<n>", "The size in bytes of the file system's sectors. Default is 4096."),
         sectors_per_cluster = arg_int0("c", "sectors_per_cluster", "<n>", "The number of sectors per cluster. Must be a power of 2. Default is 1."),
+        jobs = arg_int0("j", "jobs", "<n>", "The number of threads that read the input files. Default is 4."),
+        manifest_file = arg_file0("m", "manifest", "<file>", "Also write a manifest with the offset in the image, size and path of each file."),
+        long_names = arg_lit0("l", "long_names", "Allow names that are not in 8.3 format. FatFs on the device must be built with FF_USE_LFN enabled to open them."),
 
         end = arg_end(8),
     };
@@ -49,7 +54,12 @@ int main(int argc, char **argv)
         arg_print_syntax(stdout, argtable, "\n\n");
         printf("FAT file system image creation tool\n\n");
         printf("This tool creates a FAT filesystem image that is populated with the contents\n");
-        printf("of the specified directory. All filenames must be in 8.3 format.\n\n");
+        printf("of the specified directory. Names must be in 8.3 format, unless long\n");
+        printf("filenames are allowed with --long_names.\n\n");
+        printf("The entries of each directory are added with its subdirectories first,\n");
+        printf("then in order of their names. Each file is stored contiguously, so the\n");
+        printf("layout of the image only depends on the contents of the directory.\n");
+        printf("Set SOURCE_DATE_EPOCH to also make the timestamps in the image reproducible.\n\n");
         arg_print_glossary_gnu(stdout, argtable);
         return 0;
     }
@@ -87,14 +97,35 @@ int main(int argc, char **argv)
         image_sector_size_g = SECTOR_SIZE_DEFAULT;
     }
 
+    if (image_sector_size_g != FF_MAX_SS) {
+        fprintf(stderr, "Sector size must be %d\n", FF_MAX_SS);
+        return 1;
+    }
+
     if (sectors_per_cluster->count == 0) {
         sectors_per_cluster->count = 1;
         sectors_per_cluster->ival[0] = SECTORS_PER_CLUSTER_DEFAULT;
     }
 
+    if (jobs->count == 0) {
+        jobs->count = 1;
+        jobs->ival[0] = JOBS_DEFAULT;
+    } else if (jobs->ival[0] <= 0) {
+        fprintf(stderr, "Number of jobs must be greater than zero\n");
+        return 1;
+    }
+
+    if (manifest_file->count > 0) {
+        manifest = fopen(manifest_file->filename[0], "w");
+        if (manifest == NULL) {
+            fprintf(stderr, "Failed to open file %s for writing\n", manifest_file->filename[0]);
+            return 1;
+        }
+    }
+
     image = fatfs_init(&image_size_actual, sectors_per_cluster->ival[0] * image_sector_size_g);
 
-    if (image != NULL && directory_add(input_dir->filename[0]) == 0) {
+    if (image != NULL && directory_add(input_dir->filename[0], jobs->ival[0], long_names->count > 0, manifest) == 0) {
         FILE *outfile;
         outfile = fopen(output_file->filename[0], "wb");
         if (outfile != NULL) {
@@ -111,6 +142,13 @@ int main(int argc, char **argv)
         ret = 1;
     }
 
+    if (manifest != NULL) {
+        if (fclose(manifest) != 0) {
+            fprintf(stderr, "Failed to write manifest %s\n", manifest_file->filename[0]);
+            ret = 1;
+        }
+    }
+
     if (ret == 0) {
         printf("Filesystem image %s successfully populated with contents of directory %s\n", output_file->filename[0], input_dir->filename[0]);
     } else {
@@ -1,10 +1,15 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
+#include <stdio.h>
 #include <ff.h>
 #include "fatfs_ops.h"
 #include "ramdisk.h"
 
+#if FF_MIN_SS != FF_MAX_SS
+#error The sector size must be fixed
+#endif
+
 static FATFS fs;
 
 static char *fatfs_error_str[] = {
@@ -58,60 +63,56 @@ void *fatfs_init(size_t *image_size, size_t cluster_size)
     return RAM_disk_raw(image_size);
 }
 
-int fatfs_dir_enter(char *name)
-{
-    FRESULT res;
-
-    if (((res = f_mkdir(name)) == FR_OK) &&
-        ((res = f_chdir(name)) == FR_OK)) {
-        return 0;
-    } else {
-        fprintf(stderr, "Failed to create and enter directory %s: %s.\n", name, fatfs_error_str[res]);
-        return -1;
-    }
-}
-
-int fatfs_dir_up(void)
+int fatfs_dir_create(const char *path)
 {
     FRESULT res;
 
-    if ((res = f_chdir("..")) == FR_OK) {
+    if ((res = f_mkdir(path)) == FR_OK) {
         return 0;
     } else {
-        fprintf(stderr, "Failed to change directory: %s.\n", fatfs_error_str[res]);
+        fprintf(stderr, "Failed to create directory %s: %s.\n", path, fatfs_error_str[res]);
         return -1;
     }
 }
 
-int fatfs_file_copy(char *name, FILE *fp)
+int fatfs_file_write(const char *path, const void *data, size_t size, uint32_t *offset)
 {
-    BYTE data[1024];
-    size_t bytes_read;
     FIL fil;
     FRESULT res;
     int ret = 0;
 
-    if ((res = f_open(&fil, name, FA_CREATE_ALWAYS | FA_WRITE)) == FR_OK) {
+    *offset = 0;
+
+    if ((res = f_open(&fil, path, FA_CREATE_ALWAYS | FA_WRITE)) == FR_OK) {
 
-        while ((bytes_read = fread(data, 1, sizeof(data), fp)) > 0) {
+        if (size > 0) {
+            /*
+             * Allocate all of the file's clusters up front, so that it is
+             * contiguous in the image, and then write it in one go so that
+             * whole sectors are written directly to the RAM disk.
+             */
             UINT bw;
-            if ((res = f_write(&fil, data, bytes_read, &bw)) != FR_OK) {
-                fprintf(stderr, "Failed to write data to file %s: %s.\n", name, fatfs_error_str[res]);
+            if ((res = f_expand(&fil, size, 1)) != FR_OK) {
+                fprintf(stderr, "Failed to allocate %lu contiguous bytes for file %s: %s. Image size too small?\n",
+                        (unsigned long) size, path, fatfs_error_str[res]);
+                ret = -1;
+            } else if ((res = f_write(&fil, data, size, &bw)) != FR_OK) {
+                fprintf(stderr, "Failed to write data to file %s: %s.\n", path, fatfs_error_str[res]);
                 ret = -1;
-                break;
-            } else if (bytes_read != bw) {
-                fprintf(stderr, "Failed to write all data to file %s. Image size too small?\n", name);
+            } else if (size != bw) {
+                fprintf(stderr, "Failed to write all data to file %s. Image size too small?\n", path);
                 ret = -1;
-                break;
+            } else {
+                *offset = (uint32_t) ((fs.database + (LBA_t) (fil.obj.sclust - 2) * fs.csize) * FF_MAX_SS);
             }
         }
 
         if ((res = f_close(&fil)) != FR_OK) {
-            fprintf(stderr, "Failed to close file %s: %s.\n", name, fatfs_error_str[res]);
+            fprintf(stderr, "Failed to close file %s: %s.\n", path, fatfs_error_str[res]);
             ret = -1;
         }
     } else {
-        fprintf(stderr, "Failed to create file %s: %s.\n", name, fatfs_error_str[res]);
+        fprintf(stderr, "Failed to create file %s: %s.\n", path, fatfs_error_str[res]);
         ret = -1;
     }
 
@@ -1,15 +1,20 @@
-// Copyright 2021-2023 XMOS LIMITED.
+// Copyright 2021-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #ifndef FATFS_OPS_H_
 #define FATFS_OPS_H_
 
-#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 
 void *fatfs_init(size_t *image_size, size_t cluster_size);
-int fatfs_dir_enter(char *name);
-int fatfs_dir_up(void);
-int fatfs_file_copy(char *name, FILE *fp);
+int fatfs_dir_create(const char *path);
+
+/*
+ * Writes a file of size bytes contiguously, and sets offset to where its
+ * data starts in the image.
+ */
+int fatfs_file_write(const char *path, const void *data, size_t size, uint32_t *offset);
 
 
 #endif /* FATFS_OPS_H_ */
@@ -1,4 +1,4 @@
-// Copyright 2020-2023 XMOS LIMITED.
+// Copyright 2020-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 /*---------------------------------------------------------------------------/
@@ -67,7 +67,7 @@
 
 
 #ifndef FF_USE_EXPAND
-#define FF_USE_EXPAND	0
+#define FF_USE_EXPAND	1
 #endif
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
@@ -128,7 +128,7 @@
 
 
 #ifndef FF_USE_LFN
-#define FF_USE_LFN		0
+#define FF_USE_LFN		1
 #endif
 #ifndef FF_MAX_LFN
 #define FF_MAX_LFN		255
@@ -152,7 +152,7 @@
 
 
 #ifndef FF_LFN_UNICODE
-#define FF_LFN_UNICODE	0
+#define FF_LFN_UNICODE	2
 #endif
 /* This option switches the character encoding on the API when LFN is enabled.
 /
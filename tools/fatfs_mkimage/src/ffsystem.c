@@ -3,6 +3,7 @@
 /* (C)ChaN, 2018                                                          */
 /*------------------------------------------------------------------------*/
 
+#include <stdlib.h>
 #include <time.h>
 #include "ff.h"
 
@@ -42,8 +43,19 @@ DWORD get_fattime(void)
     struct tm *stm;
 
 
-    t = time(NULL);
-    stm = localtime(&t);
+    /*
+     * For reproducible builds, the timestamps of the volume and its files
+     * may be set with SOURCE_DATE_EPOCH.
+     */
+    const char *epoch = getenv("SOURCE_DATE_EPOCH");
+
+    if (epoch != NULL) {
+        t = (time_t) strtoll(epoch, NULL, 10);
+        stm = gmtime(&t);
+    } else {
+        t = time(NULL);
+        stm = localtime(&t);
+    }
 
     return (DWORD)(stm->tm_year - 80) << 25 |
            (DWORD)(stm->tm_mon + 1) << 21 |
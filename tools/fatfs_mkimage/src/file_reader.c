@@ -0,0 +1,236 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "file_reader.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE thread_t;
+static SRWLOCK lock = SRWLOCK_INIT;
+static CONDITION_VARIABLE cond = CONDITION_VARIABLE_INIT;
+
+#define LOCK()          AcquireSRWLockExclusive(&lock)
+#define UNLOCK()        ReleaseSRWLockExclusive(&lock)
+#define WAIT()          SleepConditionVariableSRW(&cond, &lock, INFINITE, 0)
+#define NOTIFY_ALL()    WakeAllConditionVariable(&cond)
+#else
+#include <pthread.h>
+
+typedef pthread_t thread_t;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+#define LOCK()          pthread_mutex_lock(&lock)
+#define UNLOCK()        pthread_mutex_unlock(&lock)
+#define WAIT()          pthread_cond_wait(&cond, &lock)
+#define NOTIFY_ALL()    pthread_cond_broadcast(&cond)
+#endif
+
+enum {
+    FILE_PENDING,
+    FILE_READING,
+    FILE_READ,
+    FILE_FAILED,
+};
+
+static file_reader_entry_t *entries_g;
+static size_t count_g;
+static size_t window_g;
+
+static size_t next_read;    /* The next file for a thread to read */
+static size_t next_wait;    /* The next file that will be waited on */
+static size_t bytes_held;   /* Reserved by files that are read but not released */
+static int stopping;
+
+static thread_t *threads;
+static int thread_count;
+
+static void file_read(file_reader_entry_t *entry, FILE *fp)
+{
+    int ok = 0;
+
+    entry->data = malloc(entry->size > 0 ? entry->size : 1);
+    if (entry->data != NULL) {
+        ok = fread(entry->data, 1, entry->size, fp) == entry->size;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to read file %s\n", entry->path);
+    }
+
+    LOCK();
+    entry->state = ok ? FILE_READ : FILE_FAILED;
+    NOTIFY_ALL();
+    UNLOCK();
+}
+
+static void worker(void)
+{
+    LOCK();
+    while (!stopping && next_read < count_g) {
+        size_t i = next_read++;
+        file_reader_entry_t *entry = &entries_g[i];
+        FILE *fp;
+        long size = -1;
+
+        entry->state = FILE_READING;
+        UNLOCK();
+
+        fp = fopen(entry->path, "rb");
+        if (fp != NULL) {
+            fseek(fp, 0L, SEEK_END);
+            size = ftell(fp);
+            fseek(fp, 0L, SEEK_SET);
+        }
+
+        LOCK();
+        if (size < 0) {
+            fprintf(stderr, "Failed to open file %s\n", entry->path);
+            entry->state = FILE_FAILED;
+            NOTIFY_ALL();
+            if (fp != NULL) {
+                fclose(fp);
+            }
+            continue;
+        }
+
+        /*
+         * Wait for room in the window, unless this is the file that is
+         * waited on next, which is always read so that the writer makes
+         * progress.
+         */
+        while (!stopping && i != next_wait && bytes_held > 0 && bytes_held + size > window_g) {
+            WAIT();
+        }
+        if (stopping) {
+            fclose(fp);
+            break;
+        }
+        entry->size = size;
+        bytes_held += size;
+        UNLOCK();
+
+        file_read(entry, fp);
+        fclose(fp);
+
+        LOCK();
+    }
+    UNLOCK();
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_thread(LPVOID arg)
+{
+    (void) arg;
+    worker();
+    return 0;
+}
+#else
+static void *worker_thread(void *arg)
+{
+    (void) arg;
+    worker();
+    return NULL;
+}
+#endif
+
+int file_reader_start(file_reader_entry_t *entries, size_t count, int jobs, size_t window)
+{
+    entries_g = entries;
+    count_g = count;
+    window_g = window;
+    next_read = 0;
+    next_wait = 0;
+    bytes_held = 0;
+    stopping = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i].data = NULL;
+        entries[i].size = 0;
+        entries[i].state = FILE_PENDING;
+    }
+
+    threads = calloc(jobs, sizeof(thread_t));
+    if (threads == NULL) {
+        return -1;
+    }
+
+    for (thread_count = 0; thread_count < jobs; thread_count++) {
+#ifdef _WIN32
+        threads[thread_count] = CreateThread(NULL, 0, worker_thread, NULL, 0, NULL);
+        if (threads[thread_count] == NULL) {
+            break;
+        }
+#else
+        if (pthread_create(&threads[thread_count], NULL, worker_thread, NULL) != 0) {
+            break;
+        }
+#endif
+    }
+
+    if (thread_count == 0) {
+        fprintf(stderr, "Failed to create file reader threads\n");
+        free(threads);
+        threads = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int file_reader_wait(size_t index)
+{
+    int state;
+
+    LOCK();
+    next_wait = index;
+    NOTIFY_ALL();
+    while (entries_g[index].state != FILE_READ && entries_g[index].state != FILE_FAILED) {
+        WAIT();
+    }
+    state = entries_g[index].state;
+    UNLOCK();
+
+    return state == FILE_READ ? 0 : -1;
+}
+
+void file_reader_release(size_t index)
+{
+    file_reader_entry_t *entry = &entries_g[index];
+
+    LOCK();
+    bytes_held -= entry->size;
+    free(entry->data);
+    entry->data = NULL;
+    next_wait = index + 1;
+    NOTIFY_ALL();
+    UNLOCK();
+}
+
+void file_reader_stop(void)
+{
+    LOCK();
+    stopping = 1;
+    NOTIFY_ALL();
+    UNLOCK();
+
+    for (int i = 0; i < thread_count; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+    free(threads);
+    threads = NULL;
+    thread_count = 0;
+
+    for (size_t i = 0; i < count_g; i++) {
+        free(entries_g[i].data);
+        entries_g[i].data = NULL;
+    }
+}
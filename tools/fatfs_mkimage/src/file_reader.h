@@ -0,0 +1,37 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#ifndef FILE_READER_H_
+#define FILE_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Reads a list of files into memory using a pool of threads, ahead of
+ * them being written into the image in order. Files are read in list
+ * order, and at most window bytes are held in memory at once, other than
+ * for the file that is waited on next.
+ */
+
+typedef struct {
+    const char *path;
+    uint8_t *data;
+    size_t size;
+    int state;
+} file_reader_entry_t;
+
+int file_reader_start(file_reader_entry_t *entries, size_t count, int jobs, size_t window);
+
+/*
+ * Waits for the file at index to be read. The files must be waited on in
+ * list order, and each released before the next is waited on.
+ * Returns 0 on success, or -1 if the file could not be read.
+ */
+int file_reader_wait(size_t index);
+void file_reader_release(size_t index);
+
+void file_reader_stop(void);
+
+
+#endif /* FILE_READER_H_ */
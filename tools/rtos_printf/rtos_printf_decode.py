@@ -0,0 +1,250 @@
+#!/usr/bin/env python
+# Copyright 2024 XMOS LIMITED.
+# This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+"""
+Decodes the binary messages sent by rtos_printf_deferred_flush() when
+RTOS_PRINTF_DEFERRED_BINARY is set, using the format strings in the
+application's ELF.
+
+Extract the format string table from a tile's ELF at build time:
+    python rtos_printf_decode.py extract image_n0c0_2.elf -o tile0_printf.json
+
+Decode a capture of the binary messages sent by that tile:
+    python rtos_printf_decode.py decode capture.bin --table tile0_printf.json
+
+The ELF may be given to decode in place of the table with --elf. This also
+allows strings printed with %s to be recovered when they are constants.
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+# These must be kept in sync with modules/rtos_support/api/rtos_printf.h
+FMT_SECTION = ".rtos_printf_fmt"
+# rtos_printf_binary_header_t: fmt, timestamp, core, nargs, reserved
+HEADER = struct.Struct("<IIBBH")
+MAX_ARGS = 8
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+REF_CLOCK_HZ = 100000000
+
+# %[flags][width][.precision][length]conversion
+FMT_SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|z|t|j)?([diouxXcspf%])")
+
+
+class elf_file:
+    """Just enough of an ELF32 little endian reader to find sections by name and by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError("{0} is not a 32-bit little endian ELF file".format(path))
+
+        (shoff,) = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.data, 0x2E)
+
+        headers = []
+        for i in range(shnum):
+            headers.append(struct.unpack_from("<IIIIIIIIII", self.data, shoff + i * shentsize))
+
+        strtab = headers[shstrndx]
+        self.sections = []
+        for name, type, flags, addr, offset, size, _, _, _, _ in headers:
+            self.sections.append({
+                "name": self._cstring(self.data, strtab[4] + name),
+                "type": type,
+                "flags": flags,
+                "addr": addr,
+                "offset": offset,
+                "size": size,
+            })
+
+    @staticmethod
+    def _cstring(data, offset):
+        end = data.find(b"\0", offset)
+        if end < 0:
+            end = len(data)
+        return data[offset:end].decode("utf-8", errors="replace")
+
+    def section(self, name):
+        for s in self.sections:
+            if s["name"] == name:
+                return s
+        return None
+
+    def string_at(self, addr):
+        """Returns the string at addr in any loaded section of the ELF, or None."""
+        for s in self.sections:
+            if s["flags"] & SHF_ALLOC and s["type"] != SHT_NOBITS and s["addr"] <= addr < s["addr"] + s["size"]:
+                return self._cstring(self.data, s["offset"] + addr - s["addr"])
+        return None
+
+    def format_strings(self):
+        """Returns a dictionary of every format string in the format string section, by address."""
+        s = self.section(FMT_SECTION)
+        if s is None:
+            return {}
+
+        table = {}
+        offset = 0
+        while offset < s["size"]:
+            # Each format string is a separate array, so skip any alignment padding
+            if self.data[s["offset"] + offset] == 0:
+                offset += 1
+                continue
+            string = self._cstring(self.data, s["offset"] + offset)
+            table[s["addr"] + offset] = string
+            offset += len(string.encode("utf-8")) + 1
+        return table
+
+
+class rtos_printf_decoder:
+    def __init__(self, table, elf=None):
+        self.table = table
+        self.elf = elf
+        self.Dropped = 0
+
+    def _string_arg(self, addr):
+        if self.elf is not None:
+            string = self.elf.string_at(addr)
+            if string is not None:
+                return string
+        return "<0x{0:08x}>".format(addr)
+
+    def format(self, fmt, args):
+        """Formats args with a C format string as xcore_utils_printf() would."""
+        args = list(args)
+
+        def next_arg():
+            return args.pop(0) if args else 0
+
+        def convert(m):
+            flags, width, precision, length, conv = m.groups()
+            if conv == "%":
+                return "%"
+            if width == "*":
+                width = str(next_arg())
+            if precision == "*":
+                precision = str(next_arg())
+
+            value = next_arg()
+            if length == "ll":
+                value |= next_arg() << 32
+                if conv in "di" and value & (1 << 63):
+                    value -= 1 << 64
+            elif conv in "di" and value & (1 << 31):
+                value -= 1 << 32
+
+            spec = "%" + flags + (width or "") + ("." + precision if precision else "")
+            if conv in "di":
+                return (spec + "d") % value
+            if conv == "u":
+                return (spec + "d") % value
+            if conv in "oxX":
+                return (spec + conv) % value
+            if conv == "c":
+                return (spec + "c") % chr(value & 0xFF)
+            if conv == "s":
+                return (spec + "s") % self._string_arg(value)
+            if conv == "p":
+                return "0x{0:08x}".format(value)
+            # Floats are not supported on the device
+            return m.group(0)
+
+        return FMT_SPEC.sub(convert, fmt)
+
+    def iter_messages(self, data):
+        """Yield each message in a byte string of binary messages as a dictionary."""
+        offset = 0
+        while offset + HEADER.size <= len(data):
+            fmt, timestamp, core, nargs, _ = HEADER.unpack_from(data, offset)
+            if nargs > MAX_ARGS or offset + HEADER.size + 4 * nargs > len(data):
+                raise ValueError("Corrupt message at offset {0}".format(offset))
+            args = struct.unpack_from("<{0}I".format(nargs), data, offset + HEADER.size)
+            offset += HEADER.size + 4 * nargs
+
+            if fmt == 0:
+                self.Dropped += args[0]
+                text = "rtos_printf: {0} messages dropped on core {1}\n".format(args[0], core)
+            elif fmt in self.table:
+                text = self.format(self.table[fmt], args)
+            else:
+                text = "<unknown format string 0x{0:08x}> {1}\n".format(
+                    fmt, " ".join("0x{0:08x}".format(a) for a in args))
+
+            yield {"timestamp": timestamp, "core": core, "text": text}
+
+
+def load_table(path):
+    with open(path, "r") as f:
+        return {int(addr, 0): fmt for addr, fmt in json.load(f).items()}
+
+
+def extract(args):
+    elf = elf_file(args.elf)
+    table = elf.format_strings()
+    if not table:
+        print("Warning: {0} has no {1} section".format(args.elf, FMT_SECTION), file=sys.stderr)
+
+    with open(args.output, "w") as f:
+        json.dump({"0x{0:08x}".format(addr): fmt for addr, fmt in sorted(table.items())}, f, indent=1)
+
+    print("Extracted {0} format strings".format(len(table)))
+
+
+def decode(args):
+    elf = elf_file(args.elf) if args.elf else None
+    if args.table:
+        table = load_table(args.table)
+    elif elf is not None:
+        table = elf.format_strings()
+    else:
+        sys.exit("Either --table or --elf is required")
+
+    with open(args.capture, "rb") as f:
+        data = f.read()
+
+    decoder = rtos_printf_decoder(table, elf)
+    out = open(args.output, "w") if args.output else sys.stdout
+    for msg in decoder.iter_messages(data):
+        if args.timestamps:
+            out.write("[{0:10.6f}] {1}|".format(msg["timestamp"] / REF_CLOCK_HZ, msg["core"]))
+        out.write(msg["text"])
+    if out is not sys.stdout:
+        out.close()
+
+    if decoder.Dropped:
+        print("Warning: {0} messages were dropped on the device".format(decoder.Dropped), file=sys.stderr)
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description="Decode binary rtos_printf messages")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    p = subparsers.add_parser("extract", help="Extract the format string table from a tile's ELF")
+    p.add_argument("elf", help="Tile ELF, for example from xobjdump --split")
+    p.add_argument("-o", "--output", required=True, help="Output JSON table")
+    p.set_defaults(func=extract)
+
+    p = subparsers.add_parser("decode", help="Decode a capture of binary messages")
+    p.add_argument("capture", help="Binary capture file")
+    p.add_argument("--table", help="Format string table from extract")
+    p.add_argument("--elf", help="Tile ELF, used in place of or as well as the table")
+    p.add_argument("-o", "--output", help="Output text file. Defaults to stdout")
+    p.add_argument("--timestamps", action="store_true", help="Prefix each message with its time and core")
+    p.set_defaults(func=decode)
+
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    args = parse_arguments()
+    args.func(args)
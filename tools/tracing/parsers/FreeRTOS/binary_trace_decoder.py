@@ -0,0 +1,124 @@
+# Copyright 2024 XMOS LIMITED.
+# This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+import struct
+
+# These must be kept in sync with modules/drivers/trace/FreeRTOS/api/binary_trace.h
+EVENT_TASK_SWITCHED_IN = 0x01
+EVENT_TASK_SWITCHED_OUT = 0x02
+EVENT_TASK_CREATE = 0x03
+EVENT_TASK_DELETE = 0x04
+EVENT_TASK_NAME = 0x05
+EVENT_DROPPED = 0x06
+EVENT_ISR_ENTER = 0x07
+EVENT_ISR_EXIT = 0x08
+EVENT_USER = 0x80
+
+EVENT_NAMES = {
+    EVENT_TASK_SWITCHED_IN: "IN",
+    EVENT_TASK_SWITCHED_OUT: "OUT",
+    EVENT_TASK_CREATE: "CREATE",
+    EVENT_TASK_DELETE: "DELETE",
+    EVENT_TASK_NAME: "NAME",
+    EVENT_DROPPED: "DROPPED",
+    EVENT_ISR_ENTER: "ISR_ENTER",
+    EVENT_ISR_EXIT: "ISR_EXIT",
+}
+
+# binary_trace_record_t: timestamp, task, arg, event_id, tile, core, seq
+RECORD = struct.Struct("<IIIBBBB")
+
+
+class binary_trace_decoder:
+    def __init__(self, list):
+        self.ParsedList = list
+        self.Records = []
+        self.TaskNames = {}
+        self.ProcessedList = {}
+        self.Dropped = 0
+        self.Lost = 0
+
+        self._name_parts = {}
+        self._last_time = {}
+        self._time_offset = {}
+        self._last_seq = {}
+
+    def iter_records(self, packets):
+        """
+        Yield each record from an iterable of xscope packets as it is decoded.
+        Task name records are consumed and stored in TaskNames. Timestamps
+        are extended beyond 32 bits.
+        """
+        for each in packets:
+            data = each["data"]
+            for offset in range(0, len(data) - len(data) % RECORD.size, RECORD.size):
+                timestamp, task, arg, event_id, tile, core, seq = RECORD.unpack_from(data, offset)
+                key = (tile, core)
+
+                # The 32-bit reference timer wraps every ~43 seconds
+                if key in self._last_time and timestamp < self._last_time[key]:
+                    self._time_offset[key] = self._time_offset.get(key, 0) + (1 << 32)
+                self._last_time[key] = timestamp
+                timestamp += self._time_offset.get(key, 0)
+
+                if event_id == EVENT_TASK_NAME:
+                    self._add_name_part(tile, task, seq, arg)
+                    continue
+
+                if event_id == EVENT_DROPPED:
+                    self.Dropped += arg
+                else:
+                    if key in self._last_seq and seq != (self._last_seq[key] + 1) & 0xFF:
+                        self.Lost += (seq - self._last_seq[key] - 1) & 0xFF
+                    self._last_seq[key] = seq
+
+                yield {"rectime": timestamp, "tile": tile, "core": core,
+                       "event": event_id, "task": task, "arg": arg}
+
+    def _add_name_part(self, tile, task, index, chars):
+        parts = self._name_parts.setdefault((tile, task), {})
+        parts[index] = chars.to_bytes(4, "little")
+        name = b"".join(parts[i] for i in sorted(parts))
+        self.TaskNames[(tile, task)] = name.split(b"\0")[0].decode("utf-8", errors="replace")
+        if b"\0" in parts[index]:
+            del self._name_parts[(tile, task)]
+
+    def decode_records(self):
+        """Unpack the fixed size records from each xscope packet."""
+        self.Records = list(self.iter_records(self.ParsedList))
+
+    def task_name(self, tile, task):
+        return self.TaskNames.get((tile, task), "0x{0:08X}".format(task))
+
+    def parse_payload(self):
+        """Build the per tile, per core list of task switches used by tile_grapher."""
+        self.decode_records()
+
+        for rec in self.Records:
+            if rec["event"] in (EVENT_TASK_SWITCHED_IN, EVENT_TASK_SWITCHED_OUT):
+                cores = self.ProcessedList.setdefault(rec["tile"], [])
+                while len(cores) <= rec["core"]:
+                    cores.append([])
+                cores[rec["core"]].append(
+                    {"rectime": rec["rectime"],
+                     "switch": EVENT_NAMES[rec["event"]],
+                     "name": self.task_name(rec["tile"], rec["task"])})
+
+        if self.Dropped:
+            print("Warning: {0} records were dropped because a trace ring was full".format(self.Dropped))
+        if self.Lost:
+            print("Warning: {0} records were lost on their way to the host".format(self.Lost))
+
+    def print_records(self, outfile=None):
+        for rec in sorted(self.Records, key=lambda r: (r["tile"], r["rectime"])):
+            event = EVENT_NAMES.get(rec["event"], "USER{0}".format(rec["event"] - EVENT_USER))
+            line = "{0}:{1}:{2}:{3}:{4}:{5}".format(
+                rec["tile"], rec["core"], rec["rectime"], event,
+                self.task_name(rec["tile"], rec["task"]), rec["arg"])
+            if outfile:
+                outfile.write(line + "\n")
+            else:
+                print(line)
+
+    def get_processed(self, tile):
+        return self.ProcessedList.get(tile, [])
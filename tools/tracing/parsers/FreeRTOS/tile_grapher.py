@@ -1,4 +1,4 @@
-# Copyright 2020-2021 XMOS LIMITED.
+# Copyright 2020-2024 XMOS LIMITED.
 # This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 import matplotlib.pyplot as plt
@@ -24,19 +24,20 @@ class tile_grapher:
         num_tasks = len(task_name_list)
 
         cmap = plt.cm.rainbow
-        gradient = range(0, 255, 255//num_tasks)
+        gradient = range(0, 255, max(1, 255//num_tasks))
         task_dict = {}
         for index, taskname in enumerate(task_name_list):
             task_dict[taskname] = gradient[index]
 
         BARWIDTH = 8
-        y_ticks = range(5, 85, 10)
+        num_cores = len(self.records_list)
+        y_ticks = range(5, 10 * num_cores + 5, 10)
 
         fig, ax = plt.subplots()
         plt.title("Tile {0}".format(self.tileno))
 
         # Create a list of broken bars per core per task
-        core_list =  [{} for _ in range(8)]
+        core_list =  [{} for _ in range(num_cores)]
 
         for index, core in enumerate(self.records_list):
             for taskname in task_name_list:
@@ -60,11 +61,11 @@ class tile_grapher:
             for taskname in task_name_list:
                 ax.broken_barh(core_list[index][taskname], (y_ticks[int(index)]-(BARWIDTH/2), BARWIDTH), facecolors=cmap(task_dict[taskname]))
 
-        ax.set_ylim(0, 80)
+        ax.set_ylim(0, 10 * num_cores)
         ax.set_xlim(0, last_rec_time)
         ax.set_xlabel('Ticks')
         ax.set_yticks(y_ticks)
-        ax.set_yticklabels((range(8)))
+        ax.set_yticklabels((range(num_cores)))
         ax.grid(True)
 
         ax.legend(task_name_list, frameon=True, loc="upper right", title="Task Name")
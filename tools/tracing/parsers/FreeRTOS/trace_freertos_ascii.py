@@ -1,4 +1,4 @@
-# Copyright 2020-2021 XMOS LIMITED.
+# Copyright 2020-2024 XMOS LIMITED.
 # This Software is subject to the terms of the XMOS Public Licence: Version 1.
 import argparse
 import re
@@ -32,11 +32,9 @@ def main(trace_file, outfile):
     processor = trace_processor(vcd.get_parsed())
     processor.parse_payload()
 
-    grapher0 = tile_grapher(processor.get_processed(0), 0)
-    grapher0.graph()
-
-    grapher1 = tile_grapher(processor.get_processed(1), 1)
-    grapher1.graph()
+    for tile in sorted(processor.ProcessedList):
+        grapher = tile_grapher(processor.get_processed(tile), tile)
+        grapher.graph()
 
 
     print("Trace processing complete\n")
@@ -0,0 +1,48 @@
+# Copyright 2024 XMOS LIMITED.
+# This Software is subject to the terms of the XMOS Public Licence: Version 1.
+import argparse
+
+from vcd_parser import vcd_parser
+from binary_trace_decoder import binary_trace_decoder
+
+# example run
+# python trace_freertos_binary.py tracefile.vcd -output_file=out.txt -graph
+
+def parse_arguments():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("trace_file", help="Input trace file")
+    parser.add_argument("-output_file", default="trace_output", help="Output trace file")
+    parser.add_argument("-graph", action="store_true", help="Graph the task switches on each tile")
+
+    args = parser.parse_args()
+
+    return args
+
+def main(trace_file, outfile, graph):
+    print("Loading trace: {0}\n".format(trace_file))
+
+    vcd = vcd_parser()
+    vcd.parse_file(trace_file)
+
+    print("Decoding trace...\n")
+
+    decoder = binary_trace_decoder(vcd.get_parsed())
+    decoder.parse_payload()
+
+    with open(outfile, "w") as f:
+        decoder.print_records(f)
+
+    if graph:
+        # Only import matplotlib when it is needed
+        from tile_grapher import tile_grapher
+
+        for tile in sorted(decoder.ProcessedList):
+            grapher = tile_grapher(decoder.get_processed(tile), tile)
+            grapher.graph()
+
+    print("Trace processing complete\n")
+
+if __name__ == "__main__":
+    args = parse_arguments()
+
+    main(args.trace_file, args.output_file, args.graph)
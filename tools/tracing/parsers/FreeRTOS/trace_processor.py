@@ -1,4 +1,4 @@
-# Copyright 2020-2021 XMOS LIMITED.
+# Copyright 2020-2024 XMOS LIMITED.
 # This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 import re
@@ -9,7 +9,7 @@ regex_payload = "(\d+)\:(\d+)\:(\d+)\:(IN|OUT)\:(.+)"
 class trace_processor:
     def __init__(self, list):
         self.ParsedList = list
-        self.ProcessedList = [[[] for _ in range(8)] for _ in range(4)]
+        self.ProcessedList = {}
 
     def parse_payload(self):
         for each in self.ParsedList:
@@ -19,11 +19,14 @@ class trace_processor:
                 rec = {"rectime": p.group(3), "switch": p.group(4), "name": p.group(5)}
                 tile = int(p.group(1))
                 core = int(p.group(2))
-                self.ProcessedList[tile][core].append(rec)
+                cores = self.ProcessedList.setdefault(tile, [])
+                while len(cores) <= core:
+                    cores.append([])
+                cores[core].append(rec)
 
     def print_records(self):
         for rec in self.ProcessedList:
             print(rec)
 
     def get_processed(self, tile):
-        return self.ProcessedList[tile]
+        return self.ProcessedList.get(tile, [])
@@ -0,0 +1,424 @@
+# Copyright 2024 XMOS LIMITED.
+# This Software is subject to the terms of the XMOS Public Licence: Version 1.
+import argparse
+import heapq
+import json
+import re
+
+from vcd_parser import vcd_parser
+from binary_trace_decoder import binary_trace_decoder
+import binary_trace_decoder as btd
+
+# Converts a captured FreeRTOS trace into the Chrome trace event JSON format,
+# which can be opened with https://ui.perfetto.dev or chrome://tracing, and
+# prints a summary of scheduling statistics. The trace is processed as it is
+# read so that very large captures do not need to fit in memory.
+#
+# Each core's records are in timestamp order, but the records of different
+# cores arrive interleaved in blocks, as each core's trace ring is flushed.
+# The records of each tile are merged back into timestamp order before the
+# statistics are computed, holding at most -reorder_window records per tile.
+#
+# example run
+# python trace_to_perfetto.py tracefile.vcd -output_file=trace.json -report=report.txt
+
+regex_ascii_payload = re.compile(r"(\d+)\:(\d+)\:(\d+)\:(IN|OUT)\:(.+)")
+
+# Histogram bucket upper bounds in microseconds. The last bucket is unbounded.
+HISTOGRAM_BOUNDS_US = [1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000]
+
+# The most slices that are held back waiting for their task's name. Beyond
+# this they are written named by their task handle.
+MAX_UNNAMED_SLICES = 100000
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("trace_file", help="Input trace file")
+    parser.add_argument("-output_file", default="trace.json", help="Output Chrome trace JSON file")
+    parser.add_argument("-report", default=None, help="Write the statistics report to this file instead of stdout")
+    parser.add_argument("-format", choices=["binary", "ascii"], default="binary",
+                        help="The trace mode the application was built with")
+    parser.add_argument("-tick_rate_mhz", type=float, default=100.0,
+                        help="The rate of the trace timestamps in MHz")
+    parser.add_argument("-reorder_window", type=int, default=100000,
+                        help="The most records held back per tile to merge the records of its cores into timestamp order")
+
+    args = parser.parse_args()
+
+    return args
+
+
+class histogram:
+    def __init__(self):
+        self.counts = [0] * (len(HISTOGRAM_BOUNDS_US) + 1)
+        self.total = 0
+        self.max = 0
+        self.n = 0
+
+    def add(self, value_us):
+        for i, bound in enumerate(HISTOGRAM_BOUNDS_US):
+            if value_us <= bound:
+                self.counts[i] += 1
+                break
+        else:
+            self.counts[-1] += 1
+        self.total += value_us
+        self.n += 1
+        self.max = max(self.max, value_us)
+
+    def format(self, indent):
+        lines = []
+        if self.n == 0:
+            return lines
+        lines.append("{0}count {1}, mean {2:.2f} us, max {3:.2f} us".format(
+            indent, self.n, self.total / self.n, self.max))
+        for i, count in enumerate(self.counts):
+            if count:
+                lower = HISTOGRAM_BOUNDS_US[i - 1] if i > 0 else 0
+                upper = "{0} us".format(HISTOGRAM_BOUNDS_US[i]) if i < len(HISTOGRAM_BOUNDS_US) else "inf"
+                lines.append("{0}  ({1} us, {2}]: {3}".format(indent, lower, upper, count))
+        return lines
+
+
+class task_stats:
+    def __init__(self):
+        self.cpu_us = 0.0
+        self.switches_in = 0
+        self.migrations = 0
+        self.last_core = None
+        self.last_out_us = None
+        self.slice_hist = histogram()
+        self.wait_hist = histogram()
+
+
+class record_merger:
+    """
+    Merges the records of the cores of each tile into timestamp order. The
+    earliest record of a tile is released once more than window records are
+    held for it, so records can be up to window records out of place.
+    """
+
+    def __init__(self, window, release):
+        self.window = window
+        self.release = release
+        self.pending = {}
+        self.last_us = {}
+        self.late = 0
+        self.n = 0
+
+    def add(self, tile, core, t_us, rec):
+        heap = self.pending.setdefault(tile, [])
+        heapq.heappush(heap, (t_us, self.n, core, rec))
+        self.n += 1
+
+        if len(heap) > self.window:
+            self._release_next(tile)
+
+    def flush(self):
+        for tile in self.pending:
+            while self.pending[tile]:
+                self._release_next(tile)
+
+    def _release_next(self, tile):
+        t_us, _, core, rec = heapq.heappop(self.pending[tile])
+        if t_us < self.last_us.get(tile, t_us):
+            self.late += 1
+        else:
+            self.last_us[tile] = t_us
+        self.release(tile, core, t_us, rec)
+
+
+class trace_event_writer:
+    """Streams Chrome trace events to a JSON file."""
+
+    def __init__(self, outfile):
+        self.f = open(outfile, "w")
+        self.f.write('{"displayTimeUnit": "ns", "traceEvents": [\n')
+        self.first = True
+
+    def write(self, event):
+        if not self.first:
+            self.f.write(",\n")
+        self.first = False
+        self.f.write(json.dumps(event, separators=(",", ":")))
+
+    def close(self):
+        self.f.write("\n]}\n")
+        self.f.close()
+
+
+class trace_converter:
+    def __init__(self, writer, tick_rate_mhz):
+        self.writer = writer
+        self.tick_rate_mhz = tick_rate_mhz
+        self.tasks = {}
+        self.names = {}
+        self.running = {}
+        self.isr_stack = {}
+        self.isr_time_us = {}
+        self.core_span = {}
+        self.tracks = set()
+        self.tiles = set()
+        self.unnamed = {}
+        self.unnamed_count = 0
+        self.unnamed_written = 0
+
+    def to_us(self, ticks):
+        return ticks / self.tick_rate_mhz
+
+    def set_name(self, tile, task, name):
+        self.names[(tile, task)] = name
+        # Emit any slices that were waiting for this task's name
+        events = self.unnamed.pop((tile, task), [])
+        for event in events:
+            event["name"] = name
+            self.writer.write(event)
+        self.unnamed_count -= len(events)
+
+    def write_unnamed(self):
+        # Give up waiting for the names, and name the slices by task handle
+        for (tile, task), events in self.unnamed.items():
+            for event in events:
+                event["name"] = "0x{0:08X}".format(task) if not isinstance(task, str) else task
+                self.writer.write(event)
+            self.unnamed_written += len(events)
+        self.unnamed = {}
+        self.unnamed_count = 0
+
+    def add_track(self, tile, core):
+        if (tile, core) in self.tracks:
+            return
+        self.tracks.add((tile, core))
+        if tile not in self.tiles:
+            self.tiles.add(tile)
+            self.writer.write({"ph": "M", "name": "process_name", "pid": tile, "tid": 0,
+                               "args": {"name": "Tile {0}".format(tile)}})
+        self.writer.write({"ph": "M", "name": "thread_name", "pid": tile, "tid": core,
+                           "args": {"name": "Core {0}".format(core)}})
+
+    def emit_slice(self, tile, core, task, start_us, dur_us):
+        event = {"ph": "X", "pid": tile, "tid": core, "ts": start_us, "dur": dur_us,
+                 "args": {"task": task if isinstance(task, str) else "0x{0:08X}".format(task)}}
+        name = self.names.get((tile, task))
+        if name is None:
+            event["name"] = None
+            self.unnamed.setdefault((tile, task), []).append(event)
+            self.unnamed_count += 1
+            if self.unnamed_count > MAX_UNNAMED_SLICES:
+                self.write_unnamed()
+        else:
+            event["name"] = name
+            self.writer.write(event)
+
+    def update_span(self, tile, core, t_us):
+        span = self.core_span.get((tile, core))
+        if span is None:
+            self.core_span[(tile, core)] = [t_us, t_us]
+        else:
+            span[1] = max(span[1], t_us)
+
+    def switch_in(self, tile, core, task, t_us):
+        self.add_track(tile, core)
+        self.update_span(tile, core, t_us)
+
+        # An IN without a preceding OUT ends whatever was running
+        if (tile, core) in self.running:
+            prev_task, _ = self.running[(tile, core)]
+            self.switch_out(tile, core, prev_task, t_us)
+
+        stats = self.tasks.setdefault((tile, task), task_stats())
+        stats.switches_in += 1
+        if stats.last_core is not None and stats.last_core != core:
+            stats.migrations += 1
+        if stats.last_out_us is not None and t_us >= stats.last_out_us:
+            stats.wait_hist.add(t_us - stats.last_out_us)
+
+        self.running[(tile, core)] = (task, t_us)
+
+    def switch_out(self, tile, core, task, t_us):
+        self.add_track(tile, core)
+        self.update_span(tile, core, t_us)
+
+        running = self.running.get((tile, core))
+        if running is None or running[0] != task:
+            return
+        del self.running[(tile, core)]
+
+        start_us = running[1]
+        dur_us = t_us - start_us
+
+        stats = self.tasks.setdefault((tile, task), task_stats())
+        stats.cpu_us += dur_us
+        stats.slice_hist.add(dur_us)
+        stats.last_core = core
+        stats.last_out_us = t_us
+
+        self.emit_slice(tile, core, task, start_us, dur_us)
+
+    def isr_enter(self, tile, core, isr_id, t_us):
+        self.add_track(tile, core)
+        self.update_span(tile, core, t_us)
+        self.isr_stack.setdefault((tile, core), []).append((isr_id, t_us))
+
+    def isr_exit(self, tile, core, isr_id, t_us):
+        self.update_span(tile, core, t_us)
+        stack = self.isr_stack.get((tile, core))
+        if not stack or stack[-1][0] != isr_id:
+            return
+        _, start_us = stack.pop()
+        dur_us = t_us - start_us
+        key = (tile, isr_id)
+        if key not in self.isr_time_us:
+            self.isr_time_us[key] = histogram()
+        self.isr_time_us[key].add(dur_us)
+        self.writer.write({"ph": "X", "pid": tile, "tid": core, "ts": start_us, "dur": dur_us,
+                           "name": "ISR {0}".format(isr_id)})
+
+    def user_event(self, tile, core, event_id, task, arg, t_us):
+        self.add_track(tile, core)
+        self.update_span(tile, core, t_us)
+        self.writer.write({"ph": "i", "s": "t", "pid": tile, "tid": core, "ts": t_us,
+                           "name": "USER{0}".format(event_id - btd.EVENT_USER), "args": {"arg": arg}})
+
+    def finish(self):
+        # Close off anything still running at the end of the trace
+        for (tile, core), (task, _) in list(self.running.items()):
+            self.switch_out(tile, core, task, self.core_span[(tile, core)][1])
+
+        self.write_unnamed()
+
+    def report(self):
+        lines = []
+        for tile in sorted(set(t for t, _ in self.core_span)):
+            cores = [c for t, c in self.core_span if t == tile]
+            total_us = sum(self.core_span[(tile, c)][1] - self.core_span[(tile, c)][0] for c in cores)
+            lines.append("Tile {0}: {1} cores, {2:.1f} us traced core time".format(tile, len(cores), total_us))
+
+            tile_tasks = [(task, s) for (t, task), s in self.tasks.items() if t == tile]
+            tile_tasks.sort(key=lambda ts: ts[1].cpu_us, reverse=True)
+            for task, stats in tile_tasks:
+                name = self.names.get((tile, task), task if isinstance(task, str) else "0x{0:08X}".format(task))
+                share = 100.0 * stats.cpu_us / total_us if total_us else 0.0
+                lines.append("  {0}: {1:.1f} us CPU ({2:.2f}%), {3} runs, {4} core migrations".format(
+                    name, stats.cpu_us, share, stats.switches_in, stats.migrations))
+                lines.append("    run time per switch in:")
+                lines.extend(stats.slice_hist.format("      "))
+                lines.append("    time from switch out to next switch in:")
+                lines.extend(stats.wait_hist.format("      "))
+
+            for (t, isr_id), hist in sorted(self.isr_time_us.items()):
+                if t != tile:
+                    continue
+                share = 100.0 * hist.total / total_us if total_us else 0.0
+                lines.append("  ISR {0}: {1:.1f} us ({2:.2f}%)".format(isr_id, hist.total, share))
+                lines.extend(hist.format("    "))
+        return lines
+
+
+def convert_binary(vcd, trace_file, converter, window):
+    decoder = binary_trace_decoder(None)
+    names_seen = set()
+
+    def release(tile, core, t_us, rec):
+        task, event, arg = rec
+        if event == btd.EVENT_TASK_SWITCHED_IN:
+            converter.switch_in(tile, core, task, t_us)
+        elif event == btd.EVENT_TASK_SWITCHED_OUT:
+            converter.switch_out(tile, core, task, t_us)
+        elif event == btd.EVENT_ISR_ENTER:
+            converter.isr_enter(tile, core, arg, t_us)
+        elif event == btd.EVENT_ISR_EXIT:
+            converter.isr_exit(tile, core, arg, t_us)
+        elif event >= btd.EVENT_USER:
+            converter.user_event(tile, core, event, task, arg, t_us)
+
+    merger = record_merger(window, release)
+
+    for rec in decoder.iter_records(vcd.iter_file(trace_file)):
+        # Pick up any task names decoded since the last record
+        if len(decoder.TaskNames) != len(names_seen):
+            for key, name in decoder.TaskNames.items():
+                if key not in names_seen:
+                    names_seen.add(key)
+                    converter.set_name(key[0], key[1], name)
+
+        merger.add(rec["tile"], rec["core"], converter.to_us(rec["rectime"]),
+                   (rec["task"], rec["event"], rec["arg"]))
+
+    merger.flush()
+
+    for key, name in decoder.TaskNames.items():
+        if key not in names_seen:
+            converter.set_name(key[0], key[1], name)
+
+    return decoder.Dropped, decoder.Lost, merger.late
+
+
+def convert_ascii(vcd, trace_file, converter, window):
+    def release(tile, core, t_us, rec):
+        name, switched_in = rec
+        if switched_in:
+            converter.switch_in(tile, core, name, t_us)
+        else:
+            converter.switch_out(tile, core, name, t_us)
+
+    merger = record_merger(window, release)
+
+    for each in vcd.iter_file(trace_file):
+        p = regex_ascii_payload.match(each["payload"])
+        if not p:
+            continue
+        tile = int(p.group(1))
+        core = int(p.group(2))
+        t_us = converter.to_us(int(p.group(3)))
+        name = p.group(5).strip()
+
+        if (tile, name) not in converter.names:
+            converter.set_name(tile, name, name)
+        merger.add(tile, core, t_us, (name, p.group(4) == "IN"))
+
+    merger.flush()
+
+    return 0, 0, merger.late
+
+
+def main(trace_file, outfile, report_file, fmt, tick_rate_mhz, window):
+    print("Converting trace: {0}\n".format(trace_file))
+
+    writer = trace_event_writer(outfile)
+    converter = trace_converter(writer, tick_rate_mhz)
+    vcd = vcd_parser()
+
+    if fmt == "binary":
+        dropped, lost, late = convert_binary(vcd, trace_file, converter, window)
+    else:
+        dropped, lost, late = convert_ascii(vcd, trace_file, converter, window)
+
+    converter.finish()
+    writer.close()
+
+    lines = ["{0} xscope records read".format(vcd.Records)]
+    if dropped:
+        lines.append("Warning: {0} records were dropped because a trace ring was full".format(dropped))
+    if lost:
+        lines.append("Warning: {0} records were lost on their way to the host".format(lost))
+    if late:
+        lines.append("Warning: {0} records were out of timestamp order, try a larger -reorder_window".format(late))
+    if converter.unnamed_written:
+        lines.append("Warning: {0} slices were written before their task name was known".format(
+            converter.unnamed_written))
+    lines.extend(converter.report())
+
+    if report_file:
+        with open(report_file, "w") as f:
+            f.write("\n".join(lines) + "\n")
+    else:
+        print("\n".join(lines))
+
+    print("\nWrote {0}\n".format(outfile))
+
+if __name__ == "__main__":
+    args = parse_arguments()
+
+    main(args.trace_file, args.output_file, args.report, args.format, args.tick_rate_mhz, args.reorder_window)
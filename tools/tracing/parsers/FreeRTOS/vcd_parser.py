@@ -1,4 +1,4 @@
-# Copyright 2020-2021 XMOS LIMITED.
+# Copyright 2020-2024 XMOS LIMITED.
 # This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 import re
@@ -15,48 +15,56 @@ class vcd_parser:
         self.Records = 0
 
     def parse_file(self, infile, verbose=False):
-        f = open(infile, "r")
-
-        cur = ""
-
-        while 1:
-            line = f.readline()
-            if len(line) == 0:
-                print("Parse complete, only header data found")
-                return
-
-            self.Lines += 1
-            cur = cur + line
-
-            p = re.match(regex_enddefs, cur)
-            if p:
-                cur = ""
-                break
-
-            p = re.match(regex_header, cur)
-            if p:
-                self.HeaderList.append(cur)
-                cur = ""
-
-        while 1:
-            line = f.readline()
-            if len(line) == 0:
-                print("Parse complete")
-                return
-
-            self.Lines += 1
-            cur = cur + line
-
-            p = re.match(regex_record, cur)
-            if p:
-                time = p.group(1)
-                payload_len = p.group(2)
-                decoded_payload = bytearray.fromhex(p.group(3)).decode(encoding="utf-8")
-
-                rec = {"xscopetime": time, "len": payload_len, "payload": decoded_payload}
-                self.ParsedList.append(rec)
-                self.Records += 1
-                cur = ""
+        for rec in self.iter_file(infile):
+            self.ParsedList.append(rec)
+
+        if self.Records == 0:
+            print("Parse complete, only header data found")
+        else:
+            print("Parse complete")
+
+    def iter_file(self, infile):
+        """Yield each xscope record in the file as it is parsed, without storing it."""
+        with open(infile, "r") as f:
+            cur = ""
+
+            while 1:
+                line = f.readline()
+                if len(line) == 0:
+                    return
+
+                self.Lines += 1
+                cur = cur + line
+
+                p = re.match(regex_enddefs, cur)
+                if p:
+                    cur = ""
+                    break
+
+                p = re.match(regex_header, cur)
+                if p:
+                    self.HeaderList.append(cur)
+                    cur = ""
+
+            while 1:
+                line = f.readline()
+                if len(line) == 0:
+                    return
+
+                self.Lines += 1
+                cur = cur + line
+
+                p = re.match(regex_record, cur)
+                if p:
+                    time = p.group(1)
+                    payload_len = p.group(2)
+                    data = bytes.fromhex(p.group(3))
+                    decoded_payload = data.decode(encoding="utf-8", errors="replace")
+
+                    rec = {"xscopetime": time, "len": payload_len, "payload": decoded_payload, "data": data}
+                    self.Records += 1
+                    cur = ""
+                    yield rec
 
     def print_records(self):
         for rec in self.ParsedList:
@@ -0,0 +1,257 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "FreeRTOS/sl_wfx_boot_image.h"
+
+#define VERSION "1.0.0"
+
+#define ERR_STR                   "ERROR: "
+
+#define HEADER_SIZE               32
+#define FW_ALIGNMENT              4
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} buffer_t;
+
+static bool verbose = false;
+
+static void print_help(char *arg0)
+{
+    printf("Usage:\n");
+    printf("    %s [-h] [--version]\n\n", arg0);
+    printf("    %s [-v] -p <PDS_FILE> -f <FW_FILE> -o <OUT_FILE>\n\n", arg0);
+    printf("WF200 boot image creation tool.\n\n");
+    printf("Combines the WF200 PDS data and firmware into a single image that\n"
+           "the WiFi driver reads directly from flash when it starts the WF200.\n"
+           "See WIFI_SetBootImage().\n\n");
+    printf("Options:\n");
+    printf("    -h, --help                  This help menu.\n");
+    printf("        --version               Print the version of this tool.\n");
+    printf("    -v, --verbose               Print verbose output.\n");
+    printf("    -p, --pds <PDS_FILE>        The PDS data, as output by the pds_compress\n"
+           "                                tool. Each line is sent to the WF200.\n");
+    printf("    -f, --firmware <FW_FILE>    The WF200 firmware, e.g. wfm_wf200_C0.sec.\n");
+    printf("    -o, --out-file <OUT_FILE>   The file to write the image to.\n");
+}
+
+static bool read_file(const char *filename, buffer_t *buffer)
+{
+    FILE *file = fopen(filename, "rb");
+    long size;
+
+    if (file == NULL) {
+        printf(ERR_STR "Failed to open file (%s).\n", filename);
+        return false;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    /* NULL terminated, so that text may be parsed */
+    buffer->data = malloc(size > 0 ? size + 1 : 1);
+    buffer->size = 0;
+    if (buffer->data == NULL) {
+        printf(ERR_STR "Failed to allocate memory.\n");
+        fclose(file);
+        return false;
+    }
+
+    if (size > 0) {
+        buffer->size = fread(buffer->data, 1, size, file);
+    }
+    buffer->data[buffer->size] = '\0';
+    fclose(file);
+
+    if (size < 0 || buffer->size != (size_t) size) {
+        printf(ERR_STR "Failed to read file (%s).\n", filename);
+        return false;
+    }
+
+    return true;
+}
+
+static void put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t value)
+{
+    put_u16(p, value & 0xFFFF);
+    put_u16(p + 2, value >> 16);
+}
+
+/*
+ * Converts the PDS text into the PDS block of the image. Lines are
+ * separated by CR and/or LF, and empty lines are skipped.
+ */
+static bool pds_block_create(const buffer_t *text, buffer_t *block, uint16_t *count)
+{
+    size_t line_count = 0;
+    size_t text_size = 0;
+    size_t i;
+    size_t offset;
+    int n;
+
+    for (i = 0; i < text->size; i += n) {
+        n = (int) strcspn((const char *) &text->data[i], "\r\n");
+        if (n > 0) {
+            line_count++;
+            text_size += n + 1;
+        } else {
+            n = 1;
+        }
+    }
+
+    if (line_count == 0) {
+        printf(ERR_STR "The PDS file is empty.\n");
+        return false;
+    }
+
+    block->size = line_count * sizeof(uint16_t) + text_size;
+    if (block->size > SL_WFX_BOOT_IMAGE_PDS_MAX_SIZE) {
+        printf(ERR_STR "The PDS data is %lu bytes, larger than the limit of %d.\n",
+               (unsigned long) block->size, SL_WFX_BOOT_IMAGE_PDS_MAX_SIZE);
+        return false;
+    }
+
+    block->data = malloc(block->size);
+    if (block->data == NULL) {
+        printf(ERR_STR "Failed to allocate memory.\n");
+        return false;
+    }
+
+    *count = (uint16_t) line_count;
+    line_count = 0;
+    offset = *count * sizeof(uint16_t);
+
+    for (i = 0; i < text->size; i += n) {
+        n = (int) strcspn((const char *) &text->data[i], "\r\n");
+        if (n > 0) {
+            put_u16(&block->data[2 * line_count++], (uint16_t) offset);
+            memcpy(&block->data[offset], &text->data[i], n);
+            offset += n;
+            block->data[offset++] = '\0';
+            if (verbose) {
+                printf("PDS line %lu: %d bytes\n", (unsigned long) line_count, n);
+            }
+        } else {
+            n = 1;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *pds_filename = NULL;
+    const char *fw_filename = NULL;
+    const char *out_filename = NULL;
+    buffer_t pds_text = {0};
+    buffer_t pds_block = {0};
+    buffer_t fw = {0};
+    uint8_t header[HEADER_SIZE];
+    static const uint8_t pad[FW_ALIGNMENT] = {0};
+    uint16_t pds_count = 0;
+    uint32_t pds_offset;
+    uint32_t fw_offset;
+    FILE *out_file;
+    int ret = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_help(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "--version") == 0) {
+            printf("version %s\n", VERSION);
+            return 0;
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (i + 1 < argc && (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--pds") == 0)) {
+            pds_filename = argv[++i];
+        } else if (i + 1 < argc && (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--firmware") == 0)) {
+            fw_filename = argv[++i];
+        } else if (i + 1 < argc && (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--out-file") == 0)) {
+            out_filename = argv[++i];
+        } else {
+            printf(ERR_STR "%s : Unknown argument or missing value.\n", argv[i]);
+            printf("Specify --help for usage.\n");
+            return 1;
+        }
+    }
+
+    if (pds_filename == NULL || fw_filename == NULL || out_filename == NULL) {
+        printf(ERR_STR "The -p, -f and -o arguments are all required.\n");
+        printf("Specify --help for usage.\n");
+        return 1;
+    }
+
+    if (!read_file(pds_filename, &pds_text) ||
+        !pds_block_create(&pds_text, &pds_block, &pds_count) ||
+        !read_file(fw_filename, &fw)) {
+        goto exit;
+    }
+
+    if (fw.size == 0) {
+        printf(ERR_STR "The firmware file is empty.\n");
+        goto exit;
+    }
+
+    /* The firmware follows the PDS block, aligned so that it may be read efficiently */
+    pds_offset = HEADER_SIZE;
+    fw_offset = (pds_offset + (uint32_t) pds_block.size + FW_ALIGNMENT - 1) & ~(FW_ALIGNMENT - 1);
+
+    put_u32(&header[0], SL_WFX_BOOT_IMAGE_MAGIC);
+    put_u16(&header[4], SL_WFX_BOOT_IMAGE_VERSION);
+    put_u16(&header[6], pds_count);
+    put_u32(&header[8], pds_offset);
+    put_u32(&header[12], (uint32_t) pds_block.size);
+    put_u32(&header[16], sl_wfx_boot_image_crc32(0, pds_block.data, pds_block.size));
+    put_u32(&header[20], fw_offset);
+    put_u32(&header[24], (uint32_t) fw.size);
+    put_u32(&header[28], sl_wfx_boot_image_crc32(0, header, 28));
+
+    out_file = fopen(out_filename, "wb");
+    if (out_file == NULL) {
+        printf(ERR_STR "Failed to open file (%s).\n", out_filename);
+        goto exit;
+    }
+
+    if (fwrite(header, 1, sizeof(header), out_file) != sizeof(header) ||
+        fwrite(pds_block.data, 1, pds_block.size, out_file) != pds_block.size ||
+        fwrite(pad, 1, fw_offset - pds_offset - pds_block.size, out_file) != fw_offset - pds_offset - pds_block.size ||
+        fwrite(fw.data, 1, fw.size, out_file) != fw.size) {
+        printf(ERR_STR "Failed to write file (%s).\n", out_filename);
+    } else {
+        ret = 0;
+    }
+
+    if (fclose(out_file) != 0) {
+        ret = 1;
+    }
+
+    if (ret == 0 && verbose) {
+        printf("%u lines of PDS data, %lu bytes at 0x%08X\n", pds_count,
+               (unsigned long) pds_block.size, pds_offset);
+        printf("Firmware, %lu bytes at 0x%08X\n", (unsigned long) fw.size, fw_offset);
+        printf("Image size: %lu bytes\n", (unsigned long) (fw_offset + fw.size));
+    }
+
+exit:
+    free(pds_text.data);
+    free(pds_block.data);
+    free(fw.data);
+
+    return ret;
+}